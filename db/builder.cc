@@ -8,6 +8,7 @@
 #include "db/dbformat.h"
 #include "db/table_cache.h"
 #include "db/version_edit.h"
+#include "leveldb/cache.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
@@ -46,6 +47,12 @@ Status BuildTable(const std::string& dbname,
 
     // 新建一个用于构造 Table 文件的 TableBuilder
     TableBuilder* builder = new TableBuilder(options, file);
+    // 需要预热 block_cache 时, 写文件的同时把 data block 放入 block_cache
+    uint64_t cache_id = 0;
+    if (options.warm_block_cache_level >= 0 && options.block_cache != nullptr) {
+      cache_id = options.block_cache->NewId();
+      builder->CacheDataBlocks(cache_id);
+    }
     // 获取要写入的 memtable 的最小 key 并保存到 meta->smallest
     meta->smallest.DecodeFrom(iter->key());
     // 迭代 memtable, 将 <key, value> 写入到 TableBuilder, 
@@ -82,6 +89,10 @@ Status BuildTable(const std::string& dbname,
     delete file;
     file = nullptr;
 
+    if (s.ok() && cache_id != 0) {
+      // 以写文件时使用的 cache_id 打开 table, 下面的校验直接使用它
+      s = table_cache->AddTable(meta->number, meta->file_size, cache_id);
+    }
     if (s.ok()) {
       // 为刚写入的文件生成对应的 table 对象, 
       // 并将该 table 对象放到 table_cache_ 中.
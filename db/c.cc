@@ -214,6 +214,50 @@ char* leveldb_get(
   return result;
 }
 
+char* leveldb_multi_get(
+    leveldb_t* db,
+    const leveldb_readoptions_t* options,
+    size_t num_keys,
+    const char* const* keys, const size_t* keylens,
+    unsigned char* found, size_t* vallens,
+    char** errptr) {
+  // 全部 key 都在同一个快照上读取, 结果是一致的
+  ReadOptions read_options = options->rep;
+  const Snapshot* snapshot = nullptr;
+  if (read_options.snapshot == nullptr) {
+    snapshot = db->rep->GetSnapshot();
+    read_options.snapshot = snapshot;
+  }
+  // 所有 value 拼接在一起, 最后只需要一次 malloc 和拷贝
+  std::string values;
+  std::string tmp;
+  Status s;
+  size_t i = 0;
+  for (; i < num_keys; i++) {
+    s = db->rep->Get(read_options, Slice(keys[i], keylens[i]), &tmp);
+    if (s.ok()) {
+      found[i] = 1;
+      vallens[i] = tmp.size();
+      values.append(tmp);
+    } else {
+      found[i] = 0;
+      vallens[i] = 0;
+      if (!s.IsNotFound()) {
+        SaveError(errptr, s);
+        break;
+      }
+    }
+  }
+  for (; i < num_keys; i++) {
+    found[i] = 0;
+    vallens[i] = 0;
+  }
+  if (snapshot != nullptr) {
+    db->rep->ReleaseSnapshot(snapshot);
+  }
+  return values.empty() ? nullptr : CopyString(values);
+}
+
 leveldb_iterator_t* leveldb_create_iterator(
     leveldb_t* db,
     const leveldb_readoptions_t* options) {
@@ -333,6 +377,47 @@ void leveldb_iter_get_error(const leveldb_iterator_t* iter, char** errptr) {
   SaveError(errptr, iter->rep->status());
 }
 
+// leveldb_iter_next_batch 的输出缓冲区
+struct IterBatchBuffer {
+  char* buf;
+  size_t buflen;
+  size_t used;
+  size_t n;
+  size_t* keylens;
+  size_t* vallens;
+};
+
+static bool CopyBatchEntry(void* arg, const Slice& key, const Slice& value) {
+  IterBatchBuffer* b = reinterpret_cast<IterBatchBuffer*>(arg);
+  if (key.size() + value.size() > b->buflen - b->used) {
+    return false;
+  }
+  memcpy(b->buf + b->used, key.data(), key.size());
+  b->used += key.size();
+  memcpy(b->buf + b->used, value.data(), value.size());
+  b->used += value.size();
+  b->keylens[b->n] = key.size();
+  b->vallens[b->n] = value.size();
+  b->n++;
+  return true;
+}
+
+size_t leveldb_iter_next_batch(
+    leveldb_iterator_t* iter,
+    char* buf, size_t buflen,
+    size_t max_entries,
+    size_t* keylens, size_t* vallens) {
+  IterBatchBuffer b;
+  b.buf = buf;
+  b.buflen = buflen;
+  b.used = 0;
+  b.n = 0;
+  b.keylens = keylens;
+  b.vallens = vallens;
+  iter->rep->NextBatch(max_entries, &CopyBatchEntry, &b);
+  return b.n;
+}
+
 leveldb_writebatch_t* leveldb_writebatch_create() {
   return new leveldb_writebatch_t;
 }
@@ -358,6 +443,25 @@ void leveldb_writebatch_delete(
   b->rep.Delete(Slice(key, klen));
 }
 
+void leveldb_writebatch_put_many(
+    leveldb_writebatch_t* b,
+    size_t num,
+    const char* const* keys, const size_t* klens,
+    const char* const* vals, const size_t* vlens) {
+  for (size_t i = 0; i < num; i++) {
+    b->rep.Put(Slice(keys[i], klens[i]), Slice(vals[i], vlens[i]));
+  }
+}
+
+void leveldb_writebatch_delete_many(
+    leveldb_writebatch_t* b,
+    size_t num,
+    const char* const* keys, const size_t* klens) {
+  for (size_t i = 0; i < num; i++) {
+    b->rep.Delete(Slice(keys[i], klens[i]));
+  }
+}
+
 void leveldb_writebatch_iterate(
     const leveldb_writebatch_t* b,
     void* state,
@@ -268,6 +268,71 @@ int main(int argc, char** argv) {
     leveldb_iter_destroy(iter);
   }
 
+  StartPhase("batch_ops");
+  {
+    const char* keys[3] = { "a1", "a2", "a3" };
+    size_t klens[3] = { 2, 2, 2 };
+    const char* vals[3] = { "x", "yy", "zzz" };
+    size_t vlens[3] = { 1, 2, 3 };
+    leveldb_writebatch_t* wb = leveldb_writebatch_create();
+    leveldb_writebatch_put_many(wb, 3, keys, klens, vals, vlens);
+    leveldb_writebatch_delete_many(wb, 1, keys + 1, klens + 1);
+    leveldb_write(db, woptions, wb, &err);
+    CheckNoError(err);
+    leveldb_writebatch_destroy(wb);
+    CheckGet(db, roptions, "a1", "x");
+    CheckGet(db, roptions, "a2", NULL);
+    CheckGet(db, roptions, "a3", "zzz");
+
+    // multi_get
+    const char* get_keys[4] = { "a1", "a2", "box", "a3" };
+    size_t get_klens[4] = { 2, 2, 3, 2 };
+    unsigned char found[4];
+    size_t get_vlens[4];
+    char* values = leveldb_multi_get(db, roptions, 4, get_keys, get_klens,
+                                     found, get_vlens, &err);
+    CheckNoError(err);
+    CheckCondition(found[0] && !found[1] && found[2] && found[3]);
+    CheckCondition(get_vlens[0] == 1 && get_vlens[1] == 0);
+    CheckCondition(get_vlens[2] == 1 && get_vlens[3] == 3);
+    CheckEqual("xczzz", values, 5);
+    Free(&values);
+
+    // Batched iteration: a1=x a3=zzz box=c foo=hello
+    char buf[10];
+    size_t iter_klens[3];
+    size_t iter_vlens[3];
+    leveldb_iterator_t* iter = leveldb_create_iterator(db, roptions);
+    leveldb_iter_seek_to_first(iter);
+    size_t n = leveldb_iter_next_batch(iter, buf, sizeof(buf), 3,
+                                       iter_klens, iter_vlens);
+    CheckCondition(n == 2);
+    CheckEqual("a1xa3zzz", buf, 8);
+    CheckCondition(iter_klens[0] == 2 && iter_vlens[0] == 1);
+    CheckCondition(iter_klens[1] == 2 && iter_vlens[1] == 3);
+    CheckIter(iter, "box", "c");
+    n = leveldb_iter_next_batch(iter, buf, 5, 3, iter_klens, iter_vlens);
+    CheckCondition(n == 1);
+    CheckEqual("boxc", buf, 4);
+    // "foohello" does not fit into 5 bytes.
+    n = leveldb_iter_next_batch(iter, buf, 5, 3, iter_klens, iter_vlens);
+    CheckCondition(n == 0);
+    CheckIter(iter, "foo", "hello");
+    n = leveldb_iter_next_batch(iter, buf, sizeof(buf), 3,
+                                iter_klens, iter_vlens);
+    CheckCondition(n == 1);
+    CheckCondition(!leveldb_iter_valid(iter));
+    leveldb_iter_destroy(iter);
+
+    wb = leveldb_writebatch_create();
+    leveldb_writebatch_delete_many(wb, 3, keys, klens);
+    leveldb_write(db, woptions, wb, &err);
+    CheckNoError(err);
+    leveldb_writebatch_destroy(wb);
+    CheckGet(db, roptions, "a1", NULL);
+    CheckGet(db, roptions, "a3", NULL);
+  }
+
   StartPhase("approximate_sizes");
   {
     int i;
@@ -3,6 +3,7 @@
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
 #include <sys/types.h>
+#include <algorithm>
 #include <stdio.h>
 #include <stdlib.h>
 #include "leveldb/cache.h"
@@ -28,6 +29,7 @@
 //      deleterandom  -- delete N keys in random order
 //      readseq       -- read N times sequentially
 //      readreverse   -- read N times in reverse order
+//      readseqbatch  -- read N times sequentially with Iterator::NextBatch
 //      readrandom    -- read N times in random order
 //      readmissing   -- read N missing keys in random order
 //      readhot       -- read N times in random order from 1% section of DB
@@ -37,6 +39,8 @@
 //      acquireload   -- load N*1000 times
 //   Meta operations:
 //      compact     -- Compact the entire DB
+//      compactrandom -- write N values in random order, then time a full
+//                       compaction of them (reported per value written)
 //      stats       -- Print DB stats
 //      sstables    -- Print sstable info
 //      heapprofile -- Dump a heap profile (if supported by this port)
@@ -488,6 +492,8 @@ class Benchmark {
         method = &Benchmark::ReadSequential;
       } else if (name == Slice("readreverse")) {
         method = &Benchmark::ReadReverse;
+      } else if (name == Slice("readseqbatch")) {
+        method = &Benchmark::ReadSequentialBatch;
       } else if (name == Slice("readrandom")) {
         method = &Benchmark::ReadRandom;
       } else if (name == Slice("readmissing")) {
@@ -508,6 +514,9 @@ class Benchmark {
         method = &Benchmark::ReadWhileWriting;
       } else if (name == Slice("compact")) {
         method = &Benchmark::Compact;
+      } else if (name == Slice("compactrandom")) {
+        fresh_db = true;
+        method = &Benchmark::CompactRandom;
       } else if (name == Slice("crc32c")) {
         method = &Benchmark::Crc32c;
       } else if (name == Slice("acquireload")) {
@@ -780,6 +789,33 @@ class Benchmark {
     thread->stats.AddBytes(bytes);
   }
 
+  struct ReadBatchState {
+    ThreadState* thread;
+    int64_t bytes;
+  };
+
+  static bool CountBatchEntry(void* arg, const Slice& key,
+                              const Slice& value) {
+    ReadBatchState* state = reinterpret_cast<ReadBatchState*>(arg);
+    state->bytes += key.size() + value.size();
+    state->thread->stats.FinishedSingleOp();
+    return true;
+  }
+
+  void ReadSequentialBatch(ThreadState* thread) {
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    ReadBatchState state;
+    state.thread = thread;
+    state.bytes = 0;
+    int i = 0;
+    for (iter->SeekToFirst(); i < reads_ && iter->Valid(); ) {
+      i += iter->NextBatch(std::min(reads_ - i, 1000), &CountBatchEntry,
+                           &state);
+    }
+    delete iter;
+    thread->stats.AddBytes(state.bytes);
+  }
+
   void ReadReverse(ThreadState* thread) {
     Iterator* iter = db_->NewIterator(ReadOptions());
     int i = 0;
@@ -917,6 +953,19 @@ class Benchmark {
     db_->CompactRange(nullptr, nullptr);
   }
 
+  // 只统计压实耗时: 写入阶段结束后重新开始计时, 压实完成后按写入的
+  // 数据项个数计算每个数据项的平均压实开销.
+  void CompactRandom(ThreadState* thread) {
+    DoWrite(thread, false);
+    thread->stats.Start();
+    db_->CompactRange(nullptr, nullptr);
+    for (int i = 0; i < num_; i++) {
+      thread->stats.FinishedSingleOp();
+    }
+    thread->stats.AddBytes(static_cast<int64_t>(num_) *
+                           (value_size_ + 16));
+  }
+
   void PrintStats(const char* key) {
     std::string stats;
     if (!db_->GetProperty(key, &stats)) {
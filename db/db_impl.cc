@@ -20,6 +20,7 @@
 #include "db/log_writer.h"
 #include "db/memtable.h"
 #include "db/table_cache.h"
+#include "db/transaction_log_impl.h"
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
 #include "leveldb/db.h"
@@ -32,6 +33,7 @@
 #include "table/merger.h"
 #include "table/two_level_iterator.h"
 #include "util/coding.h"
+#include "util/crc32c.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
 
@@ -39,6 +41,9 @@ namespace leveldb {
 
 const int kNumNonTableCacheFiles = 10;
 
+// 打开数据库时并行预取 block_cache 内容的线程数, 见 Options::persist_block_cache
+static const int kNumBlockCachePrefetchThreads = 4;
+
 // Information kept for every waiting writer
 // 针对调用 db 进行的写操作, 都会生成一个对应的 writer, 其封装了写入数据和写入进度.
 struct DBImpl::Writer {
@@ -46,11 +51,80 @@ struct DBImpl::Writer {
   WriteBatch* batch;
   bool sync;
   bool done;
+  WriteCallback* callback;
+  // 被合并写入之后, 如果不为 0 则还需要等待该序列号之前的数据被同步线程持久化
+  SequenceNumber sync_sequence;
   port::CondVar cv;
 
-  explicit Writer(port::Mutex* mu) : cv(mu) { }
+  explicit Writer(port::Mutex* mu)
+      : callback(nullptr), sync_sequence(0), cv(mu) { }
+};
+
+// 读视图, 将某一时刻的 mem_, imm_ 以及 current version 打包在一起并持有它们的引用.
+// 读操作只要拿到一个视图就可以在不持有 mutex_ 的情况下查询.
+//
+// 视图本身的引用计数是原子的, 但是释放视图持有的 memtable 和 version
+// 引用时必须持有 mutex_, 所以视图最后一个引用被释放时需要获取锁.
+struct DBImpl::ReadView {
+  MemTable* const mem;
+  MemTable* const imm;  // 可能为 nullptr
+  Version* const current;
+  // 创建该视图时对应的 read_view_number_
+  const uint64_t number;
+
+  ReadView(MemTable* m, MemTable* i, Version* v, uint64_t n)
+      : mem(m), imm(i), current(v), number(n), refs_(1) {
+    mem->Ref();
+    if (imm != nullptr) imm->Ref();
+    current->Ref();
+  }
+
+  void Ref() { refs_.fetch_add(1, std::memory_order_relaxed); }
+
+  // 递减引用计数, 如果这是最后一个引用则返回 true,
+  // 此时调用者需要持有 mutex_ 调用 DBImpl::DeleteReadView.
+  bool Unref() {
+    return refs_.fetch_sub(1, std::memory_order_acq_rel) == 1;
+  }
+
+ private:
+  std::atomic<int> refs_;
+};
+
+// 每个槽位独占一个 cache line, 避免不同线程之间的伪共享.
+struct DBImpl::ReadViewSlot {
+  // 槽位中存储的视图持有一个引用. 线程使用期间槽位会被置为 in-use 标记,
+  // 用完后再通过 CAS 放回去; 如果期间视图被 InstallReadView 回收
+  // (槽位被置为 nullptr), CAS 会失败, 线程自行释放引用.
+  std::atomic<DBImpl::ReadView*> view;
+  char padding[64 - sizeof(std::atomic<DBImpl::ReadView*>)];
+};
+
+// 一个等待读线程处理的异步查询, 已经确定了读取的视图和序列号.
+struct DBImpl::AsyncGet {
+  ReadView* view;        // 持有一个引用
+  ReadOptions options;
+  std::string user_key;  // 带时间戳时已经拼上了读取时间点
+  SequenceNumber sequence;
+  GetCallback callback;
+  void* arg;
 };
 
+namespace {
+
+// 其地址用作槽位的 in-use 标记
+char read_view_in_use;
+
+// 每个线程首次读取时分配一个编号, 编号决定了该线程使用的读视图缓存槽位.
+uint32_t ThreadReadViewId() {
+  static std::atomic<uint32_t> next_id(0);
+  static thread_local uint32_t id =
+      next_id.fetch_add(1, std::memory_order_relaxed);
+  return id;
+}
+
+}  // anonymous namespace
+
 struct DBImpl::CompactionState {
   Compaction* const compaction;
 
@@ -67,6 +141,8 @@ struct DBImpl::CompactionState {
     uint64_t number;
     uint64_t file_size;
     InternalKey smallest, largest;
+    // 非 0 表示写文件时以它为前缀把 data block 放入了 block_cache
+    uint64_t cache_id;
   };
   std::vector<Output> outputs;
 
@@ -105,6 +181,7 @@ Options SanitizeOptions(const std::string& dbname,
   ClipToRange(&result.write_buffer_size, 64<<10,                      1<<30);
   ClipToRange(&result.max_file_size,     1<<20,                       1<<30);
   ClipToRange(&result.block_size,        1<<10,                       4<<20);
+  ClipToRange(&result.async_read_threads, 1,                          256);
   if (result.info_log == nullptr) {
     // Open a log file in the same directory as the db
     src.env->CreateDir(dbname);  // In case it does not exist
@@ -132,12 +209,15 @@ static int TableCacheSize(const Options& sanitized_options) {
 DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
     : env_(raw_options.env),
       internal_comparator_(raw_options.comparator),
-      internal_filter_policy_(raw_options.filter_policy),
+      internal_filter_policy_(raw_options.filter_policy,
+                              raw_options.comparator->timestamp_size()),
       options_(SanitizeOptions(dbname, &internal_comparator_,
                                &internal_filter_policy_, raw_options)),
       owns_info_log_(options_.info_log != raw_options.info_log),
       owns_cache_(options_.block_cache != raw_options.block_cache),
       dbname_(dbname),
+      wal_dir_(raw_options.wal_dir.empty() ? dbname : raw_options.wal_dir),
+      previous_wal_dir_(dbname),
       table_cache_(new TableCache(dbname_, options_, TableCacheSize(options_))),
       db_lock_(nullptr),
       shutting_down_(nullptr),
@@ -148,24 +228,102 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
       logfile_number_(0),
       log_(nullptr),
       seed_(0),
+      read_view_(nullptr),
+      read_view_number_(0),
+      compacted_sequence_(0),
+      read_view_slots_(new ReadViewSlot[kNumReadViewSlots]),
+      async_cv_(&async_mutex_),
+      async_threads_(0),
+      async_idle_threads_(0),
+      async_shutting_down_(false),
+      log_sync_mode_(kLogSyncUnknown),
+      log_appended_sequence_(0),
+      log_synced_sequence_(0),
+      log_sync_requested_(0),
+      log_sync_in_progress_(false),
+      log_sync_thread_running_(false),
+      log_sync_cv_(&mutex_),
+      log_synced_signal_(&mutex_),
       tmp_batch_(new WriteBatch),
       background_compaction_scheduled_(false),
       manual_compaction_(nullptr),
       versions_(new VersionSet(dbname_, &options_, table_cache_,
-                               &internal_comparator_)) {
+                               &internal_comparator_)),
+      purge_cv_(&purge_mutex_),
+      purge_thread_running_(false),
+      purge_in_progress_(false),
+      purge_shutting_down_(false),
+      next_prefetch_job_(0),
+      prefetch_threads_(0),
+      full_history_ts_low_(raw_options.full_history_ts_low) {
   has_imm_.Release_Store(nullptr);
+  for (int level = 0; level < config::kNumLevels; level++) {
+    level_filter_policies_[level] = nullptr;
+    if (options_.filter_policy != nullptr &&
+        static_cast<size_t>(level) < raw_options.level_filter_policies.size()) {
+      const FilterPolicy* policy = raw_options.level_filter_policies[level];
+      if (policy != nullptr && policy != raw_options.filter_policy) {
+        level_filter_policies_[level] = new InternalFilterPolicy(
+            policy, raw_options.comparator->timestamp_size());
+      }
+    }
+  }
+  for (size_t i = 0; i < kNumReadViewSlots; i++) {
+    read_view_slots_[i].view.store(nullptr, std::memory_order_relaxed);
+  }
 }
 
 DBImpl::~DBImpl() {
+  // 先完成全部未完成的异步查询, 它们要用到下面释放的各种资源
+  async_mutex_.Lock();
+  async_shutting_down_ = true;
+  async_cv_.SignalAll();
+  while (async_threads_ > 0) {
+    async_cv_.Wait();
+  }
+  async_mutex_.Unlock();
+
   // Wait for background work to finish
   mutex_.Lock();
   shutting_down_.Release_Store(this);  // Any non-null value is ok 随便存个非空值即可, 标记正在关闭
-  while (background_compaction_scheduled_) { // 循环是为了防止虚假唤醒误判
+  // 循环是为了防止虚假唤醒误判. 预取线程看到 shutting_down_ 后会尽快退出.
+  while (background_compaction_scheduled_ || prefetch_threads_ > 0) {
     background_work_finished_signal_.Wait(); // 等待后台工作结束
   }
+  // 等待 WAL 同步线程退出
+  log_sync_cv_.SignalAll();
+  while (log_sync_thread_running_) {
+    log_synced_signal_.Wait();
+  }
+  // 此时已经没有读者了, 释放各个槽位缓存的视图以及当前视图.
+  for (size_t i = 0; i < kNumReadViewSlots; i++) {
+    ReadView* view =
+        read_view_slots_[i].view.exchange(nullptr, std::memory_order_acquire);
+    if (view != nullptr && view->Unref()) {
+      DeleteReadView(view);
+    }
+  }
+  if (read_view_ != nullptr && read_view_->Unref()) {
+    DeleteReadView(read_view_);
+  }
+  read_view_ = nullptr;
   mutex_.Unlock();
+  delete[] read_view_slots_;
+
+  // 删除线程不再限速, 删完排队的文件后退出. 要在释放文件锁之前完成,
+  // 以免和之后打开同一个数据库的进程冲突.
+  purge_mutex_.Lock();
+  purge_shutting_down_ = true;
+  purge_cv_.SignalAll();
+  while (purge_thread_running_) {
+    purge_cv_.Wait();
+  }
+  purge_mutex_.Unlock();
 
   if (db_lock_ != nullptr) {
+    if (options_.persist_block_cache) {
+      SaveBlockCache();
+    }
     env_->UnlockFile(db_lock_);
   }
 
@@ -183,6 +341,9 @@ DBImpl::~DBImpl() {
   if (owns_cache_) {
     delete options_.block_cache;
   }
+  for (int level = 0; level < config::kNumLevels; level++) {
+    delete level_filter_policies_[level];
+  }
 }
 
 // 初始化一个 version_edit 对象, 创建 MANIFEST 文件, 并将前述 version_edit 序列化为一条日志写入到该文件;
@@ -235,6 +396,24 @@ void DBImpl::MaybeIgnoreError(Status* s) const {
 // 删除过期文件
 void DBImpl::DeleteObsoleteFiles() {
   mutex_.AssertHeld();
+  std::vector<ObsoleteFile> files;
+  FindObsoleteFiles(false, &files);
+  if (files.empty()) {
+    return;
+  }
+
+  MutexLock l(&purge_mutex_);
+  purge_queue_.insert(purge_queue_.end(), files.begin(), files.end());
+  if (!purge_thread_running_) {
+    purge_thread_running_ = true;
+    env_->StartThread(&DBImpl::PurgeThread, this);
+  }
+  purge_cv_.Signal();
+}
+
+void DBImpl::FindObsoleteFiles(bool full_scan,
+                               std::vector<ObsoleteFile>* files) {
+  mutex_.AssertHeld();
 
   if (!bg_error_.ok()) {
 		// 如果后台任务出错, 我们不清楚新的 version 是否成功提交,
@@ -242,55 +421,346 @@ void DBImpl::DeleteObsoleteFiles() {
     return;
   }
 
-  // 将当前全部 sstable 文件添加到 live 集合中
-  std::set<uint64_t> live = pending_outputs_;
-  // 将全部存活 version 中维护的文件添加到 live 集合中
-  versions_->AddLiveFiles(&live);
+  const bool retain_logs =
+      (options_.wal_ttl_seconds > 0 || options_.wal_size_limit > 0);
+  std::vector<uint64_t> obsolete_logs;
+  std::vector<uint64_t> obsolete_tables;
+  // 不管是否遍历目录都要取走, 遍历目录时它们已经包含在遍历结果中了
+  versions_->TakeObsoleteFiles(&obsolete_tables);
+
+  if (full_scan) {
+    // 将当前全部 sstable 文件添加到 live 集合中
+    std::set<uint64_t> live = pending_outputs_;
+    // 将全部存活 version 中维护的文件添加到 live 集合中
+    versions_->AddLiveFiles(&live);
+
+    std::vector<std::string> filenames;
+    // 故意忽略返回值可能反馈的错误, 反正是 GC, 能回收多少是多少
+    env_->GetChildren(dbname_, &filenames);
+    std::sort(filenames.begin(), filenames.end());
+    live_logs_.clear();
+    uint64_t number;
+    FileType type;
+    for (size_t i = 0; i < filenames.size(); i++) {
+      if (ParseFileName(filenames[i], &number, &type)) {
+        bool keep = true;
+        switch (type) {
+          case kLogFile:
+            keep = ((number >= versions_->LogNumber()) ||
+                    (number == versions_->PrevLogNumber()));
+            if (wal_dir_ != dbname_) {
+              // 设置 wal_dir 之前遗留在数据库目录下的 log 文件, 不再保留
+              // 给 GetUpdatesSince 使用, 恢复完成后直接删除.
+              break;
+            }
+            if (keep) {
+              live_logs_.push_back(number);
+            } else if (retain_logs) {
+              // 交给下面的 RetainObsoleteLogs 决定是否删除
+              obsolete_logs.push_back(number);
+              keep = true;
+            }
+            break;
+          case kDescriptorFile:
+            // Keep my manifest file, and any newer incarnations'
+            // (in case there is a race that allows other incarnations)
+            keep = (number >= versions_->ManifestFileNumber());
+            break;
+          case kTableFile:
+            keep = (live.find(number) != live.end());
+            break;
+          case kTempFile:
+            // Any temp files that are currently being written to must
+            // be recorded in pending_outputs_, which is inserted into "live"
+            keep = (live.find(number) != live.end());
+            break;
+          case kCurrentFile:
+          case kDBLockFile:
+          case kInfoLogFile:
+          case kBlockCacheFile:
+          case kWalDirFile:
+          case kIdentityFile:
+            keep = true;
+            break;
+        }
 
-  std::vector<std::string> filenames;
-	// 故意忽略返回值可能反馈的错误, 反正是 GC, 能回收多少是多少
-  env_->GetChildren(dbname_, &filenames);
-  uint64_t number;
-  FileType type;
-  for (size_t i = 0; i < filenames.size(); i++) {
-    if (ParseFileName(filenames[i], &number, &type)) {
-      bool keep = true;
-      switch (type) {
-        case kLogFile:
-          keep = ((number >= versions_->LogNumber()) ||
-                  (number == versions_->PrevLogNumber()));
-          break;
-        case kDescriptorFile:
-          // Keep my manifest file, and any newer incarnations'
-          // (in case there is a race that allows other incarnations)
-          keep = (number >= versions_->ManifestFileNumber());
-          break;
-        case kTableFile:
-          keep = (live.find(number) != live.end());
-          break;
-        case kTempFile:
-          // Any temp files that are currently being written to must
-          // be recorded in pending_outputs_, which is inserted into "live"
-          keep = (live.find(number) != live.end());
-          break;
-        case kCurrentFile:
-        case kDBLockFile:
-        case kInfoLogFile:
-          keep = true;
-          break;
+        if (!keep) {
+          ObsoleteFile file;
+          file.fname = dbname_ + "/" + filenames[i];
+          file.type = type;
+          file.number = number;
+          files->push_back(file);
+        }
       }
-
-      if (!keep) {
-        if (type == kTableFile) {
-          table_cache_->Evict(number);
+    }
+    // log 目录下只关心 log 文件. 上次打开时的 log 目录和数据库目录一样,
+    // 其中的 log 文件恢复完成后直接删除.
+    std::vector<std::string> dirs;
+    ExtraLogDirs(&dirs);
+    for (size_t d = 0; d < dirs.size(); d++) {
+      const bool current_dir = (dirs[d] == wal_dir_);
+      filenames.clear();
+      env_->GetChildren(dirs[d], &filenames);
+      for (size_t i = 0; i < filenames.size(); i++) {
+        if (!ParseFileName(filenames[i], &number, &type) ||
+            type != kLogFile) {
+          continue;
         }
-        Log(options_.info_log, "Delete type=%d #%lld\n",
-            static_cast<int>(type),
-            static_cast<unsigned long long>(number));
-        env_->DeleteFile(dbname_ + "/" + filenames[i]);
+        if ((number >= versions_->LogNumber()) ||
+            (number == versions_->PrevLogNumber())) {
+          if (current_dir) {
+            live_logs_.push_back(number);
+          }
+        } else if (retain_logs && current_dir) {
+          obsolete_logs.push_back(number);
+        } else {
+          ObsoleteFile file;
+          file.fname = dirs[d] + "/" + filenames[i];
+          file.type = kLogFile;
+          file.number = number;
+          files->push_back(file);
+        }
+      }
+    }
+    // 文件名按字符串排序, 编号不一定有序
+    std::sort(live_logs_.begin(), live_logs_.end());
+  } else {
+    // 运行期间不会再产生新的 MANIFEST 文件, 过期的只有被 version 移除的
+    // sstable 文件以及数据已经写入 sstable 的 log 文件.
+    for (size_t i = 0; i < obsolete_tables.size(); i++) {
+      // 压实失败时还没有生效的输出文件可能已经过期, 这时 bg_error_
+      // 不再为空, 不会走到这里. 保险起见仍然跳过正在写的文件.
+      if (pending_outputs_.count(obsolete_tables[i]) > 0) {
+        continue;
+      }
+      ObsoleteFile file;
+      file.fname = TableFileName(dbname_, obsolete_tables[i]);
+      file.type = kTableFile;
+      file.number = obsolete_tables[i];
+      files->push_back(file);
+    }
+    while (!live_logs_.empty() &&
+           live_logs_.front() < versions_->LogNumber() &&
+           live_logs_.front() != versions_->PrevLogNumber()) {
+      const uint64_t number = live_logs_.front();
+      live_logs_.pop_front();
+      if (retain_logs) {
+        obsolete_logs.push_back(number);
+      } else {
+        ObsoleteFile file;
+        file.fname = LogFileName(wal_dir_, number);
+        file.type = kLogFile;
+        file.number = number;
+        files->push_back(file);
+      }
+    }
+    if (retain_logs) {
+      // 之前保留下来的 log 文件也要重新检查
+      for (std::map<uint64_t, uint64_t>::const_iterator iter =
+               retained_logs_.begin();
+           iter != retained_logs_.end(); ++iter) {
+        obsolete_logs.push_back(iter->first);
+      }
+    }
+  }
+
+  if (retain_logs) {
+    std::sort(obsolete_logs.begin(), obsolete_logs.end());
+    RetainObsoleteLogs(obsolete_logs, files);
+  }
+}
+
+void DBImpl::RetainObsoleteLogs(const std::vector<uint64_t>& logs,
+                                std::vector<ObsoleteFile>* files) {
+  mutex_.AssertHeld();
+  const uint64_t now = env_->NowMicros();
+  std::map<uint64_t, uint64_t> retained;
+  std::vector<uint64_t> sizes(logs.size(), 0);
+  uint64_t total_size = 0;
+  for (size_t i = 0; i < logs.size(); i++) {
+    // 第一次发现过期的 log 文件从现在开始计时
+    std::map<uint64_t, uint64_t>::const_iterator iter =
+        retained_logs_.find(logs[i]);
+    retained[logs[i]] = (iter != retained_logs_.end()) ? iter->second : now;
+    env_->GetFileSize(LogFileName(wal_dir_, logs[i]), &sizes[i]);
+    total_size += sizes[i];
+  }
+
+  // 从最老的开始删除, 保证保留下来的 log 文件总是连续的.
+  const uint64_t ttl_micros = options_.wal_ttl_seconds * 1000000;
+  for (size_t i = 0; i < logs.size(); i++) {
+    const bool expired =
+        ttl_micros > 0 && now - retained[logs[i]] > ttl_micros;
+    const bool oversized =
+        options_.wal_size_limit > 0 && total_size > options_.wal_size_limit;
+    if (!expired && !oversized) {
+      break;
+    }
+    ObsoleteFile file;
+    file.fname = LogFileName(wal_dir_, logs[i]);
+    file.type = kLogFile;
+    file.number = logs[i];
+    files->push_back(file);
+    retained.erase(logs[i]);
+    total_size -= sizes[i];
+  }
+  retained_logs_.swap(retained);
+}
+
+void DBImpl::DeleteObsoleteFile(const ObsoleteFile& file) {
+  if (file.type == kTableFile) {
+    table_cache_->Evict(file.number);
+  }
+  Log(options_.info_log, "Delete type=%d #%lld\n",
+      static_cast<int>(file.type),
+      static_cast<unsigned long long>(file.number));
+  env_->DeleteFile(file.fname);
+}
+
+void DBImpl::PurgeThread(void* db) {
+  reinterpret_cast<DBImpl*>(db)->PurgeLoop();
+}
+
+// 删除线程不断取出排队的文件进行删除, 数据库关闭时删完全部文件再退出.
+void DBImpl::PurgeLoop() {
+  const uint64_t rate = options_.delete_rate_bytes_per_second;
+  purge_mutex_.Lock();
+  while (true) {
+    while (purge_queue_.empty() && !purge_shutting_down_) {
+      purge_cv_.Wait();
+    }
+    if (purge_queue_.empty()) {
+      break;
+    }
+    ObsoleteFile file = purge_queue_.front();
+    purge_queue_.pop_front();
+    purge_in_progress_ = true;
+    const bool throttle = rate > 0 && !purge_shutting_down_;
+    purge_mutex_.Unlock();
+
+    uint64_t size = 0;
+    if (throttle) {
+      env_->GetFileSize(file.fname, &size);
+    }
+    DeleteObsoleteFile(file);
+
+    purge_mutex_.Lock();
+    // 按删除的字节数等待, 分段等待以便数据库关闭时尽快结束
+    uint64_t delay = static_cast<uint64_t>(size * 1e6 / (rate > 0 ? rate : 1));
+    while (delay > 0 && !purge_shutting_down_) {
+      const uint64_t micros = std::min<uint64_t>(delay, 100000);
+      purge_mutex_.Unlock();
+      env_->SleepForMicroseconds(static_cast<int>(micros));
+      purge_mutex_.Lock();
+      delay -= micros;
+    }
+    purge_in_progress_ = false;
+    purge_cv_.SignalAll();
+  }
+  purge_thread_running_ = false;
+  purge_cv_.SignalAll();
+  purge_mutex_.Unlock();
+}
+
+// BLOCKCACHE 文件由若干 <文件编号, block 偏移量> 构成(均为 varint64),
+// 末尾是覆盖前面全部内容的 masked crc32c(fixed32).
+// 文件只是一个优化提示, 写入失败或者内容损坏都直接忽略.
+void DBImpl::SaveBlockCache() {
+  std::vector<std::pair<uint64_t, uint64_t>> blocks;
+  table_cache_->GetCachedBlocks(&blocks);
+  if (blocks.empty()) {
+    // 比如打开后没有任何读取, 保留上一次记录的内容
+    return;
+  }
+  std::string contents;
+  for (size_t i = 0; i < blocks.size(); i++) {
+    PutVarint64(&contents, blocks[i].first);
+    PutVarint64(&contents, blocks[i].second);
+  }
+  PutFixed32(&contents,
+             crc32c::Mask(crc32c::Value(contents.data(), contents.size())));
+  Status s = WriteStringToFile(env_, contents, BlockCacheFileName(dbname_));
+  Log(options_.info_log, "Saved %d block cache entries: %s",
+      static_cast<int>(blocks.size()), s.ToString().c_str());
+}
+
+void DBImpl::StartBlockCachePrefetch() {
+  std::string contents;
+  if (!ReadFileToString(env_, BlockCacheFileName(dbname_), &contents).ok() ||
+      contents.size() < 4) {
+    return;
+  }
+  Slice input(contents.data(), contents.size() - 4);
+  if (crc32c::Unmask(DecodeFixed32(input.data() + input.size())) !=
+      crc32c::Value(input.data(), input.size())) {
+    Log(options_.info_log, "Ignoring corrupted block cache file");
+    return;
+  }
+  std::map<uint64_t, std::vector<uint64_t>> offsets;
+  uint64_t number, offset;
+  while (GetVarint64(&input, &number) && GetVarint64(&input, &offset)) {
+    offsets[number].push_back(offset);
+  }
+
+  MutexLock l(&mutex_);
+  // 只预取仍然存活的文件, 文件大小也从当前版本中获取
+  Version* current = versions_->current();
+  for (int level = 0; level < config::kNumLevels; level++) {
+    std::vector<FileMetaData*> files;
+    current->GetOverlappingInputs(level, nullptr, nullptr, &files);
+    for (size_t i = 0; i < files.size(); i++) {
+      std::map<uint64_t, std::vector<uint64_t>>::iterator it =
+          offsets.find(files[i]->number);
+      if (it != offsets.end()) {
+        BlockCachePrefetchJob job;
+        job.number = files[i]->number;
+        job.file_size = files[i]->file_size;
+        job.offsets.swap(it->second);
+        std::sort(job.offsets.begin(), job.offsets.end());
+        prefetch_jobs_.push_back(job);
       }
     }
   }
+  const int threads = std::min<int>(kNumBlockCachePrefetchThreads,
+                                    static_cast<int>(prefetch_jobs_.size()));
+  Log(options_.info_log, "Prefetching blocks of %d tables with %d threads",
+      static_cast<int>(prefetch_jobs_.size()), threads);
+  for (int i = 0; i < threads; i++) {
+    prefetch_threads_++;
+    env_->StartThread(&DBImpl::BlockCachePrefetchThread, this);
+  }
+}
+
+void DBImpl::BlockCachePrefetchThread(void* db) {
+  reinterpret_cast<DBImpl*>(db)->BlockCachePrefetchLoop();
+}
+
+void DBImpl::BlockCachePrefetchLoop() {
+  mutex_.Lock();
+  while (next_prefetch_job_ < prefetch_jobs_.size() &&
+         shutting_down_.Acquire_Load() == nullptr) {
+    // 线程全部退出之前 prefetch_jobs_ 不会被修改, 可以在锁外使用 job
+    const BlockCachePrefetchJob& job = prefetch_jobs_[next_prefetch_job_++];
+    mutex_.Unlock();
+    // 文件可能已经被压实删除, 忽略错误
+    table_cache_->PrefetchBlocks(job.number, job.file_size, job.offsets);
+    mutex_.Lock();
+  }
+  if (--prefetch_threads_ == 0) {
+    prefetch_jobs_.clear();
+    next_prefetch_job_ = 0;
+    background_work_finished_signal_.SignalAll();
+  }
+  mutex_.Unlock();
+}
+
+void DBImpl::ExtraLogDirs(std::vector<std::string>* dirs) const {
+  if (previous_wal_dir_ != dbname_ && previous_wal_dir_ != wal_dir_) {
+    dirs->push_back(previous_wal_dir_);
+  }
+  if (wal_dir_ != dbname_) {
+    dirs->push_back(wal_dir_);
+  }
 }
 
 // 该方法用于刚打开数据库时从磁盘读取数据在内存建立 level 架构.
@@ -309,6 +779,9 @@ Status DBImpl::Recover(VersionEdit* edit, bool *save_manifest) {
   // may already exist from a previous failed creation attempt.
   // 创建数据库目录(一个目录代表一个数据库)
   env_->CreateDir(dbname_);
+  if (wal_dir_ != dbname_) {
+    env_->CreateDir(wal_dir_);
+  }
   assert(db_lock_ == nullptr);
   // 锁定该目录
   Status s = env_->LockFile(LockFileName(dbname_), &db_lock_);
@@ -336,6 +809,19 @@ Status DBImpl::Recover(VersionEdit* edit, bool *save_manifest) {
     }
   }
 
+  // 读取数据库的唯一标识, 之前版本创建的数据库没有该文件, 为其生成一个.
+  // 恢复过程中就可能打开 table, 所以要先设置好.
+  uint64_t db_id;
+  if (env_->FileExists(IdentityFileName(dbname_))) {
+    s = ReadIdentityFile(env_, dbname_, &db_id);
+  } else {
+    s = SetIdentityFile(env_, dbname_, &db_id);
+  }
+  if (!s.ok()) {
+    return s;
+  }
+  table_cache_->SetDbId(db_id);
+
   // 该方法负责从最后一个 MANIFEST 文件解析内容出来与当前 Version
   // 保存的 level 架构合并保存到一个
   // 新建的 Version 中, 然后将这个新的 version 作为当前的 version.
@@ -381,6 +867,34 @@ Status DBImpl::Recover(VersionEdit* edit, bool *save_manifest) {
         logs.push_back(number);
     }
   }
+  // log 文件还可能位于上次打开时的 wal_dir(记录在 WALDIR 文件中)以及本次的
+  // wal_dir_ 下, 这些目录都需要恢复. log_dirs 记录每个 log 文件所在的目录.
+  // 上次的 log 目录无法读取时打开失败, 否则其中的更新会被悄悄丢掉.
+  s = ReadWalDirFile(env_, dbname_, &previous_wal_dir_);
+  if (!s.ok()) {
+    return s;
+  }
+  std::map<uint64_t, std::string> log_dirs;
+  for (size_t i = 0; i < logs.size(); i++) {
+    log_dirs[logs[i]] = dbname_;
+  }
+  std::vector<std::string> dirs;
+  ExtraLogDirs(&dirs);
+  for (size_t d = 0; d < dirs.size(); d++) {
+    filenames.clear();
+    s = env_->GetChildren(dirs[d], &filenames);
+    if (!s.ok()) {
+      return s;
+    }
+    for (size_t i = 0; i < filenames.size(); i++) {
+      if (ParseFileName(filenames[i], &number, &type) && type == kLogFile &&
+          ((number >= min_log) || (number == prev_log)) &&
+          log_dirs.count(number) == 0) {
+        logs.push_back(number);
+        log_dirs[number] = dirs[d];
+      }
+    }
+  }
   // 若 versionset 中记录的文件多于从当前数据库目录中读取到的文件,
   // 则说明数据库目录有文件丢失, 数据库损坏.
   if (!expected.empty()) {
@@ -396,8 +910,8 @@ Status DBImpl::Recover(VersionEdit* edit, bool *save_manifest) {
   for (size_t i = 0; i < logs.size(); i++) {
     // 从旧到新逐个 log 文件恢复, 如果有 log 文件转换为 sorted string table 文件(如大小到达阈值)落盘则
     // 将 save_manifest 标记为 true, 表示需要写日志到 manifest 文件.
-    s = RecoverLogFile(logs[i], (i == logs.size() - 1), save_manifest, edit,
-                       &max_sequence);
+    s = RecoverLogFile(logs[i], log_dirs[logs[i]], (i == logs.size() - 1), save_manifest,
+                       edit, &max_sequence);
     if (!s.ok()) {
       return s;
     }
@@ -419,8 +933,9 @@ Status DBImpl::Recover(VersionEdit* edit, bool *save_manifest) {
 // 如果该 log 文件继续使用则将其对应 memtable 赋值到 mem_ 继续使用;
 // 否则将 log 文件对应 memtable 转换为 sstable 文件写入磁盘, 同时标记 save_manifest 为 true,
 // 表示 level 架构变动需要记录文件变更到 manifest 文件.
-Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
-                              bool* save_manifest, VersionEdit* edit,
+Status DBImpl::RecoverLogFile(uint64_t log_number, const std::string& dir,
+                              bool last_log, bool* save_manifest,
+                              VersionEdit* edit,
                               SequenceNumber* max_sequence) {
   struct LogReporter : public log::Reader::Reporter {
     Env* env;
@@ -438,7 +953,7 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
   mutex_.AssertHeld();
 
   // Open the log file
-  std::string fname = LogFileName(dbname_, log_number);
+  std::string fname = LogFileName(dir, log_number);
   SequentialFile* file;
   Status status = env_->NewSequentialFile(fname, &file);
   if (!status.ok()) {
@@ -477,9 +992,24 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
       continue;
     }
     WriteBatchInternal::SetContents(&batch, record);
+    // 定长 key 模式下 memtable 无法保存其它长度的 key
+    if (options_.fixed_key_length > 0) {
+      status = WriteBatchInternal::CheckKeyLength(&batch,
+                                                  options_.fixed_key_length);
+      if (!status.ok()) {
+        break;
+      }
+    }
+    if (user_comparator()->timestamp_size() > 0) {
+      status = WriteBatchInternal::CheckTimestampSize(
+          &batch, user_comparator()->timestamp_size());
+      if (!status.ok()) {
+        break;
+      }
+    }
 
     if (mem == nullptr) {
-      mem = new MemTable(internal_comparator_);
+      mem = new MemTable(internal_comparator_, options_.fixed_key_length);
       mem->Ref();
     }
     // 将数据填充到 memtable
@@ -516,7 +1046,9 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
   delete file;
 
   // See if we should keep reusing the last log file.
-  if (status.ok() && options_.reuse_logs && last_log && compactions == 0) {
+  // 数据库目录下遗留的 log 文件不再续用, 新的 log 文件要写到 wal_dir_ 下.
+  if (status.ok() && options_.reuse_logs && last_log && compactions == 0 &&
+      dir == wal_dir_) {
     assert(logfile_ == nullptr);
     assert(log_ == nullptr);
     assert(mem_ == nullptr);
@@ -534,7 +1066,7 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
         mem = nullptr;
       } else {
         // mem can be nullptr if lognum exists but was empty.
-        mem_ = new MemTable(internal_comparator_);
+        mem_ = new MemTable(internal_comparator_, options_.fixed_key_length);
         mem_->Ref();
       }
     }
@@ -580,7 +1112,9 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
     // 将 memtable 序列化为一个 sorted string table 文件并写入磁盘,
     // 文件大小会被保存到 meta 中. 同时将 sstable 对应的 Table 实例放入
     // table_cache_ 中.
-    s = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    // 构造完成之后才能确定放到哪一层, 这里按 level-0 的参数构造
+    s = BuildTable(dbname_, env_, TableOptionsForLevel(0, false), table_cache_,
+                   iter, &meta);
     // 构造完毕, 重新获取锁, 诸如 pending_outputs_ 需要 mutex_ 来守护
     mutex_.Lock();
   }
@@ -668,6 +1202,7 @@ void DBImpl::CompactMemTable() {
     imm_->Unref();
     imm_ = nullptr;
     has_imm_.Release_Store(nullptr);
+    InstallReadView();
     // 删除过期文件
     DeleteObsoleteFiles();
   } else {
@@ -715,6 +1250,24 @@ void DBImpl::CompactRange(const Slice* begin, const Slice* end) {
   }
 }
 
+Status DBImpl::IncreaseFullHistoryTsLow(const Slice& ts) {
+  const Comparator* ucmp = user_comparator();
+  if (ucmp->timestamp_size() == 0) {
+    return Status::InvalidArgument("timestamp not supported by comparator",
+                                   ucmp->Name());
+  }
+  if (ts.size() != ucmp->timestamp_size()) {
+    return Status::InvalidArgument("timestamp size mismatch");
+  }
+  MutexLock l(&mutex_);
+  // 下界只能调高, 已经回收的历史版本无法恢复
+  if (full_history_ts_low_.empty() ||
+      ucmp->CompareTimestamp(ts, full_history_ts_low_) > 0) {
+    full_history_ts_low_.assign(ts.data(), ts.size());
+  }
+  return Status::OK();
+}
+
 void DBImpl::TEST_CompactRange(int level, const Slice* begin,
                                const Slice* end) {
   assert(level >= 0);
@@ -778,6 +1331,8 @@ void DBImpl::RecordBackgroundError(const Status& s) {
   if (bg_error_.ok()) {
     bg_error_ = s;
     background_work_finished_signal_.SignalAll();
+    // 等待同步的写入不会再等到同步完成了
+    log_synced_signal_.SignalAll();
   }
 }
 
@@ -884,7 +1439,9 @@ void DBImpl::BackgroundCompaction() {
                        f->smallest, f->largest);
     // 应用本次移动操作
     status = versions_->LogAndApply(c->edit(), &mutex_);
-    if (!status.ok()) {
+    if (status.ok()) {
+      InstallReadView();
+    } else {
       RecordBackgroundError(status);
     }
     VersionSet::LevelSummaryStorage tmp;
@@ -968,6 +1525,7 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
     out.number = file_number;
     out.smallest.Clear();
     out.largest.Clear();
+    out.cache_id = 0;
     compact->outputs.push_back(out);
     mutex_.Unlock();
   }
@@ -976,11 +1534,28 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
   std::string fname = TableFileName(dbname_, file_number);
   Status s = env_->NewWritableFile(fname, &compact->outfile);
   if (s.ok()) {
-    compact->builder = new TableBuilder(options_, compact->outfile);
+    const Compaction* c = compact->compaction;
+    compact->builder = new TableBuilder(
+        TableOptionsForLevel(c->level() + 1, c->IsBottommostLevel()),
+        compact->outfile);
+    if (c->level() + 1 <= options_.warm_block_cache_level) {
+      compact->current_output()->cache_id = options_.block_cache->NewId();
+      compact->builder->CacheDataBlocks(compact->current_output()->cache_id);
+    }
   }
   return s;
 }
 
+Options DBImpl::TableOptionsForLevel(int level, bool bottommost) const {
+  Options result = options_;
+  if (bottommost && options_.optimize_filters_for_hits) {
+    result.filter_policy = nullptr;
+  } else if (level_filter_policies_[level] != nullptr) {
+    result.filter_policy = level_filter_policies_[level];
+  }
+  return result;
+}
+
 // 用压实内容构造 sstable 文件并落盘, 同时加载一遍确保构造正确.
 Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
                                           Iterator* input) {
@@ -994,6 +1569,10 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
   // Check for iterator errors
   Status s = input->status();
   const uint64_t current_entries = compact->builder->NumEntries();
+  if (current_entries > 0) {
+    // 最后写入的就是最大的 key, 压实过程中不再逐个记录
+    compact->current_output()->largest.DecodeFrom(compact->builder->LastKey());
+  }
   if (s.ok()) {
     // 完成 sstable 构造和落盘
     s = compact->builder->Finish();
@@ -1016,6 +1595,11 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
   delete compact->outfile;
   compact->outfile = nullptr;
 
+  const uint64_t cache_id = compact->current_output()->cache_id;
+  if (s.ok() && current_entries > 0 && cache_id != 0) {
+    // 以写文件时使用的 cache_id 打开 table, 下面的校验直接使用它
+    s = table_cache_->AddTable(output_number, current_bytes, cache_id);
+  }
   if (s.ok() && current_entries > 0) {
     // 确保生成的 sstable 文件可用(加载解析一遍, 成功即可)
     Iterator* iter = table_cache_->NewIterator(ReadOptions(),
@@ -1054,7 +1638,11 @@ Status DBImpl::InstallCompactionResults(CompactionState* compact) {
         level + 1,
         out.number, out.file_size, out.smallest, out.largest);
   }
-  return versions_->LogAndApply(compact->compaction->edit(), &mutex_);
+  Status s = versions_->LogAndApply(compact->compaction->edit(), &mutex_);
+  if (s.ok()) {
+    InstallReadView();
+  }
+  return s;
 }
 
 // 具体压实就做一件事情:
@@ -1074,14 +1662,20 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   assert(versions_->NumLevelFiles(compact->compaction->level()) > 0);
   assert(compact->builder == nullptr);
   assert(compact->outfile == nullptr);
-  // 如果快照列表为空, 则将最新的操作序列号作为最小的快照
-  if (snapshots_.empty()) {
-    compact->smallest_snapshot = versions_->LastSequence();
-  } else {
-    // 否则从快照列表获取最老的快照对应的序列号作为最小快照.
-    // 虽然最老, 但是没有 release 就是要保障可见性的.
-    compact->smallest_snapshot = snapshots_.oldest()->sequence_number();
-  }
+  // 如果快照列表为空, 则将最新的操作序列号作为最小的快照;
+  // 否则从快照列表获取最老的快照对应的序列号作为最小快照.
+  // 虽然最老, 但是没有 release 就是要保障可见性的.
+  // 获取快照不再需要 mutex_, 所以必须先读取最新序列号再检查快照列表,
+  // 具体原因见 SnapshotRegistry::OldestSequence.
+  const SequenceNumber last_sequence = versions_->LastSequence();
+  compact->smallest_snapshot = snapshots_.OldestSequence(last_sequence);
+  if (compact->smallest_snapshot >
+      compacted_sequence_.load(std::memory_order_relaxed)) {
+    compacted_sequence_.store(compact->smallest_snapshot,
+                              std::memory_order_release);
+  }
+  // 历史版本保留下界可能被并发调高, 先拷贝一份
+  const std::string full_history_ts_low = full_history_ts_low_;
 
   // 真正做压实工作的之前要释放锁
   mutex_.Unlock();
@@ -1103,6 +1697,15 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   // 如果 user key 出现多次, 下面这个用于记录上次出现时对应的
   // internal key 的序列号.
   SequenceNumber last_sequence_for_key = kMaxSequenceNumber;
+  // 带时间戳时, 同一个 key 的不同版本是不同的 user key, 按时间戳从新到旧排列.
+  // 下面两个变量用于回收早于 full_history_ts_low 的历史版本: 如果某个 key 已经
+  // 出现过一个对全部快照可见且时间戳不晚于 full_history_ts_low 的版本, 那么
+  // 在不早于 full_history_ts_low 的时间点上读取永远看不到它之后的更老版本.
+  const size_t ts_size = user_comparator()->timestamp_size();
+  const bool gc_history = ts_size > 0 && !full_history_ts_low.empty();
+  std::string current_key_without_ts;  // 只有去掉时间戳的部分有意义
+  bool older_versions_hidden = false;
+  const Comparator* const ucmp = user_comparator();
   for (; input->Valid() && !shutting_down_.Acquire_Load(); ) {
     // 优先处理已经写满待压实的 memtable
     if (has_imm_.NoBarrier_Load() != nullptr) {
@@ -1141,25 +1744,43 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
       current_user_key.clear();
       has_current_user_key = false;
       last_sequence_for_key = kMaxSequenceNumber;
+      current_key_without_ts.clear();
+      older_versions_hidden = false;
     } else {
       // 如果这个 user key 之前迭代未出现过, 记下来
       if (!has_current_user_key ||
-          user_comparator()->Compare(ikey.user_key,
-                                     Slice(current_user_key)) != 0) {
+          ucmp->Compare(ikey.user_key, Slice(current_user_key)) != 0) {
         current_user_key.assign(ikey.user_key.data(), ikey.user_key.size());
         has_current_user_key = true;
         // 标记这个 user key 截止目前轮次迭代对应的序列号;
         // 因为是首次出现所以这里直接置为序列号最大可能取值.
         last_sequence_for_key = kMaxSequenceNumber;
       }
+      if (gc_history &&
+          (current_key_without_ts.empty() ||
+           ucmp->CompareWithoutTimestamp(
+               ikey.user_key, Slice(current_key_without_ts)) != 0)) {
+        current_key_without_ts.assign(ikey.user_key.data(),
+                                      ikey.user_key.size());
+        older_versions_hidden = false;
+      }
 
       // 序列号过小, 丢弃这个 key 本次迭代对应的数据; 后面还有这个 key
       // 对应的更新的数据.
       if (last_sequence_for_key <= compact->smallest_snapshot) {
         // Hidden by an newer entry for same user key
         drop = true;    // 规则 (A)
+      } else if (older_versions_hidden) {
+        // 早于历史版本保留下界且被更新的版本遮住了
+        drop = true;    // 规则 (B)
       } else if (ikey.type == kTypeDeletion &&
                  ikey.sequence <= compact->smallest_snapshot &&
+                 (ts_size == 0 ||
+                  (gc_history &&
+                   ucmp->CompareTimestamp(
+                       Slice(ikey.user_key.data() + ikey.user_key.size() -
+                                 ts_size, ts_size),
+                       full_history_ts_low) <= 0)) &&
                  compact->compaction->IsBaseLevelForKey(ikey.user_key)) {
         // 对于这个 user key:
         // (1) 更高的 levels(指的是祖父 level 及之上)没有对应数据了
@@ -1168,9 +1789,22 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         // 更小的数据在循环的未来几次迭代中会被丢弃(根据上面的规则(A)).
         //
         // 综上, 这个删除标记已经过期了并且可以被丢弃.
+        //
+        // 带时间戳时, IsBaseLevelForKey 忽略时间戳判断, 保证更高的 levels 没有
+        // 同一个 key 的任何版本; 删除标记还必须不晚于 full_history_ts_low,
+        // 这样本次压实中时间戳更老的版本都会被下面设置的规则 (B) 丢弃.
         drop = true;
       }
 
+      if (gc_history && !older_versions_hidden &&
+          ikey.sequence <= compact->smallest_snapshot &&
+          ucmp->CompareTimestamp(
+              Slice(ikey.user_key.data() + ikey.user_key.size() - ts_size,
+                    ts_size),
+              full_history_ts_low) <= 0) {
+        older_versions_hidden = true;
+      }
+
       last_sequence_for_key = ikey.sequence;
     }
 #if 0
@@ -1197,8 +1831,8 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         // 所以当前 user key 肯定是最小的
         compact->current_output()->smallest.DecodeFrom(key);
       }
-      // 否则当前 user key 目前就是最大的
-      compact->current_output()->largest.DecodeFrom(key);
+      // 最大的 key 等到 FinishCompactionOutputFile 时从 builder 取得,
+      // 不用每个数据项都拷贝一次.
       // 将该 user key 对应的数据项写入 sstable.
       // TODO 这里有个地方没看明白:
       // 如果当前 user key 首次出现, 则
@@ -1260,64 +1894,122 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   return status;
 }
 
-namespace {
+void DBImpl::CleanupReadView(void* arg1, void* arg2) {
+  DBImpl* db = reinterpret_cast<DBImpl*>(arg1);
+  ReadView* view = reinterpret_cast<ReadView*>(arg2);
+  db->ReturnReadView(view, kNoReadViewSlot);
+}
 
-// 对迭代器状态暂存, 用于迭代器析构时取出来进行资源释放相关操作.
-struct IterState {
-  port::Mutex* const mu;
-  Version* const version GUARDED_BY(mu);
-  MemTable* const mem GUARDED_BY(mu);
-  MemTable* const imm GUARDED_BY(mu);
+// 获取一个读视图. 每个线程优先使用自己槽位中缓存的视图, 只要该视图
+// 编号与 read_view_number_ 一致就说明它仍然是最新的, 无需加锁直接使用;
+// 否则持有 mutex_ 换上最新的视图.
+DBImpl::ReadView* DBImpl::GetReadView(size_t* slot) {
+  ReadView* const in_use = reinterpret_cast<ReadView*>(&read_view_in_use);
+  const size_t index = ThreadReadViewId() % kNumReadViewSlots;
+  ReadView* view = read_view_slots_[index].view.exchange(
+      in_use, std::memory_order_acquire);
+  if (view == in_use) {
+    // 线程数超过槽位数时, 槽位可能正在被另一个线程使用, 退化为加锁获取.
+    *slot = kNoReadViewSlot;
+    MutexLock l(&mutex_);
+    read_view_->Ref();
+    return read_view_;
+  }
 
-  IterState(port::Mutex* mutex, MemTable* mem, MemTable* imm, Version* version)
-      : mu(mutex), version(version), mem(mem), imm(imm) { }
-};
+  *slot = index;
+  if (view != nullptr &&
+      view->number == read_view_number_.load(std::memory_order_acquire)) {
+    return view;
+  }
 
-static void CleanupIteratorState(void* arg1, void* arg2) {
-  IterState* state = reinterpret_cast<IterState*>(arg1);
-  state->mu->Lock();
-  state->mem->Unref();
-  if (state->imm != nullptr) state->imm->Unref();
-  state->version->Unref();
-  state->mu->Unlock();
-  delete state;
+  MutexLock l(&mutex_);
+  if (view != nullptr && view->Unref()) {
+    DeleteReadView(view);
+  }
+  view = read_view_;
+  view->Ref();
+  return view;
 }
 
-}  // anonymous namespace
+// 归还读视图. 如果视图来自缓存槽位则尝试放回去, 放回失败说明
+// 槽位在此期间被 InstallReadView 回收了, 此时释放视图引用即可.
+void DBImpl::ReturnReadView(ReadView* view, size_t slot) {
+  if (slot != kNoReadViewSlot) {
+    ReadView* expected = reinterpret_cast<ReadView*>(&read_view_in_use);
+    if (read_view_slots_[slot].view.compare_exchange_strong(
+            expected, view, std::memory_order_release)) {
+      return;
+    }
+  }
+  if (view->Unref()) {
+    MutexLock l(&mutex_);
+    DeleteReadView(view);
+  }
+}
+
+void DBImpl::InstallReadView() {
+  mutex_.AssertHeld();
+  ReadView* old = read_view_;
+  read_view_ = new ReadView(
+      mem_, imm_, versions_->current(),
+      read_view_number_.load(std::memory_order_relaxed) + 1);
+  read_view_number_.store(read_view_->number, std::memory_order_release);
+  if (old != nullptr && old->Unref()) {
+    DeleteReadView(old);
+  }
+
+  // 回收各个槽位缓存的老视图, 否则空闲线程会一直持有老的 memtable 和 version,
+  // 导致内存和 sstable 文件无法被及时释放. 正在被使用的槽位同样置空,
+  // 使用者归还时发现槽位已被回收会自行释放引用.
+  ReadView* const in_use = reinterpret_cast<ReadView*>(&read_view_in_use);
+  for (size_t i = 0; i < kNumReadViewSlots; i++) {
+    ReadView* cached =
+        read_view_slots_[i].view.exchange(nullptr, std::memory_order_acq_rel);
+    if (cached != nullptr && cached != in_use && cached->Unref()) {
+      DeleteReadView(cached);
+    }
+  }
+}
+
+void DBImpl::DeleteReadView(ReadView* view) {
+  mutex_.AssertHeld();
+  view->mem->Unref();
+  if (view->imm != nullptr) view->imm->Unref();
+  view->current->Unref();
+  delete view;
+}
 
 // 该方法负责按序将当前 memtable 以及全部 sorted string table 文件对应的迭代器构造出来, 
 // 然后将其组装成一个逻辑迭代器 MergingIterator. 然后就可以用该迭代器遍历整个数据库了.
 Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
                                       SequenceNumber* latest_snapshot,
                                       uint32_t* seed) {
-  mutex_.Lock();
+  size_t slot;
+  ReadView* view = GetReadView(&slot);
+  // 序列号要在获取视图之后读取, 原因见 DBImpl::Get.
   *latest_snapshot = versions_->LastSequence();
 
   // Collect together all needed child iterators
   std::vector<Iterator*> list;
   // 把当前 memtable 迭代器加入其中
-  list.push_back(mem_->NewIterator());
-  mem_->Ref();
-  if (imm_ != nullptr) {
+  list.push_back(view->mem->NewIterator());
+  if (view->imm != nullptr) {
     // 把待写盘 memtable 迭代器追加到列表中
-    list.push_back(imm_->NewIterator());
-    imm_->Ref();
+    list.push_back(view->imm->NewIterator());
   }
   // 将当前 version 维护的 level 架构中每个 sorted string table 文件对应的迭代器追加到列表中
-  versions_->current()->AddIterators(options, &list);
+  view->current->AddIterators(options, &list);
   // 将全部迭代器上面加一层抽象构成一个逻辑迭代器 MergingIterator
   Iterator* internal_iter =
       NewMergingIterator(&internal_comparator_, &list[0], list.size());
-  versions_->current()->Ref();
 
-  // 由于当前 memtable/in-merging-memtable/各个 level 的 sorted string tables 的迭代器都被用了,
-  // 所以它们各自引用计数要累加. 等到用完还要递减以释放不需要的内存.
-  IterState* cleanup = new IterState(&mutex_, mem_, imm_, versions_->current());
-  // 注册该逻辑迭代器对应的清理函数, 该迭代器析构时就会执行清理函数释释放资源.
-  internal_iter->RegisterCleanup(CleanupIteratorState, cleanup, nullptr);
+  // 迭代器单独持有视图的一个引用, 这样视图中的 memtable/version 在迭代器
+  // 存活期间都不会被释放. 迭代器析构时执行清理函数释放该引用.
+  view->Ref();
+  internal_iter->RegisterCleanup(CleanupReadView, this, view);
+  ReturnReadView(view, slot);
 
-  *seed = ++seed_;
-  mutex_.Unlock();
+  *seed = seed_.fetch_add(1, std::memory_order_relaxed) + 1;
   return internal_iter;
 }
 
@@ -1332,6 +2024,54 @@ int64_t DBImpl::TEST_MaxNextLevelOverlappingBytes() {
   return versions_->MaxNextLevelOverlappingBytes();
 }
 
+void DBImpl::TEST_WaitForBlockCachePrefetch() {
+  MutexLock l(&mutex_);
+  while (prefetch_threads_ > 0) {
+    background_work_finished_signal_.Wait();
+  }
+}
+
+void DBImpl::TEST_WaitForPurge() {
+  MutexLock l(&purge_mutex_);
+  while (!purge_queue_.empty() || purge_in_progress_) {
+    purge_cv_.Wait();
+  }
+}
+
+// 检查 ReadOptions::timestamp 是否和 comparator 匹配.
+static Status CheckReadTimestamp(const Comparator* ucmp,
+                                 const ReadOptions& options) {
+  if (options.timestamp != nullptr) {
+    if (ucmp->timestamp_size() == 0) {
+      return Status::InvalidArgument("timestamp not supported by comparator",
+                                     ucmp->Name());
+    }
+    if (options.timestamp->size() != ucmp->timestamp_size()) {
+      return Status::InvalidArgument("timestamp size mismatch");
+    }
+  }
+  return Status::OK();
+}
+
+// 支持时间戳时 key 不带时间戳, 拼上读取时间点(没有指定就用最大的时间戳)
+// 之后再查找, 这样定位到的就是时间戳不晚于读取时间点的最新版本.
+// 拼接结果存储在 *buf 中.
+static Slice AppendReadTimestamp(const Comparator* ucmp,
+                                 const ReadOptions& options,
+                                 const Slice& key, std::string* buf) {
+  const size_t ts_size = ucmp->timestamp_size();
+  if (ts_size == 0) {
+    return key;
+  }
+  buf->assign(key.data(), key.size());
+  if (options.timestamp != nullptr) {
+    buf->append(options.timestamp->data(), ts_size);
+  } else {
+    buf->append(ts_size, '\xff');
+  }
+  return *buf;
+}
+
 // 先查询当前在用的 memtable, 如果没有则查询正在转换为 sorted string table 的 memtable 中寻找, 
 // 如果没有则我们在磁盘上采用从底向上 level-by-level 的寻找目标 key. 
 // 由于 level 越低数据越新, 因此, 当我们在一个较低的 level 找到数据的时候, 不用在更高的 levels 找了.
@@ -1341,8 +2081,21 @@ int64_t DBImpl::TEST_MaxNextLevelOverlappingBytes() {
 Status DBImpl::Get(const ReadOptions& options,
                    const Slice& key,
                    std::string* value) {
-  Status s;
-  MutexLock l(&mutex_);
+  Status s = CheckReadTimestamp(user_comparator(), options);
+  if (!s.ok()) {
+    return s;
+  }
+
+  std::string key_with_ts;
+  Slice user_key =
+      AppendReadTimestamp(user_comparator(), options, key, &key_with_ts);
+
+  // 读视图打包了 mem_, imm_ 以及 VersionSet 的当前 Version(保存了目前最新
+  // 的 level 架构信息, 即每个 level 各自包含了哪些文件覆盖了哪些键区间).
+  // 稳定状态下获取视图不需要加锁.
+  size_t slot;
+  ReadView* view = GetReadView(&slot);
+
   SequenceNumber snapshot;
   if (options.snapshot != nullptr) {
     // 如果查询某个快照版本对应的 value(比如针对同样的 key,
@@ -1353,54 +2106,160 @@ Status DBImpl::Get(const ReadOptions& options,
     // 否则就用目前数据库最大序列号作为查询时组装 internal_key
     // 用的序列号, 保证查到的是最新的那次更新.
     // (比较时候也会用到序列号, 序列号越大越新)
+    //
+    // 注意序列号必须在获取视图之后读取: 视图中的 sstable 可能已经被压实过,
+    // 压实时只保证不大于当时最新序列号的数据可见, 如果先读序列号, 得到的
+    // 序列号可能比压实时的还小, 从而读到已经被覆盖的老数据.
     snapshot = versions_->LastSequence();
   }
 
-  MemTable* mem = mem_;
-  MemTable* imm = imm_;
-  // VersionSet 的当前 Version 保存了目前最新
-  // 的 level 架构信息(每个 level 各自包含了哪些文件覆盖了哪些键区间)
-  Version* current = versions_->current();
-  mem->Ref();
-  if (imm != nullptr) imm->Ref();
-  current->Ref();
-
   bool have_stat_update = false;
   Version::GetStats stats;
 
-  // 当读取文件和 memtables 的时候, 释放锁
-  {
-    mutex_.Unlock();
-    // 根据 user_key 和快照对应的序列号构造一个 internal_key
-    LookupKey lkey(key, snapshot);
-    // 先查询内存中与当前 log 文件对应的 memtable
-    if (mem->Get(lkey, value, &s)) {
-      // Done
-      // 查不到再去待压实的 memtable 去查询
-    } else if (imm != nullptr && imm->Get(lkey, value, &s)) {
-      // Done
-    } else {
-      // 查不到再逐 level 去 sstable 文件查找
-      s = current->Get(options, lkey, value, &stats);
-      have_stat_update = true;
-    }
-    mutex_.Lock();
+  // 根据 user_key 和快照对应的序列号构造一个 internal_key
+  LookupKey lkey(user_key, snapshot);
+  // 先查询内存中与当前 log 文件对应的 memtable
+  if (view->mem->Get(lkey, value, &s)) {
+    // Done
+    // 查不到再去待压实的 memtable 去查询
+  } else if (view->imm != nullptr && view->imm->Get(lkey, value, &s)) {
+    // Done
+  } else {
+    // 查不到再逐 level 去 sstable 文件查找
+    s = view->current->Get(options, lkey, value, &stats);
+    have_stat_update = true;
   }
 
-  // 每次查询完都要检查下是否有文件查询次数已经达到最大需要进行压实了.
-  if (have_stat_update && current->UpdateStats(stats)) {
-    MaybeScheduleCompaction();
+  // 只有查询过程中查找了不止一个文件才需要更新统计信息, 这时才需要加锁,
+  // 然后检查下是否有文件查询次数已经达到最大需要进行压实了.
+  if (have_stat_update && stats.seek_file != nullptr) {
+    MutexLock l(&mutex_);
+    if (view->current->UpdateStats(stats)) {
+      MaybeScheduleCompaction();
+    }
   }
-  mem->Unref();
-  if (imm != nullptr) imm->Unref();
-  current->Unref();
+  ReturnReadView(view, slot);
   return s;
 }
 
+// 和 Get 的查找过程相同, 只是 memtable 中找不到时把剩下的 sstable 查找
+// 交给读线程去做.
+void DBImpl::GetAsync(const ReadOptions& options, const Slice& key,
+                      GetCallback callback, void* arg) {
+  Status s = CheckReadTimestamp(user_comparator(), options);
+  if (!s.ok()) {
+    (*callback)(arg, s, Slice());
+    return;
+  }
+
+  std::string key_with_ts;
+  Slice user_key =
+      AppendReadTimestamp(user_comparator(), options, key, &key_with_ts);
+
+  size_t slot;
+  ReadView* view = GetReadView(&slot);
+  // 和 Get 一样, 序列号必须在获取视图之后读取
+  SequenceNumber snapshot;
+  if (options.snapshot != nullptr) {
+    snapshot =
+        static_cast<const SnapshotImpl*>(options.snapshot)->sequence_number();
+  } else {
+    snapshot = versions_->LastSequence();
+  }
+
+  LookupKey lkey(user_key, snapshot);
+  std::string value;
+  if (view->mem->Get(lkey, &value, &s) ||
+      (view->imm != nullptr && view->imm->Get(lkey, &value, &s))) {
+    // 不需要读取磁盘, 直接完成
+    ReturnReadView(view, slot);
+    (*callback)(arg, s, value);
+    return;
+  }
+
+  // 读线程处理期间视图要一直有效, 另外持有一个引用
+  AsyncGet* request = new AsyncGet;
+  view->Ref();
+  request->view = view;
+  request->options = options;
+  // 快照和时间戳已经体现在序列号和 user_key 中了, 调用者返回之后可以释放它们
+  request->options.snapshot = nullptr;
+  request->options.timestamp = nullptr;
+  request->user_key.assign(user_key.data(), user_key.size());
+  request->sequence = snapshot;
+  request->callback = callback;
+  request->arg = arg;
+  ReturnReadView(view, slot);
+  EnqueueAsyncGet(request);
+}
+
+void DBImpl::EnqueueAsyncGet(AsyncGet* request) {
+  MutexLock l(&async_mutex_);
+  async_gets_.push_back(request);
+  // 空闲的读线程不够处理全部排队的查询时再启动一个
+  if (static_cast<size_t>(async_idle_threads_) < async_gets_.size() &&
+      async_threads_ < options_.async_read_threads) {
+    async_threads_++;
+    env_->StartThread(&DBImpl::AsyncReadThread, this);
+  }
+  async_cv_.Signal();
+}
+
+void DBImpl::AsyncReadThread(void* db) {
+  reinterpret_cast<DBImpl*>(db)->AsyncReadLoop();
+}
+
+// 读线程不断取出排队的查询进行处理, 数据库关闭时处理完全部查询再退出.
+void DBImpl::AsyncReadLoop() {
+  async_mutex_.Lock();
+  while (true) {
+    while (async_gets_.empty() && !async_shutting_down_) {
+      async_idle_threads_++;
+      async_cv_.Wait();
+      async_idle_threads_--;
+    }
+    if (async_gets_.empty()) {
+      break;
+    }
+    AsyncGet* request = async_gets_.front();
+    async_gets_.pop_front();
+    async_mutex_.Unlock();
+    RunAsyncGet(request);
+    async_mutex_.Lock();
+  }
+  async_threads_--;
+  async_cv_.SignalAll();
+  async_mutex_.Unlock();
+}
+
+void DBImpl::RunAsyncGet(AsyncGet* request) {
+  ReadView* view = request->view;
+  LookupKey lkey(request->user_key, request->sequence);
+  std::string value;
+  Version::GetStats stats;
+  Status s = view->current->Get(request->options, lkey, &value, &stats);
+  if (stats.seek_file != nullptr) {
+    MutexLock l(&mutex_);
+    if (view->current->UpdateStats(stats)) {
+      MaybeScheduleCompaction();
+    }
+  }
+  if (view->Unref()) {
+    MutexLock l(&mutex_);
+    DeleteReadView(view);
+  }
+  (*request->callback)(request->arg, s, value);
+  delete request;
+}
+
 // 将内存 memtable 和磁盘 sorted string table 文件全部数据结构
 // 串起来构造一个大一统迭代器, 可以遍历整个数据库.
 // 具体由 leveldb::DBImpl::NewInternalIterator 负责完成.
 Iterator* DBImpl::NewIterator(const ReadOptions& options) {
+  Status s = CheckReadTimestamp(user_comparator(), options);
+  if (!s.ok()) {
+    return NewErrorIterator(s);
+  }
   SequenceNumber latest_snapshot;
   uint32_t seed;
   // 将内存和磁盘全部数据结构串起来构造一个大一统迭代器, 可以遍历整个数据库
@@ -1410,7 +2269,108 @@ Iterator* DBImpl::NewIterator(const ReadOptions& options) {
       (options.snapshot != nullptr
        ? static_cast<const SnapshotImpl*>(options.snapshot)->sequence_number()
        : latest_snapshot),
-      seed);
+      options.timestamp, options.iterate_lower_bound,
+      options.iterate_upper_bound, seed);
+}
+
+Status DBImpl::GetUpdatesSince(uint64_t seq, TransactionLogIterator** iter) {
+  *iter = nullptr;
+  std::vector<SequentialFile*> files;
+  SequenceNumber last_sequence;
+  Status s;
+  {
+    // 持有 mutex_ 期间打开全部 log 文件, 这样之后即使文件被删除了也能读取.
+    MutexLock l(&mutex_);
+    last_sequence = versions_->LastSequence();
+    std::vector<std::string> filenames;
+    s = env_->GetChildren(wal_dir_, &filenames);
+    std::vector<uint64_t> logs;
+    uint64_t number;
+    FileType type;
+    for (size_t i = 0; i < filenames.size(); i++) {
+      if (ParseFileName(filenames[i], &number, &type) && type == kLogFile) {
+        logs.push_back(number);
+      }
+    }
+    std::sort(logs.begin(), logs.end());
+    for (size_t i = 0; i < logs.size() && s.ok(); i++) {
+      SequentialFile* file;
+      s = env_->NewSequentialFile(LogFileName(wal_dir_, logs[i]), &file);
+      if (s.ok()) {
+        files.push_back(file);
+      } else if (s.IsNotFound()) {
+        // 删除线程不持有 mutex_, 过期 log 可能在遍历目录之后被删掉了.
+        // 此时它之前的文件都已经接不上后面的更新, 一并丢弃, 只保留连续的部分;
+        // 请求的序列号已经不在时由迭代器返回 NotFound.
+        for (size_t j = 0; j < files.size(); j++) {
+          delete files[j];
+        }
+        files.clear();
+        s = Status::OK();
+      }
+    }
+  }
+  if (!s.ok()) {
+    for (size_t i = 0; i < files.size(); i++) {
+      delete files[i];
+    }
+    return s;
+  }
+  // 读取 log 文件不需要加锁
+  return NewTransactionLogIterator(files, seq, last_sequence, iter);
+}
+
+// 将 iter 定位到 lkey, 如果第一个不小于 lkey 的 internal key 对应的 user key
+// 就是要找的 key, 则将其序列号存储到 *sequence 中并返回 true.
+static bool SeekLatestSequence(Iterator* iter, const LookupKey& lkey,
+                               const Comparator* ucmp,
+                               SequenceNumber* sequence, Status* s) {
+  iter->Seek(lkey.internal_key());
+  bool found = false;
+  if (iter->Valid()) {
+    ParsedInternalKey parsed;
+    if (!ParseInternalKey(iter->key(), &parsed)) {
+      *s = Status::Corruption("corrupted internal key in DBImpl");
+    } else if (ucmp->Compare(parsed.user_key, lkey.user_key()) == 0) {
+      *sequence = parsed.sequence;
+      found = true;
+    }
+  }
+  if (s->ok()) {
+    *s = iter->status();
+  }
+  delete iter;
+  return found;
+}
+
+Status DBImpl::GetLatestSequenceForKey(const Slice& key,
+                                       SequenceNumber* sequence,
+                                       bool* found,
+                                       SequenceNumber* compacted_sequence) {
+  Status s;
+  size_t slot;
+  ReadView* view = GetReadView(&slot);
+  // 必须在获取视图之后读取: 压实开始前就更新了 compacted_sequence_,
+  // 视图中的 sstable 可能丢弃过的记录都不会晚于读到的值.
+  *compacted_sequence = compacted_sequence_.load(std::memory_order_acquire);
+  // 用最大序列号构造查询 key, 这样定位到的就是 key 最新的那条记录.
+  LookupKey lkey(key, kMaxSequenceNumber);
+  const Comparator* ucmp = user_comparator();
+  *found = SeekLatestSequence(view->mem->NewIterator(), lkey, ucmp,
+                              sequence, &s);
+  if (!*found && s.ok() && view->imm != nullptr) {
+    *found = SeekLatestSequence(view->imm->NewIterator(), lkey, ucmp,
+                                sequence, &s);
+  }
+  if (!*found && s.ok()) {
+    // memtable 里没有, 只好去 sstable 文件中找. 和 Get 一样只查可能包含
+    // key 的文件; 这里只关心序列号, 不需要把读到的 block 放入缓存.
+    ReadOptions options;
+    options.fill_cache = false;
+    s = view->current->GetLatestSequence(options, lkey, sequence, found);
+  }
+  ReturnReadView(view, slot);
+  return s;
 }
 
 void DBImpl::RecordReadSample(Slice key) {
@@ -1425,13 +2385,12 @@ void DBImpl::RecordReadSample(Slice key) {
 // 和操作序列号一起构成一个 internal_key, 针对 user_key 相等的情况
 // 比如针对 hello 这个 user_key Put 多次, 则每次序列号就不一样,
 // 于是根据特定序列号可以查询到特定的那次 Put 写入的 value 值.
+// 快照集合自己负责同步, 获取和释放快照都不需要 mutex_.
 const Snapshot* DBImpl::GetSnapshot() {
-  MutexLock l(&mutex_);
-  return snapshots_.New(versions_->LastSequence());
+  return snapshots_.New(versions_);
 }
 
 void DBImpl::ReleaseSnapshot(const Snapshot* snapshot) {
-  MutexLock l(&mutex_);
   snapshots_.Delete(static_cast<const SnapshotImpl*>(snapshot));
 }
 
@@ -1446,11 +2405,35 @@ Status DBImpl::Delete(const WriteOptions& options, const Slice& key) {
 }
 
 Status DBImpl::Write(const WriteOptions& options, WriteBatch* my_batch) {
+  return WriteWithCallback(options, my_batch, nullptr);
+}
+
+Status DBImpl::WriteWithCallback(const WriteOptions& options,
+                                 WriteBatch* my_batch,
+                                 WriteCallback* callback) {
+  // 定长 key 模式下先拒绝长度不符的 key, 它们无法写入 memtable 和 sstable
+  if (my_batch != nullptr && options_.fixed_key_length > 0) {
+    Status s = WriteBatchInternal::CheckKeyLength(my_batch,
+                                                  options_.fixed_key_length);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  // 带时间戳的 comparator 要求每个 key 末尾都有时间戳, 更短的 key 会让
+  // 去掉时间戳的计算越界
+  const size_t ts_size = user_comparator()->timestamp_size();
+  if (my_batch != nullptr && ts_size > 0) {
+    Status s = WriteBatchInternal::CheckTimestampSize(my_batch, ts_size);
+    if (!s.ok()) {
+      return s;
+    }
+  }
   // 每次批量写会被封装为一个 Writer
   Writer w(&mutex_); // 注意这里并不执行上锁操作.
   w.batch = my_batch;
   w.sync = options.sync;
   w.done = false;
+  w.callback = callback;
 
   // 上锁保护下面的 writers_ 队列操作, 注意这里用的锁
 	// 和上面创建 Writer 用的是一把锁.
@@ -1473,6 +2456,9 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* my_batch) {
 	// 这里的检查和上面 while 中的检查构成了一个 double check, 因为 while 和 if
 	// 之间有个时间窗口.
   if (w.done) {
+    if (w.status.ok() && w.sync_sequence > 0) {
+      return WaitForLogSync(w.sync_sequence);
+    }
     return w.status;
   }
 
@@ -1484,6 +2470,8 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* my_batch) {
   Status status = MakeRoomForWrite(my_batch == nullptr);
   uint64_t last_sequence = versions_->LastSequence();
   Writer* last_writer = &w;
+  // 本次合并写入的数据是否需要交给同步线程持久化
+  bool wait_for_sync = false;
 	// nullptr batch 用于触发压实
   if (status.ok() && my_batch != nullptr) {
     // 队首 writer 负责将队列前面若干 writers 的 batch 合并为一个 group.
@@ -1495,7 +2483,8 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* my_batch) {
     // 从而确保了 log/memtable 相关操作的线程安全.
 		//
     // 执行这些操作需要持有锁, 确保不会同时发生多个针对相同数据的  合并操作.
-    WriteBatch* updates = BuildBatchGroup(&last_writer);
+    bool group_sync;
+    WriteBatch* updates = BuildBatchGroup(&last_writer, &group_sync);
     // 设置本批次第一个写操作的序列号, 然后根据操作个数更新全局写操作的序列号,
     // 执行这些操作需要持有锁, 确保 sequence 被互斥访问.
     WriteBatchInternal::SetSequence(updates, last_sequence + 1);
@@ -1505,22 +2494,50 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* my_batch) {
 		// 当前日志写入, 可以避免并发 loggers 和并发写操作到 mem_.
 		// 只要 &w 不出队, 后面的 writers 就没机会出循环(这个循环相当于一个通过自旋做同步的设施),
 		// 也就到不了这里和它竞争写入 log 文件或 memtable, 所以没有线程安全问题.
+    bool rejected = false;
+    const LogSyncMode sync_mode = log_sync_mode_;
+    LogSyncMode new_sync_mode = sync_mode;
     {
       // 这里临时释放可以让其它 writer 趁机在 Write 方法入口处进入写入队列.
       mutex_.Unlock();
+      // 带回调的 writer 不会被合并, 所以 updates 就是 w 自己的 batch.
+      // 回调失败则放弃写入, 不影响数据库状态.
+      if (w.callback != nullptr) {
+        status = w.callback->Callback(this);
+        rejected = !status.ok();
+      }
       // 将合并后的 batch 作为 record 追加到 log 文件中
-      status = log_->AddRecord(WriteBatchInternal::Contents(updates));
+      if (status.ok()) {
+        status = log_->AddRecord(WriteBatchInternal::Contents(updates));
+      }
       bool sync_error = false;
-      if (status.ok() && options.sync) {
-				// 如果调用方要求同步写入, 这里要进行一次刷盘
-        status = logfile_->Sync();
+      if (status.ok() && group_sync && sync_mode != kLogSyncThread) {
+				// 如果调用方要求同步写入, 这里要进行一次刷盘.
+        // 第一次同步时顺便检查 log 文件是否支持由同步线程在后台同步.
+        if (sync_mode == kLogSyncUnknown) {
+          status = logfile_->SyncFlushed();
+          if (status.IsNotSupportedError()) {
+            new_sync_mode = kLogSyncInline;
+            status = logfile_->Sync();
+          } else {
+            new_sync_mode = kLogSyncThread;
+          }
+        } else {
+          status = logfile_->Sync();
+        }
         if (!status.ok()) {
           sync_error = true;
         }
       }
       if (status.ok()) {
-        // 如果追加 log 文件成功,则将被追加的数据插入到内存中的 memtable 中
-        status = WriteBatchInternal::InsertInto(updates, mem_);
+        // 如果追加 log 文件成功,则将被追加的数据插入到内存中的 memtable 中.
+        // 整组写入完成之后才更新 LastSequence, 组内被覆盖的更新对读者
+        // 和快照都不可见, 可以按需只插入每个 key 的最后一次更新.
+        if (options_.dedup_group_updates) {
+          status = WriteBatchInternal::InsertIntoDeduplicated(updates, mem_);
+        } else {
+          status = WriteBatchInternal::InsertInto(updates, mem_);
+        }
       }
 			// 写完了, 后面要操作 writers_ 队列了, 而这个队列在上面拦着一堆后来的 writer,
 			// 要修改状态了, 所以要获取锁.
@@ -1534,10 +2551,31 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* my_batch) {
 				// 时通过返回的状态感知到.
         RecordBackgroundError(status);
       }
+      if (new_sync_mode != sync_mode) {
+        log_sync_mode_ = new_sync_mode;
+        if (new_sync_mode == kLogSyncThread) {
+          log_sync_thread_running_ = true;
+          env_->StartThread(&DBImpl::LogSyncThread, this);
+        }
+      }
     }
     if (updates == tmp_batch_) tmp_batch_->Clear();
 
-    versions_->SetLastSequence(last_sequence);
+    if (!rejected) {
+      versions_->SetLastSequence(last_sequence);
+    }
+    if (status.ok()) {
+      log_appended_sequence_ = last_sequence;
+      if (group_sync && sync_mode == kLogSyncThread) {
+        // 必须在离开写入队列之前登记, 这样之后切换 log 文件时能知道
+        // 老 log 文件中还有数据等待持久化.
+        if (last_sequence > log_sync_requested_) {
+          log_sync_requested_ = last_sequence;
+        }
+        log_sync_cv_.Signal();
+        wait_for_sync = true;
+      }
+    }
   }
 
   // 参与上面 batch group 写入 log 文件的 writer 都取出来并设置为写入完成
@@ -1550,6 +2588,7 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* my_batch) {
     if (ready != &w) {
 			// 传递合并写执行结果给 group 中各个 writer
       ready->status = status;
+      ready->sync_sequence = (wait_for_sync && ready->sync) ? last_sequence : 0;
       ready->done = true;
       // 唤醒当前方法入口的 w.cv.Wait(), 通过此处被唤醒的
 			// writers 都是被合并到队首 writer 统一写入 log 文件的.
@@ -1566,13 +2605,88 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* my_batch) {
     writers_.front()->cv.Signal();
   }
 
+  // 离开写入队列之后再等待持久化, 不耽误后面的写入
+  if (wait_for_sync && w.sync) {
+    status = WaitForLogSync(last_sequence);
+  }
   return status;
 }
 
+void DBImpl::LogSyncThread(void* db) {
+  reinterpret_cast<DBImpl*>(db)->LogSyncLoop();
+}
+
+void DBImpl::LogSyncLoop() {
+  MutexLock l(&mutex_);
+  while (shutting_down_.Acquire_Load() == nullptr) {
+    if (log_sync_in_progress_ || log_sync_requested_ <= log_synced_sequence_ ||
+        !bg_error_.ok()) {
+      log_sync_cv_.Wait();
+      continue;
+    }
+    // 一次同步覆盖目前已经追加的全部数据, 而不只是等待中的那些.
+    // 写入队首每次追加之后都会 Flush, 同步期间还可以继续追加.
+    const SequenceNumber target = log_appended_sequence_;
+    WritableFile* file = logfile_;
+    log_sync_in_progress_ = true;
+    mutex_.Unlock();
+    Status s = file->SyncFlushed();
+    mutex_.Lock();
+    log_sync_in_progress_ = false;
+    if (s.ok()) {
+      if (target > log_synced_sequence_) {
+        log_synced_sequence_ = target;
+      }
+    } else {
+      // log 文件状态不确定了, 之后的写操作全部失败
+      RecordBackgroundError(s);
+    }
+    log_synced_signal_.SignalAll();
+  }
+  log_sync_thread_running_ = false;
+  log_synced_signal_.SignalAll();
+}
+
+Status DBImpl::WaitForLogSync(SequenceNumber sequence) {
+  mutex_.AssertHeld();
+  while (log_synced_sequence_ < sequence && bg_error_.ok()) {
+    log_synced_signal_.Wait();
+  }
+  if (log_synced_sequence_ >= sequence) {
+    return Status::OK();
+  }
+  return bg_error_;
+}
+
+Status DBImpl::SyncLogForSwitch() {
+  mutex_.AssertHeld();
+  while (log_sync_in_progress_) {
+    log_synced_signal_.Wait();
+  }
+  if (log_sync_requested_ <= log_synced_sequence_) {
+    return Status::OK();
+  }
+  // 调用者位于写入队首, 不会有并发的追加, 可以直接 Sync
+  const SequenceNumber target = log_appended_sequence_;
+  log_sync_in_progress_ = true;
+  mutex_.Unlock();
+  Status s = logfile_->Sync();
+  mutex_.Lock();
+  log_sync_in_progress_ = false;
+  if (s.ok()) {
+    log_synced_sequence_ = target;
+  } else {
+    RecordBackgroundError(s);
+  }
+  log_synced_signal_.SignalAll();
+  log_sync_cv_.Signal();
+  return s;
+}
+
 // 当外部调用 db 写数据时, 该方法将队列前若干 writer 的 batch 合并到一起.
 // 返回合并后的结果 batch, 参数 last_writer 也作为输出参数, 包含了被合并的最后一个 writer 的指针.
 // 要求: Writer 队列不为空且对手元素的 batch 不为 nullptr.
-WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
+WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer, bool* sync) {
   mutex_.AssertHeld();
   assert(!writers_.empty());
   // 取出队首 writer
@@ -1595,17 +2709,24 @@ WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
   }
 
   *last_writer = first;
+  *sync = first->sync;
   std::deque<Writer*>::iterator iter = writers_.begin();
   ++iter;  // Advance past "first"
   // iter 从 first 之后 writer 开始遍历
   for (; iter != writers_.end(); ++iter) {
     Writer* w = *iter;
-		// 同步写操作不做合并
-    if (w->sync && !first->sync) {
+		// 同步写操作不做合并. 由同步线程负责持久化时同步写入各自等待同步完成,
+    // 可以和非同步写入合并.
+    if (w->sync && !first->sync && log_sync_mode_ != kLogSyncThread) {
       // Do not include a sync write into a batch handled by a non-sync write.
       break;
     }
 
+    // 带回调的写操作要单独写入, 这样回调失败时只需放弃它自己的 batch.
+    if (first->callback != nullptr || w->callback != nullptr) {
+      break;
+    }
+
     if (w->batch != nullptr) {
       size += WriteBatchInternal::ByteSize(w->batch);
       if (size > max_size) {
@@ -1624,6 +2745,9 @@ WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
     }
     // last_writer 指向被合并的最后一个 writer
     *last_writer = w;
+    if (w->sync) {
+      *sync = true;
+    }
   }
   return result;
 }
@@ -1676,10 +2800,15 @@ Status DBImpl::MakeRoomForWrite(bool force) {
     } else {
 			// 尝试切换到新的 memtable, 同时触发一个针对老 memtable 的压实.
       assert(versions_->PrevLogNumber() == 0);
+      // 老 log 文件关闭之前, 先持久化同步写入正在等待的数据
+      s = SyncLogForSwitch();
+      if (!s.ok()) {
+        break;
+      }
       uint64_t new_log_number = versions_->NewFileNumber();
       WritableFile* lfile = nullptr;
       // 分配新文件号, 创建新的 log 文件
-      s = env_->NewWritableFile(LogFileName(dbname_, new_log_number), &lfile);
+      s = env_->NewWritableFile(LogFileName(wal_dir_, new_log_number), &lfile);
       if (!s.ok()) {
         // Avoid chewing through file number space in a tight loop.
         versions_->ReuseFileNumber(new_log_number);
@@ -1690,6 +2819,7 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       logfile_ = lfile;
       // 更新当前在写文件的文件号
       logfile_number_ = new_log_number;
+      live_logs_.push_back(new_log_number);
       // 生成一个新的 log writer 负责写文件
       log_ = new log::Writer(lfile);
       // 将满了的 mem_ 赋值给 imm_ 等待被落盘
@@ -1697,8 +2827,9 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       // 将 imm_ 存储到 has_imm_ 中
       has_imm_.Release_Store(imm_);
       // 创建一个与新 log 文件对应的 memtable
-      mem_ = new MemTable(internal_comparator_);
+      mem_ = new MemTable(internal_comparator_, options_.fixed_key_length);
       mem_->Ref();
+      InstallReadView();
 			// 创建新文件后将强制状态取消
       force = false; // Do not force another compaction if have room
       // 如果需要触发压实操作, 则进行压实. 由于上面设置了 imm_, 只要之前 mem_ 不为空则必触发压实.
@@ -1825,6 +2956,30 @@ void DBImpl::GetApproximateSizes(
   }
 }
 
+// 和 GetApproximateSizes 一样, 但同时估计数据项个数并且包含 memtable.
+// 通过读视图获取 memtable 和 version, 不需要持有 mutex_.
+void DBImpl::GetApproximateStats(const Range* range, int n,
+                                 uint64_t* sizes, uint64_t* counts) {
+  size_t slot;
+  ReadView* view = GetReadView(&slot);
+  for (int i = 0; i < n; i++) {
+    InternalKey k1(range[i].start, kMaxSequenceNumber, kValueTypeForSeek);
+    InternalKey k2(range[i].limit, kMaxSequenceNumber, kValueTypeForSeek);
+    versions_->ApproximateStatsOf(view->current, k1, k2, &sizes[i], &counts[i]);
+
+    uint64_t entries, bytes;
+    view->mem->ApproximateStats(k1.Encode(), k2.Encode(), &entries, &bytes);
+    sizes[i] += bytes;
+    counts[i] += entries;
+    if (view->imm != nullptr) {
+      view->imm->ApproximateStats(k1.Encode(), k2.Encode(), &entries, &bytes);
+      sizes[i] += bytes;
+      counts[i] += entries;
+    }
+  }
+  ReturnReadView(view, slot);
+}
+
 // Default implementations of convenience methods that subclasses of DB
 // can call if they wish
 //
@@ -1846,10 +3001,40 @@ Status DB::Delete(const WriteOptions& opt, const Slice& key) {
 
 DB::~DB() { }
 
+Status DB::IncreaseFullHistoryTsLow(const Slice& ts) {
+  return Status::NotSupported("IncreaseFullHistoryTsLow");
+}
+
+Status DB::GetUpdatesSince(uint64_t seq, TransactionLogIterator** iter) {
+  *iter = nullptr;
+  return Status::NotSupported("GetUpdatesSince");
+}
+
+void DB::GetApproximateStats(const Range* range, int n,
+                             uint64_t* sizes, uint64_t* counts) {
+  GetApproximateSizes(range, n, sizes);
+  for (int i = 0; i < n; i++) {
+    counts[i] = 0;
+  }
+}
+
+void DB::GetAsync(const ReadOptions& options, const Slice& key,
+                  GetCallback callback, void* arg) {
+  std::string value;
+  Status s = Get(options, key, &value);
+  (*callback)(arg, s, value);
+}
+
 Status DB::Open(const Options& options, const std::string& dbname,
                 DB** dbptr) {
   *dbptr = nullptr;
 
+  if (!options.full_history_ts_low.empty() &&
+      options.full_history_ts_low.size() !=
+          options.comparator->timestamp_size()) {
+    return Status::InvalidArgument("full_history_ts_low size mismatch");
+  }
+
   DBImpl* impl = new DBImpl(options, dbname);
   impl->mutex_.Lock();
   // 新建一个 edit
@@ -1866,15 +3051,16 @@ Status DB::Open(const Options& options, const std::string& dbname,
     // log 文件名就是一个数字, 由 VersionSet 负责维护.
     uint64_t new_log_number = impl->versions_->NewFileNumber();
     WritableFile* lfile;
-    s = options.env->NewWritableFile(LogFileName(dbname, new_log_number),
-                                     &lfile);
+    s = options.env->NewWritableFile(
+        LogFileName(impl->wal_dir_, new_log_number), &lfile);
     // log 文件创建成功, 则将其 log 名字记录到 edit, 并创建对应的 memtable
     if (s.ok()) {
       edit.SetLogNumber(new_log_number);
       impl->logfile_ = lfile;
       impl->logfile_number_ = new_log_number;
       impl->log_ = new log::Writer(lfile);
-      impl->mem_ = new MemTable(impl->internal_comparator_);
+      impl->mem_ = new MemTable(impl->internal_comparator_,
+                                impl->options_.fixed_key_length);
       impl->mem_->Ref();
     }
   }
@@ -1886,14 +3072,28 @@ Status DB::Open(const Options& options, const std::string& dbname,
     edit.SetLogNumber(impl->logfile_number_);
     s = impl->versions_->LogAndApply(&edit, &impl->mutex_);
   }
-  // 数据库打开成功, 启动过期文件删除和周期性压实任务
+  // 之前的 log 文件都已经恢复, 记录新的 log 目录, 下次打开时据此找到 log 文件.
+  // 上次的 log 目录仍然在 ExtraLogDirs 中, 下面会清理其中过期的 log 文件.
+  if (s.ok() && impl->previous_wal_dir_ != impl->wal_dir_) {
+    s = SetWalDirFile(impl->env_, dbname, impl->wal_dir_);
+  }
+  // 数据库打开成功, 遍历目录找出上次运行遗留的过期文件, 启动周期性压实任务
+  std::vector<DBImpl::ObsoleteFile> obsolete_files;
   if (s.ok()) {
-    impl->DeleteObsoleteFiles();
+    impl->InstallReadView();
+    impl->FindObsoleteFiles(true, &obsolete_files);
     impl->MaybeScheduleCompaction();
   }
   impl->mutex_.Unlock();
   if (s.ok()) {
+    // 打开期间直接删除, 保证 Open 返回后目录中没有遗留的文件
+    for (size_t i = 0; i < obsolete_files.size(); i++) {
+      impl->DeleteObsoleteFile(obsolete_files[i]);
+    }
     assert(impl->mem_ != nullptr);
+    if (options.persist_block_cache) {
+      impl->StartBlockCachePrefetch();
+    }
     *dbptr = impl;
   } else {
     delete impl;
@@ -1917,6 +3117,18 @@ Status DestroyDB(const std::string& dbname, const Options& options) {
   const std::string lockname = LockFileName(dbname);
   result = env->LockFile(lockname, &lock);
   if (result.ok()) {
+    // log 目录包括 options.wal_dir 以及 WALDIR 文件记录的上次使用的目录,
+    // 要在删除 WALDIR 文件之前读取.
+    std::set<std::string> wal_dirs;
+    if (!options.wal_dir.empty()) {
+      wal_dirs.insert(options.wal_dir);
+    }
+    std::string recorded_wal_dir;
+    if (ReadWalDirFile(env, dbname, &recorded_wal_dir).ok()) {
+      wal_dirs.insert(recorded_wal_dir);
+    }
+    wal_dirs.erase(dbname);
+
     uint64_t number;
     FileType type;
     for (size_t i = 0; i < filenames.size(); i++) {
@@ -1928,6 +3140,22 @@ Status DestroyDB(const std::string& dbname, const Options& options) {
         }
       }
     }
+    for (std::set<std::string>::const_iterator it = wal_dirs.begin();
+         it != wal_dirs.end(); ++it) {
+      // log 目录只属于这一个数据库, 但用户可能在其中放了别的文件, 所以只删除 log 文件
+      filenames.clear();
+      env->GetChildren(*it, &filenames);  // Ignore error if missing
+      for (size_t i = 0; i < filenames.size(); i++) {
+        if (ParseFileName(filenames[i], &number, &type) &&
+            type == kLogFile) {
+          Status del = env->DeleteFile(*it + "/" + filenames[i]);
+          if (result.ok() && !del.ok()) {
+            result = del;
+          }
+        }
+      }
+      env->DeleteDir(*it);  // Ignore error in case dir contains other files
+    }
     env->UnlockFile(lock);  // Ignore error since state is already gone
     env->DeleteFile(lockname);
     env->DeleteDir(dbname);  // Ignore error in case dir contains other files
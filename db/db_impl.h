@@ -5,9 +5,13 @@
 #ifndef STORAGE_LEVELDB_DB_DB_IMPL_H_
 #define STORAGE_LEVELDB_DB_DB_IMPL_H_
 
+#include <atomic>
 #include <deque>
+#include <map>
 #include <set>
+#include <vector>
 #include "db/dbformat.h"
+#include "db/filename.h"
 #include "db/log_writer.h"
 #include "db/snapshot.h"
 #include "leveldb/db.h"
@@ -22,6 +26,19 @@ class TableCache;
 class Version;
 class VersionEdit;
 class VersionSet;
+class DBImpl;
+
+// 写操作的回调, 用于在数据真正写入之前做最后一次检查.
+//
+// Callback 在当前写操作位于写入队列队首期间被调用(调用时不持有 mutex_),
+// 回调期间不会有其它写操作被写入, 所以回调看到的就是本次写入之前数据库的最终状态.
+// 如果 Callback 返回非 ok 状态, 本次写入会被放弃, 该状态会返回给调用者.
+class WriteCallback {
+ public:
+  virtual ~WriteCallback() { }
+
+  virtual Status Callback(DBImpl* db) = 0;
+};
 
 class DBImpl : public DB {
  public:
@@ -35,12 +52,34 @@ class DBImpl : public DB {
   virtual Status Get(const ReadOptions& options,
                      const Slice& key,
                      std::string* value);
+  virtual void GetAsync(const ReadOptions& options, const Slice& key,
+                        GetCallback callback, void* arg);
   virtual Iterator* NewIterator(const ReadOptions&);
   virtual const Snapshot* GetSnapshot();
   virtual void ReleaseSnapshot(const Snapshot* snapshot);
   virtual bool GetProperty(const Slice& property, std::string* value);
   virtual void GetApproximateSizes(const Range* range, int n, uint64_t* sizes);
+  virtual void GetApproximateStats(const Range* range, int n,
+                                   uint64_t* sizes, uint64_t* counts);
   virtual void CompactRange(const Slice* begin, const Slice* end);
+  virtual Status IncreaseFullHistoryTsLow(const Slice& ts);
+  virtual Status GetUpdatesSince(uint64_t seq, TransactionLogIterator** iter);
+
+  // 和 Write 一样, 但是在写入之前会调用 callback 做检查, 具体见 WriteCallback.
+  // 带有 callback 的写操作不会和其它写操作合并.
+  Status WriteWithCallback(const WriteOptions& options, WriteBatch* updates,
+                           WriteCallback* callback);
+
+  // 查找 key 最近一次被写入(包括删除)时的序列号, 找到则将其存储在 *sequence
+  // 中并将 *found 置为 true; 如果数据库中没有 key 的任何记录, *found 置为 false.
+  // 先查找 memtable, 只有在 memtable 中找不到时才会查找 sstable 文件.
+  //
+  // 压实会丢弃删除标记以及被它遮住的记录, 所以 *found 为 false 时只能保证
+  // 序列号大于 *compacted_sequence 的范围内没有写入过 key.
+  Status GetLatestSequenceForKey(const Slice& key, SequenceNumber* sequence,
+                                 bool* found,
+                                 SequenceNumber* compacted_sequence)
+      LOCKS_EXCLUDED(mutex_);
 
   // Extra methods (for testing) that are not in the public DB interface
 
@@ -59,6 +98,13 @@ class DBImpl : public DB {
   // file at a level >= 1.
   int64_t TEST_MaxNextLevelOverlappingBytes();
 
+  // Wait until the background thread has deleted every obsolete file
+  // queued so far.
+  void TEST_WaitForPurge();
+
+  // Wait until the block cache prefetch started by DB::Open has finished.
+  void TEST_WaitForBlockCachePrefetch();
+
   // 记录在特定 internal key 中读取到的字节的一个抽样.
   // 抽样基本每隔 config::kReadBytesPeriod 字节进行一次.
   void RecordReadSample(Slice key);
@@ -67,6 +113,41 @@ class DBImpl : public DB {
   friend class DB;
   struct CompactionState;
   struct Writer;
+  struct ReadView;
+  struct ReadViewSlot;
+  struct AsyncGet;
+
+  // 等待后台线程删除的过期文件
+  struct ObsoleteFile {
+    std::string fname;
+    FileType type;
+    uint64_t number;
+  };
+
+  // 读视图缓存槽位个数. 每个线程根据自己的编号固定映射到一个槽位上,
+  // 线程数不超过该值时各线程互不干扰.
+  static const size_t kNumReadViewSlots = 64;
+  // 表示读视图不是从缓存槽位取出的, 用完后直接释放引用.
+  static const size_t kNoReadViewSlot = ~static_cast<size_t>(0);
+
+  // 获取一个可供读取的视图, 稳定状态下不需要获取 mutex_.
+  // 如果视图来自某个缓存槽位, 槽位编号存储在 *slot 中, 否则为 kNoReadViewSlot.
+  // 用完之后必须调用 ReturnReadView 归还.
+  ReadView* GetReadView(size_t* slot) LOCKS_EXCLUDED(mutex_);
+  void ReturnReadView(ReadView* view, size_t slot) LOCKS_EXCLUDED(mutex_);
+
+  // 根据当前的 mem_, imm_ 以及 current version 生成一个新的读视图并使之生效,
+  // 同时回收各个线程缓存的老视图. mem_, imm_ 或者 current version
+  // 每次发生变化之后都要调用该方法.
+  void InstallReadView() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void DeleteReadView(ReadView* view) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  static void CleanupReadView(void* arg1, void* arg2);
+
+  // 把需要读取 sstable 的异步查询交给读线程, 必要时启动新的读线程.
+  void EnqueueAsyncGet(AsyncGet* request) LOCKS_EXCLUDED(async_mutex_);
+  static void AsyncReadThread(void* db);
+  void AsyncReadLoop() LOCKS_EXCLUDED(async_mutex_);
+  void RunAsyncGet(AsyncGet* request) LOCKS_EXCLUDED(mutex_);
 
   Iterator* NewInternalIterator(const ReadOptions&,
                                 SequenceNumber* latest_snapshot,
@@ -83,15 +164,47 @@ class DBImpl : public DB {
   void MaybeIgnoreError(Status* s) const;
 
   // Delete any unneeded files and stale in-memory entries.
+  // 找出过期文件交给后台线程删除, 不在持有 mutex_ 的时候删除文件.
   void DeleteObsoleteFiles() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  // 将过期文件追加到 *files 中. full_scan 为 true 时遍历数据库目录,
+  // 可以找出上次运行遗留下来的文件, 只在打开数据库时使用; 否则只根据
+  // 之后 version 变化以及 log 切换的记录确定过期文件.
+  void FindObsoleteFiles(bool full_scan, std::vector<ObsoleteFile>* files)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // 按照 Options::wal_ttl_seconds 和 Options::wal_size_limit 处理恢复不再
+  // 需要的 log 文件 logs(按编号从小到大排列), 超出限制需要删除的那些追加到 *files 中.
+  void RetainObsoleteLogs(const std::vector<uint64_t>& logs,
+                          std::vector<ObsoleteFile>* files)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // 删除一个过期文件, 调用时不能持有 mutex_.
+  void DeleteObsoleteFile(const ObsoleteFile& file) LOCKS_EXCLUDED(mutex_);
+  // 后台删除线程, 按照 Options::delete_rate_bytes_per_second 限速.
+  static void PurgeThread(void* db);
+  void PurgeLoop() LOCKS_EXCLUDED(purge_mutex_);
+
+  // 见 Options::persist_block_cache. 关闭数据库时将 block_cache 中属于本数据库
+  // 的 block 记录到 BLOCKCACHE 文件, 打开时启动若干后台线程将它们读回 block_cache.
+  void SaveBlockCache();
+  void StartBlockCachePrefetch() LOCKS_EXCLUDED(mutex_);
+  static void BlockCachePrefetchThread(void* db);
+  void BlockCachePrefetchLoop() LOCKS_EXCLUDED(mutex_);
+
   // 将内存中的 memtable 转换为 sstable 文件并写入到磁盘中.
   // 当且仅当该方法执行成功后, 切换到一组新的 log-file/memtable 组合并且写一个新的描述符.
   // 如果执行失败, 则将错误记录到 bg_error_.
 	// 调用该方法之前必须获取相应的锁.
   void CompactMemTable() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
-  Status RecoverLogFile(uint64_t log_number, bool last_log, bool* save_manifest,
+  // 除数据库目录之外可能存放 log 文件的目录: 上次打开时的 log 目录以及 wal_dir_
+  void ExtraLogDirs(std::vector<std::string>* dirs) const
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // 恢复目录 dir 下编号为 log_number 的 log 文件
+  Status RecoverLogFile(uint64_t log_number, const std::string& dir,
+                        bool last_log, bool* save_manifest,
                         VersionEdit* edit, SequenceNumber* max_sequence)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
@@ -100,9 +213,20 @@ class DBImpl : public DB {
 
   Status MakeRoomForWrite(bool force /* compact even if there is room? */)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
-  WriteBatch* BuildBatchGroup(Writer** last_writer)
+  WriteBatch* BuildBatchGroup(Writer** last_writer, bool* sync)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  // WAL 同步线程. 同步写入把自己的序列号登记到 log_sync_requested_ 后等待,
+  // 同步线程每次同步都覆盖当时已经追加的全部数据, 期间的请求合并到下一次同步.
+  static void LogSyncThread(void* db);
+  void LogSyncLoop();
+  // 等待序列号不大于 sequence 的数据持久化.
+  Status WaitForLogSync(SequenceNumber sequence)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // 切换 log 文件之前调用: 等待同步线程结束对当前 log 文件的同步,
+  // 还有写入在等待持久化时直接同步当前 log 文件.
+  Status SyncLogForSwitch() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   void RecordBackgroundError(const Status& s);
 
   void MaybeScheduleCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
@@ -114,6 +238,10 @@ class DBImpl : public DB {
   Status DoCompactionWork(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  // 返回写入 level 层 sstable 时使用的参数, 区别只在于 filter_policy,
+  // 见 Options::level_filter_policies 以及 Options::optimize_filters_for_hits.
+  Options TableOptionsForLevel(int level, bool bottommost) const;
+
   Status OpenCompactionOutputFile(CompactionState* compact);
   Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input);
   Status InstallCompactionResults(CompactionState* compact)
@@ -123,10 +251,17 @@ class DBImpl : public DB {
   Env* const env_;
   const InternalKeyComparator internal_comparator_;
   const InternalFilterPolicy internal_filter_policy_;
+  // Options::level_filter_policies 对应的 internal filter policy,
+  // 为 nullptr 表示该层使用 options_.filter_policy.
+  InternalFilterPolicy* level_filter_policies_[config::kNumLevels];
   const Options options_;  // options_.comparator == &internal_comparator_
   const bool owns_info_log_;
   const bool owns_cache_;
   const std::string dbname_;
+  // log 文件所在目录, 即 Options::wal_dir, 未设置时与 dbname_ 相同
+  const std::string wal_dir_;
+  // 上次打开时的 log 目录, Recover 时从 WALDIR 文件读取
+  std::string previous_wal_dir_ GUARDED_BY(mutex_);
 
   // table_cache_ 提供了自己的同步设施
   TableCache* const table_cache_; 
@@ -149,7 +284,49 @@ class DBImpl : public DB {
   // 当前在写 log 文件的文件号
   uint64_t logfile_number_ GUARDED_BY(mutex_);
   log::Writer* log_;
-  uint32_t seed_ GUARDED_BY(mutex_);  // For sampling.
+  std::atomic<uint32_t> seed_;  // For sampling.
+
+  // 当前生效的读视图, 持有 mem_, imm_ 以及 current version 的引用.
+  ReadView* read_view_ GUARDED_BY(mutex_);
+  // 当前生效的读视图编号, 每次 InstallReadView 都会递增.
+  // 读线程据此判断自己缓存的视图是否已经过期.
+  std::atomic<uint64_t> read_view_number_;
+  // 压实用过的最大的 smallest_snapshot. 压实只会丢弃序列号不大于它的记录,
+  // 在它之后写入的记录都还在. 开始压实前更新, 不受 mutex_ 保护.
+  std::atomic<uint64_t> compacted_sequence_;
+  // 各个线程缓存读视图的槽位, 共 kNumReadViewSlots 个.
+  ReadViewSlot* read_view_slots_;
+
+  // GetAsync 的读线程以及等待它们处理的查询, 不受 mutex_ 保护.
+  port::Mutex async_mutex_;
+  // 读线程在上面等待新的查询, 析构时在上面等待读线程退出
+  port::CondVar async_cv_ GUARDED_BY(async_mutex_);
+  std::deque<AsyncGet*> async_gets_ GUARDED_BY(async_mutex_);
+  int async_threads_ GUARDED_BY(async_mutex_);       // 已经启动的读线程个数
+  int async_idle_threads_ GUARDED_BY(async_mutex_);  // 正在等待查询的读线程个数
+  bool async_shutting_down_ GUARDED_BY(async_mutex_);
+
+  // 同步写入如何同步 log 文件. 第一次同步写入时检查 log 文件是否支持
+  // WritableFile::SyncFlushed, 支持则交给同步线程, 否则由写入队首直接 Sync.
+  enum LogSyncMode {
+    kLogSyncUnknown,
+    kLogSyncInline,
+    kLogSyncThread
+  };
+  LogSyncMode log_sync_mode_ GUARDED_BY(mutex_);
+  // 已经追加到 log 文件的最大序列号
+  SequenceNumber log_appended_sequence_ GUARDED_BY(mutex_);
+  // 同步线程已经持久化的最大序列号
+  SequenceNumber log_synced_sequence_ GUARDED_BY(mutex_);
+  // 同步写入等待持久化的最大序列号
+  SequenceNumber log_sync_requested_ GUARDED_BY(mutex_);
+  // 当前是否有线程在同步 log 文件(不持有 mutex_)
+  bool log_sync_in_progress_ GUARDED_BY(mutex_);
+  bool log_sync_thread_running_ GUARDED_BY(mutex_);
+  // 同步线程在上面等待新的同步请求
+  port::CondVar log_sync_cv_ GUARDED_BY(mutex_);
+  // 同步写入在上面等待同步完成
+  port::CondVar log_synced_signal_ GUARDED_BY(mutex_);
 
   // Queue of writers.
   std::deque<Writer*> writers_ GUARDED_BY(mutex_);
@@ -163,7 +340,8 @@ class DBImpl : public DB {
   // 前面的数据项. 但如果用户想用前面的数据项咋办呢? 我们用
   // 那个特定数据项对应的序列号来做快照就行了, 查找某个 user key
   // 的时候, 带上快照, 组装成 internal key, 就能找到了.
-  SnapshotList snapshots_ GUARDED_BY(mutex_);
+  // 快照集合内部按线程分片加锁, 不受 mutex_ 保护.
+  SnapshotRegistry snapshots_;
 
   // Set of table files to protect from deletion because they are
   // part of ongoing compactions.
@@ -190,6 +368,37 @@ class DBImpl : public DB {
   // 偏执模式下执行后台压实任务时是否遇到了错误
   Status bg_error_ GUARDED_BY(mutex_);
 
+  // 当前数据库目录中恢复可能还需要的 log 文件编号, 从小到大排列.
+  // 打开数据库时通过遍历目录得到, 之后每次切换 log 文件追加新的编号.
+  std::deque<uint64_t> live_logs_ GUARDED_BY(mutex_);
+
+  // 等待后台线程删除的过期文件, 不受 mutex_ 保护.
+  port::Mutex purge_mutex_;
+  // 删除线程在上面等待新的文件, 析构以及 TEST_WaitForPurge 在上面等待删除完成
+  port::CondVar purge_cv_ GUARDED_BY(purge_mutex_);
+  std::deque<ObsoleteFile> purge_queue_ GUARDED_BY(purge_mutex_);
+  bool purge_thread_running_ GUARDED_BY(purge_mutex_);
+  bool purge_in_progress_ GUARDED_BY(purge_mutex_);  // 正在删除取出的文件
+  bool purge_shutting_down_ GUARDED_BY(purge_mutex_);
+
+  // 打开数据库时需要预取的 block, 由 prefetch_threads_ 个线程并行处理,
+  // 每个线程依次领取 next_prefetch_job_ 指向的文件. 线程全部退出后清空.
+  struct BlockCachePrefetchJob {
+    uint64_t number;
+    uint64_t file_size;
+    std::vector<uint64_t> offsets;  // 升序排列
+  };
+  std::vector<BlockCachePrefetchJob> prefetch_jobs_ GUARDED_BY(mutex_);
+  size_t next_prefetch_job_ GUARDED_BY(mutex_);
+  int prefetch_threads_ GUARDED_BY(mutex_);
+
+  // 为 GetUpdatesSince 保留下来的过期 log 文件, 编号到开始保留时间(微秒)的映射.
+  // 重启之后重新开始计时.
+  std::map<uint64_t, uint64_t> retained_logs_ GUARDED_BY(mutex_);
+
+  // 历史版本保留下界, 见 Options::full_history_ts_low
+  std::string full_history_ts_low_ GUARDED_BY(mutex_);
+
   // Per level compaction stats.  stats_[level] stores the stats for
   // compactions that produced data for the specified "level".
   // 每个 level 对应的的压实过程统计. 
@@ -4,6 +4,8 @@
 
 #include "db/db_iter.h"
 
+#include <stdint.h>
+
 #include "db/filename.h"
 #include "db/db_impl.h"
 #include "db/dbformat.h"
@@ -46,15 +48,36 @@ class DBIter: public Iterator {
   };
 
   DBIter(DBImpl* db, const Comparator* cmp, Iterator* iter, SequenceNumber s,
-         uint32_t seed)
+         const Slice* timestamp, const Slice* lower_bound,
+         const Slice* upper_bound, uint32_t seed)
       : db_(db),
         user_comparator_(cmp),
         iter_(iter),
         sequence_(s),
+        timestamp_size_(cmp->timestamp_size()),
+        has_lower_bound_(lower_bound != nullptr),
+        has_upper_bound_(upper_bound != nullptr),
         direction_(kForward),
         valid_(false),
         rnd_(seed),
         bytes_until_read_sampling_(RandomCompactionPeriod()) {
+    if (timestamp_size_ > 0) {
+      // 没有指定时间点就读取最新版本, 全 0xff 是最大的时间戳
+      if (timestamp != nullptr) {
+        timestamp_.assign(timestamp->data(), timestamp->size());
+      } else {
+        timestamp_.assign(timestamp_size_, '\xff');
+      }
+    }
+    // 上下界拼上读取时间点, 这样就能与带时间戳的 user key 比较
+    if (has_lower_bound_) {
+      lower_bound_.assign(lower_bound->data(), lower_bound->size());
+      lower_bound_.append(timestamp_);
+    }
+    if (has_upper_bound_) {
+      upper_bound_.assign(upper_bound->data(), upper_bound->size());
+      upper_bound_.append(timestamp_);
+    }
   }
   virtual ~DBIter() {
     delete iter_;
@@ -66,7 +89,7 @@ class DBIter: public Iterator {
   }
   virtual Slice value() const {
     assert(valid_);
-    return (direction_ == kForward) ? iter_->value() : saved_value_;
+    return (direction_ == kForward) ? iter_->value() : reverse_value_;
   }
   virtual Status status() const {
     if (status_.ok()) {
@@ -81,17 +104,71 @@ class DBIter: public Iterator {
   virtual void Seek(const Slice& target);
   virtual void SeekToFirst();
   virtual void SeekToLast();
+  virtual size_t NextBatch(size_t max_n, BatchCallback callback, void* arg);
 
  private:
+  // NextBatch 过程中的状态
+  struct BatchState {
+    DBIter* db_iter;
+    size_t max_n;
+    size_t count;        // 调用方已经接收的数据项个数
+    bool skipping;       // 是否在跳过 user key 不大于 saved_key_ 的数据项
+    bool stopped;        // 是否已经停在下一个要返回的数据项上
+    bool exhausted;      // 是否已经越过上界
+    BatchCallback callback;
+    void* arg;
+  };
+  static bool BatchEntry(void* arg, const Slice& key, const Slice& value);
+
   void FindNextUserEntry(bool skipping, std::string* skip);
   void FindPrevUserEntry();
   bool ParseKey(ParsedInternalKey* key);
+  bool ParseKey(const Slice& k, const Slice& v, ParsedInternalKey* key);
+  // 将 target 的 internal key 形式(带上读取的序列号和时间点)保存到 saved_key_
+  void SaveSeekKey(const Slice& target);
+
+  // 数据项对本迭代器是否可见: 序列号不大于快照, 时间戳不晚于读取时间点.
+  inline bool IsVisible(const ParsedInternalKey& ikey) const {
+    if (ikey.sequence > sequence_) {
+      return false;
+    }
+    if (timestamp_size_ == 0) {
+      return true;
+    }
+    const Slice& k = ikey.user_key;
+    return user_comparator_->CompareTimestamp(
+        Slice(k.data() + k.size() - timestamp_size_, timestamp_size_),
+        timestamp_) <= 0;
+  }
+
+  // 比较两个 user key 是否属于同一个 key, 带时间戳时忽略时间戳.
+  inline int CompareUserKey(const Slice& a, const Slice& b) const {
+    return (timestamp_size_ == 0)
+               ? user_comparator_->Compare(a, b)
+               : user_comparator_->CompareWithoutTimestamp(a, b);
+  }
+
+  // user key 是否不小于上界
+  inline bool AtOrAfterUpperBound(const Slice& user_key) const {
+    return has_upper_bound_ && CompareUserKey(user_key, upper_bound_) >= 0;
+  }
+
+  // user key 是否小于下界
+  inline bool BeforeLowerBound(const Slice& user_key) const {
+    return has_lower_bound_ && CompareUserKey(user_key, lower_bound_) < 0;
+  }
+
+  // 去掉上下界末尾的时间戳
+  inline Slice BoundWithoutTimestamp(const std::string& bound) const {
+    return Slice(bound.data(), bound.size() - timestamp_size_);
+  }
 
   inline void SaveKey(const Slice& k, std::string* dst) {
     dst->assign(k.data(), k.size());
   }
 
   inline void ClearSavedValue() {
+    reverse_value_.clear();
     if (saved_value_.capacity() > 1048576) {
       std::string empty;
       swap(empty, saved_value_);
@@ -109,10 +186,20 @@ class DBIter: public Iterator {
   const Comparator* const user_comparator_;
   Iterator* const iter_;
   SequenceNumber const sequence_;
+  const size_t timestamp_size_;
+  std::string timestamp_;     // 读取时间点, 仅当 timestamp_size_ > 0 时有效
+  // 迭代范围 [lower_bound_, upper_bound_), timestamp_size_ > 0 时末尾拼有 timestamp_
+  const bool has_lower_bound_;
+  const bool has_upper_bound_;
+  std::string lower_bound_;
+  std::string upper_bound_;
 
   Status status_;
   std::string saved_key_;     // == current key when direction_==kReverse
   std::string saved_value_;   // == current raw value when direction_==kReverse
+  // 反向迭代时当前的 value. 如果内部迭代器的 value 在移动之后依然有效,
+  // 直接指向它, 否则指向 saved_value_.
+  Slice reverse_value_;
   Direction direction_;
   bool valid_;
 
@@ -125,9 +212,12 @@ class DBIter: public Iterator {
 };
 
 inline bool DBIter::ParseKey(ParsedInternalKey* ikey) {
-  Slice k = iter_->key();
+  return ParseKey(iter_->key(), iter_->value(), ikey);
+}
 
-  size_t bytes_read = k.size() + iter_->value().size();
+inline bool DBIter::ParseKey(const Slice& k, const Slice& v,
+                             ParsedInternalKey* ikey) {
+  size_t bytes_read = k.size() + v.size();
   while (bytes_until_read_sampling_ < bytes_read) {
     bytes_until_read_sampling_ += RandomCompactionPeriod();
     db_->RecordReadSample(k);
@@ -176,7 +266,12 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   assert(direction_ == kForward);
   do {
     ParsedInternalKey ikey;
-    if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
+    const bool parsed = ParseKey(&ikey);
+    if (parsed && AtOrAfterUpperBound(ikey.user_key)) {
+      // 越过上界就不必再扫描, 包括上界之后的删除标记
+      break;
+    }
+    if (parsed && IsVisible(ikey)) {
       switch (ikey.type) {
         case kTypeDeletion:
           // Arrange to skip all upcoming entries for this key since
@@ -186,7 +281,7 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
           break;
         case kTypeValue:
           if (skipping &&
-              user_comparator_->Compare(ikey.user_key, *skip) <= 0) {
+              CompareUserKey(ikey.user_key, *skip) <= 0) {
             // Entry hidden
           } else {
             valid_ = true;
@@ -202,6 +297,74 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   valid_ = false;
 }
 
+// 和 FindNextUserEntry 的逻辑相同, 只是内部迭代器的每个数据项由
+// iter_->NextBatch 推送过来. 返回 false 时 iter_ 停在当前数据项上.
+bool DBIter::BatchEntry(void* arg, const Slice& key, const Slice& value) {
+  BatchState* state = reinterpret_cast<BatchState*>(arg);
+  DBIter* db_iter = state->db_iter;
+  ParsedInternalKey ikey;
+  if (!db_iter->ParseKey(key, value, &ikey)) {
+    return true;
+  }
+  if (db_iter->AtOrAfterUpperBound(ikey.user_key)) {
+    state->exhausted = true;
+    return false;
+  }
+  if (db_iter->IsVisible(ikey)) {
+    switch (ikey.type) {
+      case kTypeDeletion:
+        db_iter->SaveKey(ikey.user_key, &db_iter->saved_key_);
+        state->skipping = true;
+        break;
+      case kTypeValue:
+        if (state->skipping &&
+            db_iter->CompareUserKey(ikey.user_key, db_iter->saved_key_) <= 0) {
+          // Entry hidden
+        } else {
+          // 找到了下一个要返回的数据项
+          if (state->count == state->max_n ||
+              !(*state->callback)(state->arg, ikey.user_key, value)) {
+            state->stopped = true;
+            return false;
+          }
+          state->count++;
+          // 跳过该 key 剩下的旧版本
+          db_iter->SaveKey(ikey.user_key, &db_iter->saved_key_);
+          state->skipping = true;
+        }
+        break;
+    }
+  }
+  return true;
+}
+
+size_t DBIter::NextBatch(size_t max_n, BatchCallback callback, void* arg) {
+  if (!valid_ || max_n == 0) {
+    return 0;
+  }
+  if (direction_ == kReverse) {
+    return Iterator::NextBatch(max_n, callback, arg);
+  }
+
+  BatchState state;
+  state.db_iter = this;
+  state.max_n = max_n;
+  state.count = 0;
+  state.skipping = false;
+  state.stopped = false;
+  state.exhausted = false;
+  state.callback = callback;
+  state.arg = arg;
+  // 内部迭代器不限个数, 由 BatchEntry 决定在哪里停下来
+  while (!state.stopped && !state.exhausted && iter_->Valid()) {
+    iter_->NextBatch(SIZE_MAX, &DBIter::BatchEntry, &state);
+  }
+  // 停下来时 iter_ 恰好位于下一个要返回的数据项上, 和 FindNextUserEntry 一致
+  valid_ = state.stopped;
+  saved_key_.clear();
+  return state.count;
+}
+
 void DBIter::Prev() {
   assert(valid_);
 
@@ -218,8 +381,7 @@ void DBIter::Prev() {
         ClearSavedValue();
         return;
       }
-      if (user_comparator_->Compare(ExtractUserKey(iter_->key()),
-                                    saved_key_) < 0) {
+      if (CompareUserKey(ExtractUserKey(iter_->key()), saved_key_) < 0) {
         break;
       }
     }
@@ -236,9 +398,14 @@ void DBIter::FindPrevUserEntry() {
   if (iter_->Valid()) {
     do {
       ParsedInternalKey ikey;
-      if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
+      const bool parsed = ParseKey(&ikey);
+      if (parsed && BeforeLowerBound(ikey.user_key)) {
+        // 越过下界, 相当于到达了开头
+        break;
+      }
+      if (parsed && IsVisible(ikey) && !AtOrAfterUpperBound(ikey.user_key)) {
         if ((value_type != kTypeDeletion) &&
-            user_comparator_->Compare(ikey.user_key, saved_key_) < 0) {
+            CompareUserKey(ikey.user_key, saved_key_) < 0) {
           // We encountered a non-deleted value in entries for previous keys,
           break;
         }
@@ -248,12 +415,18 @@ void DBIter::FindPrevUserEntry() {
           ClearSavedValue();
         } else {
           Slice raw_value = iter_->value();
-          if (saved_value_.capacity() > raw_value.size() + 1048576) {
-            std::string empty;
-            swap(empty, saved_value_);
-          }
           SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
-          saved_value_.assign(raw_value.data(), raw_value.size());
+          if (iter_->IsValuePinned()) {
+            // 不用拷贝
+            reverse_value_ = raw_value;
+          } else {
+            if (saved_value_.capacity() > raw_value.size() + 1048576) {
+              std::string empty;
+              swap(empty, saved_value_);
+            }
+            saved_value_.assign(raw_value.data(), raw_value.size());
+            reverse_value_ = saved_value_;
+          }
         }
       }
       iter_->Prev();
@@ -271,12 +444,28 @@ void DBIter::FindPrevUserEntry() {
   }
 }
 
+void DBIter::SaveSeekKey(const Slice& target) {
+  saved_key_.clear();
+  if (timestamp_size_ > 0) {
+    // target 不带时间戳, 拼上读取时间点, 定位到 target 第一个可见的版本
+    std::string key_with_ts(target.data(), target.size());
+    key_with_ts.append(timestamp_);
+    AppendInternalKey(&saved_key_, ParsedInternalKey(key_with_ts, sequence_,
+                                                     kValueTypeForSeek));
+  } else {
+    AppendInternalKey(
+        &saved_key_, ParsedInternalKey(target, sequence_, kValueTypeForSeek));
+  }
+}
+
 void DBIter::Seek(const Slice& target) {
   direction_ = kForward;
   ClearSavedValue();
-  saved_key_.clear();
-  AppendInternalKey(
-      &saved_key_, ParsedInternalKey(target, sequence_, kValueTypeForSeek));
+  SaveSeekKey(target);
+  if (BeforeLowerBound(ExtractUserKey(saved_key_))) {
+    // 不从下界之前开始
+    SaveSeekKey(BoundWithoutTimestamp(lower_bound_));
+  }
   iter_->Seek(saved_key_);
   if (iter_->Valid()) {
     FindNextUserEntry(false, &saved_key_ /* temporary storage */);
@@ -286,6 +475,10 @@ void DBIter::Seek(const Slice& target) {
 }
 
 void DBIter::SeekToFirst() {
+  if (has_lower_bound_) {
+    Seek(BoundWithoutTimestamp(lower_bound_));
+    return;
+  }
   direction_ = kForward;
   ClearSavedValue();
   iter_->SeekToFirst();
@@ -299,7 +492,19 @@ void DBIter::SeekToFirst() {
 void DBIter::SeekToLast() {
   direction_ = kReverse;
   ClearSavedValue();
-  iter_->SeekToLast();
+  if (has_upper_bound_) {
+    // 从上界之前开始. 带时间戳时上界的部分版本排在 seek 位置之前,
+    // 由 FindPrevUserEntry 跳过.
+    SaveSeekKey(BoundWithoutTimestamp(upper_bound_));
+    iter_->Seek(saved_key_);
+    if (iter_->Valid()) {
+      iter_->Prev();
+    } else {
+      iter_->SeekToLast();
+    }
+  } else {
+    iter_->SeekToLast();
+  }
   FindPrevUserEntry();
 }
 
@@ -310,8 +515,12 @@ Iterator* NewDBIterator(
     const Comparator* user_key_comparator,
     Iterator* internal_iter,
     SequenceNumber sequence,
+    const Slice* timestamp,
+    const Slice* lower_bound,
+    const Slice* upper_bound,
     uint32_t seed) {
-  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed);
+  return new DBIter(db, user_key_comparator, internal_iter, sequence,
+                    timestamp, lower_bound, upper_bound, seed);
 }
 
 }  // namespace leveldb
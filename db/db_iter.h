@@ -16,10 +16,19 @@ class DBImpl;
 // Return a new iterator that converts internal keys (yielded by
 // "*internal_iter") that were live at the specified "sequence" number
 // into appropriate user keys.
+//
+// 如果 user_key_comparator 支持时间戳, 只返回时间戳不晚于 *timestamp
+// 的版本中最新的那个; timestamp 为 nullptr 时返回最新版本.
+//
+// lower_bound 和 upper_bound 不为空时只返回位于 [*lower_bound, *upper_bound)
+// 的 user key(不含时间戳), 上下界会被拷贝.
 Iterator* NewDBIterator(DBImpl* db,
                         const Comparator* user_key_comparator,
                         Iterator* internal_iter,
                         SequenceNumber sequence,
+                        const Slice* timestamp,
+                        const Slice* lower_bound,
+                        const Slice* upper_bound,
                         uint32_t seed);
 
 }  // namespace leveldb
@@ -117,12 +117,17 @@ class SpecialEnv : public EnvWrapper {
   bool count_random_reads_;
   AtomicCounter random_read_counter_;
 
+  // Counted random reads copy their data into the caller's scratch buffer,
+  // like a file that is not mmap'ed, so that blocks become cachable.
+  bool copy_random_reads_;
+
   explicit SpecialEnv(Env* base) : EnvWrapper(base) {
     delay_data_sync_.Release_Store(nullptr);
     data_sync_error_.Release_Store(nullptr);
     no_space_.Release_Store(nullptr);
     non_writable_.Release_Store(nullptr);
     count_random_reads_ = false;
+    copy_random_reads_ = false;
     manifest_sync_error_.Release_Store(nullptr);
     manifest_write_error_.Release_Store(nullptr);
   }
@@ -205,21 +210,27 @@ class SpecialEnv : public EnvWrapper {
      private:
       RandomAccessFile* target_;
       AtomicCounter* counter_;
+      bool copy_;
      public:
-      CountingFile(RandomAccessFile* target, AtomicCounter* counter)
-          : target_(target), counter_(counter) {
+      CountingFile(RandomAccessFile* target, AtomicCounter* counter, bool copy)
+          : target_(target), counter_(counter), copy_(copy) {
       }
       virtual ~CountingFile() { delete target_; }
       virtual Status Read(uint64_t offset, size_t n, Slice* result,
                           char* scratch) const {
         counter_->Increment();
-        return target_->Read(offset, n, result, scratch);
+        Status s = target_->Read(offset, n, result, scratch);
+        if (s.ok() && copy_ && result->data() != scratch) {
+          memcpy(scratch, result->data(), result->size());
+          *result = Slice(scratch, result->size());
+        }
+        return s;
       }
     };
 
     Status s = target()->NewRandomAccessFile(f, r);
     if (s.ok() && count_random_reads_) {
-      *r = new CountingFile(*r, &random_read_counter_);
+      *r = new CountingFile(*r, &random_read_counter_, copy_random_reads_);
     }
     return s;
   }
@@ -452,7 +463,16 @@ class DBTest {
     return result;
   }
 
+  // Obsolete files are deleted in the background; wait for that so the
+  // directory listing reflects the current state of the DB.
+  void WaitForPurge() {
+    if (db_ != nullptr) {
+      dbfull()->TEST_WaitForPurge();
+    }
+  }
+
   int CountFiles() {
+    WaitForPurge();
     std::vector<std::string> files;
     env_->GetChildren(dbname_, &files);
     return static_cast<int>(files.size());
@@ -515,6 +535,7 @@ class DBTest {
   }
 
   bool DeleteAnSSTFile() {
+    WaitForPurge();
     std::vector<std::string> filenames;
     ASSERT_OK(env_->GetChildren(dbname_, &filenames));
     uint64_t number;
@@ -530,6 +551,7 @@ class DBTest {
 
   // Returns number of files renamed.
   int RenameLDBToSST() {
+    WaitForPurge();
     std::vector<std::string> filenames;
     ASSERT_OK(env_->GetChildren(dbname_, &filenames));
     uint64_t number;
@@ -656,6 +678,114 @@ TEST(DBTest, GetIdenticalSnapshots) {
   } while (ChangeOptions());
 }
 
+namespace {
+
+struct AsyncGetState {
+  port::Mutex mu;
+  port::CondVar cv;
+  int pending GUARDED_BY(mu);
+
+  AsyncGetState() : cv(&mu), pending(0) { }
+
+  void Wait() {
+    MutexLock l(&mu);
+    while (pending > 0) {
+      cv.Wait();
+    }
+  }
+};
+
+static std::string AsyncKey(int i) {
+  char buf[100];
+  snprintf(buf, sizeof(buf), "key%06d", i);
+  return std::string(buf);
+}
+
+struct AsyncGetResult {
+  AsyncGetState* state;
+  std::string result;
+};
+
+static void AsyncGetDone(void* arg, const Status& s, const Slice& value) {
+  AsyncGetResult* r = reinterpret_cast<AsyncGetResult*>(arg);
+  if (s.ok()) {
+    r->result = value.ToString();
+  } else if (s.IsNotFound()) {
+    r->result = "NOT_FOUND";
+  } else {
+    r->result = s.ToString();
+  }
+  MutexLock l(&r->state->mu);
+  r->state->pending--;
+  r->state->cv.SignalAll();
+}
+
+}  // namespace
+
+TEST(DBTest, GetAsync) {
+  // Older values live in a table file, newer ones in the memtable.
+  for (int i = 0; i < 100; i++) {
+    ASSERT_OK(Put(AsyncKey(i), "v" + NumberToString(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+  for (int i = 0; i < 10; i++) {
+    ASSERT_OK(Put(AsyncKey(i), "w" + NumberToString(i)));
+  }
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_OK(Put(AsyncKey(50), "x"));
+  ASSERT_OK(Delete(AsyncKey(51)));
+
+  AsyncGetState state;
+  std::vector<AsyncGetResult> results(103);
+  {
+    MutexLock l(&state.mu);
+    state.pending = results.size();
+  }
+  for (size_t i = 0; i < results.size(); i++) {
+    results[i].state = &state;
+  }
+  for (int i = 0; i < 100; i++) {
+    db_->GetAsync(ReadOptions(), AsyncKey(i), &AsyncGetDone, &results[i]);
+  }
+  db_->GetAsync(ReadOptions(), "missing", &AsyncGetDone, &results[100]);
+  ReadOptions snapshot_options;
+  snapshot_options.snapshot = snapshot;
+  db_->GetAsync(snapshot_options, AsyncKey(50), &AsyncGetDone, &results[101]);
+  db_->GetAsync(snapshot_options, AsyncKey(51), &AsyncGetDone, &results[102]);
+  // The lookups are bound to the snapshot when issued.
+  db_->ReleaseSnapshot(snapshot);
+  state.Wait();
+
+  for (int i = 0; i < 100; i++) {
+    std::string expected = (i < 10) ? "w" + NumberToString(i)
+                         : (i == 50) ? "x"
+                         : (i == 51) ? "NOT_FOUND"
+                         : "v" + NumberToString(i);
+    ASSERT_EQ(expected, results[i].result);
+  }
+  ASSERT_EQ("NOT_FOUND", results[100].result);
+  ASSERT_EQ("v50", results[101].result);
+  ASSERT_EQ("v51", results[102].result);
+
+  // Closing the DB completes every outstanding lookup first.
+  dbfull()->TEST_CompactMemTable();
+  {
+    MutexLock l(&state.mu);
+    state.pending = 100;
+  }
+  for (int i = 0; i < 100; i++) {
+    results[i].result.clear();
+    db_->GetAsync(ReadOptions(), AsyncKey(i), &AsyncGetDone, &results[i]);
+  }
+  Close();
+  {
+    MutexLock l(&state.mu);
+    ASSERT_EQ(0, state.pending);
+  }
+  ASSERT_EQ("w0", results[0].result);
+  ASSERT_EQ("v99", results[99].result);
+}
+
 TEST(DBTest, IterateOverEmptySnapshot) {
   do {
     const Snapshot* snapshot = db_->GetSnapshot();
@@ -952,6 +1082,77 @@ TEST(DBTest, IterMultiWithDelete) {
   } while (ChangeOptions());
 }
 
+namespace {
+
+struct NextBatchOutput {
+  std::string entries;
+  size_t accepted;
+  size_t limit;  // Refuse entries once this many were accepted
+};
+
+static bool AppendNextBatchEntry(void* arg, const Slice& key,
+                                 const Slice& value) {
+  NextBatchOutput* out = reinterpret_cast<NextBatchOutput*>(arg);
+  if (out->accepted >= out->limit) {
+    return false;
+  }
+  out->entries += key.ToString() + "->" + value.ToString() + " ";
+  out->accepted++;
+  return true;
+}
+
+}  // namespace
+
+TEST(DBTest, IterNextBatch) {
+  do {
+    Random rnd(301);
+    for (int i = 0; i < 300; i++) {
+      std::string k(1, static_cast<char>('a' + rnd.Uniform(26)));
+      if (rnd.OneIn(4)) {
+        ASSERT_OK(Delete(k));
+      } else {
+        ASSERT_OK(Put(k, "v" + NumberToString(i)));
+      }
+      if (i == 150) {
+        dbfull()->TEST_CompactMemTable();
+      }
+    }
+    const Snapshot* snapshot = db_->GetSnapshot();
+    for (int i = 0; i < 50; i++) {
+      std::string k(1, static_cast<char>('a' + rnd.Uniform(26)));
+      ASSERT_OK(Put(k, "w" + NumberToString(i)));
+    }
+
+    for (int pass = 0; pass < 2; pass++) {
+      ReadOptions options;
+      options.snapshot = (pass == 0) ? nullptr : snapshot;
+      std::string expected;
+      Iterator* iter = db_->NewIterator(options);
+      for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        expected += iter->key().ToString() + "->" + iter->value().ToString() +
+                    " ";
+      }
+      delete iter;
+
+      NextBatchOutput out;
+      out.accepted = 0;
+      iter = db_->NewIterator(options);
+      iter->SeekToFirst();
+      while (iter->Valid()) {
+        size_t max_n = 1 + rnd.Uniform(5);
+        out.limit = out.accepted + (rnd.OneIn(3) ? rnd.Uniform(max_n) : max_n);
+        size_t before = out.accepted;
+        size_t n = iter->NextBatch(max_n, &AppendNextBatchEntry, &out);
+        ASSERT_EQ(out.accepted - before, n);
+      }
+      ASSERT_OK(iter->status());
+      delete iter;
+      ASSERT_EQ(expected, out.entries);
+    }
+    db_->ReleaseSnapshot(snapshot);
+  } while (ChangeOptions());
+}
+
 TEST(DBTest, Recover) {
   do {
     ASSERT_OK(Put("foo", "v1"));
@@ -1261,6 +1462,54 @@ TEST(DBTest, ApproximateSizes_MixOfSmallAndLarge) {
   } while (ChangeOptions());
 }
 
+TEST(DBTest, ApproximateStats) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000000;        // Large write buffer
+  options.compression = kNoCompression;
+  options.create_if_missing = true;
+  DestroyAndReopen(&options);
+
+  uint64_t size, count;
+  Range r("", "xyz");
+  db_->GetApproximateStats(&r, 1, &size, &count);
+  ASSERT_EQ(0, size);
+  ASSERT_EQ(0, count);
+
+  const int N = 10000;
+  Random rnd(301);
+  for (int i = 0; i < N; i++) {
+    ASSERT_OK(Put(Key(i), RandomString(&rnd, 100)));
+  }
+
+  // Unlike GetApproximateSizes(), the memtable is accounted for.
+  db_->GetApproximateStats(&r, 1, &size, &count);
+  ASSERT_TRUE(Between(count, N / 2, N * 2));
+  ASSERT_GT(size, 100 * N / 2);
+  const std::string middle = Key(N / 2);
+  Range half("", middle);
+  db_->GetApproximateStats(&half, 1, &size, &count);
+  ASSERT_TRUE(Between(count, N / 8, N));
+
+  // Tables count entries at data block granularity.
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_GT(TotalTableFiles(), 0);
+  db_->GetApproximateStats(&r, 1, &size, &count);
+  ASSERT_TRUE(Between(count, N - 100, N));
+  ASSERT_TRUE(Between(size, 100 * N, 120 * N));
+  db_->GetApproximateStats(&half, 1, &size, &count);
+  ASSERT_TRUE(Between(count, N / 2 - 100, N / 2 + 100));
+  Range empty(middle, middle);
+  db_->GetApproximateStats(&empty, 1, &size, &count);
+  ASSERT_EQ(0, count);
+
+  // Overwrites in the memtable add to the table estimates.
+  for (int i = 0; i < N / 2; i++) {
+    ASSERT_OK(Put(Key(i), "v"));
+  }
+  db_->GetApproximateStats(&half, 1, &size, &count);
+  ASSERT_TRUE(Between(count, N / 2 + N / 8, N * 2));
+}
+
 TEST(DBTest, IteratorPinsRef) {
   Put("foo", "hello");
 
@@ -1316,6 +1565,10 @@ TEST(DBTest, HiddenValuesAreRemoved) {
   do {
     Random rnd(301);
     FillLevels("a", "z");
+    // FillLevels leaves enough level-0 files behind to trigger an automatic
+    // compaction.  Finish it now so that it cannot race with the snapshot
+    // below and compact away level-0 while the snapshot is still live.
+    dbfull()->TEST_CompactRange(0, nullptr, nullptr);
 
     std::string big = RandomString(&rnd, 50000);
     Put("foo", big);
@@ -1569,6 +1822,261 @@ TEST(DBTest, CustomComparator) {
   }
 }
 
+namespace {
+
+std::string KeyWithTs(const std::string& k, uint64_t ts) {
+  std::string result = k;
+  PutFixed64(&result, ts);
+  return result;
+}
+
+std::string GetAtTs(DB* db, const std::string& k, uint64_t ts,
+                    const Snapshot* snapshot = nullptr) {
+  std::string ts_buf;
+  PutFixed64(&ts_buf, ts);
+  Slice ts_slice(ts_buf);
+  ReadOptions options;
+  options.timestamp = &ts_slice;
+  options.snapshot = snapshot;
+  std::string result;
+  Status s = db->Get(options, k, &result);
+  if (s.IsNotFound()) {
+    result = "NOT_FOUND";
+  } else if (!s.ok()) {
+    result = s.ToString();
+  }
+  return result;
+}
+
+// Returns "key@ts->value" pairs yielded by an iterator reading at "ts".
+std::string IterAtTs(DB* db, uint64_t ts, bool reverse) {
+  std::string ts_buf;
+  PutFixed64(&ts_buf, ts);
+  Slice ts_slice(ts_buf);
+  ReadOptions options;
+  options.timestamp = &ts_slice;
+  Iterator* iter = db->NewIterator(options);
+  std::string result;
+  if (reverse) {
+    iter->SeekToLast();
+  } else {
+    iter->SeekToFirst();
+  }
+  for (; iter->Valid(); reverse ? iter->Prev() : iter->Next()) {
+    Slice k = iter->key();
+    if (!result.empty()) {
+      result += " ";
+    }
+    result += k.ToString().substr(0, k.size() - 8) + "@" +
+              NumberToString(DecodeFixed64(k.data() + k.size() - 8)) + "->" +
+              iter->value().ToString();
+  }
+  delete iter;
+  return result;
+}
+
+}  // namespace
+
+TEST(DBTest, TimestampedGet) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.comparator = BytewiseComparatorWithU64Ts();
+  // Filters are built over keys without timestamp.
+  const FilterPolicy* policy = NewBloomFilterPolicy(10);
+  options.filter_policy = policy;
+  DestroyAndReopen(&options);
+  ASSERT_OK(Put(KeyWithTs("a", 1), "v1"));
+  ASSERT_OK(Put(KeyWithTs("a", 3), "v3"));
+  ASSERT_OK(Delete(KeyWithTs("a", 5)));
+  ASSERT_OK(Put(KeyWithTs("b", 2), "vb"));
+
+  // Check the memtable first, then the same data in sstables.
+  for (int i = 0; i < 2; i++) {
+    ASSERT_EQ("NOT_FOUND", GetAtTs(db_, "a", 0));
+    ASSERT_EQ("v1", GetAtTs(db_, "a", 1));
+    ASSERT_EQ("v1", GetAtTs(db_, "a", 2));
+    ASSERT_EQ("v3", GetAtTs(db_, "a", 3));
+    ASSERT_EQ("v3", GetAtTs(db_, "a", 4));
+    ASSERT_EQ("NOT_FOUND", GetAtTs(db_, "a", 5));
+    ASSERT_EQ("NOT_FOUND", GetAtTs(db_, "b", 1));
+    ASSERT_EQ("vb", GetAtTs(db_, "b", 9));
+    ASSERT_EQ("NOT_FOUND", GetAtTs(db_, "c", 9));
+    // Without a timestamp the newest version is read.
+    ASSERT_EQ("NOT_FOUND", Get("a"));
+    ASSERT_EQ("vb", Get("b"));
+    dbfull()->TEST_CompactMemTable();
+  }
+
+  std::string value;
+  Slice bad_ts("123");
+  ReadOptions read_options;
+  read_options.timestamp = &bad_ts;
+  ASSERT_TRUE(db_->Get(read_options, "a", &value).IsInvalidArgument());
+  ASSERT_TRUE(db_->IncreaseFullHistoryTsLow(bad_ts).IsInvalidArgument());
+
+  // Keys too short to carry a timestamp are rejected before being applied.
+  ASSERT_TRUE(Put("a", "short").IsInvalidArgument());
+  ASSERT_TRUE(Delete("").IsInvalidArgument());
+  WriteBatch batch;
+  batch.Put(KeyWithTs("c", 1), "vc");
+  batch.Put("c", "short");
+  ASSERT_TRUE(db_->Write(WriteOptions(), &batch).IsInvalidArgument());
+  ASSERT_EQ("NOT_FOUND", GetAtTs(db_, "c", 1));
+
+  // Comparators without timestamps reject timestamped reads.
+  options.comparator = BytewiseComparator();
+  options.filter_policy = nullptr;
+  DestroyAndReopen(&options);
+  delete policy;
+  std::string ts_buf;
+  PutFixed64(&ts_buf, 1);
+  Slice ts(ts_buf);
+  read_options.timestamp = &ts;
+  ASSERT_TRUE(db_->Get(read_options, "a", &value).IsInvalidArgument());
+  Iterator* iter = db_->NewIterator(read_options);
+  ASSERT_TRUE(iter->status().IsInvalidArgument());
+  delete iter;
+  ASSERT_TRUE(db_->IncreaseFullHistoryTsLow(ts).IsInvalidArgument());
+}
+
+TEST(DBTest, TimestampedGetWithSnapshot) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.comparator = BytewiseComparatorWithU64Ts();
+  DestroyAndReopen(&options);
+  ASSERT_OK(Put(KeyWithTs("a", 5), "v5"));
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_OK(Put(KeyWithTs("a", 7), "v7"));
+  ASSERT_OK(Put(KeyWithTs("a", 9), "v9"));
+
+  // Newer timestamps sort before the snapshot's version but were written
+  // after the snapshot, so they must be skipped.  Check the memtable,
+  // then a level-0 table, then the bottom level.
+  for (int i = 0; i < 3; i++) {
+    ASSERT_EQ("v5", Get("a", snapshot));
+    ASSERT_EQ("v5", GetAtTs(db_, "a", 9, snapshot));
+    ASSERT_EQ("v5", GetAtTs(db_, "a", 6, snapshot));
+    ASSERT_EQ("NOT_FOUND", GetAtTs(db_, "a", 4, snapshot));
+    ASSERT_EQ("v7", GetAtTs(db_, "a", 8));
+    ASSERT_EQ("v9", GetAtTs(db_, "a", 9));
+    if (i == 0) {
+      dbfull()->TEST_CompactMemTable();
+    } else {
+      for (int level = 0; level < config::kNumLevels - 1; level++) {
+        dbfull()->TEST_CompactRange(level, nullptr, nullptr);
+      }
+    }
+  }
+  db_->ReleaseSnapshot(snapshot);
+}
+
+TEST(DBTest, TimestampedIterator) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.comparator = BytewiseComparatorWithU64Ts();
+  DestroyAndReopen(&options);
+  ASSERT_OK(Put(KeyWithTs("a", 1), "a1"));
+  ASSERT_OK(Put(KeyWithTs("a", 4), "a4"));
+  ASSERT_OK(Put(KeyWithTs("b", 3), "b3"));
+  ASSERT_OK(Delete(KeyWithTs("b", 5)));
+  ASSERT_OK(Put(KeyWithTs("c", 6), "c6"));
+
+  for (int i = 0; i < 2; i++) {
+    ASSERT_EQ("", IterAtTs(db_, 0, false));
+    ASSERT_EQ("a@1->a1", IterAtTs(db_, 2, false));
+    ASSERT_EQ("a@1->a1 b@3->b3", IterAtTs(db_, 3, false));
+    ASSERT_EQ("b@3->b3 a@1->a1", IterAtTs(db_, 3, true));
+    ASSERT_EQ("a@4->a4 b@3->b3", IterAtTs(db_, 4, false));
+    ASSERT_EQ("a@4->a4", IterAtTs(db_, 5, false));
+    ASSERT_EQ("a@4->a4 c@6->c6", IterAtTs(db_, 9, false));
+    ASSERT_EQ("c@6->c6 a@4->a4", IterAtTs(db_, 9, true));
+    dbfull()->TEST_CompactMemTable();
+  }
+
+  // Seek takes a key without timestamp; direction changes skip the
+  // versions that are not visible at the read timestamp.
+  std::string ts_buf;
+  PutFixed64(&ts_buf, 3);
+  Slice ts(ts_buf);
+  ReadOptions read_options;
+  read_options.timestamp = &ts;
+  Iterator* iter = db_->NewIterator(read_options);
+  iter->Seek("b");
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ(KeyWithTs("b", 3), iter->key().ToString());
+  iter->Prev();
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ(KeyWithTs("a", 1), iter->key().ToString());
+  iter->Next();
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ(KeyWithTs("b", 3), iter->key().ToString());
+  iter->Next();
+  ASSERT_TRUE(!iter->Valid());
+  delete iter;
+}
+
+TEST(DBTest, TimestampedHistoryGC) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.comparator = BytewiseComparatorWithU64Ts();
+  DestroyAndReopen(&options);
+  for (uint64_t ts = 1; ts <= 5; ts++) {
+    ASSERT_OK(Put(KeyWithTs("a", ts), "v" + NumberToString(ts)));
+  }
+
+  std::string ts_buf;
+  PutFixed64(&ts_buf, 3);
+  ASSERT_OK(db_->IncreaseFullHistoryTsLow(ts_buf));
+  // Lowering the bound has no effect.
+  ts_buf.clear();
+  PutFixed64(&ts_buf, 1);
+  ASSERT_OK(db_->IncreaseFullHistoryTsLow(ts_buf));
+
+  // Reads before compaction still see the full history.
+  ASSERT_EQ("v1", GetAtTs(db_, "a", 1));
+  ASSERT_EQ("v2", GetAtTs(db_, "a", 2));
+
+  dbfull()->TEST_CompactMemTable();
+  for (int level = 0; level < config::kNumLevels - 1; level++) {
+    dbfull()->TEST_CompactRange(level, nullptr, nullptr);
+  }
+
+  // Versions older than the newest one at or before the bound are gone.
+  ASSERT_EQ("NOT_FOUND", GetAtTs(db_, "a", 1));
+  ASSERT_EQ("NOT_FOUND", GetAtTs(db_, "a", 2));
+  ASSERT_EQ("v3", GetAtTs(db_, "a", 3));
+  ASSERT_EQ("v4", GetAtTs(db_, "a", 4));
+  ASSERT_EQ("v5", GetAtTs(db_, "a", 9));
+}
+
+TEST(DBTest, TimestampedDeletionGC) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.comparator = BytewiseComparatorWithU64Ts();
+  DestroyAndReopen(&options);
+  ASSERT_OK(Put(KeyWithTs("a", 1), "a1"));
+  ASSERT_OK(Delete(KeyWithTs("a", 2)));
+  ASSERT_OK(Put(KeyWithTs("b", 5), "b5"));
+  ASSERT_OK(Delete(KeyWithTs("b", 6)));
+
+  std::string ts_buf;
+  PutFixed64(&ts_buf, 3);
+  ASSERT_OK(db_->IncreaseFullHistoryTsLow(ts_buf));
+  dbfull()->TEST_CompactMemTable();
+  for (int level = 0; level < config::kNumLevels - 1; level++) {
+    dbfull()->TEST_CompactRange(level, nullptr, nullptr);
+  }
+
+  // A deletion at or before the bound goes away with what it hides once
+  // it reaches the bottom; a later one is still needed by reads.
+  ASSERT_EQ("[ ]", AllEntriesFor(KeyWithTs("a", 2)));
+  ASSERT_EQ("[ ]", AllEntriesFor(KeyWithTs("a", 1)));
+  ASSERT_EQ("[ DEL ]", AllEntriesFor(KeyWithTs("b", 6)));
+  ASSERT_EQ("NOT_FOUND", GetAtTs(db_, "a", 9));
+  ASSERT_EQ("b5", GetAtTs(db_, "b", 5));
+  ASSERT_EQ("NOT_FOUND", GetAtTs(db_, "b", 9));
+}
+
 TEST(DBTest, ManualCompaction) {
   ASSERT_EQ(config::kMaxMemCompactLevel, 2)
       << "Need to update this test to match kMaxMemCompactLevel";
@@ -1857,6 +2365,120 @@ TEST(DBTest, FilesDeletedAfterCompaction) {
   ASSERT_EQ(CountFiles(), num_files);
 }
 
+namespace {
+// Blocks deletions of files numbered below "block_below_" while "block_"
+// is set.  Files created later (e.g. an empty table dropped by a memtable
+// compaction) are deleted as usual.
+class BlockDeleteEnv : public EnvWrapper {
+ public:
+  port::AtomicPointer block_;
+  port::AtomicPointer blocked_;  // Set once a deletion has been blocked
+  uint64_t block_below_;
+
+  explicit BlockDeleteEnv(Env* base)
+      : EnvWrapper(base), block_(nullptr), blocked_(nullptr),
+        block_below_(0) { }
+
+  Status DeleteFile(const std::string& f) {
+    uint64_t number;
+    FileType type;
+    const size_t slash = f.rfind('/');
+    const std::string base = (slash == std::string::npos) ? f
+                                                          : f.substr(slash + 1);
+    if (block_.Acquire_Load() != nullptr &&
+        ParseFileName(base, &number, &type) && number < block_below_) {
+      blocked_.Release_Store(this);
+      while (block_.Acquire_Load() != nullptr) {
+        SleepForMicroseconds(1000);
+      }
+    }
+    return target()->DeleteFile(f);
+  }
+};
+}  // namespace
+
+TEST(DBTest, ObsoleteFilesDeletedInBackground) {
+  BlockDeleteEnv env(env_);
+  Options options = CurrentOptions();
+  options.env = &env;
+  Reopen(&options);
+
+  ASSERT_OK(Put("foo", "v1"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_OK(Put("foo", "v2"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+
+  // Compacting the two tables together makes both of them obsolete.
+  std::vector<std::string> filenames;
+  ASSERT_OK(env_->GetChildren(dbname_, &filenames));
+  uint64_t number;
+  FileType type;
+  for (size_t i = 0; i < filenames.size(); i++) {
+    if (ParseFileName(filenames[i], &number, &type) &&
+        number >= env.block_below_) {
+      env.block_below_ = number + 1;
+    }
+  }
+  env.block_.Release_Store(&env);
+  Compact("a", "z");
+  for (int i = 0; i < 10000 && env.blocked_.Acquire_Load() == nullptr; i++) {
+    env_->SleepForMicroseconds(1000);
+  }
+  ASSERT_TRUE(env.blocked_.Acquire_Load() != nullptr);
+
+  // The DB stays fully usable while a deletion is stuck.
+  ASSERT_OK(Put("bar", "v3"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("v2", Get("foo"));
+  ASSERT_EQ("v3", Get("bar"));
+
+  env.block_.Release_Store(nullptr);
+  dbfull()->TEST_WaitForPurge();
+  ASSERT_OK(env_->GetChildren(dbname_, &filenames));
+  int tables = 0;
+  int logs = 0;
+  for (size_t i = 0; i < filenames.size(); i++) {
+    if (ParseFileName(filenames[i], &number, &type)) {
+      if (type == kTableFile) tables++;
+      if (type == kLogFile) logs++;
+    }
+  }
+  ASSERT_EQ(TotalTableFiles(), tables);
+  ASSERT_EQ(1, logs);
+  Close();
+}
+
+TEST(DBTest, DedupGroupUpdates) {
+  Options options = CurrentOptions();
+  options.dedup_group_updates = true;
+  Reopen(&options);
+
+  WriteBatch batch;
+  batch.Put("foo", "v1");
+  batch.Put("bar", "v2");
+  batch.Put("foo", "v3");
+  batch.Delete("bar");
+  batch.Put("foo", "v4");
+  ASSERT_OK(db_->Write(WriteOptions(), &batch));
+  ASSERT_EQ("v4", Get("foo"));
+  ASSERT_EQ("NOT_FOUND", Get("bar"));
+  // Overwritten updates never reach the memtable.
+  ASSERT_EQ("[ v4 ]", AllEntriesFor("foo"));
+  ASSERT_EQ("[ DEL ]", AllEntriesFor("bar"));
+
+  // Sequence numbers still advance by the full batch size.
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_OK(Put("foo", "v5"));
+  ASSERT_EQ("v5", Get("foo"));
+  ASSERT_EQ("v4", Get("foo", snapshot));
+  db_->ReleaseSnapshot(snapshot);
+
+  // The log still holds every update; recovery ends in the same state.
+  Reopen(&options);
+  ASSERT_EQ("v5", Get("foo"));
+  ASSERT_EQ("NOT_FOUND", Get("bar"));
+}
+
 TEST(DBTest, BloomFilter) {
   env_->count_random_reads_ = true;
   Options options = CurrentOptions();
@@ -1904,6 +2526,331 @@ TEST(DBTest, BloomFilter) {
   delete options.filter_policy;
 }
 
+TEST(DBTest, FilterPolicyPerLevel) {
+  const FilterPolicy* bloom10 = NewBloomFilterPolicy(10);
+  const FilterPolicy* bloom1 = NewBloomFilterPolicy(1);
+  const int N = 10000;
+  for (int config = 0; config < 2; config++) {
+    env_->count_random_reads_ = true;
+    Options options = CurrentOptions();
+    options.env = env_;
+    options.create_if_missing = true;
+    options.block_cache = NewLRUCache(0);  // Prevent cache hits
+    options.filter_policy = bloom10;
+    if (config == 0) {
+      options.optimize_filters_for_hits = true;
+    } else {
+      options.level_filter_policies.assign(config::kNumLevels, bloom1);
+    }
+    DestroyAndReopen(&options);
+
+    // Push everything through a compaction into the last level with data.
+    for (int i = 0; i < N; i++) {
+      ASSERT_OK(Put(Key(i), Key(i)));
+    }
+    dbfull()->TEST_CompactMemTable();
+    for (int i = 0; i < N; i += 100) {
+      ASSERT_OK(Put(Key(i), Key(i)));
+    }
+    Compact("a", "z");
+    ASSERT_EQ(TotalTableFiles(),
+              NumTableFilesAtLevel(config::kMaxMemCompactLevel));
+
+    // Prevent auto compactions triggered by seeks
+    env_->delay_data_sync_.Release_Store(env_);
+    env_->random_read_counter_.Reset();
+    for (int i = 0; i < N; i++) {
+      ASSERT_EQ(Key(i), Get(Key(i)));
+    }
+    ASSERT_EQ(N, env_->random_read_counter_.Read());
+
+    env_->random_read_counter_.Reset();
+    for (int i = 0; i < N; i++) {
+      ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+    }
+    const int reads = env_->random_read_counter_.Read();
+    fprintf(stderr, "config %d: %d missing => %d reads\n", config, N, reads);
+    if (config == 0) {
+      // No filter at all for the bottommost level.
+      ASSERT_GE(reads, N - 1);
+    } else {
+      // One bit per key gives far more false positives than ten.
+      ASSERT_GE(reads, N / 2);
+      ASSERT_LT(reads, N);
+    }
+
+    env_->delay_data_sync_.Release_Store(nullptr);
+    Close();
+    delete options.block_cache;
+  }
+  delete bloom1;
+  delete bloom10;
+}
+
+TEST(DBTest, WarmBlockCacheOnWrite) {
+  const int N = 1000;
+  for (int warm = 0; warm < 2; warm++) {
+    env_->count_random_reads_ = true;
+    Options options = CurrentOptions();
+    options.env = env_;
+    options.create_if_missing = true;
+    options.block_cache = NewLRUCache(8 << 20);
+    options.warm_block_cache_level = warm ? config::kNumLevels - 1 : -1;
+    DestroyAndReopen(&options);
+
+    for (int i = 0; i < N; i++) {
+      ASSERT_OK(Put(Key(i), std::string(100, 'v')));
+    }
+    dbfull()->TEST_CompactMemTable();
+    env_->random_read_counter_.Reset();
+    for (int i = 0; i < N; i++) {
+      ASSERT_EQ(std::string(100, 'v'), Get(Key(i)));
+    }
+    if (warm) {
+      ASSERT_EQ(0, env_->random_read_counter_.Read());
+    } else {
+      ASSERT_GT(env_->random_read_counter_.Read(), 0);
+    }
+
+    // Overwrite half of the keys and merge everything in a compaction.
+    for (int i = 0; i < N; i += 2) {
+      ASSERT_OK(Put(Key(i), std::string(100, 'w')));
+    }
+    dbfull()->TEST_CompactMemTable();
+    Compact("a", "z");
+    ASSERT_EQ(0, NumTableFilesAtLevel(0));
+    env_->random_read_counter_.Reset();
+    for (int i = 0; i < N; i++) {
+      ASSERT_EQ(std::string(100, (i % 2 == 0) ? 'w' : 'v'), Get(Key(i)));
+    }
+    if (warm) {
+      ASSERT_EQ(0, env_->random_read_counter_.Read());
+    } else {
+      ASSERT_GT(env_->random_read_counter_.Read(), 0);
+    }
+
+    Close();
+    delete options.block_cache;
+  }
+}
+
+TEST(DBTest, PersistBlockCache) {
+  env_->count_random_reads_ = true;
+  env_->copy_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.create_if_missing = true;
+  options.block_cache = NewLRUCache(8 << 20);
+  options.persist_block_cache = true;
+  DestroyAndReopen(&options);
+
+  const int N = 1000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_OK(Put(Key(i), std::string(100, 'v')));
+  }
+  dbfull()->TEST_CompactMemTable();
+  // Only the first half of the keys is read and thus cached.
+  for (int i = 0; i < N / 2; i++) {
+    ASSERT_EQ(std::string(100, 'v'), Get(Key(i)));
+  }
+  Close();
+  ASSERT_TRUE(env_->FileExists(BlockCacheFileName(dbname_)));
+
+  // Restart with an empty cache: the hot blocks are prefetched on open.
+  delete options.block_cache;
+  options.block_cache = NewLRUCache(8 << 20);
+  Reopen(&options);
+  dbfull()->TEST_WaitForBlockCachePrefetch();
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N / 2; i++) {
+    ASSERT_EQ(std::string(100, 'v'), Get(Key(i)));
+  }
+  ASSERT_EQ(0, env_->random_read_counter_.Read());
+  // The other half was never cached and has to be read from the table.
+  ASSERT_EQ(std::string(100, 'v'), Get(Key(N - 1)));
+  ASSERT_EQ(1, env_->random_read_counter_.Read());
+
+  // A corrupted record is ignored.
+  Close();
+  ASSERT_OK(WriteStringToFile(env_, "garbage", BlockCacheFileName(dbname_)));
+  Reopen(&options);
+  dbfull()->TEST_WaitForBlockCachePrefetch();
+  ASSERT_EQ(std::string(100, 'v'), Get(Key(0)));
+
+  env_->copy_random_reads_ = false;
+  Close();
+  delete options.block_cache;
+}
+
+static std::string FixedKey(int i) {
+  char buf[100];
+  snprintf(buf, sizeof(buf), "%016d", i);
+  return std::string(buf);
+}
+
+TEST(DBTest, FixedKeyLength) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.fixed_key_length = 16;
+  options.write_buffer_size = 100000;  // Small write buffer
+  DestroyAndReopen(&options);
+
+  ASSERT_TRUE(Put("short", "v").IsInvalidArgument());
+  WriteBatch batch;
+  batch.Put(FixedKey(1), "v");
+  batch.Delete(FixedKey(1) + "x");
+  ASSERT_TRUE(db_->Write(WriteOptions(), &batch).IsInvalidArgument());
+  ASSERT_EQ("NOT_FOUND", Get(FixedKey(1)));
+
+  const int N = 2000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_OK(Put(FixedKey(i), std::string(100, 'a' + i % 26)));
+  }
+  ASSERT_OK(Delete(FixedKey(7)));
+
+  // Recover the memtable from the log, then push everything into tables.
+  Reopen(&options);
+  ASSERT_EQ(std::string(100, 'a' + 42 % 26), Get(FixedKey(42)));
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_EQ(0, NumTableFilesAtLevel(0));
+  ASSERT_GT(TotalTableFiles(), 0);
+
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(i == 7 ? "NOT_FOUND" : std::string(100, 'a' + i % 26),
+              Get(FixedKey(i)));
+  }
+  ASSERT_EQ("NOT_FOUND", Get("short"));
+
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  ASSERT_EQ(N - 1, count);
+  iter->Seek(FixedKey(50).substr(0, 15));
+  ASSERT_EQ(FixedKey(50), iter->key().ToString());
+  iter->Seek(FixedKey(77) + "x");
+  ASSERT_EQ(FixedKey(78), iter->key().ToString());
+  iter->Seek(FixedKey(7));
+  ASSERT_EQ(FixedKey(8), iter->key().ToString());
+  iter->Prev();
+  ASSERT_EQ(FixedKey(6), iter->key().ToString());
+  delete iter;
+}
+
+TEST(DBTest, IterateBounds) {
+  do {
+    ASSERT_OK(Put("a", "va"));
+    ASSERT_OK(Put("b", "vb"));
+    ASSERT_OK(Put("c", "vc"));
+    ASSERT_OK(Put("d", "vd"));
+    ASSERT_OK(Put("e", "ve"));
+    ASSERT_OK(Delete("c"));
+
+    Slice lower("b"), upper("e");
+    ReadOptions options;
+    options.iterate_lower_bound = &lower;
+    options.iterate_upper_bound = &upper;
+    Iterator* iter = db_->NewIterator(options);
+    iter->SeekToFirst();
+    ASSERT_EQ(IterStatus(iter), "b->vb");
+    iter->Next();
+    ASSERT_EQ(IterStatus(iter), "d->vd");
+    iter->Next();
+    ASSERT_EQ(IterStatus(iter), "(invalid)");
+
+    iter->SeekToLast();
+    ASSERT_EQ(IterStatus(iter), "d->vd");
+    iter->Prev();
+    ASSERT_EQ(IterStatus(iter), "b->vb");
+    iter->Prev();
+    ASSERT_EQ(IterStatus(iter), "(invalid)");
+
+    iter->Seek("a");
+    ASSERT_EQ(IterStatus(iter), "b->vb");
+    iter->Seek("c");
+    ASSERT_EQ(IterStatus(iter), "d->vd");
+    iter->Seek("e");
+    ASSERT_EQ(IterStatus(iter), "(invalid)");
+
+    NextBatchOutput out;
+    out.accepted = 0;
+    out.limit = 10;
+    ASSERT_EQ(0, iter->NextBatch(10, &AppendNextBatchEntry, &out));
+    iter->Seek("b");
+    ASSERT_EQ(2, iter->NextBatch(10, &AppendNextBatchEntry, &out));
+    ASSERT_EQ("b->vb d->vd ", out.entries);
+    ASSERT_EQ(IterStatus(iter), "(invalid)");
+    delete iter;
+
+    // An empty range.
+    options.iterate_upper_bound = &lower;
+    iter = db_->NewIterator(options);
+    iter->SeekToFirst();
+    ASSERT_EQ(IterStatus(iter), "(invalid)");
+    iter->SeekToLast();
+    ASSERT_EQ(IterStatus(iter), "(invalid)");
+    delete iter;
+  } while (ChangeOptions());
+}
+
+TEST(DBTest, RangeFilter) {
+  for (int use_filter = 0; use_filter < 2; use_filter++) {
+    env_->count_random_reads_ = true;
+    Options options = CurrentOptions();
+    options.env = env_;
+    options.block_cache = NewLRUCache(0);  // Prevent cache hits
+    options.create_if_missing = true;
+    options.range_filter = (use_filter == 1);
+    DestroyAndReopen(&options);
+
+    // Two tables whose key ranges overlap, but only the second one holds
+    // keys starting with "m".
+    ASSERT_OK(Put("a1", "v"));
+    ASSERT_OK(Put("z1", "v"));
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_OK(Put("m1", "v"));
+    ASSERT_OK(Put("m2", "v"));
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_EQ(2, TotalTableFiles());
+
+    // Open both tables before counting.
+    ASSERT_EQ("v", Get("a1"));
+    ASSERT_EQ("v", Get("m1"));
+
+    Slice lower("m"), upper("n");
+    ReadOptions read_options;
+    read_options.iterate_lower_bound = &lower;
+    read_options.iterate_upper_bound = &upper;
+    env_->random_read_counter_.Reset();
+    Iterator* iter = db_->NewIterator(read_options);
+    int count = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      count++;
+    }
+    ASSERT_OK(iter->status());
+    delete iter;
+    ASSERT_EQ(2, count);
+    // Without the range filter the first table is read as well.
+    ASSERT_EQ(use_filter ? 1 : 2, env_->random_read_counter_.Read());
+
+    // A range without keys reads nothing.
+    Slice empty_lower("b"), empty_upper("c");
+    read_options.iterate_lower_bound = &empty_lower;
+    read_options.iterate_upper_bound = &empty_upper;
+    env_->random_read_counter_.Reset();
+    iter = db_->NewIterator(read_options);
+    iter->SeekToFirst();
+    ASSERT_TRUE(!iter->Valid());
+    delete iter;
+    ASSERT_EQ(use_filter ? 0 : 1, env_->random_read_counter_.Read());
+
+    env_->count_random_reads_ = false;
+    Close();
+    delete options.block_cache;
+  }
+}
+
 // Multi-threaded test:
 namespace {
 
@@ -2002,6 +2949,267 @@ TEST(DBTest, MultiThreaded) {
   } while (ChangeOptions());
 }
 
+namespace {
+
+// Use more reader threads than DBImpl has read view slots so that some
+// threads have to share a slot.
+static const int kNumReadViewThreads = 80;
+
+struct ReadViewState {
+  DBTest* test;
+  port::AtomicPointer stop;
+  port::AtomicPointer thread_done[kNumReadViewThreads];
+  port::AtomicPointer failed;
+};
+
+struct ReadViewThread {
+  ReadViewState* state;
+  int id;
+};
+
+static void ReadViewThreadBody(void* arg) {
+  ReadViewThread* t = reinterpret_cast<ReadViewThread*>(arg);
+  DB* db = t->state->test->db_;
+  int last = -1;
+  while (t->state->stop.Acquire_Load() == nullptr) {
+    std::string value;
+    Status s = db->Get(ReadOptions(), "foo", &value);
+    // The writer stores increasing values, so a later read must never
+    // observe an older value than an earlier one.
+    int v = s.ok() ? atoi(value.c_str()) : -1;
+    if (v < last) {
+      t->state->failed.Release_Store(t);
+    }
+    last = v;
+  }
+  t->state->thread_done[t->id].Release_Store(t);
+}
+
+}  // namespace
+
+TEST(DBTest, ConcurrentReadsAcrossMemTableSwitches) {
+  ReadViewState state;
+  state.test = this;
+  state.stop.Release_Store(nullptr);
+  state.failed.Release_Store(nullptr);
+  ReadViewThread thread[kNumReadViewThreads];
+  for (int id = 0; id < kNumReadViewThreads; id++) {
+    state.thread_done[id].Release_Store(nullptr);
+    thread[id].state = &state;
+    thread[id].id = id;
+    env_->StartThread(ReadViewThreadBody, &thread[id]);
+  }
+
+  // Keep overwriting "foo" and switching memtables so that the read views
+  // cached by the reader threads go stale over and over again.
+  char buf[20];
+  for (int i = 0; i < 200; i++) {
+    snprintf(buf, sizeof(buf), "%d", i);
+    ASSERT_OK(Put("foo", buf));
+    if (i % 20 == 0) {
+      ASSERT_OK(dbfull()->TEST_CompactMemTable());
+    }
+    ASSERT_EQ(buf, Get("foo"));
+  }
+
+  state.stop.Release_Store(&state);
+  for (int id = 0; id < kNumReadViewThreads; id++) {
+    while (state.thread_done[id].Acquire_Load() == nullptr) {
+      DelayMilliseconds(10);
+    }
+  }
+  ASSERT_TRUE(state.failed.Acquire_Load() == nullptr);
+  ASSERT_EQ("199", Get("foo"));
+}
+
+namespace {
+
+// Log files that support SyncFlushed(), so that sync writes are handed to
+// the WAL sync thread.  Each sync is slowed down and counted.
+class SlowSyncEnv : public EnvWrapper {
+ public:
+  std::atomic<int> syncs;
+
+  explicit SlowSyncEnv(Env* base) : EnvWrapper(base), syncs(0) { }
+
+  Status NewWritableFile(const std::string& f, WritableFile** r) {
+    class SlowSyncFile : public WritableFile {
+     public:
+      SlowSyncFile(SlowSyncEnv* env, WritableFile* base)
+          : env_(env), base_(base) { }
+      ~SlowSyncFile() { delete base_; }
+      Status Append(const Slice& data) { return base_->Append(data); }
+      Status Close() { return base_->Close(); }
+      Status Flush() { return base_->Flush(); }
+      Status Sync() { return base_->Sync(); }
+      Status SyncFlushed() {
+        env_->syncs.fetch_add(1);
+        env_->SleepForMicroseconds(2000);
+        return base_->SyncFlushed();
+      }
+
+     private:
+      SlowSyncEnv* env_;
+      WritableFile* base_;
+    };
+
+    Status s = target()->NewWritableFile(f, r);
+    if (s.ok() && strstr(f.c_str(), ".log") != nullptr) {
+      *r = new SlowSyncFile(this, *r);
+    }
+    return s;
+  }
+};
+
+static const int kNumSyncWriters = 8;
+static const int kSyncWritesPerThread = 50;
+
+struct SyncWriteState {
+  DB* db;
+  port::AtomicPointer thread_done[kNumSyncWriters];
+  port::AtomicPointer failed;
+};
+
+struct SyncWriteThread {
+  SyncWriteState* state;
+  int id;
+};
+
+static void SyncWriteThreadBody(void* arg) {
+  SyncWriteThread* t = reinterpret_cast<SyncWriteThread*>(arg);
+  WriteOptions options;
+  // Odd threads write without sync so that both kinds share write groups.
+  options.sync = (t->id % 2 == 0);
+  std::string value(1000, static_cast<char>('a' + t->id));
+  for (int i = 0; i < kSyncWritesPerThread; i++) {
+    char key[100];
+    snprintf(key, sizeof(key), "%d.%d", t->id, i);
+    if (!t->state->db->Put(options, key, value).ok()) {
+      t->state->failed.Release_Store(t);
+    }
+  }
+  t->state->thread_done[t->id].Release_Store(t);
+}
+
+}  // namespace
+
+TEST(DBTest, SyncWritesShareLogSyncs) {
+  SlowSyncEnv env(Env::Default());
+  Options options = CurrentOptions();
+  options.env = &env;
+  options.create_if_missing = true;
+  // Small memtables so that log files are switched while syncs are pending.
+  options.write_buffer_size = 64 << 10;
+  DestroyAndReopen(&options);
+
+  SyncWriteState state;
+  state.db = db_;
+  state.failed.Release_Store(nullptr);
+  SyncWriteThread thread[kNumSyncWriters];
+  for (int id = 0; id < kNumSyncWriters; id++) {
+    state.thread_done[id].Release_Store(nullptr);
+    thread[id].state = &state;
+    thread[id].id = id;
+    env_->StartThread(SyncWriteThreadBody, &thread[id]);
+  }
+  for (int id = 0; id < kNumSyncWriters; id++) {
+    while (state.thread_done[id].Acquire_Load() == nullptr) {
+      DelayMilliseconds(10);
+    }
+  }
+  ASSERT_TRUE(state.failed.Acquire_Load() == nullptr);
+
+  // Concurrent sync writes are covered by shared syncs instead of one
+  // sync each.
+  const int sync_writes = kNumSyncWriters / 2 * kSyncWritesPerThread;
+  ASSERT_GT(env.syncs.load(), 0);
+  ASSERT_LT(env.syncs.load(), sync_writes);
+
+  Reopen(&options);
+  for (int id = 0; id < kNumSyncWriters; id++) {
+    for (int i = 0; i < kSyncWritesPerThread; i++) {
+      char key[100];
+      snprintf(key, sizeof(key), "%d.%d", id, i);
+      ASSERT_EQ(std::string(1000, static_cast<char>('a' + id)), Get(key));
+    }
+  }
+  Close();
+}
+
+namespace {
+
+static const int kNumSnapshotThreads = 8;
+
+struct SnapshotState {
+  DBTest* test;
+  port::AtomicPointer stop;
+  port::AtomicPointer thread_done[kNumSnapshotThreads];
+  port::AtomicPointer failed;
+};
+
+struct SnapshotThread {
+  SnapshotState* state;
+  int id;
+};
+
+static void SnapshotThreadBody(void* arg) {
+  SnapshotThread* t = reinterpret_cast<SnapshotThread*>(arg);
+  DB* db = t->state->test->db_;
+  while (t->state->stop.Acquire_Load() == nullptr) {
+    const Snapshot* snapshot = db->GetSnapshot();
+    ReadOptions options;
+    options.snapshot = snapshot;
+    std::string first, second;
+    Status s1 = db->Get(options, "foo", &first);
+    // Give the writer a chance to overwrite "foo" and compact the old
+    // value away; the snapshot must keep it visible regardless.
+    DelayMilliseconds(1);
+    Status s2 = db->Get(options, "foo", &second);
+    if (s1.ok() != s2.ok() || first != second) {
+      t->state->failed.Release_Store(t);
+    }
+    db->ReleaseSnapshot(snapshot);
+  }
+  t->state->thread_done[t->id].Release_Store(t);
+}
+
+}  // namespace
+
+TEST(DBTest, ConcurrentSnapshotsAcrossCompactions) {
+  SnapshotState state;
+  state.test = this;
+  state.stop.Release_Store(nullptr);
+  state.failed.Release_Store(nullptr);
+  SnapshotThread thread[kNumSnapshotThreads];
+  for (int id = 0; id < kNumSnapshotThreads; id++) {
+    state.thread_done[id].Release_Store(nullptr);
+    thread[id].state = &state;
+    thread[id].id = id;
+    env_->StartThread(SnapshotThreadBody, &thread[id]);
+  }
+
+  // Overwrite "foo" and compact while the threads take and release
+  // snapshots without holding the DB mutex.
+  char buf[20];
+  for (int i = 0; i < 100; i++) {
+    snprintf(buf, sizeof(buf), "%d", i);
+    ASSERT_OK(Put("foo", buf));
+    if (i % 10 == 0) {
+      ASSERT_OK(dbfull()->TEST_CompactMemTable());
+      dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+    }
+  }
+
+  state.stop.Release_Store(&state);
+  for (int id = 0; id < kNumSnapshotThreads; id++) {
+    while (state.thread_done[id].Acquire_Load() == nullptr) {
+      DelayMilliseconds(10);
+    }
+  }
+  ASSERT_TRUE(state.failed.Acquire_Load() == nullptr);
+  ASSERT_EQ("99", Get("foo"));
+}
+
 namespace {
 typedef std::map<std::string, std::string> KVMap;
 }
@@ -3,6 +3,7 @@
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
 #include <stdio.h>
+#include <string.h>
 #include "db/dbformat.h"
 #include "port/port.h"
 #include "util/coding.h"
@@ -78,6 +79,13 @@ int InternalKeyComparator::Compare(const Slice& akey, const Slice& bkey) const {
   return r;
 }
 
+bool IsBytewiseInternalKeyComparator(const Comparator* cmp) {
+  // Comparator 没有类型信息, 只能通过名字识别 InternalKeyComparator
+  return strcmp(cmp->Name(), "leveldb.InternalKeyComparator") == 0 &&
+         static_cast<const InternalKeyComparator*>(cmp)->user_comparator() ==
+             BytewiseComparator();
+}
+
 void InternalKeyComparator::FindShortestSeparator(
       std::string* start,
       const Slice& limit) const {
@@ -123,7 +131,7 @@ void InternalFilterPolicy::CreateFilter(const Slice* keys, int n,
   // (下面这个循环将 keys[] 中的 internal_key 全都替换为了 user_key). 
   Slice* mkey = const_cast<Slice*>(keys);
   for (int i = 0; i < n; i++) {
-    mkey[i] = ExtractUserKey(keys[i]);
+    mkey[i] = FilterKey(keys[i]);
     // TODO(sanjay): Suppress dups?
   }
   user_policy_->CreateFilter(keys, n, dst);
@@ -131,7 +139,7 @@ void InternalFilterPolicy::CreateFilter(const Slice* keys, int n,
 
 bool InternalFilterPolicy::KeyMayMatch(const Slice& key, const Slice& f) const {
   // 因为创建过滤策略的时候用的是 user_key, 所以这里查找前需要将 key 的 user_key 抽出来
-  return user_policy_->KeyMayMatch(ExtractUserKey(key), f);
+  return user_policy_->KeyMayMatch(FilterKey(key), f);
 }
 
 LookupKey::LookupKey(const Slice& user_key, SequenceNumber s) {
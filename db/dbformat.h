@@ -6,6 +6,7 @@
 #define STORAGE_LEVELDB_DB_DBFORMAT_H_
 
 #include <stdio.h>
+#include <string.h>
 #include "leveldb/comparator.h"
 #include "leveldb/db.h"
 #include "leveldb/filter_policy.h"
@@ -164,14 +165,70 @@ class InternalKeyComparator : public Comparator {
   int Compare(const InternalKey& a, const InternalKey& b) const;
 };
 
+// 如果 cmp 是一个 user comparator 为 BytewiseComparator() 的
+// InternalKeyComparator 则返回 true. 定长 key 模式下只有这种情况可以
+// 绕开 comparator 直接比较 key 的字节内容.
+bool IsBytewiseInternalKeyComparator(const Comparator* cmp);
+
+// 定长 key 模式(Options::fixed_key_length)下比较两个长度为 kUserKeyLength
+// 的 user key, 等价于 BytewiseComparator. 长度在编译期确定, 编译器可以将
+// memcmp 展开; 常见的 8 字节和 16 字节的 key 被特化为按大端序比较 uint64.
+template <size_t kUserKeyLength>
+inline int CompareFixedUserKeys(const char* a, const char* b) {
+  return memcmp(a, b, kUserKeyLength);
+}
+
+template <>
+inline int CompareFixedUserKeys<8>(const char* a, const char* b) {
+  const uint64_t x = DecodeBigEndian64(a);
+  const uint64_t y = DecodeBigEndian64(b);
+  return (x < y) ? -1 : (x > y);
+}
+
+template <>
+inline int CompareFixedUserKeys<16>(const char* a, const char* b) {
+  uint64_t x = DecodeBigEndian64(a);
+  uint64_t y = DecodeBigEndian64(b);
+  if (x == y) {
+    x = DecodeBigEndian64(a + 8);
+    y = DecodeBigEndian64(b + 8);
+  }
+  return (x < y) ? -1 : (x > y);
+}
+
+// 比较两个 user key 长度为 kUserKeyLength 的 internal key, 结果同
+// user comparator 为 BytewiseComparator() 的 InternalKeyComparator.
+template <size_t kUserKeyLength>
+inline int CompareFixedInternalKeys(const char* a, const char* b) {
+  int r = CompareFixedUserKeys<kUserKeyLength>(a, b);
+  if (r == 0) {
+    // user key 相同则序列号越大 internal key 越小
+    const uint64_t anum = DecodeFixed64(a + kUserKeyLength);
+    const uint64_t bnum = DecodeFixed64(b + kUserKeyLength);
+    r = (anum > bnum) ? -1 : (anum < bnum);
+  }
+  return r;
+}
+
 // Filter policy wrapper that converts from internal keys to user keys
 //
 // 一个 wrapper, 负责将 internal_key 转换为 user_key, 然后使用内部封装的用户定义的过滤器策略. 
+//
+// 如果 user key 带有时间戳(timestamp_size 不为 0), 会把时间戳也去掉, 这样
+// 同一个 key 的不同版本对应过滤器中的同一项, 按任意时间点查询都能命中.
 class InternalFilterPolicy : public FilterPolicy {
  private:
   const FilterPolicy* const user_policy_;
+  const size_t timestamp_size_;
+
+  Slice FilterKey(const Slice& internal_key) const {
+    Slice user_key = ExtractUserKey(internal_key);
+    return Slice(user_key.data(), user_key.size() - timestamp_size_);
+  }
  public:
-  explicit InternalFilterPolicy(const FilterPolicy* p) : user_policy_(p) { }
+  explicit InternalFilterPolicy(const FilterPolicy* p,
+                                size_t timestamp_size = 0)
+      : user_policy_(p), timestamp_size_(timestamp_size) { }
   virtual const char* Name() const;
   virtual void CreateFilter(const Slice* keys, int n, std::string* dst) const;
   virtual bool KeyMayMatch(const Slice& key, const Slice& filter) const;
@@ -266,6 +323,9 @@ class LookupKey {
   // 返回 internal_key 的 user_key 部分
   Slice user_key() const { return Slice(kstart_, end_ - kstart_ - 8); }
 
+  // 返回构造时传入的序列号
+  SequenceNumber sequence() const { return DecodeFixed64(end_ - 8) >> 8; }
+
  private:
   // We construct a char array of the form:
   //    klength  varint32               <-- start_ // internal_key 长度
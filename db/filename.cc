@@ -4,6 +4,7 @@
 
 #include <ctype.h>
 #include <stdio.h>
+#include <random>
 #include "db/filename.h"
 #include "db/dbformat.h"
 #include "leveldb/env.h"
@@ -72,12 +73,27 @@ std::string OldInfoLogFileName(const std::string& dbname) {
   return dbname + "/LOG.old";
 }
 
+std::string BlockCacheFileName(const std::string& dbname) {
+  return dbname + "/BLOCKCACHE";
+}
+
+std::string WalDirFileName(const std::string& dbname) {
+  return dbname + "/WALDIR";
+}
+
+std::string IdentityFileName(const std::string& dbname) {
+  return dbname + "/IDENTITY";
+}
+
 
 // 每个 leveldb 数据库目录的文件结构如下:
 //    dbname/CURRENT
 //    dbname/LOCK
 //    dbname/LOG
 //    dbname/LOG.old
+//    dbname/BLOCKCACHE
+//    dbname/WALDIR
+//    dbname/IDENTITY
 //    dbname/MANIFEST-[0-9]+
 //    dbname/[0-9]+.(log|sst|ldb)
 // 解析 filename, 将其中数字部分存储到 number 中
@@ -97,6 +113,15 @@ bool ParseFileName(const std::string& filename,
   } else if (rest == "LOG" || rest == "LOG.old") {
     *number = 0;
     *type = kInfoLogFile;
+  } else if (rest == "BLOCKCACHE") {
+    *number = 0;
+    *type = kBlockCacheFile;
+  } else if (rest == "WALDIR") {
+    *number = 0;
+    *type = kWalDirFile;
+  } else if (rest == "IDENTITY") {
+    *number = 0;
+    *type = kIdentityFile;
   } else if (rest.starts_with("MANIFEST-")) {
     rest.remove_prefix(strlen("MANIFEST-"));
     uint64_t num;
@@ -151,4 +176,70 @@ Status SetCurrentFile(Env* env, const std::string& dbname,
   return s;
 }
 
+Status SetWalDirFile(Env* env, const std::string& dbname,
+                     const std::string& wal_dir) {
+  const std::string fname = WalDirFileName(dbname);
+  if (wal_dir == dbname) {
+    Status s = env->DeleteFile(fname);
+    return (s.ok() || !env->FileExists(fname)) ? Status::OK() : s;
+  }
+  // 和 CURRENT 一样先写临时文件再重命名, 这样该文件要么是旧的内容要么是新的内容
+  std::string tmp = fname + ".dbtmp";
+  Status s = WriteStringToFileSync(env, wal_dir + "\n", tmp);
+  if (s.ok()) {
+    s = env->RenameFile(tmp, fname);
+  }
+  if (!s.ok()) {
+    env->DeleteFile(tmp);
+  }
+  return s;
+}
+
+Status ReadWalDirFile(Env* env, const std::string& dbname,
+                      std::string* wal_dir) {
+  const std::string fname = WalDirFileName(dbname);
+  if (!env->FileExists(fname)) {
+    *wal_dir = dbname;
+    return Status::OK();
+  }
+  Status s = ReadFileToString(env, fname, wal_dir);
+  if (s.ok()) {
+    if (wal_dir->empty() || (*wal_dir)[wal_dir->size() - 1] != '\n') {
+      return Status::Corruption("WALDIR file does not end with newline");
+    }
+    wal_dir->resize(wal_dir->size() - 1);
+  }
+  return s;
+}
+
+Status SetIdentityFile(Env* env, const std::string& dbname, uint64_t* id) {
+  // 时间和随机数混在一起, 即使 random_device 退化成确定性的实现,
+  // 不同时间创建的数据库也能得到不同的标识.
+  std::random_device rd;
+  *id = ((static_cast<uint64_t>(rd()) << 32) | rd()) ^ env->NowMicros();
+  const std::string fname = IdentityFileName(dbname);
+  std::string tmp = fname + ".dbtmp";
+  Status s = WriteStringToFileSync(env, NumberToString(*id) + "\n", tmp);
+  if (s.ok()) {
+    s = env->RenameFile(tmp, fname);
+  }
+  if (!s.ok()) {
+    env->DeleteFile(tmp);
+  }
+  return s;
+}
+
+Status ReadIdentityFile(Env* env, const std::string& dbname, uint64_t* id) {
+  std::string contents;
+  Status s = ReadFileToString(env, IdentityFileName(dbname), &contents);
+  if (!s.ok()) {
+    return s;
+  }
+  Slice input(contents);
+  if (!ConsumeDecimalNumber(&input, id) || input != Slice("\n")) {
+    return Status::Corruption("malformed IDENTITY file");
+  }
+  return Status::OK();
+}
+
 }  // namespace leveldb
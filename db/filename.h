@@ -25,7 +25,10 @@ enum FileType {
   kDescriptorFile,
   kCurrentFile,
   kTempFile,
-  kInfoLogFile  // Either the current one, or an old one
+  kInfoLogFile,  // Either the current one, or an old one
+  kBlockCacheFile,  // 关闭时记录的 block_cache 内容, 见 Options::persist_block_cache
+  kWalDirFile,  // 记录 log 文件所在目录, 见 Options::wal_dir
+  kIdentityFile  // 数据库的唯一标识, 见 Options::persistent_cache
 };
 
 // Return the name of the log file with the specified number
@@ -73,6 +76,19 @@ std::string InfoLogFileName(const std::string& dbname);
 // Return the name of the old info log file for "dbname".
 std::string OldInfoLogFileName(const std::string& dbname);
 
+// Return the name of the file that lists the blocks cached for "dbname".
+// 返回关闭数据库时记录 block_cache 中缓存了哪些 block 的文件的名字.
+std::string BlockCacheFileName(const std::string& dbname);
+
+// Return the name of the file recording where "dbname" keeps its logs.
+// 返回记录 log 文件所在目录(Options::wal_dir)的文件的名字. log 文件就在
+// 数据库目录下时不存在该文件.
+std::string WalDirFileName(const std::string& dbname);
+
+// Return the name of the file holding the unique id of "dbname".
+// 返回保存数据库唯一标识的文件的名字.
+std::string IdentityFileName(const std::string& dbname);
+
 // 每个 leveldb 数据库目录的文件结构如下:
 //    dbname/CURRENT
 //    dbname/LOCK
@@ -92,6 +108,22 @@ bool ParseFileName(const std::string& filename,
 Status SetCurrentFile(Env* env, const std::string& dbname,
                       uint64_t descriptor_number);
 
+// 将 wal_dir 记录到 WALDIR 文件中; wal_dir 就是 dbname 时删除该文件.
+Status SetWalDirFile(Env* env, const std::string& dbname,
+                     const std::string& wal_dir);
+
+// 读取 WALDIR 文件记录的 log 目录存储到 *wal_dir 中, 文件不存在时为 dbname.
+Status ReadWalDirFile(Env* env, const std::string& dbname,
+                      std::string* wal_dir);
+
+// 为数据库生成一个新的随机标识写入 IDENTITY 文件, 并存储到 *id 中.
+// 数据库被销毁重建或者修复之后标识都会改变, persistent_cache 据此
+// 区分不同数据库中编号相同的 sstable 文件.
+Status SetIdentityFile(Env* env, const std::string& dbname, uint64_t* id);
+
+// 读取 IDENTITY 文件记录的标识存储到 *id 中.
+Status ReadIdentityFile(Env* env, const std::string& dbname, uint64_t* id);
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_DB_FILENAME_H_
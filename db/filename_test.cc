@@ -34,6 +34,9 @@ TEST(FileNameTest, Parse) {
     { "MANIFEST-7",         7,     kDescriptorFile },
     { "LOG",                0,     kInfoLogFile },
     { "LOG.old",            0,     kInfoLogFile },
+    { "BLOCKCACHE",         0,     kBlockCacheFile },
+    { "WALDIR",             0,     kWalDirFile },
+    { "IDENTITY",           0,     kIdentityFile },
     { "18446744073709551615.log", 18446744073709551615ull, kLogFile },
   };
   for (int i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
@@ -126,6 +129,24 @@ TEST(FileNameTest, Construction) {
   ASSERT_TRUE(ParseFileName(fname.c_str() + 4, &number, &type));
   ASSERT_EQ(0, number);
   ASSERT_EQ(kInfoLogFile, type);
+
+  fname = BlockCacheFileName("foo");
+  ASSERT_EQ("foo/", std::string(fname.data(), 4));
+  ASSERT_TRUE(ParseFileName(fname.c_str() + 4, &number, &type));
+  ASSERT_EQ(0, number);
+  ASSERT_EQ(kBlockCacheFile, type);
+
+  fname = WalDirFileName("foo");
+  ASSERT_EQ("foo/", std::string(fname.data(), 4));
+  ASSERT_TRUE(ParseFileName(fname.c_str() + 4, &number, &type));
+  ASSERT_EQ(0, number);
+  ASSERT_EQ(kWalDirFile, type);
+
+  fname = IdentityFileName("foo");
+  ASSERT_EQ("foo/", std::string(fname.data(), 4));
+  ASSERT_TRUE(ParseFileName(fname.c_str() + 4, &number, &type));
+  ASSERT_EQ(0, number);
+  ASSERT_EQ(kIdentityFile, type);
 }
 
 }  // namespace leveldb
@@ -20,10 +20,14 @@ static Slice GetLengthPrefixedSlice(const char* data) {
   return Slice(p, len); // 拷贝构造, 不过还好, 都是指针和内置类型拷贝. 
 }
 
-MemTable::MemTable(const InternalKeyComparator& cmp)
-    : comparator_(cmp),
+MemTable::MemTable(const InternalKeyComparator& cmp, size_t fixed_key_length)
+    : comparator_(cmp,
+                  (fixed_key_length > 0 &&
+                   cmp.user_comparator() == BytewiseComparator())
+                      ? fixed_key_length + 8 : 0),
       refs_(0),
-      table_(comparator_, &arena_) {
+      table_(comparator_, &arena_),
+      num_entries_(0) {
 }
 
 MemTable::~MemTable() {
@@ -32,8 +36,26 @@ MemTable::~MemTable() {
 
 size_t MemTable::ApproximateMemoryUsage() { return arena_.MemoryUsage(); }
 
+Slice MemTable::KeyComparator::Key(const char* entry) const {
+  return (key_width == 0) ? GetLengthPrefixedSlice(entry)
+                          : Slice(entry, key_width);
+}
+
 int MemTable::KeyComparator::operator()(const char* aptr, const char* bptr)
     const {
+  switch (key_width) {
+    case 0:
+      break;
+    // 定长 key 直接比较字节内容, 常见的 8 字节和 16 字节 user key
+    // 使用编译期特化的比较函数
+    case 16 + 8:
+      return CompareFixedInternalKeys<16>(aptr, bptr);
+    case 8 + 8:
+      return CompareFixedInternalKeys<8>(aptr, bptr);
+    default:
+      return comparator.Compare(Slice(aptr, key_width),
+                                Slice(bptr, key_width));
+  }
   // Internal keys are encoded as length-prefixed strings.
   // 获取数据项的前半部分, 即 internal_key
   Slice a = GetLengthPrefixedSlice(aptr);
@@ -54,28 +76,64 @@ static const char* EncodeKey(std::string* scratch, const Slice& target) {
   return scratch->data();
 }
 
+// 定长 key 模式下为 target 构造一个长度为 key_width 的 internal key,
+// 在 memtable 中 Seek 它和 Seek target 的结果相同.
+// 仅适用于 user comparator 为 BytewiseComparator() 的情况.
+static const char* EncodeFixedKey(std::string* scratch, const Slice& target,
+                                  size_t key_width) {
+  if (target.size() == key_width) {
+    return target.data();
+  }
+  const size_t user_key_length = key_width - 8;
+  Slice user_key = ExtractUserKey(target);
+  scratch->clear();
+  if (user_key.size() < user_key_length) {
+    // 末尾补 0 得到不小于 user_key 的最小定长 key. 序列号取最大值,
+    // 使其排在该 key 的全部数据项之前.
+    scratch->append(user_key.data(), user_key.size());
+    scratch->append(user_key_length - user_key.size(), '\0');
+    PutFixed64(scratch, (kMaxSequenceNumber << 8) | kValueTypeForSeek);
+  } else {
+    // 截断后的 key 小于 user_key. 序列号取 0(memtable 中的序列号都大于 0),
+    // 使其排在该 key 的全部数据项之后.
+    scratch->append(user_key.data(), user_key_length);
+    PutFixed64(scratch, 0);
+  }
+  return scratch->data();
+}
+
 // 一个 wrapper, 内部封装了一个干活的 skiplist::iterator
 class MemTableIterator: public Iterator {
  public:
-  explicit MemTableIterator(MemTable::Table* table) : iter_(table) { }
+  MemTableIterator(MemTable::Table* table,
+                   const MemTable::KeyComparator* comparator)
+      : iter_(table), comparator_(comparator) { }
 
   virtual bool Valid() const { return iter_.Valid(); }
-  virtual void Seek(const Slice& k) { iter_.Seek(EncodeKey(&tmp_, k)); }
+  virtual void Seek(const Slice& k) {
+    const size_t key_width = comparator_->key_width;
+    iter_.Seek(key_width == 0 ? EncodeKey(&tmp_, k)
+                              : EncodeFixedKey(&tmp_, k, key_width));
+  }
   virtual void SeekToFirst() { iter_.SeekToFirst(); }
   virtual void SeekToLast() { iter_.SeekToLast(); }
   virtual void Next() { iter_.Next(); }
   virtual void Prev() { iter_.Prev(); }
-  virtual Slice key() const { return GetLengthPrefixedSlice(iter_.key()); }
+  virtual Slice key() const { return comparator_->Key(iter_.key()); }
   virtual Slice value() const {
-    Slice key_slice = GetLengthPrefixedSlice(iter_.key());
+    Slice key_slice = comparator_->Key(iter_.key());
     return GetLengthPrefixedSlice(key_slice.data() + key_slice.size());
   }
 
   // 该迭代器默认返回 OK
   virtual Status status() const { return Status::OK(); }
 
+  // value 存储在 memtable 的 arena 中, memtable 销毁之前一直有效
+  virtual bool IsValuePinned() const { return true; }
+
  private:
   MemTable::Table::Iterator iter_;
+  const MemTable::KeyComparator* const comparator_;
   // 用于 EncodeKey 方法存储编码后的 internal_key
   std::string tmp_;       // For passing to EncodeKey
 
@@ -84,8 +142,28 @@ class MemTableIterator: public Iterator {
   void operator=(const MemTableIterator&);
 };
 
+void MemTable::ApproximateStats(const Slice& start, const Slice& limit,
+                                uint64_t* entries, uint64_t* bytes) {
+  const size_t key_width = comparator_.key_width;
+  std::string scratch;
+  const uint64_t start_count = table_.EstimateCount(
+      key_width == 0 ? EncodeKey(&scratch, start)
+                     : EncodeFixedKey(&scratch, start, key_width));
+  const uint64_t limit_count = table_.EstimateCount(
+      key_width == 0 ? EncodeKey(&scratch, limit)
+                     : EncodeFixedKey(&scratch, limit, key_width));
+  *entries = limit_count > start_count ? limit_count - start_count : 0;
+  // 估计值可能超过实际的数据项个数
+  const uint64_t total = num_entries_.load(std::memory_order_relaxed);
+  if (*entries > total) {
+    *entries = total;
+  }
+  *bytes = (total == 0) ? 0 : static_cast<uint64_t>(
+      static_cast<double>(ApproximateMemoryUsage()) * *entries / total);
+}
+
 Iterator* MemTable::NewIterator() {
-  return new MemTableIterator(&table_);
+  return new MemTableIterator(&table_, &comparator_);
 }
 
 void MemTable::Add(SequenceNumber s, ValueType type,
@@ -99,18 +177,21 @@ void MemTable::Add(SequenceNumber s, ValueType type,
   //  序列号 + 操作类型, 
   //  varint32 类型的 value_size, 
   //  value]
-  // 其中, internal_key_size = user_key size + 8
+  // 其中, internal_key_size = user_key size + 8.
+  // 定长 key 模式下省去 internal_key_size.
   size_t key_size = key.size();
   size_t val_size = value.size();
   size_t internal_key_size = key_size + 8;
+  const bool fixed_width = (comparator_.key_width != 0);
+  assert(!fixed_width || internal_key_size == comparator_.key_width);
   // 编码后的数据项总长度
   const size_t encoded_len =
-      VarintLength(internal_key_size) + internal_key_size +
-      VarintLength(val_size) + val_size; 
+      (fixed_width ? 0 : VarintLength(internal_key_size)) +
+      internal_key_size + VarintLength(val_size) + val_size;
   // 分配用来存储数据项的内存    
   char* buf = arena_.Allocate(encoded_len); 
   // 将编码为 varint32 格式的 internal_key_size 写入内存
-  char* p = EncodeVarint32(buf, internal_key_size); 
+  char* p = fixed_width ? buf : EncodeVarint32(buf, internal_key_size);
   // 将 user_key 写入内存
   memcpy(p, key.data(), key_size); 
   p += key_size;
@@ -126,6 +207,8 @@ void MemTable::Add(SequenceNumber s, ValueType type,
   assert(p + val_size == buf + encoded_len);
   // 将数据项插入跳跃表
   table_.Insert(buf); 
+  num_entries_.store(num_entries_.load(std::memory_order_relaxed) + 1,
+                     std::memory_order_relaxed);
 }
 
 bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
@@ -136,6 +219,13 @@ bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
   // MemTable 每个 key 的序列号. 外部具体实现是采用 DB 记录的最大
   // 序列号.
   Slice memkey = key.memtable_key();
+  if (comparator_.key_width != 0) {
+    // 定长 key 模式下长度不符的 key 肯定不存在
+    if (key.internal_key().size() != comparator_.key_width) {
+      return false;
+    }
+    memkey = key.internal_key();
+  }
   // 为底层的 skiplist 创建一个临时的迭代器
   Table::Iterator iter(&table_);
   // 返回第一个大于等于 memkey 的数据项(数据项在 iter 内部存着),
@@ -145,7 +235,7 @@ bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
   // 序列号最大的那个 key 肯定是第一个.
   iter.Seek(memkey.data()); 
   // iter 指向有效 node, 即 node 不为 nullptr
-  if (iter.Valid()) { 
+  while (iter.Valid()) { 
     // 每个数据项格式如下:
     //    klength  varint32
     //    userkey  char[klength-8] // 源码注释这里有误, 应该是 klength - 8
@@ -160,18 +250,28 @@ bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
     // 注意, memtable 将底层的 SkipList 的 key(确切应该说是数据项)
     // 声明为了 char* 类型. 这里的 entry 是 SkipList.Node 里包含的整个数据项. 
     const char* entry = iter.key();
-    uint32_t key_length;
     // 解析 internal_key 长度
-    const char* key_ptr = GetVarint32Ptr(entry, entry+5, &key_length); 
+    Slice internal_key = comparator_.Key(entry);
+    const char* key_ptr = internal_key.data();
+    const uint32_t key_length = internal_key.size();
     // 比较 user_key. 
     // 因为 internal_key 包含了 tag 所以任意两个 internal_key 
     // 肯定是不一样的, 而我们真正在意的是 user_key, 
     // 所以这里调用 user_comparator 比较 user_key. 
-    if (comparator_.comparator.user_comparator()->Compare(
+    // 如果 user_key 带有时间戳, 定位到的是时间戳不晚于查询时间点的版本,
+    // 只需比较去掉时间戳的部分.
+    if (comparator_.comparator.user_comparator()->CompareWithoutTimestamp(
             Slice(key_ptr, key_length - 8),
             key.user_key()) == 0) {
       // 解析 tag, 包含 7 字节序列号和 1 字节操作类型(新增/删除)
       const uint64_t tag = DecodeFixed64(key_ptr + key_length - 8);
+      // 带时间戳时, Seek() 只跳过了和查询时间戳相同且序列号更大的版本,
+      // 时间戳更早的版本序列号可能比快照还大, 对快照不可见, 要继续往后找.
+      // 不带时间戳时 Seek() 已经跳过了全部这样的版本, 这里不会成立.
+      if ((tag >> 8) > key.sequence()) {
+        iter.Next();
+        continue;
+      }
       // 解析 tag 中的 ValueType. 
       // leveldb 删除某个 user_key 的时候不是通过一个插入墓碑消息实现的吗? 
       // 那怎么确保在 SkipList.Seek() 时候返回删除操作对应的数据项, 
@@ -195,6 +295,7 @@ bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
           return true;
       }
     }
+    break;
   }
   return false;
 }
@@ -5,6 +5,7 @@
 #ifndef STORAGE_LEVELDB_DB_MEMTABLE_H_
 #define STORAGE_LEVELDB_DB_MEMTABLE_H_
 
+#include <atomic>
 #include <string>
 #include "leveldb/db.h"
 #include "db/dbformat.h"
@@ -28,7 +29,12 @@ class MemTable {
   //
   // MemTable 是基于引用计数的, 每个 MemTable 实例初始引用计数为 0, 调用者必须
   // 至少调用一次 Ref() 方法. 
-  explicit MemTable(const InternalKeyComparator& comparator);
+  //
+  // fixed_key_length 不为 0 且 user comparator 为 BytewiseComparator() 时,
+  // 全部 user key 长度都必须等于该值, 此时数据项不再保存 key 的长度前缀,
+  // 比较时也直接比较 key 的字节内容.
+  explicit MemTable(const InternalKeyComparator& comparator,
+                    size_t fixed_key_length = 0);
 
   // Increase reference count.
   //
@@ -53,6 +59,12 @@ class MemTable {
   // 当 memtable 被修改时调用该方法也是安全的, 该方法底层实现直接用的 arena_ 持有内存的字节数. 
   size_t ApproximateMemoryUsage();
 
+  // 估计 internal key 位于 [start, limit) 的数据项个数(*entries)以及它们占用
+  // 的内存字节数(*bytes). 数据项个数由 skiplist 的索引层估计, 字节数按数据项
+  // 个数占比分摊 ApproximateMemoryUsage(). 可以与 Add 并发调用.
+  void ApproximateStats(const Slice& start, const Slice& limit,
+                        uint64_t* entries, uint64_t* bytes);
+
   // Return an iterator that yields the contents of the memtable.
   //
   // The caller must ensure that the underlying MemTable remains live
@@ -98,7 +110,12 @@ class MemTable {
   // 的 key 类型就是 char*, 而类 KeyComparator 对象会被传给 SkipList 作为 key 比较器. 
   struct KeyComparator {
     const InternalKeyComparator comparator;
-    explicit KeyComparator(const InternalKeyComparator& c) : comparator(c) { }
+    // 定长 internal key 的长度, 为 0 表示数据项的 internal key 带有长度前缀
+    const size_t key_width;
+    KeyComparator(const InternalKeyComparator& c, size_t w)
+        : comparator(c), key_width(w) { }
+    // 返回数据项 entry 的 internal key
+    Slice Key(const char* entry) const;
     // 注意, 这个操作符重载方法很关键, 该方法的会先从 char* 类型地址获取 internal_key, 
     // 然后对 internal_key 进行比较. 
     // 该方法未在 memtable 直接调用, 而是被底层的 SkipList 使用了.
@@ -117,6 +134,8 @@ class MemTable {
   Arena arena_;
   // SkipList, 存储 memtable 里的数据
   Table table_;
+  // 已经插入的数据项个数, Add 更新, 其它线程可能并发读取
+  std::atomic<uint64_t> num_entries_;
 
   // No copying allowed 
   // 不允许拷贝和赋值 memtable 实例, 只能通过增加引用计数复用
@@ -0,0 +1,220 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/optimistic_transaction_db.h"
+
+#include <map>
+#include <string>
+
+#include "db/db_impl.h"
+#include "db/dbformat.h"
+#include "db/snapshot.h"
+#include "leveldb/write_batch_with_index.h"
+
+namespace leveldb {
+
+namespace {
+
+// 事务记录的 key 以及记录时数据库的序列号.
+// 同一个 key 被记录多次时保留最小的序列号.
+typedef std::map<std::string, SequenceNumber> TrackedKeys;
+
+// 提交时在写入队列队首检查记录的 key 是否被修改过.
+class ConflictChecker : public WriteCallback {
+ public:
+  explicit ConflictChecker(const TrackedKeys* keys) : keys_(keys) { }
+
+  virtual Status Callback(DBImpl* db) {
+    for (TrackedKeys::const_iterator iter = keys_->begin();
+         iter != keys_->end(); ++iter) {
+      SequenceNumber latest;
+      bool found;
+      SequenceNumber compacted;
+      Status s = db->GetLatestSequenceForKey(iter->first, &latest, &found,
+                                             &compacted);
+      if (!s.ok()) {
+        return s;
+      }
+      // key 最新一次写入的序列号比记录时的大, 说明记录之后它被修改过.
+      if (found && latest > iter->second) {
+        return Status::Busy("write conflict", iter->first);
+      }
+      // 记录之后的写入可能已经和删除标记一起被压实丢弃了, 无法判断是否冲突,
+      // 只能按冲突处理.
+      if (!found && compacted > iter->second) {
+        return Status::Busy("history compacted, cannot check write conflict",
+                            iter->first);
+      }
+    }
+    return Status::OK();
+  }
+
+ private:
+  const TrackedKeys* keys_;
+};
+
+class OptimisticTransactionImpl : public Transaction {
+ public:
+  OptimisticTransactionImpl(DBImpl* db, const Comparator* comparator,
+                            const WriteOptions& write_options,
+                            const OptimisticTransactionOptions& txn_options)
+      : db_(db),
+        write_options_(write_options),
+        txn_options_(txn_options),
+        snapshot_(nullptr),
+        batch_(comparator) {
+    Begin();
+  }
+
+  virtual ~OptimisticTransactionImpl() {
+    Clear();
+  }
+
+  virtual Status Get(const ReadOptions& options,
+                     const Slice& key, std::string* value) {
+    ReadOptions read_options = options;
+    const Snapshot* snapshot = nullptr;
+    if (read_options.snapshot == nullptr) {
+      if (snapshot_ != nullptr) {
+        read_options.snapshot = snapshot_;
+      } else {
+        // 用一个临时快照固定读取时的序列号, 这样记录的序列号和读到的数据一致.
+        snapshot = db_->GetSnapshot();
+        read_options.snapshot = snapshot;
+      }
+    }
+    // 本事务自己写过的 key 直接返回 batch 中的结果
+    Status s = batch_.GetFromBatchAndDB(db_, read_options, key, value);
+    TrackKey(key, SequenceOf(read_options.snapshot));
+    if (snapshot != nullptr) {
+      db_->ReleaseSnapshot(snapshot);
+    }
+    return s;
+  }
+
+  // 读到的 key 都会被记录并在提交时检查, 所以和 Get 没有区别.
+  virtual Status GetForUpdate(const ReadOptions& options,
+                              const Slice& key, std::string* value) {
+    return Get(options, key, value);
+  }
+
+  virtual Status Put(const Slice& key, const Slice& value) {
+    TrackKey(key, CurrentSequence());
+    batch_.Put(key, value);
+    return Status::OK();
+  }
+
+  virtual Status Delete(const Slice& key) {
+    TrackKey(key, CurrentSequence());
+    batch_.Delete(key);
+    return Status::OK();
+  }
+
+  virtual Status Commit() {
+    Status s;
+    if (!tracked_.empty()) {
+      ConflictChecker checker(&tracked_);
+      s = db_->WriteWithCallback(write_options_, batch_.GetWriteBatch(),
+                                 &checker);
+    }
+    Clear();
+    Begin();
+    return s;
+  }
+
+  virtual void Rollback() {
+    Clear();
+    Begin();
+  }
+
+ private:
+  static SequenceNumber SequenceOf(const Snapshot* snapshot) {
+    return static_cast<const SnapshotImpl*>(snapshot)->sequence_number();
+  }
+
+  // 写操作记录的序列号: 设置了快照则为快照的序列号, 否则为数据库当前最新的序列号.
+  SequenceNumber CurrentSequence() {
+    if (snapshot_ != nullptr) {
+      return SequenceOf(snapshot_);
+    }
+    const Snapshot* snapshot = db_->GetSnapshot();
+    SequenceNumber sequence = SequenceOf(snapshot);
+    db_->ReleaseSnapshot(snapshot);
+    return sequence;
+  }
+
+  void TrackKey(const Slice& key, SequenceNumber sequence) {
+    std::pair<TrackedKeys::iterator, bool> r =
+        tracked_.insert(std::make_pair(key.ToString(), sequence));
+    if (!r.second && sequence < r.first->second) {
+      r.first->second = sequence;
+    }
+  }
+
+  void Begin() {
+    if (txn_options_.set_snapshot) {
+      snapshot_ = db_->GetSnapshot();
+    }
+  }
+
+  void Clear() {
+    if (snapshot_ != nullptr) {
+      db_->ReleaseSnapshot(snapshot_);
+      snapshot_ = nullptr;
+    }
+    batch_.Clear();
+    tracked_.clear();
+  }
+
+  DBImpl* const db_;
+  const WriteOptions write_options_;
+  const OptimisticTransactionOptions txn_options_;
+  const Snapshot* snapshot_;
+  WriteBatchWithIndex batch_;
+  TrackedKeys tracked_;
+};
+
+class OptimisticTransactionDBImpl : public OptimisticTransactionDB {
+ public:
+  OptimisticTransactionDBImpl(DB* db, const Comparator* comparator)
+      : db_(db), comparator_(comparator) { }
+
+  virtual ~OptimisticTransactionDBImpl() {
+    delete db_;
+  }
+
+  virtual Transaction* BeginTransaction(
+      const WriteOptions& write_options,
+      const OptimisticTransactionOptions& txn_options) {
+    return new OptimisticTransactionImpl(static_cast<DBImpl*>(db_),
+                                         comparator_, write_options,
+                                         txn_options);
+  }
+
+  virtual DB* GetBaseDB() { return db_; }
+
+ private:
+  DB* const db_;
+  const Comparator* const comparator_;
+};
+
+}  // anonymous namespace
+
+Transaction::~Transaction() { }
+
+OptimisticTransactionDB::~OptimisticTransactionDB() { }
+
+Status OptimisticTransactionDB::Open(const Options& options,
+                                     const std::string& name,
+                                     OptimisticTransactionDB** dbptr) {
+  *dbptr = nullptr;
+  DB* db;
+  Status s = DB::Open(options, name, &db);
+  if (s.ok()) {
+    *dbptr = new OptimisticTransactionDBImpl(db, options.comparator);
+  }
+  return s;
+}
+
+}  // namespace leveldb
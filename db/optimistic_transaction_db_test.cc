@@ -0,0 +1,277 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/optimistic_transaction_db.h"
+
+#include <stdlib.h>
+
+#include "db/db_impl.h"
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "util/mutexlock.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+class OptimisticTransactionDBTest {
+ public:
+  std::string dbname_;
+  Options options_;
+  OptimisticTransactionDB* txn_db_;
+  DB* db_;
+
+  OptimisticTransactionDBTest() {
+    dbname_ = test::TmpDir() + "/optimistic_transaction_db_test";
+    DestroyDB(dbname_, Options());
+    options_.create_if_missing = true;
+    ASSERT_OK(OptimisticTransactionDB::Open(options_, dbname_, &txn_db_));
+    db_ = txn_db_->GetBaseDB();
+  }
+
+  ~OptimisticTransactionDBTest() {
+    delete txn_db_;
+    DestroyDB(dbname_, Options());
+  }
+
+  std::string Get(const std::string& k) {
+    std::string result;
+    Status s = db_->Get(ReadOptions(), k, &result);
+    if (s.IsNotFound()) {
+      result = "NOT_FOUND";
+    } else if (!s.ok()) {
+      result = s.ToString();
+    }
+    return result;
+  }
+
+  // Pushes all data down to the bottom level, dropping obsolete entries.
+  void CompactAll() {
+    DBImpl* dbi = reinterpret_cast<DBImpl*>(db_);
+    ASSERT_OK(dbi->TEST_CompactMemTable());
+    for (int level = 0; level < config::kNumLevels - 1; level++) {
+      dbi->TEST_CompactRange(level, nullptr, nullptr);
+    }
+  }
+
+  std::string Get(Transaction* txn, const std::string& k) {
+    std::string result;
+    Status s = txn->Get(ReadOptions(), k, &result);
+    if (s.IsNotFound()) {
+      result = "NOT_FOUND";
+    } else if (!s.ok()) {
+      result = s.ToString();
+    }
+    return result;
+  }
+};
+
+TEST(OptimisticTransactionDBTest, CommitAndReadYourWrites) {
+  ASSERT_OK(db_->Put(WriteOptions(), "a", "va"));
+  Transaction* txn = txn_db_->BeginTransaction(WriteOptions());
+  ASSERT_EQ("va", Get(txn, "a"));
+  ASSERT_OK(txn->Put("a", "va2"));
+  ASSERT_OK(txn->Put("b", "vb"));
+  ASSERT_OK(txn->Delete("c"));
+  ASSERT_EQ("va2", Get(txn, "a"));
+  ASSERT_EQ("vb", Get(txn, "b"));
+  ASSERT_EQ("NOT_FOUND", Get(txn, "c"));
+  // Buffered writes are not visible outside the transaction.
+  ASSERT_EQ("va", Get("a"));
+  ASSERT_EQ("NOT_FOUND", Get("b"));
+  ASSERT_OK(txn->Commit());
+  ASSERT_EQ("va2", Get("a"));
+  ASSERT_EQ("vb", Get("b"));
+  delete txn;
+}
+
+TEST(OptimisticTransactionDBTest, Rollback) {
+  Transaction* txn = txn_db_->BeginTransaction(WriteOptions());
+  ASSERT_OK(txn->Put("a", "va"));
+  txn->Rollback();
+  ASSERT_OK(txn->Commit());
+  ASSERT_EQ("NOT_FOUND", Get("a"));
+  delete txn;
+}
+
+TEST(OptimisticTransactionDBTest, ConflictOnReadKey) {
+  ASSERT_OK(db_->Put(WriteOptions(), "a", "v1"));
+  Transaction* txn = txn_db_->BeginTransaction(WriteOptions());
+  ASSERT_EQ("v1", Get(txn, "a"));
+  ASSERT_OK(db_->Put(WriteOptions(), "a", "v2"));
+  ASSERT_OK(txn->Put("b", "vb"));
+  Status s = txn->Commit();
+  ASSERT_TRUE(s.IsBusy());
+  ASSERT_EQ("v2", Get("a"));
+  ASSERT_EQ("NOT_FOUND", Get("b"));
+
+  // The transaction was reset by the failed commit and can be retried.
+  ASSERT_EQ("v2", Get(txn, "a"));
+  ASSERT_OK(txn->Put("b", "vb"));
+  ASSERT_OK(txn->Commit());
+  ASSERT_EQ("vb", Get("b"));
+  delete txn;
+}
+
+TEST(OptimisticTransactionDBTest, ConflictOnWrittenKey) {
+  Transaction* txn1 = txn_db_->BeginTransaction(WriteOptions());
+  Transaction* txn2 = txn_db_->BeginTransaction(WriteOptions());
+  ASSERT_OK(txn1->Put("a", "1"));
+  ASSERT_OK(txn2->Put("a", "2"));
+  ASSERT_OK(txn2->Commit());
+  ASSERT_TRUE(txn1->Commit().IsBusy());
+  ASSERT_EQ("2", Get("a"));
+  delete txn1;
+  delete txn2;
+}
+
+TEST(OptimisticTransactionDBTest, NoConflictOnOtherKeys) {
+  Transaction* txn = txn_db_->BeginTransaction(WriteOptions());
+  ASSERT_EQ("NOT_FOUND", Get(txn, "a"));
+  ASSERT_OK(db_->Put(WriteOptions(), "b", "vb"));
+  ASSERT_OK(db_->Delete(WriteOptions(), "c"));
+  ASSERT_OK(txn->Put("a", "va"));
+  ASSERT_OK(txn->Commit());
+  ASSERT_EQ("va", Get("a"));
+  delete txn;
+}
+
+TEST(OptimisticTransactionDBTest, ConflictAfterMemTableFlush) {
+  ASSERT_OK(db_->Put(WriteOptions(), "a", "v1"));
+  Transaction* txn = txn_db_->BeginTransaction(WriteOptions());
+  ASSERT_EQ("v1", Get(txn, "a"));
+  ASSERT_OK(db_->Put(WriteOptions(), "a", "v2"));
+  // Move the conflicting write out of the memtable so that it has to be
+  // found in a table file.
+  ASSERT_OK(reinterpret_cast<DBImpl*>(db_)->TEST_CompactMemTable());
+  ASSERT_OK(txn->Put("a", "v3"));
+  ASSERT_TRUE(txn->Commit().IsBusy());
+  ASSERT_EQ("v2", Get("a"));
+
+  // Without a conflicting write the flushed key does not block the commit.
+  ASSERT_EQ("v2", Get(txn, "a"));
+  ASSERT_OK(txn->Put("a", "v3"));
+  ASSERT_OK(txn->Commit());
+  ASSERT_EQ("v3", Get("a"));
+  delete txn;
+}
+
+TEST(OptimisticTransactionDBTest, ConflictAfterDeletionCompacted) {
+  Transaction* txn = txn_db_->BeginTransaction(WriteOptions());
+  ASSERT_EQ("NOT_FOUND", Get(txn, "a"));
+  // Write and delete the key, then compact away every trace of it.
+  ASSERT_OK(db_->Put(WriteOptions(), "a", "v1"));
+  ASSERT_OK(db_->Delete(WriteOptions(), "a"));
+  CompactAll();
+  ASSERT_OK(txn->Put("a", "v2"));
+  ASSERT_TRUE(txn->Commit().IsBusy());
+  ASSERT_EQ("NOT_FOUND", Get("a"));
+
+  // Keys read after the compaction can be checked again.
+  ASSERT_EQ("NOT_FOUND", Get(txn, "a"));
+  ASSERT_OK(txn->Put("a", "v2"));
+  ASSERT_OK(txn->Commit());
+  ASSERT_EQ("v2", Get("a"));
+  delete txn;
+
+  // A transaction snapshot keeps the deletion, so the write is seen as an
+  // ordinary conflict.
+  OptimisticTransactionOptions txn_options;
+  txn_options.set_snapshot = true;
+  txn = txn_db_->BeginTransaction(WriteOptions(), txn_options);
+  ASSERT_EQ("NOT_FOUND", Get(txn, "b"));
+  ASSERT_OK(db_->Put(WriteOptions(), "b", "v1"));
+  ASSERT_OK(db_->Delete(WriteOptions(), "b"));
+  CompactAll();
+  ASSERT_OK(txn->Put("b", "v2"));
+  Status s = txn->Commit();
+  ASSERT_TRUE(s.IsBusy());
+  ASSERT_TRUE(s.ToString().find("write conflict") != std::string::npos)
+      << s.ToString();
+  delete txn;
+}
+
+TEST(OptimisticTransactionDBTest, SetSnapshot) {
+  ASSERT_OK(db_->Put(WriteOptions(), "a", "v1"));
+  OptimisticTransactionOptions txn_options;
+  txn_options.set_snapshot = true;
+  Transaction* txn = txn_db_->BeginTransaction(WriteOptions(), txn_options);
+  ASSERT_OK(db_->Put(WriteOptions(), "a", "v2"));
+  // Reads are served from the snapshot taken when the transaction began,
+  // and the later write conflicts with it.
+  ASSERT_EQ("v1", Get(txn, "a"));
+  ASSERT_TRUE(txn->Commit().IsBusy());
+  delete txn;
+}
+
+namespace {
+
+static const int kNumThreads = 4;
+static const int kNumIncrements = 100;
+
+struct CounterState {
+  OptimisticTransactionDB* db;
+  port::Mutex mu;
+  port::CondVar cv;
+  int remaining;
+  bool failed;
+
+  CounterState() : cv(&mu), remaining(kNumThreads), failed(false) { }
+};
+
+static void IncrementCounter(void* arg) {
+  CounterState* state = reinterpret_cast<CounterState*>(arg);
+  Transaction* txn = state->db->BeginTransaction(WriteOptions());
+  bool failed = false;
+  for (int i = 0; i < kNumIncrements && !failed; i++) {
+    while (true) {
+      std::string value;
+      Status s = txn->Get(ReadOptions(), "counter", &value);
+      int counter = s.ok() ? atoi(value.c_str()) : 0;
+      char buf[20];
+      snprintf(buf, sizeof(buf), "%d", counter + 1);
+      txn->Put("counter", buf);
+      s = txn->Commit();
+      if (s.ok()) {
+        break;
+      } else if (!s.IsBusy()) {
+        failed = true;
+        break;
+      }
+    }
+  }
+  delete txn;
+
+  MutexLock l(&state->mu);
+  if (failed) {
+    state->failed = true;
+  }
+  state->remaining--;
+  state->cv.Signal();
+}
+
+}  // namespace
+
+TEST(OptimisticTransactionDBTest, ConcurrentIncrements) {
+  CounterState state;
+  state.db = txn_db_;
+  for (int i = 0; i < kNumThreads; i++) {
+    Env::Default()->StartThread(IncrementCounter, &state);
+  }
+  {
+    MutexLock l(&state.mu);
+    while (state.remaining > 0) {
+      state.cv.Wait();
+    }
+    ASSERT_TRUE(!state.failed);
+  }
+  char buf[20];
+  snprintf(buf, sizeof(buf), "%d", kNumThreads * kNumIncrements);
+  ASSERT_EQ(buf, Get("counter"));
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
@@ -29,6 +29,7 @@ class RecoveryTest {
   }
 
   DBImpl* dbfull() const { return reinterpret_cast<DBImpl*>(db_); }
+  const std::string& dbname() const { return dbname_; }
   Env* env() const { return env_; }
 
   bool CanAppend() {
@@ -113,8 +114,12 @@ class RecoveryTest {
   }
 
   std::vector<uint64_t> GetFiles(FileType t) {
+    return GetFilesIn(dbname_, t);
+  }
+
+  std::vector<uint64_t> GetFilesIn(const std::string& dir, FileType t) {
     std::vector<std::string> filenames;
-    ASSERT_OK(env_->GetChildren(dbname_, &filenames));
+    ASSERT_OK(env_->GetChildren(dir, &filenames));
     std::vector<uint64_t> result;
     for (size_t i = 0; i < filenames.size(); i++) {
       uint64_t number;
@@ -130,6 +135,11 @@ class RecoveryTest {
     return GetFiles(kLogFile).size();
   }
 
+  // Directory used by tests that keep log files apart from the DB.
+  std::string WalDir() const {
+    return dbname_ + "_wal";
+  }
+
   int NumTables() {
     return GetFiles(kTableFile).size();
   }
@@ -250,6 +260,95 @@ TEST(RecoveryTest, LogFileReuse) {
   }
 }
 
+TEST(RecoveryTest, SeparateWalDir) {
+  Options options;
+  options.create_if_missing = true;
+  options.reuse_logs = true;
+  options.wal_dir = WalDir();
+  DestroyDB(WalDir(), Options());
+
+  // Logs written before wal_dir was set are recovered from the DB dir.
+  ASSERT_OK(Put("foo", "bar"));
+  ASSERT_OK(OpenWithStatus(&options));
+  ASSERT_EQ(0, NumLogs());
+  ASSERT_EQ(1, GetFilesIn(WalDir(), kLogFile).size());
+  ASSERT_EQ("bar", Get("foo"));
+
+  ASSERT_OK(Put("baz", "qux"));
+  Close();
+  ASSERT_OK(OpenWithStatus(&options));
+  ASSERT_EQ(0, NumLogs());
+  ASSERT_EQ(1, GetFilesIn(WalDir(), kLogFile).size());
+  ASSERT_EQ("bar", Get("foo"));
+  ASSERT_EQ("qux", Get("baz"));
+
+  // Repair converts logs from both directories.
+  ASSERT_OK(Put("repaired", "yes"));
+  Close();
+  ASSERT_OK(RepairDB(dbname(), options));
+  ASSERT_OK(OpenWithStatus(&options));
+  ASSERT_EQ("yes", Get("repaired"));
+  ASSERT_EQ("qux", Get("baz"));
+
+  Close();
+  ASSERT_OK(DestroyDB(dbname(), options));
+  std::vector<std::string> filenames;
+  env()->GetChildren(WalDir(), &filenames);
+  uint64_t number;
+  FileType type;
+  for (size_t i = 0; i < filenames.size(); i++) {
+    ASSERT_TRUE(!ParseFileName(filenames[i], &number, &type) ||
+                type != kLogFile) << filenames[i];
+  }
+}
+
+TEST(RecoveryTest, ChangeWalDir) {
+  const std::string dir_a = WalDir() + "_a";
+  const std::string dir_b = WalDir() + "_b";
+  DestroyDB(dir_a, Options());
+  DestroyDB(dir_b, Options());
+  Options options;
+  options.create_if_missing = true;
+  options.wal_dir = dir_a;
+  ASSERT_OK(OpenWithStatus(&options));
+  ASSERT_OK(Put("foo", "a"));
+  Close();
+
+  // Logs left in the previous wal_dir are recovered, then deleted.
+  options.wal_dir = dir_b;
+  ASSERT_OK(OpenWithStatus(&options));
+  ASSERT_EQ("a", Get("foo"));
+  ASSERT_EQ(0, GetFilesIn(dir_a, kLogFile).size());
+  ASSERT_EQ(1, GetFilesIn(dir_b, kLogFile).size());
+  ASSERT_OK(Put("foo", "b"));
+  Close();
+
+  // The same holds when moving the logs back into the DB directory.
+  options.wal_dir.clear();
+  ASSERT_OK(OpenWithStatus(&options));
+  ASSERT_EQ("b", Get("foo"));
+  ASSERT_EQ(0, GetFilesIn(dir_b, kLogFile).size());
+  ASSERT_EQ(1, NumLogs());
+  Close();
+
+  // An unreadable previous wal_dir fails the open instead of losing writes.
+  options.wal_dir = dir_a;
+  ASSERT_OK(OpenWithStatus(&options));
+  ASSERT_OK(Put("foo", "c"));
+  Close();
+  ASSERT_OK(env()->RenameFile(dir_a, dir_a + ".moved"));
+  options.wal_dir = dir_b;
+  ASSERT_TRUE(!OpenWithStatus(&options).ok());
+  ASSERT_OK(env()->RenameFile(dir_a + ".moved", dir_a));
+  ASSERT_OK(OpenWithStatus(&options));
+  ASSERT_EQ("c", Get("foo"));
+
+  Close();
+  ASSERT_OK(DestroyDB(dbname(), options));
+  env()->DeleteDir(dir_a);
+  ASSERT_TRUE(!env()->FileExists(dir_b));
+}
+
 TEST(RecoveryTest, MultipleMemTables) {
   // Make a large log.
   const int kNum = 1000;
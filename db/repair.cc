@@ -24,6 +24,9 @@
 //   Store per-table metadata (smallest, largest, largest-seq#, ...)
 //   in the table's meta section to speed up ScanTable.
 
+#include <map>
+#include <set>
+
 #include "db/builder.h"
 #include "db/db_impl.h"
 #include "db/dbformat.h"
@@ -50,12 +53,13 @@ class Repairer {
       : dbname_(dbname),
         env_(options.env),
         icmp_(options.comparator),
-        ipolicy_(options.filter_policy),
+        ipolicy_(options.filter_policy, options.comparator->timestamp_size()),
         options_(SanitizeOptions(dbname, &icmp_, &ipolicy_, options)),
         owns_info_log_(options_.info_log != options.info_log),
         owns_cache_(options_.block_cache != options.block_cache),
         next_file_number_(1) {
     // TableCache 可能很小, 因为我们预期每个 table 将只打开一次.
+    // 没有设置数据库标识, 所以修复期间不会读写 persistent_cache.
     table_cache_ = new TableCache(dbname_, options_, 10);
   }
 
@@ -76,6 +80,12 @@ class Repairer {
       ExtractMetaData();
       status = WriteDescriptor();
     }
+    if (status.ok()) {
+      // 修复后的数据库可能复用之前用过的文件编号, 换一个标识以免
+      // persistent_cache 命中之前文件的 block.
+      uint64_t db_id;
+      status = SetIdentityFile(env_, dbname_, &db_id);
+    }
     if (status.ok()) {
       unsigned long long bytes = 0;
       for (size_t i = 0; i < tables_.size(); i++) {
@@ -112,6 +122,8 @@ class Repairer {
   std::vector<std::string> manifests_;
   std::vector<uint64_t> table_numbers_;
   std::vector<uint64_t> logs_;
+  // 不在数据库目录下的 log 文件所在的目录
+  std::map<uint64_t, std::string> log_dirs_;
   std::vector<TableInfo> tables_;
   uint64_t next_file_number_;
 
@@ -157,15 +169,47 @@ class Repairer {
         }
       }
     }
+
+    // log 文件可能位于 options_.wal_dir 或者 WALDIR 文件记录的目录下,
+    // 这些目录下只关心 log 文件
+    std::set<std::string> wal_dirs;
+    if (!options_.wal_dir.empty()) {
+      wal_dirs.insert(options_.wal_dir);
+    }
+    std::string recorded_wal_dir;
+    if (ReadWalDirFile(env_, dbname_, &recorded_wal_dir).ok()) {
+      wal_dirs.insert(recorded_wal_dir);
+    }
+    wal_dirs.erase(dbname_);
+    for (std::set<std::string>::const_iterator it = wal_dirs.begin();
+         it != wal_dirs.end(); ++it) {
+      filenames.clear();
+      env_->GetChildren(*it, &filenames);  // Ignore error if missing
+      for (size_t i = 0; i < filenames.size(); i++) {
+        if (ParseFileName(filenames[i], &number, &type) &&
+            type == kLogFile && log_dirs_.count(number) == 0) {
+          if (number + 1 > next_file_number_) {
+            next_file_number_ = number + 1;
+          }
+          logs_.push_back(number);
+          log_dirs_[number] = *it;
+        }
+      }
+    }
     return status;
   }
 
+  std::string LogName(uint64_t number) const {
+    std::map<uint64_t, std::string>::const_iterator it = log_dirs_.find(number);
+    return LogFileName(it != log_dirs_.end() ? it->second : dbname_, number);
+  }
+
   // 读取每个 log 文件将其转换为 memtable, 然后
   // 将 memtable 序列化为 sstable 文件.
   void ConvertLogFilesToTables() {
     for (size_t i = 0; i < logs_.size(); i++) {
       // 拼接 log 文件名
-      std::string logname = LogFileName(dbname_, logs_[i]);
+      std::string logname = LogName(logs_[i]);
       
       Status status = ConvertLogToTable(logs_[i]);
       if (!status.ok()) {
@@ -195,7 +239,7 @@ class Repairer {
     };
 
     // 打开 log file
-    std::string logname = LogFileName(dbname_, log);
+    std::string logname = LogName(log);
     SequentialFile* lfile;
     Status status = env_->NewSequentialFile(logname, &lfile);
     if (!status.ok()) {
@@ -0,0 +1,556 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/sharded_db.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <deque>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "leveldb/comparator.h"
+#include "leveldb/env.h"
+#include "leveldb/iterator.h"
+#include "leveldb/write_batch.h"
+#include "port/port.h"
+#include "table/merger.h"
+#include "util/coding.h"
+#include "util/hash.h"
+#include "util/logging.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+// A utility routine: write "data" to the named file and Sync() it.
+Status WriteStringToFileSync(Env* env, const Slice& data,
+                             const std::string& fname);
+
+namespace {
+
+// 记录分片方式的文件, 内容见 ShardedDB::Open
+std::string ShardingFileName(const std::string& name) {
+  return name + "/SHARDS";
+}
+
+// 第 i 个分片所在的目录
+std::string ShardDirName(const std::string& name, int i) {
+  char buf[100];
+  snprintf(buf, sizeof(buf), "/shard-%06d", i);
+  return name + buf;
+}
+
+enum ShardingType {
+  kHashSharding = 0,
+  kRangeSharding = 1
+};
+
+// 每个分片使用一个独立的后台线程执行 Schedule 提交的任务(即压实),
+// 这样各分片的压实可以并行执行而不是排队等待 Env 唯一的后台线程.
+// 其余操作都转发给 target().
+class ShardEnv : public EnvWrapper {
+ public:
+  explicit ShardEnv(Env* base)
+      : EnvWrapper(base),
+        cv_(&mu_),
+        started_(false),
+        shutting_down_(false),
+        exited_(false) { }
+
+  // 分片数据库关闭时已经等待其后台任务全部完成, 这里只需要让线程退出
+  virtual ~ShardEnv() {
+    MutexLock l(&mu_);
+    if (started_) {
+      shutting_down_ = true;
+      cv_.SignalAll();
+      while (!exited_) {
+        cv_.Wait();
+      }
+    }
+  }
+
+  virtual void Schedule(void (*function)(void*), void* arg) {
+    MutexLock l(&mu_);
+    if (!started_) {
+      started_ = true;
+      target()->StartThread(&ShardEnv::BGThreadWrapper, this);
+    }
+    queue_.push_back(BGItem());
+    queue_.back().function = function;
+    queue_.back().arg = arg;
+    cv_.Signal();
+  }
+
+ private:
+  struct BGItem { void* arg; void (*function)(void*); };
+
+  static void BGThreadWrapper(void* arg) {
+    reinterpret_cast<ShardEnv*>(arg)->BGThread();
+  }
+
+  void BGThread() {
+    mu_.Lock();
+    while (true) {
+      while (queue_.empty() && !shutting_down_) {
+        cv_.Wait();
+      }
+      if (queue_.empty()) {
+        break;
+      }
+      void (*function)(void*) = queue_.front().function;
+      void* arg = queue_.front().arg;
+      queue_.pop_front();
+      mu_.Unlock();
+      (*function)(arg);
+      mu_.Lock();
+    }
+    exited_ = true;
+    cv_.SignalAll();
+    mu_.Unlock();
+  }
+
+  port::Mutex mu_;
+  port::CondVar cv_;
+  bool started_;
+  bool shutting_down_;
+  bool exited_;
+  std::deque<BGItem> queue_;
+};
+
+// 由每个分片各自的快照构成
+class ShardedSnapshot : public Snapshot {
+ public:
+  std::vector<const Snapshot*> snapshots;
+};
+
+class ShardedDBImpl : public ShardedDB {
+ public:
+  ShardedDBImpl(const Options& options,
+                const std::vector<std::string>& split_keys, int num_shards)
+      : env_(options.env),
+        user_comparator_(options.comparator),
+        split_keys_(split_keys),
+        num_shards_(num_shards) { }
+
+  virtual ~ShardedDBImpl() {
+    // 先关闭分片数据库, 之后才能停止它们的后台线程
+    for (size_t i = 0; i < shards_.size(); i++) {
+      delete shards_[i];
+    }
+    for (size_t i = 0; i < envs_.size(); i++) {
+      delete envs_[i];
+    }
+  }
+
+  // 以 options 打开位于 dir 目录的分片
+  Status AddShard(const Options& options, const std::string& dir) {
+    ShardEnv* env = new ShardEnv(options.env);
+    envs_.push_back(env);
+    Options shard_options = options;
+    shard_options.env = env;
+    DB* db;
+    Status s = DB::Open(shard_options, dir, &db);
+    if (s.ok()) {
+      shards_.push_back(db);
+    }
+    return s;
+  }
+
+  // 返回 key 所属分片的编号
+  int ShardFor(const Slice& key) const {
+    if (split_keys_.empty()) {
+      return Hash(key.data(), key.size(), 0) % num_shards_;
+    }
+    // 第一个大于 key 的分割点的下标就是分片编号
+    int left = 0;
+    int right = static_cast<int>(split_keys_.size());
+    while (left < right) {
+      const int mid = left + (right - left) / 2;
+      if (user_comparator_->Compare(split_keys_[mid], key) <= 0) {
+        left = mid + 1;
+      } else {
+        right = mid;
+      }
+    }
+    return left;
+  }
+
+  virtual int NumShards() const { return num_shards_; }
+
+  virtual DB* GetShard(int i) {
+    assert(i >= 0 && i < num_shards_);
+    return shards_[i];
+  }
+
+  virtual Status Put(const WriteOptions& options,
+                     const Slice& key, const Slice& value) {
+    return shards_[ShardFor(key)]->Put(options, key, value);
+  }
+
+  virtual Status Delete(const WriteOptions& options, const Slice& key) {
+    return shards_[ShardFor(key)]->Delete(options, key);
+  }
+
+  // 只涉及一个分片的 batch 直接写入该分片, 否则按分片拆分后依次写入,
+  // 遇到错误立即返回, 之前已经写入的分片不会回滚.
+  virtual Status Write(const WriteOptions& options, WriteBatch* updates) {
+    ShardChecker checker(this);
+    Status s = updates->Iterate(&checker);
+    if (!s.ok() || checker.shard < 0) {
+      return s;
+    }
+    if (!checker.multiple) {
+      return shards_[checker.shard]->Write(options, updates);
+    }
+
+    std::vector<WriteBatch> batches(num_shards_);
+    BatchSplitter splitter(this, &batches);
+    s = updates->Iterate(&splitter);
+    for (int i = 0; s.ok() && i < num_shards_; i++) {
+      if (splitter.counts[i] > 0) {
+        s = shards_[i]->Write(options, &batches[i]);
+      }
+    }
+    return s;
+  }
+
+  virtual Status Get(const ReadOptions& options,
+                     const Slice& key, std::string* value) {
+    const int shard = ShardFor(key);
+    return shards_[shard]->Get(ShardReadOptions(options, shard), key, value);
+  }
+
+  virtual void GetAsync(const ReadOptions& options, const Slice& key,
+                        GetCallback callback, void* arg) {
+    const int shard = ShardFor(key);
+    shards_[shard]->GetAsync(ShardReadOptions(options, shard), key,
+                             callback, arg);
+  }
+
+  // 归并全部分片的迭代器. 每个 key 只属于一个分片, 各个子迭代器之间没有重复的 key.
+  virtual Iterator* NewIterator(const ReadOptions& options) {
+    std::vector<Iterator*> list(num_shards_);
+    for (int i = 0; i < num_shards_; i++) {
+      list[i] = shards_[i]->NewIterator(ShardReadOptions(options, i));
+    }
+    return NewMergingIterator(user_comparator_, &list[0], num_shards_);
+  }
+
+  virtual const Snapshot* GetSnapshot() {
+    ShardedSnapshot* snapshot = new ShardedSnapshot;
+    for (int i = 0; i < num_shards_; i++) {
+      snapshot->snapshots.push_back(shards_[i]->GetSnapshot());
+    }
+    return snapshot;
+  }
+
+  virtual void ReleaseSnapshot(const Snapshot* snapshot) {
+    const ShardedSnapshot* s = static_cast<const ShardedSnapshot*>(snapshot);
+    for (int i = 0; i < num_shards_; i++) {
+      shards_[i]->ReleaseSnapshot(s->snapshots[i]);
+    }
+    delete s;
+  }
+
+  // 数值类的属性对全部分片求和, 其它属性按分片依次拼接
+  virtual bool GetProperty(const Slice& property, std::string* value) {
+    const bool numeric =
+        property.starts_with("leveldb.num-files-at-level") ||
+        property == Slice("leveldb.approximate-memory-usage");
+    uint64_t sum = 0;
+    value->clear();
+    for (int i = 0; i < num_shards_; i++) {
+      std::string v;
+      if (!shards_[i]->GetProperty(property, &v)) {
+        return false;
+      }
+      if (numeric) {
+        sum += strtoull(v.c_str(), nullptr, 10);
+      } else {
+        char buf[100];
+        snprintf(buf, sizeof(buf), "--- shard %d ---\n", i);
+        value->append(buf);
+        value->append(v);
+      }
+    }
+    if (numeric) {
+      *value = NumberToString(sum);
+    }
+    return true;
+  }
+
+  virtual void GetApproximateSizes(const Range* range, int n,
+                                   uint64_t* sizes) {
+    std::vector<uint64_t> shard_sizes(n);
+    for (int j = 0; j < n; j++) {
+      sizes[j] = 0;
+    }
+    for (int i = 0; i < num_shards_; i++) {
+      shards_[i]->GetApproximateSizes(range, n, &shard_sizes[0]);
+      for (int j = 0; j < n; j++) {
+        sizes[j] += shard_sizes[j];
+      }
+    }
+  }
+
+  virtual void GetApproximateStats(const Range* range, int n,
+                                   uint64_t* sizes, uint64_t* counts) {
+    std::vector<uint64_t> shard_sizes(n);
+    std::vector<uint64_t> shard_counts(n);
+    for (int j = 0; j < n; j++) {
+      sizes[j] = 0;
+      counts[j] = 0;
+    }
+    for (int i = 0; i < num_shards_; i++) {
+      shards_[i]->GetApproximateStats(range, n, &shard_sizes[0],
+                                      &shard_counts[0]);
+      for (int j = 0; j < n; j++) {
+        sizes[j] += shard_sizes[j];
+        counts[j] += shard_counts[j];
+      }
+    }
+  }
+
+  // 与 [*begin, *end] 有交集的分片并行压实, 全部完成后返回
+  virtual void CompactRange(const Slice* begin, const Slice* end) {
+    int first = 0;
+    int last = num_shards_ - 1;
+    if (!split_keys_.empty()) {
+      if (begin != nullptr) first = ShardFor(*begin);
+      if (end != nullptr) last = ShardFor(*end);
+    }
+    if (first > last) {
+      return;
+    }
+
+    port::Mutex mu;
+    port::CondVar cv(&mu);
+    int remaining = last - first;
+    std::vector<CompactionJob> jobs(last - first);
+    for (int i = first; i < last; i++) {
+      CompactionJob* job = &jobs[i - first];
+      job->db = shards_[i];
+      job->begin = begin;
+      job->end = end;
+      job->mu = &mu;
+      job->cv = &cv;
+      job->remaining = &remaining;
+      env_->StartThread(&ShardedDBImpl::CompactionThread, job);
+    }
+    // 最后一个分片在当前线程压实
+    shards_[last]->CompactRange(begin, end);
+    MutexLock l(&mu);
+    while (remaining > 0) {
+      cv.Wait();
+    }
+  }
+
+ private:
+  // 统计 batch 涉及的分片, 只涉及一个分片时 multiple 为 false
+  struct ShardChecker : public WriteBatch::Handler {
+    explicit ShardChecker(const ShardedDBImpl* d)
+        : db(d), shard(-1), multiple(false) { }
+    virtual void Put(const Slice& key, const Slice& value) { Add(key); }
+    virtual void Delete(const Slice& key) { Add(key); }
+    void Add(const Slice& key) {
+      const int s = db->ShardFor(key);
+      if (shard < 0) {
+        shard = s;
+      } else if (s != shard) {
+        multiple = true;
+      }
+    }
+    const ShardedDBImpl* const db;
+    int shard;
+    bool multiple;
+  };
+
+  // 将 batch 中的操作按所属分片拆分到 batches 中
+  struct BatchSplitter : public WriteBatch::Handler {
+    BatchSplitter(const ShardedDBImpl* d, std::vector<WriteBatch>* b)
+        : db(d), batches(b), counts(b->size(), 0) { }
+    virtual void Put(const Slice& key, const Slice& value) {
+      const int s = db->ShardFor(key);
+      (*batches)[s].Put(key, value);
+      counts[s]++;
+    }
+    virtual void Delete(const Slice& key) {
+      const int s = db->ShardFor(key);
+      (*batches)[s].Delete(key);
+      counts[s]++;
+    }
+    const ShardedDBImpl* const db;
+    std::vector<WriteBatch>* const batches;
+    std::vector<int> counts;
+  };
+
+  struct CompactionJob {
+    DB* db;
+    const Slice* begin;
+    const Slice* end;
+    port::Mutex* mu;
+    port::CondVar* cv;
+    int* remaining;
+  };
+
+  static void CompactionThread(void* arg) {
+    CompactionJob* job = reinterpret_cast<CompactionJob*>(arg);
+    job->db->CompactRange(job->begin, job->end);
+    MutexLock l(job->mu);
+    if (--*job->remaining == 0) {
+      job->cv->Signal();
+    }
+  }
+
+  // 将 options 中的 ShardedSnapshot 替换为第 shard 个分片自己的快照
+  ReadOptions ShardReadOptions(const ReadOptions& options, int shard) const {
+    ReadOptions result = options;
+    if (options.snapshot != nullptr) {
+      result.snapshot =
+          static_cast<const ShardedSnapshot*>(options.snapshot)
+              ->snapshots[shard];
+    }
+    return result;
+  }
+
+  Env* const env_;
+  const Comparator* const user_comparator_;
+  // 按范围分片时的分割点, 为空表示按哈希值分片
+  const std::vector<std::string> split_keys_;
+  const int num_shards_;
+  std::vector<ShardEnv*> envs_;
+  std::vector<DB*> shards_;
+};
+
+}  // namespace
+
+ShardedDB::~ShardedDB() { }
+
+// SHARDS 文件记录分片方式, 格式为:
+//    type        varint32(kHashSharding 或 kRangeSharding)
+//    num_shards  varint32
+//    split_keys  length-prefixed string[num_shards - 1](仅按范围分片时)
+// 之后打开时分片方式必须与之完全一致.
+Status ShardedDB::Open(const Options& options,
+                       const ShardedDBOptions& sharded_options,
+                       const std::string& name,
+                       ShardedDB** dbptr) {
+  *dbptr = nullptr;
+  const Comparator* ucmp = options.comparator;
+  if (ucmp->timestamp_size() != 0) {
+    return Status::InvalidArgument("timestamps not supported by ShardedDB",
+                                   ucmp->Name());
+  }
+  if (options.persistent_cache != nullptr) {
+    // persistent_cache 的 key 由文件编号构成, 不能由多个分片共享
+    return Status::InvalidArgument(
+        "persistent_cache not supported by ShardedDB");
+  }
+  const std::vector<std::string>& split_keys = sharded_options.split_keys;
+  for (size_t i = 1; i < split_keys.size(); i++) {
+    if (ucmp->Compare(split_keys[i - 1], split_keys[i]) >= 0) {
+      return Status::InvalidArgument("split_keys must be strictly increasing");
+    }
+  }
+  const int num_shards = split_keys.empty()
+      ? sharded_options.num_shards
+      : static_cast<int>(split_keys.size()) + 1;
+  if (num_shards < 1) {
+    return Status::InvalidArgument("num_shards must be positive");
+  }
+
+  std::string sharding;
+  PutVarint32(&sharding, split_keys.empty() ? kHashSharding : kRangeSharding);
+  PutVarint32(&sharding, num_shards);
+  for (size_t i = 0; i < split_keys.size(); i++) {
+    PutLengthPrefixedSlice(&sharding, split_keys[i]);
+  }
+
+  Env* env = options.env;
+  const std::string fname = ShardingFileName(name);
+  const bool exists = env->FileExists(fname);
+  if (exists) {
+    if (options.error_if_exists) {
+      return Status::InvalidArgument(name, "exists (error_if_exists is true)");
+    }
+    std::string existing;
+    Status s = ReadFileToString(env, fname, &existing);
+    if (!s.ok()) {
+      return s;
+    }
+    if (existing != sharding) {
+      return Status::InvalidArgument(
+          name, "does not match the existing sharding");
+    }
+  } else {
+    if (!options.create_if_missing) {
+      return Status::InvalidArgument(
+          name, "does not exist (create_if_missing is false)");
+    }
+    env->CreateDir(name);  // In case it does not exist
+  }
+
+  // 分片目录可能因为上次创建时中途失败而已经存在
+  Options shard_options = options;
+  shard_options.error_if_exists = false;
+  if (!options.wal_dir.empty()) {
+    // 每个分片的 log 文件放在 wal_dir 下各自的子目录中, 否则编号会冲突
+    env->CreateDir(options.wal_dir);  // In case it does not exist
+  }
+  ShardedDBImpl* impl = new ShardedDBImpl(options, split_keys, num_shards);
+  Status s;
+  for (int i = 0; s.ok() && i < num_shards; i++) {
+    if (!options.wal_dir.empty()) {
+      shard_options.wal_dir = ShardDirName(options.wal_dir, i);
+    }
+    s = impl->AddShard(shard_options, ShardDirName(name, i));
+  }
+  // 全部分片都创建成功之后才记录分片方式
+  if (s.ok() && !exists) {
+    s = WriteStringToFileSync(env, sharding, fname);
+  }
+  if (s.ok()) {
+    *dbptr = impl;
+  } else {
+    delete impl;
+  }
+  return s;
+}
+
+Status DestroyShardedDB(const std::string& name, const Options& options) {
+  Env* env = options.env;
+  std::vector<std::string> filenames;
+  Status result = env->GetChildren(name, &filenames);
+  if (!result.ok()) {
+    // Ignore error in case directory does not exist
+    return Status::OK();
+  }
+  // 有的 Env(例如 memenv)会把子目录中的文件也一并列出, 所以只取第一级目录名
+  std::set<std::string> shard_dirs;
+  for (size_t i = 0; i < filenames.size(); i++) {
+    if (Slice(filenames[i]).starts_with("shard-")) {
+      shard_dirs.insert(filenames[i].substr(0, filenames[i].find('/')));
+    }
+  }
+  Options shard_options = options;
+  for (std::set<std::string>::const_iterator it = shard_dirs.begin();
+       it != shard_dirs.end(); ++it) {
+    if (!options.wal_dir.empty()) {
+      shard_options.wal_dir = options.wal_dir + "/" + *it;
+    }
+    Status del = DestroyDB(name + "/" + *it, shard_options);
+    if (result.ok() && !del.ok()) {
+      result = del;
+    }
+  }
+  env->DeleteFile(ShardingFileName(name));
+  env->DeleteDir(name);  // Ignore error in case dir contains other files
+  if (!options.wal_dir.empty()) {
+    env->DeleteDir(options.wal_dir);  // Ignore error
+  }
+  return result;
+}
+
+}  // namespace leveldb
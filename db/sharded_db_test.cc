@@ -0,0 +1,276 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/sharded_db.h"
+
+#include <string>
+#include <vector>
+
+#include "helpers/memenv/memenv.h"
+#include "leveldb/env.h"
+#include "leveldb/iterator.h"
+#include "leveldb/write_batch.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+static std::string Key(int i) {
+  char buf[100];
+  snprintf(buf, sizeof(buf), "key%06d", i);
+  return buf;
+}
+
+class ShardedDBTest {
+ public:
+  Env* env_;
+  std::string dbname_;
+  ShardedDB* db_;
+
+  ShardedDBTest()
+      : env_(NewMemEnv(Env::Default())), dbname_("/sharded"), db_(nullptr) { }
+
+  ~ShardedDBTest() {
+    delete db_;
+    delete env_;
+  }
+
+  Options CurrentOptions() {
+    Options options;
+    options.env = env_;
+    options.create_if_missing = true;
+    return options;
+  }
+
+  Status TryOpen(const ShardedDBOptions& sharded_options) {
+    delete db_;
+    db_ = nullptr;
+    return ShardedDB::Open(CurrentOptions(), sharded_options, dbname_, &db_);
+  }
+
+  void Open(const ShardedDBOptions& sharded_options) {
+    ASSERT_OK(TryOpen(sharded_options));
+  }
+
+  std::string Get(const std::string& k, const Snapshot* snapshot = nullptr) {
+    ReadOptions options;
+    options.snapshot = snapshot;
+    std::string result;
+    Status s = db_->Get(options, k, &result);
+    if (s.IsNotFound()) {
+      result = "NOT_FOUND";
+    } else if (!s.ok()) {
+      result = s.ToString();
+    }
+    return result;
+  }
+
+  // Returns the number of keys stored directly in shard i.
+  int CountShard(int i) {
+    Iterator* iter = db_->GetShard(i)->NewIterator(ReadOptions());
+    int count = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      count++;
+    }
+    delete iter;
+    return count;
+  }
+};
+
+TEST(ShardedDBTest, HashSharding) {
+  ShardedDBOptions sharded_options;
+  sharded_options.num_shards = 4;
+  Open(sharded_options);
+  ASSERT_EQ(4, db_->NumShards());
+
+  for (int i = 0; i < 200; i++) {
+    ASSERT_OK(db_->Put(WriteOptions(), Key(i), "v" + Key(i)));
+  }
+  ASSERT_OK(db_->Delete(WriteOptions(), Key(7)));
+  ASSERT_EQ("v" + Key(3), Get(Key(3)));
+  ASSERT_EQ("NOT_FOUND", Get(Key(7)));
+
+  // Every shard received part of the keys.
+  int total = 0;
+  for (int i = 0; i < db_->NumShards(); i++) {
+    ASSERT_GT(CountShard(i), 0);
+    total += CountShard(i);
+  }
+  ASSERT_EQ(199, total);
+
+  // The merged iterator visits all keys in order.
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  int expected = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    if (expected == 7) expected++;
+    ASSERT_EQ(Key(expected), iter->key().ToString());
+    expected++;
+  }
+  ASSERT_EQ(200, expected);
+  iter->Seek(Key(100));
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ(Key(100), iter->key().ToString());
+  iter->Prev();
+  ASSERT_EQ(Key(99), iter->key().ToString());
+  delete iter;
+}
+
+TEST(ShardedDBTest, CrossShardBatch) {
+  ShardedDBOptions sharded_options;
+  Open(sharded_options);
+
+  WriteBatch batch;
+  for (int i = 0; i < 50; i++) {
+    batch.Put(Key(i), "x");
+  }
+  batch.Delete(Key(10));
+  ASSERT_OK(db_->Write(WriteOptions(), &batch));
+  for (int i = 0; i < 50; i++) {
+    ASSERT_EQ(i == 10 ? "NOT_FOUND" : "x", Get(Key(i)));
+  }
+
+  WriteBatch empty;
+  ASSERT_OK(db_->Write(WriteOptions(), &empty));
+}
+
+TEST(ShardedDBTest, Snapshot) {
+  ShardedDBOptions sharded_options;
+  Open(sharded_options);
+  for (int i = 0; i < 20; i++) {
+    ASSERT_OK(db_->Put(WriteOptions(), Key(i), "v1"));
+  }
+  const Snapshot* snapshot = db_->GetSnapshot();
+  for (int i = 0; i < 20; i++) {
+    ASSERT_OK(db_->Put(WriteOptions(), Key(i), "v2"));
+  }
+  ASSERT_OK(db_->Delete(WriteOptions(), Key(5)));
+
+  for (int i = 0; i < 20; i++) {
+    ASSERT_EQ("v1", Get(Key(i), snapshot));
+  }
+  ASSERT_EQ("NOT_FOUND", Get(Key(5)));
+
+  ReadOptions options;
+  options.snapshot = snapshot;
+  Iterator* iter = db_->NewIterator(options);
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ASSERT_EQ("v1", iter->value().ToString());
+    count++;
+  }
+  ASSERT_EQ(20, count);
+  delete iter;
+  db_->ReleaseSnapshot(snapshot);
+}
+
+TEST(ShardedDBTest, Reopen) {
+  ShardedDBOptions sharded_options;
+  sharded_options.num_shards = 3;
+  Open(sharded_options);
+  for (int i = 0; i < 100; i++) {
+    ASSERT_OK(db_->Put(WriteOptions(), Key(i), Key(i)));
+  }
+  Open(sharded_options);
+  for (int i = 0; i < 100; i++) {
+    ASSERT_EQ(Key(i), Get(Key(i)));
+  }
+
+  // A different sharding would route keys to the wrong shards.
+  sharded_options.num_shards = 4;
+  ASSERT_TRUE(TryOpen(sharded_options).IsInvalidArgument());
+  ASSERT_TRUE(db_ == nullptr);
+  sharded_options.split_keys.push_back("key000050");
+  ASSERT_TRUE(TryOpen(sharded_options).IsInvalidArgument());
+
+  sharded_options.split_keys.clear();
+  sharded_options.num_shards = 3;
+  Open(sharded_options);
+  ASSERT_EQ(Key(42), Get(Key(42)));
+}
+
+TEST(ShardedDBTest, RangeSharding) {
+  ShardedDBOptions sharded_options;
+  sharded_options.split_keys.push_back("g");
+  sharded_options.split_keys.push_back("p");
+  Open(sharded_options);
+  ASSERT_EQ(3, db_->NumShards());
+
+  const char* keys[] = { "a", "f", "g", "h", "o", "p", "z" };
+  const int shards[] = { 0, 0, 1, 1, 1, 2, 2 };
+  for (int i = 0; i < 7; i++) {
+    ASSERT_OK(db_->Put(WriteOptions(), keys[i], keys[i]));
+  }
+  for (int i = 0; i < 7; i++) {
+    std::string value;
+    ASSERT_OK(db_->GetShard(shards[i])->Get(ReadOptions(), keys[i], &value));
+    ASSERT_EQ(keys[i], value);
+  }
+  ASSERT_EQ(2, CountShard(0));
+  ASSERT_EQ(3, CountShard(1));
+  ASSERT_EQ(2, CountShard(2));
+
+  // Every shard flushes its memtable and compacts in parallel.
+  db_->CompactRange(nullptr, nullptr);
+  std::string files;
+  int total = 0;
+  for (int level = 0; level < 7; level++) {
+    ASSERT_TRUE(db_->GetProperty(
+        "leveldb.num-files-at-level" + std::to_string(level), &files));
+    total += std::stoi(files);
+  }
+  ASSERT_EQ(3, total);
+
+  // Compacting a range only touches the overlapping shards.
+  ASSERT_OK(db_->Put(WriteOptions(), "b", "b"));
+  Slice begin("a"), end("c");
+  db_->CompactRange(&begin, &end);
+  ASSERT_EQ("b", Get("b"));
+
+  std::string stats;
+  ASSERT_TRUE(db_->GetProperty("leveldb.stats", &stats));
+  ASSERT_NE(std::string::npos, stats.find("--- shard 2 ---"));
+  ASSERT_TRUE(!db_->GetProperty("leveldb.no-such-property", &stats));
+
+  uint64_t size;
+  Range r("a", "z");
+  db_->GetApproximateSizes(&r, 1, &size);
+  ASSERT_GT(size, 0);
+}
+
+TEST(ShardedDBTest, InvalidOptions) {
+  ShardedDBOptions sharded_options;
+  sharded_options.split_keys.push_back("p");
+  sharded_options.split_keys.push_back("g");
+  ASSERT_TRUE(TryOpen(sharded_options).IsInvalidArgument());
+
+  sharded_options.split_keys.clear();
+  sharded_options.num_shards = 0;
+  ASSERT_TRUE(TryOpen(sharded_options).IsInvalidArgument());
+
+  sharded_options.num_shards = 2;
+  Options options = CurrentOptions();
+  options.create_if_missing = false;
+  ASSERT_TRUE(ShardedDB::Open(options, sharded_options, dbname_, &db_)
+                  .IsInvalidArgument());
+  ASSERT_TRUE(db_ == nullptr);
+}
+
+TEST(ShardedDBTest, Destroy) {
+  ShardedDBOptions sharded_options;
+  Open(sharded_options);
+  ASSERT_OK(db_->Put(WriteOptions(), "k", "v"));
+  delete db_;
+  db_ = nullptr;
+  ASSERT_OK(DestroyShardedDB(dbname_, CurrentOptions()));
+  ASSERT_TRUE(!env_->FileExists(dbname_ + "/SHARDS"));
+
+  sharded_options.num_shards = 2;
+  Open(sharded_options);
+  ASSERT_EQ("NOT_FOUND", Get("k"));
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
@@ -74,6 +74,13 @@ class SkipList {
   // 当且仅当 sliplist 中存在与 key 相等的数据项时才返回 true. 
   bool Contains(const Key& key) const;
 
+  // Returns an estimate of the number of entries less than key, derived
+  // from the number of nodes passed at each level while searching for it.
+  //
+  // 估计小于 key 的数据项个数. 查找 key 时每下降一层, 之前经过的每个节点
+  // 平均代表 kBranching 个下一层的节点, 代价与查找相同.
+  uint64_t EstimateCount(const Key& key) const;
+
   // Iteration over the contents of a skip list
   //
   // 用于迭代 skiplist 内容的迭代器
@@ -139,6 +146,8 @@ class SkipList {
  private:
   // 默认 SkipList 最多 12 个 level
   enum { kMaxHeight = 12 }; 
+  // 每个节点以 1/kBranching 的概率出现在上一层
+  enum { kBranching = 4 };
 
   // Immutable after construction
   Comparator const compare_; // 初始化以后不可更改
@@ -328,7 +337,6 @@ int SkipList<Key,Comparator>::RandomHeight() {
   // 以 1/kBranching 概率循环递增 height. 
   // 每次拔擢都是在前一次拔擢成功的前提下再进行, 如果前一次失败则停止拔擢. 
   // 假设 kBranching == 4, 则返回 1 概率为 1/4, 返回 2 概率为 1/16, .... 
-  static const unsigned int kBranching = 4;
   // 每个节点最少有一层索引(就是原始链表)
   int height = 1;
   while (height < kMaxHeight && ((rnd_.Next() % kBranching) == 0)) {
@@ -508,6 +516,28 @@ bool SkipList<Key,Comparator>::Contains(const Key& key) const {
   }
 }
 
+template<typename Key, class Comparator>
+uint64_t SkipList<Key,Comparator>::EstimateCount(const Key& key) const {
+  uint64_t count = 0;
+  Node* x = head_;
+  int level = GetMaxHeight() - 1;
+  while (true) {
+    assert(x == head_ || compare_(x->key, key) < 0);
+    Node* next = x->Next(level);
+    if (next == nullptr || compare_(next->key, key) >= 0) {
+      if (level == 0) {
+        return count;
+      }
+      // 下沉一层, 已经经过的节点数按比例放大
+      count *= kBranching;
+      level--;
+    } else {
+      x = next;
+      count++;
+    }
+  }
+}
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_DB_SKIPLIST_H_
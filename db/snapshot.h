@@ -5,12 +5,18 @@
 #ifndef STORAGE_LEVELDB_DB_SNAPSHOT_H_
 #define STORAGE_LEVELDB_DB_SNAPSHOT_H_
 
+#include <atomic>
 #include "db/dbformat.h"
+#include "db/version_set.h"
 #include "leveldb/db.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/mutexlock.h"
 
 namespace leveldb {
 
 class SnapshotList;
+class SnapshotRegistry;
 
 // Snapshots 保存在 DB 的一个双向循环链表中, 
 // 每个 SnapshotImpl 对应一个具体的序列号. 
@@ -18,12 +24,13 @@ class SnapshotImpl : public Snapshot {
  public:
   // 构造函数允许一个序列号隐式地转换为一个 SnapshotImpl 对象
   SnapshotImpl(SequenceNumber sequence_number)
-      : sequence_number_(sequence_number) {}
+      : sequence_number_(sequence_number), shard_(0) {}
 
   SequenceNumber sequence_number() const { return sequence_number_; }
 
  private:
   friend class SnapshotList;
+  friend class SnapshotRegistry;
 
   // 下面两个指针用于构造双向循环链表
   SnapshotImpl* prev_;
@@ -31,6 +38,9 @@ class SnapshotImpl : public Snapshot {
 
   const SequenceNumber sequence_number_;
 
+  // 该快照所在的 SnapshotRegistry 分片
+  int shard_;
+
 #if !defined(NDEBUG)
   SnapshotList* list_ = nullptr;
 #endif  // !defined(NDEBUG)
@@ -83,6 +93,75 @@ class SnapshotList {
   SnapshotImpl head_;
 };
 
+// 可以被多个线程并发访问的快照集合, 获取和释放快照都不需要 DB 的 mutex_.
+//
+// 快照被分散到 kNumShards 个分片中, 每个分片是一个由自己的锁守护的 SnapshotList,
+// 线程根据自己的编号固定使用某个分片, 所以不同线程获取和释放快照基本不会互相竞争.
+// 压实时需要的最老快照通过逐个检查各个分片的最老快照得到.
+class SnapshotRegistry {
+ public:
+  static const int kNumShards = 16;
+
+  SnapshotRegistry() { }
+
+  // 用 versions 当前最新的序列号创建一个快照.
+  SnapshotImpl* New(const VersionSet* versions) {
+    const int shard = ShardForCurrentThread();
+    Shard* s = &shards_[shard];
+    MutexLock l(&s->mu);
+    // 序列号必须在持有分片锁期间读取, 这样一来同一分片内的快照
+    // 仍然按序列号递增排列, 而且能够保证 OldestSequence 的正确性.
+    SnapshotImpl* snapshot = s->list.New(versions->LastSequence());
+    snapshot->shard_ = shard;
+    return snapshot;
+  }
+
+  void Delete(const SnapshotImpl* snapshot) {
+    Shard* s = &shards_[snapshot->shard_];
+    MutexLock l(&s->mu);
+    s->list.Delete(snapshot);
+  }
+
+  // 返回全部存活快照中最小的序列号, 如果没有存活的快照则返回 last_sequence.
+  //
+  // 要求: last_sequence 必须在调用该方法之前读取. 如果某个快照在本方法检查其
+  // 分片之后才加入, 那么它的序列号是在检查之后读取的, 一定不小于 last_sequence,
+  // 所以返回值对它来说依然是安全的.
+  SequenceNumber OldestSequence(SequenceNumber last_sequence) {
+    SequenceNumber oldest = last_sequence;
+    for (int i = 0; i < kNumShards; i++) {
+      MutexLock l(&shards_[i].mu);
+      if (!shards_[i].list.empty()) {
+        SequenceNumber seq = shards_[i].list.oldest()->sequence_number();
+        if (seq < oldest) {
+          oldest = seq;
+        }
+      }
+    }
+    return oldest;
+  }
+
+ private:
+  struct Shard {
+    port::Mutex mu;
+    SnapshotList list GUARDED_BY(mu);
+  };
+
+  // 每个线程首次获取快照时分配一个编号, 编号决定了它使用哪个分片.
+  static int ShardForCurrentThread() {
+    static std::atomic<uint32_t> next_id(0);
+    static thread_local uint32_t id =
+        next_id.fetch_add(1, std::memory_order_relaxed);
+    return static_cast<int>(id % kNumShards);
+  }
+
+  Shard shards_[kNumShards];
+
+  // No copying allowed
+  SnapshotRegistry(const SnapshotRegistry&);
+  void operator=(const SnapshotRegistry&);
+};
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_DB_SNAPSHOT_H_
@@ -4,6 +4,8 @@
 
 #include "db/table_cache.h"
 
+#include <map>
+
 #include "db/filename.h"
 #include "leveldb/env.h"
 #include "leveldb/table.h"
@@ -37,7 +39,8 @@ TableCache::TableCache(const std::string& dbname,
     : env_(options.env),
       dbname_(dbname),
       options_(options),
-      cache_(NewLRUCache(entries)) {
+      cache_(NewLRUCache(entries)),
+      db_id_(0) {
 }
 
 TableCache::~TableCache() {
@@ -50,7 +53,7 @@ TableCache::~TableCache() {
 // 否则, 根据 file_number 读取文件构造一个新的 table, 
 // 将其插入到 cache_, 并将结果保存到 handle. 
 Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
-                             Cache::Handle** handle) {
+                             Cache::Handle** handle, uint64_t cache_id) {
   Status s;
   // 将文件号编码到字节数组 buf 中
   char buf[sizeof(file_number)];
@@ -77,7 +80,8 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
     }
     // 根据成功打开的文件, 创建一个 Table 对象并将其地址保存到 table 中
     if (s.ok()) {
-      s = Table::Open(options_, file, file_size, &table);
+      s = Table::Open(options_, file, file_size, db_id_, file_number,
+                      cache_id, &table);
     }
 
     if (!s.ok()) {
@@ -172,10 +176,101 @@ Status TableCache::Get(const ReadOptions& options,
   return s;
 }
 
+bool TableCache::RangeMayMatch(uint64_t file_number, uint64_t file_size,
+                               const Slice* lower, const Slice* upper) {
+  Cache::Handle* handle = nullptr;
+  if (!FindTable(file_number, file_size, &handle).ok()) {
+    return true;
+  }
+  Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+  const bool result = t->RangeMayMatch(lower, upper);
+  cache_->Release(handle);
+  return result;
+}
+
+bool TableCache::ApproximatePositionOf(uint64_t file_number,
+                                       uint64_t file_size, const Slice& key,
+                                       uint64_t* offset, uint64_t* entries) {
+  *offset = 0;
+  *entries = 0;
+  Cache::Handle* handle = nullptr;
+  if (!FindTable(file_number, file_size, &handle).ok()) {
+    return false;
+  }
+  Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+  const bool result = t->ApproximatePositionOf(key, offset, entries);
+  cache_->Release(handle);
+  return result;
+}
+
 void TableCache::Evict(uint64_t file_number) {
   char buf[sizeof(file_number)];
   EncodeFixed64(buf, file_number);
   cache_->Erase(Slice(buf, sizeof(buf)));
 }
 
+Status TableCache::AddTable(uint64_t file_number, uint64_t file_size,
+                            uint64_t cache_id) {
+  Cache::Handle* handle = nullptr;
+  Status s = FindTable(file_number, file_size, &handle, cache_id);
+  if (s.ok()) {
+    cache_->Release(handle);
+  }
+  return s;
+}
+
+// 记录每个已打开 table 的 block_cache key 前缀到其文件编号的映射
+void TableCache::CollectCacheId(void* arg, const Slice& key, void* value) {
+  std::map<uint64_t, uint64_t>* ids =
+      reinterpret_cast<std::map<uint64_t, uint64_t>*>(arg);
+  TableAndFile* tf = reinterpret_cast<TableAndFile*>(value);
+  (*ids)[tf->table->CacheId()] = DecodeFixed64(key.data());
+}
+
+namespace {
+struct CachedBlockCollector {
+  std::map<uint64_t, uint64_t> ids;
+  std::vector<std::pair<uint64_t, uint64_t>>* blocks;
+};
+}  // anonymous namespace
+
+// block_cache 的 key 为 cache_id 与 block 偏移量, 见 Table::BlockReader.
+// 不属于本数据库 table 的数据项(比如共享 block_cache 的其它数据库) 被忽略.
+static void CollectBlock(void* arg, const Slice& key, void* value) {
+  CachedBlockCollector* c = reinterpret_cast<CachedBlockCollector*>(arg);
+  if (key.size() != 16) {
+    return;
+  }
+  std::map<uint64_t, uint64_t>::const_iterator it =
+      c->ids.find(DecodeFixed64(key.data()));
+  if (it != c->ids.end()) {
+    c->blocks->push_back(
+        std::make_pair(it->second, DecodeFixed64(key.data() + 8)));
+  }
+}
+
+void TableCache::GetCachedBlocks(
+    std::vector<std::pair<uint64_t, uint64_t>>* blocks) {
+  Cache* block_cache = options_.block_cache;
+  if (block_cache == nullptr) {
+    return;
+  }
+  CachedBlockCollector collector;
+  collector.blocks = blocks;
+  cache_->ApplyToAllEntries(&CollectCacheId, &collector.ids);
+  block_cache->ApplyToAllEntries(&CollectBlock, &collector);
+}
+
+Status TableCache::PrefetchBlocks(uint64_t file_number, uint64_t file_size,
+                                  const std::vector<uint64_t>& offsets) {
+  Cache::Handle* handle = nullptr;
+  Status s = FindTable(file_number, file_size, &handle);
+  if (s.ok()) {
+    Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+    t->PrefetchBlocks(offsets);
+    cache_->Release(handle);
+  }
+  return s;
+}
+
 }  // namespace leveldb
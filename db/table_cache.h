@@ -9,6 +9,8 @@
 
 #include <string>
 #include <stdint.h>
+#include <utility>
+#include <vector>
 #include "db/dbformat.h"
 #include "leveldb/cache.h"
 #include "leveldb/table.h"
@@ -72,10 +74,42 @@ class TableCache {
              void* arg,
              void (*handle_result)(void*, const Slice&, const Slice&));
 
+  // file_number 对应的 table 中是否可能有 user key 位于 [*lower, *upper),
+  // 见 Options::range_filter. 打开 table 出错时返回 true, 由之后的读操作报告错误.
+  bool RangeMayMatch(uint64_t file_number, uint64_t file_size,
+                     const Slice* lower, const Slice* upper);
+
+  // 见 Table::ApproximatePositionOf, key 为 internal key.
+  // 打开 table 出错时返回 false, *offset 和 *entries 均为 0.
+  bool ApproximatePositionOf(uint64_t file_number, uint64_t file_size,
+                             const Slice& key, uint64_t* offset,
+                             uint64_t* entries);
+
   // 从 LRUCache 驱逐 file_number 对应的 table 对象
   void Evict(uint64_t file_number);
 
+  // 设置数据库的唯一标识, 之后打开的 table 才会使用 persistent_cache.
+  // 必须在打开任何 table 之前调用.
+  void SetDbId(uint64_t db_id) { db_id_ = db_id; }
+
+  // 打开刚写好的 table 文件并放入缓存, 以 cache_id 作为其 block_cache 的 key 前缀,
+  // 这样写文件时通过 TableBuilder::CacheDataBlocks 放入 block_cache 的
+  // data block 即可被直接命中.
+  Status AddTable(uint64_t file_number, uint64_t file_size, uint64_t cache_id);
+
+  // 将 block_cache 中属于已打开 table 的 data block 以 <文件编号, block 偏移量>
+  // 的形式追加到 *blocks, 较热的 block 排在前面.
+  void GetCachedBlocks(std::vector<std::pair<uint64_t, uint64_t>>* blocks);
+
+  // 将 file_number 对应 table 中偏移量位于 offsets(升序排列) 的 data block
+  // 读入 block_cache.
+  Status PrefetchBlocks(uint64_t file_number, uint64_t file_size,
+                        const std::vector<uint64_t>& offsets);
+
  private:
+  // 用于 GetCachedBlocks 遍历 cache_
+  static void CollectCacheId(void* arg, const Slice& key, void* value);
+
   // 一些环境变量
   Env* const env_;
   // 对应的数据库名字
@@ -84,13 +118,17 @@ class TableCache {
   const Options& options_;
   // 一个基于特定淘汰算法(如 LRU)的 Cache
   Cache* cache_;
+  // 数据库的唯一标识, 见 Table::Open
+  uint64_t db_id_;
 
   // 私有方法.
   // 从 cache_ 查找 file_number 对应的 table, 如果查到则将其
   // 在 cache_ 对应的指针保存到 handle; 
   // 否则, 根据 file_number 读取文件构造一个新的 table, 
   // 将其插入到 cache_, 并将结果保存到 handle. 
-  Status FindTable(uint64_t file_number, uint64_t file_size, Cache::Handle**);
+  // cache_id 非 0 时, 新打开的 table 以它作为 block_cache 的 key 前缀
+  Status FindTable(uint64_t file_number, uint64_t file_size, Cache::Handle**,
+                   uint64_t cache_id = 0);
 };
 
 }  // namespace leveldb
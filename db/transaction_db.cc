@@ -0,0 +1,173 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/transaction_db.h"
+
+#include <atomic>
+#include <set>
+#include <string>
+
+#include "db/transaction_lock_mgr.h"
+#include "db/write_batch_internal.h"
+#include "leveldb/env.h"
+#include "leveldb/write_batch_with_index.h"
+
+namespace leveldb {
+
+namespace {
+
+class PessimisticTransactionImpl : public Transaction {
+ public:
+  PessimisticTransactionImpl(DB* db, const Comparator* comparator,
+                             TransactionLockMgr* lock_mgr, uint64_t txn_id,
+                             const WriteOptions& write_options,
+                             int64_t lock_timeout_micros)
+      : db_(db),
+        lock_mgr_(lock_mgr),
+        txn_id_(txn_id),
+        write_options_(write_options),
+        lock_timeout_micros_(lock_timeout_micros),
+        batch_(comparator) {
+  }
+
+  virtual ~PessimisticTransactionImpl() {
+    Clear();
+  }
+
+  virtual Status Get(const ReadOptions& options,
+                     const Slice& key, std::string* value) {
+    // 本事务自己写过的 key 直接返回 batch 中的结果
+    return batch_.GetFromBatchAndDB(db_, options, key, value);
+  }
+
+  // 先加锁再读取, 之后直到事务结束其它事务都无法修改该 key.
+  virtual Status GetForUpdate(const ReadOptions& options,
+                              const Slice& key, std::string* value) {
+    Status s = Lock(key);
+    if (s.ok()) {
+      s = Get(options, key, value);
+    }
+    return s;
+  }
+
+  virtual Status Put(const Slice& key, const Slice& value) {
+    Status s = Lock(key);
+    if (s.ok()) {
+      batch_.Put(key, value);
+    }
+    return s;
+  }
+
+  virtual Status Delete(const Slice& key) {
+    Status s = Lock(key);
+    if (s.ok()) {
+      batch_.Delete(key);
+    }
+    return s;
+  }
+
+  // 全部写操作通过一次批量写原子地写入, 写入之后才释放锁,
+  // 这样其它事务拿到锁之后一定能读到本事务的写入结果.
+  virtual Status Commit() {
+    Status s;
+    WriteBatch* updates = batch_.GetWriteBatch();
+    if (WriteBatchInternal::Count(updates) > 0) {
+      s = db_->Write(write_options_, updates);
+    }
+    Clear();
+    return s;
+  }
+
+  virtual void Rollback() {
+    Clear();
+  }
+
+ private:
+  Status Lock(const Slice& key) {
+    std::string k = key.ToString();
+    if (locked_.count(k) > 0) {
+      return Status::OK();
+    }
+    Status s = lock_mgr_->TryLock(txn_id_, k, lock_timeout_micros_);
+    if (s.ok()) {
+      locked_.insert(k);
+    }
+    return s;
+  }
+
+  void Clear() {
+    for (std::set<std::string>::const_iterator iter = locked_.begin();
+         iter != locked_.end(); ++iter) {
+      lock_mgr_->UnLock(txn_id_, *iter);
+    }
+    locked_.clear();
+    batch_.Clear();
+  }
+
+  DB* const db_;
+  TransactionLockMgr* const lock_mgr_;
+  const uint64_t txn_id_;
+  const WriteOptions write_options_;
+  const int64_t lock_timeout_micros_;
+  WriteBatchWithIndex batch_;
+  // 本事务持有锁的 key
+  std::set<std::string> locked_;
+};
+
+class TransactionDBImpl : public TransactionDB {
+ public:
+  TransactionDBImpl(DB* db, const Options& options,
+                    const TransactionDBOptions& txn_db_options)
+      : db_(db),
+        comparator_(options.comparator),
+        txn_db_options_(txn_db_options),
+        lock_mgr_(txn_db_options.num_stripes, txn_db_options.deadlock_detect,
+                  options.env),
+        next_txn_id_(1) {
+  }
+
+  virtual ~TransactionDBImpl() {
+    delete db_;
+  }
+
+  virtual Transaction* BeginTransaction(
+      const WriteOptions& write_options,
+      const TransactionOptions& txn_options) {
+    int64_t timeout = txn_options.lock_timeout >= 0
+                          ? txn_options.lock_timeout
+                          : txn_db_options_.lock_timeout;
+    int64_t timeout_micros = timeout >= 0 ? timeout * 1000 : -1;
+    return new PessimisticTransactionImpl(
+        db_, comparator_, &lock_mgr_, next_txn_id_.fetch_add(1, std::memory_order_relaxed),
+        write_options, timeout_micros);
+  }
+
+  virtual DB* GetBaseDB() { return db_; }
+
+ private:
+  DB* const db_;
+  const Comparator* const comparator_;
+  const TransactionDBOptions txn_db_options_;
+  TransactionLockMgr lock_mgr_;
+  std::atomic<uint64_t> next_txn_id_;
+};
+
+}  // anonymous namespace
+
+TransactionDB::~TransactionDB() { }
+
+Status TransactionDB::Open(const Options& options,
+                           const TransactionDBOptions& txn_db_options,
+                           const std::string& name,
+                           TransactionDB** dbptr) {
+  *dbptr = nullptr;
+  DB* db;
+  Status s = DB::Open(options, name, &db);
+  if (s.ok()) {
+    *dbptr = new TransactionDBImpl(db, options, txn_db_options);
+  }
+  return s;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,277 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/transaction_db.h"
+
+#include <stdlib.h>
+
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "util/mutexlock.h"
+#include "util/random.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+class TransactionDBTest {
+ public:
+  std::string dbname_;
+  Options options_;
+  TransactionDBOptions txn_db_options_;
+  TransactionDB* txn_db_;
+  DB* db_;
+
+  TransactionDBTest() : txn_db_(nullptr), db_(nullptr) {
+    dbname_ = test::TmpDir() + "/transaction_db_test";
+    DestroyDB(dbname_, Options());
+    options_.create_if_missing = true;
+    txn_db_options_.lock_timeout = 100;
+    Reopen();
+  }
+
+  ~TransactionDBTest() {
+    delete txn_db_;
+    DestroyDB(dbname_, Options());
+  }
+
+  void Reopen() {
+    delete txn_db_;
+    txn_db_ = nullptr;
+    ASSERT_OK(TransactionDB::Open(options_, txn_db_options_, dbname_,
+                                  &txn_db_));
+    db_ = txn_db_->GetBaseDB();
+  }
+
+  std::string Get(const std::string& k) {
+    std::string result;
+    Status s = db_->Get(ReadOptions(), k, &result);
+    if (s.IsNotFound()) {
+      result = "NOT_FOUND";
+    } else if (!s.ok()) {
+      result = s.ToString();
+    }
+    return result;
+  }
+};
+
+TEST(TransactionDBTest, CommitAndRollback) {
+  Transaction* txn = txn_db_->BeginTransaction(WriteOptions());
+  ASSERT_OK(txn->Put("a", "va"));
+  ASSERT_OK(txn->Put("b", "vb"));
+  std::string value;
+  ASSERT_OK(txn->Get(ReadOptions(), "a", &value));
+  ASSERT_EQ("va", value);
+  ASSERT_EQ("NOT_FOUND", Get("a"));
+  ASSERT_OK(txn->Commit());
+  ASSERT_EQ("va", Get("a"));
+  ASSERT_EQ("vb", Get("b"));
+
+  ASSERT_OK(txn->Delete("a"));
+  txn->Rollback();
+  ASSERT_OK(txn->Commit());
+  ASSERT_EQ("va", Get("a"));
+  delete txn;
+}
+
+TEST(TransactionDBTest, LockTimeout) {
+  Transaction* txn1 = txn_db_->BeginTransaction(WriteOptions());
+  Transaction* txn2 = txn_db_->BeginTransaction(WriteOptions());
+  std::string value;
+  ASSERT_TRUE(txn1->GetForUpdate(ReadOptions(), "a", &value).IsNotFound());
+  ASSERT_TRUE(txn2->Put("a", "v2").IsBusy());
+  ASSERT_TRUE(txn2->GetForUpdate(ReadOptions(), "a", &value).IsBusy());
+  // Plain reads never wait for locks.
+  ASSERT_TRUE(txn2->Get(ReadOptions(), "a", &value).IsNotFound());
+
+  ASSERT_OK(txn1->Put("a", "v1"));
+  ASSERT_OK(txn1->Commit());
+  // The lock was released by the commit.
+  ASSERT_OK(txn2->GetForUpdate(ReadOptions(), "a", &value));
+  ASSERT_EQ("v1", value);
+  ASSERT_OK(txn2->Put("a", "v2"));
+  ASSERT_OK(txn2->Commit());
+  ASSERT_EQ("v2", Get("a"));
+  delete txn1;
+  delete txn2;
+}
+
+TEST(TransactionDBTest, DeleteReleasesLocks) {
+  Transaction* txn1 = txn_db_->BeginTransaction(WriteOptions());
+  ASSERT_OK(txn1->Put("a", "v1"));
+  delete txn1;
+  Transaction* txn2 = txn_db_->BeginTransaction(WriteOptions());
+  ASSERT_OK(txn2->Put("a", "v2"));
+  ASSERT_OK(txn2->Commit());
+  ASSERT_EQ("v2", Get("a"));
+  delete txn2;
+}
+
+namespace {
+
+struct DeadlockState {
+  Transaction* txn;
+  port::Mutex mu;
+  port::CondVar cv;
+  bool done;
+  Status status;
+
+  DeadlockState() : cv(&mu), done(false) { }
+};
+
+static void LockB(void* arg) {
+  DeadlockState* state = reinterpret_cast<DeadlockState*>(arg);
+  Status s = state->txn->Put("b", "v");
+  MutexLock l(&state->mu);
+  state->status = s;
+  state->done = true;
+  state->cv.Signal();
+}
+
+}  // namespace
+
+TEST(TransactionDBTest, DeadlockDetection) {
+  // Wait forever so that only deadlock detection can break the cycle.
+  txn_db_options_.lock_timeout = -1;
+  Reopen();
+
+  Transaction* txn1 = txn_db_->BeginTransaction(WriteOptions());
+  Transaction* txn2 = txn_db_->BeginTransaction(WriteOptions());
+  ASSERT_OK(txn1->Put("a", "v1"));
+  ASSERT_OK(txn2->Put("b", "v2"));
+
+  // txn1 blocks on "b" held by txn2 ...
+  DeadlockState state;
+  state.txn = txn1;
+  Env::Default()->StartThread(LockB, &state);
+  Env::Default()->SleepForMicroseconds(100000);
+
+  // ... so txn2 waiting on "a" would deadlock and fails right away.
+  Status s = txn2->Put("a", "v2");
+  ASSERT_TRUE(s.IsBusy());
+  txn2->Rollback();
+
+  {
+    MutexLock l(&state.mu);
+    while (!state.done) {
+      state.cv.Wait();
+    }
+    ASSERT_OK(state.status);
+  }
+  ASSERT_OK(txn1->Commit());
+  ASSERT_EQ("v1", Get("a"));
+  ASSERT_EQ("v", Get("b"));
+  delete txn1;
+  delete txn2;
+}
+
+namespace {
+
+static const int kNumAccounts = 8;
+static const int kNumThreads = 4;
+static const int kNumTransfers = 200;
+static const int kInitialBalance = 1000;
+
+struct TransferState {
+  TransactionDB* db;
+  port::Mutex mu;
+  port::CondVar cv;
+  int remaining;
+  bool failed;
+
+  TransferState() : cv(&mu), remaining(kNumThreads), failed(false) { }
+};
+
+static std::string AccountKey(int i) {
+  char buf[20];
+  snprintf(buf, sizeof(buf), "account%d", i);
+  return buf;
+}
+
+static void TransferThread(void* arg) {
+  TransferState* state = reinterpret_cast<TransferState*>(arg);
+  Random rnd(static_cast<uint32_t>(reinterpret_cast<uintptr_t>(&rnd)));
+  Transaction* txn = state->db->BeginTransaction(WriteOptions());
+  bool failed = false;
+  for (int i = 0; i < kNumTransfers && !failed; i++) {
+    int from = rnd.Uniform(kNumAccounts);
+    int to = rnd.Uniform(kNumAccounts);
+    if (from == to) {
+      continue;
+    }
+    while (true) {
+      std::string from_value, to_value;
+      Status s = txn->GetForUpdate(ReadOptions(), AccountKey(from),
+                                   &from_value);
+      if (s.ok()) {
+        s = txn->GetForUpdate(ReadOptions(), AccountKey(to), &to_value);
+      }
+      if (s.ok()) {
+        char buf[20];
+        snprintf(buf, sizeof(buf), "%d", atoi(from_value.c_str()) - 1);
+        s = txn->Put(AccountKey(from), buf);
+        if (s.ok()) {
+          snprintf(buf, sizeof(buf), "%d", atoi(to_value.c_str()) + 1);
+          s = txn->Put(AccountKey(to), buf);
+        }
+      }
+      if (s.ok()) {
+        s = txn->Commit();
+        if (!s.ok()) {
+          failed = true;
+        }
+        break;
+      }
+      txn->Rollback();
+      if (!s.IsBusy()) {
+        failed = true;
+        break;
+      }
+    }
+  }
+  delete txn;
+
+  MutexLock l(&state->mu);
+  if (failed) {
+    state->failed = true;
+  }
+  state->remaining--;
+  state->cv.Signal();
+}
+
+}  // namespace
+
+TEST(TransactionDBTest, ConcurrentTransfers) {
+  char buf[20];
+  snprintf(buf, sizeof(buf), "%d", kInitialBalance);
+  for (int i = 0; i < kNumAccounts; i++) {
+    ASSERT_OK(db_->Put(WriteOptions(), AccountKey(i), buf));
+  }
+
+  TransferState state;
+  state.db = txn_db_;
+  for (int i = 0; i < kNumThreads; i++) {
+    Env::Default()->StartThread(TransferThread, &state);
+  }
+  {
+    MutexLock l(&state.mu);
+    while (state.remaining > 0) {
+      state.cv.Wait();
+    }
+    ASSERT_TRUE(!state.failed);
+  }
+
+  // Every transfer moves one unit between accounts, so the total is
+  // preserved only if transfers were serialized correctly.
+  int total = 0;
+  for (int i = 0; i < kNumAccounts; i++) {
+    total += atoi(Get(AccountKey(i)).c_str());
+  }
+  ASSERT_EQ(kNumAccounts * kInitialBalance, total);
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
@@ -0,0 +1,127 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/transaction_lock_mgr.h"
+
+#include "util/hash.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+TransactionLockMgr::TransactionLockMgr(size_t num_stripes,
+                                       bool deadlock_detect, Env* env)
+    : num_stripes_(num_stripes > 0 ? num_stripes : 1),
+      deadlock_detect_(deadlock_detect),
+      env_(env),
+      stripes_(new Stripe[num_stripes_]) {
+}
+
+TransactionLockMgr::~TransactionLockMgr() {
+  delete[] stripes_;
+}
+
+TransactionLockMgr::Stripe* TransactionLockMgr::GetStripe(
+    const std::string& key) {
+  return &stripes_[Hash(key.data(), key.size(), 0) % num_stripes_];
+}
+
+Status TransactionLockMgr::TryLock(uint64_t txn_id, const std::string& key,
+                                   int64_t timeout_micros) {
+  Stripe* stripe = GetStripe(key);
+  const uint64_t deadline =
+      timeout_micros < 0 ? 0 : env_->NowMicros() + timeout_micros;
+
+  MutexLock l(&stripe->mu);
+  while (true) {
+    std::map<std::string, uint64_t>::iterator iter = stripe->locks.find(key);
+    if (iter == stripe->locks.end()) {
+      stripe->locks.insert(std::make_pair(key, txn_id));
+      return Status::OK();
+    }
+    const uint64_t holder = iter->second;
+    if (holder == txn_id) {
+      return Status::OK();
+    }
+
+    uint64_t wait_micros = 0;
+    if (timeout_micros >= 0) {
+      const uint64_t now = env_->NowMicros();
+      if (now >= deadline) {
+        return Status::Busy("lock timeout", key);
+      }
+      wait_micros = deadline - now;
+    }
+
+    if (deadlock_detect_ && !AddWaiter(txn_id, holder, key)) {
+      return Status::Busy("deadlock", key);
+    }
+    // 条带内任意 key 被释放都会唤醒等待者, 所以醒来后要重新检查.
+    if (timeout_micros >= 0) {
+      stripe->cv.TimedWait(wait_micros);
+    } else {
+      stripe->cv.Wait();
+    }
+    if (deadlock_detect_) {
+      RemoveWaiter(txn_id);
+    }
+  }
+}
+
+void TransactionLockMgr::UnLock(uint64_t txn_id, const std::string& key) {
+  Stripe* stripe = GetStripe(key);
+  {
+    MutexLock l(&stripe->mu);
+    std::map<std::string, uint64_t>::iterator iter = stripe->locks.find(key);
+    if (iter == stripe->locks.end() || iter->second != txn_id) {
+      return;
+    }
+    stripe->locks.erase(iter);
+    if (deadlock_detect_) {
+      RemoveWaitersFor(txn_id, key);
+    }
+  }
+  stripe->cv.SignalAll();
+}
+
+bool TransactionLockMgr::AddWaiter(uint64_t txn_id, uint64_t holder,
+                                   const std::string& key) {
+  MutexLock l(&wait_mu_);
+  // 每个事务最多等待一个持有者, 沿着等待链前进, 链的长度不会超过等待者个数.
+  uint64_t current = holder;
+  for (size_t i = 0; i <= wait_for_.size(); i++) {
+    if (current == txn_id) {
+      return false;
+    }
+    std::map<uint64_t, WaitEdge>::const_iterator iter =
+        wait_for_.find(current);
+    if (iter == wait_for_.end()) {
+      break;
+    }
+    current = iter->second.holder;
+  }
+  WaitEdge& edge = wait_for_[txn_id];
+  edge.holder = holder;
+  edge.key = key;
+  return true;
+}
+
+void TransactionLockMgr::RemoveWaiter(uint64_t txn_id) {
+  MutexLock l(&wait_mu_);
+  wait_for_.erase(txn_id);
+}
+
+void TransactionLockMgr::RemoveWaitersFor(uint64_t holder,
+                                          const std::string& key) {
+  MutexLock l(&wait_mu_);
+  std::map<uint64_t, WaitEdge>::iterator iter = wait_for_.begin();
+  while (iter != wait_for_.end()) {
+    if (iter->second.holder == holder && iter->second.key == key) {
+      wait_for_.erase(iter++);
+    } else {
+      ++iter;
+    }
+  }
+}
+
+}  // namespace leveldb
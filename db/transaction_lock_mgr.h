@@ -0,0 +1,78 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_DB_TRANSACTION_LOCK_MGR_H_
+#define STORAGE_LEVELDB_DB_TRANSACTION_LOCK_MGR_H_
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include "leveldb/env.h"
+#include "leveldb/status.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
+
+namespace leveldb {
+
+// 悲观事务使用的 key 级别排他锁管理器.
+//
+// 锁表按 key 的哈希值被分成若干条带(stripe), 每个条带有自己的互斥量和条件变量,
+// 不同条带上的加锁和解锁互不影响. 每个 key 最多被一个事务持有.
+//
+// 开启死锁检测时, 管理器维护一张等待图: 每个正在等待的事务只会等待一个持有者,
+// 所以沿着等待链走下去如果回到了自己, 说明等待会导致死锁.
+class TransactionLockMgr {
+ public:
+  TransactionLockMgr(size_t num_stripes, bool deadlock_detect, Env* env);
+  ~TransactionLockMgr();
+
+  TransactionLockMgr(const TransactionLockMgr&) = delete;
+  TransactionLockMgr& operator=(const TransactionLockMgr&) = delete;
+
+  // 为事务 txn_id 获取 key 上的排他锁, 如果该事务已经持有这把锁直接返回 OK.
+  // 最多等待 timeout_micros 微秒(小于 0 表示一直等待), 超时返回 Busy;
+  // 如果开启了死锁检测并且等待会导致死锁, 立即返回 Busy.
+  Status TryLock(uint64_t txn_id, const std::string& key,
+                 int64_t timeout_micros);
+
+  // 释放事务 txn_id 持有的 key 上的锁.
+  void UnLock(uint64_t txn_id, const std::string& key);
+
+ private:
+  struct Stripe {
+    port::Mutex mu;
+    port::CondVar cv;
+    // key -> 持有该 key 的事务
+    std::map<std::string, uint64_t> locks GUARDED_BY(mu);
+
+    Stripe() : cv(&mu) { }
+  };
+
+  Stripe* GetStripe(const std::string& key);
+
+  // 等待图中的一条边: 等待者在等待 holder 释放 key.
+  struct WaitEdge {
+    uint64_t holder;
+    std::string key;
+  };
+
+  // 记录 txn_id 正在等待 holder 释放 key, 如果这会形成环则不记录并返回 false.
+  bool AddWaiter(uint64_t txn_id, uint64_t holder, const std::string& key);
+  void RemoveWaiter(uint64_t txn_id);
+  // holder 释放了 key, 等待这把锁的事务都会被唤醒重新检查, 清掉对应的边.
+  void RemoveWaitersFor(uint64_t holder, const std::string& key);
+
+  const size_t num_stripes_;
+  const bool deadlock_detect_;
+  Env* const env_;
+  Stripe* stripes_;
+
+  port::Mutex wait_mu_;
+  // 等待图: 等待者 -> 它正在等待的持有者
+  std::map<uint64_t, WaitEdge> wait_for_ GUARDED_BY(wait_mu_);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_TRANSACTION_LOCK_MGR_H_
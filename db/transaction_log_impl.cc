@@ -0,0 +1,192 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/transaction_log_impl.h"
+
+#include <string>
+
+#include "db/log_reader.h"
+#include "db/write_batch_internal.h"
+#include "leveldb/env.h"
+
+namespace leveldb {
+
+TransactionLogIterator::TransactionLogIterator() { }
+
+TransactionLogIterator::~TransactionLogIterator() { }
+
+namespace {
+
+class TransactionLogIteratorImpl : public TransactionLogIterator {
+ public:
+  // 一个 log 文件及其 reader. 为了找到起始文件, 每个文件的第一条记录
+  // 会被提前读出来暂存在 first_record 中.
+  struct LogSource {
+    SequentialFile* file;
+    log::Reader* reader;
+    std::string scratch;
+    Slice first_record;
+    bool has_first_record;
+  };
+
+  TransactionLogIteratorImpl(const std::vector<SequentialFile*>& files,
+                             SequenceNumber sequence,
+                             SequenceNumber last_sequence)
+      : sequence_(sequence),
+        last_sequence_(last_sequence),
+        current_(0),
+        valid_(false) {
+    reporter_.status = &status_;
+    for (size_t i = 0; i < files.size(); i++) {
+      LogSource* source = new LogSource;
+      source->file = files[i];
+      source->reader = new log::Reader(files[i], &reporter_, true /*checksum*/,
+                                       0 /*initial_offset*/);
+      source->has_first_record =
+          source->reader->ReadRecord(&source->first_record, &source->scratch);
+      sources_.push_back(source);
+    }
+  }
+
+  virtual ~TransactionLogIteratorImpl() {
+    for (size_t i = 0; i < sources_.size(); i++) {
+      delete sources_[i]->reader;
+      delete sources_[i]->file;
+      delete sources_[i];
+    }
+  }
+
+  // 定位到包含 sequence_ 的 batch.
+  void SeekToStart() {
+    // 从最后一个起始序列号不大于 sequence_ 的文件开始读, 之前的文件
+    // 不可能包含 sequence_ 及其之后的 batch.
+    SequenceNumber earliest = kMaxSequenceNumber;
+    for (size_t i = 0; i < sources_.size() && status_.ok(); i++) {
+      LogSource* source = sources_[i];
+      if (!source->has_first_record ||
+          source->first_record.size() < 12) {
+        continue;
+      }
+      WriteBatchInternal::SetContents(&batch_, source->first_record);
+      const SequenceNumber first = WriteBatchInternal::Sequence(&batch_);
+      if (earliest == kMaxSequenceNumber) {
+        earliest = first;
+      }
+      if (first <= sequence_) {
+        current_ = i;
+      }
+    }
+    if (!status_.ok() || sequence_ > last_sequence_) {
+      return;
+    }
+    if (earliest == kMaxSequenceNumber || earliest > sequence_) {
+      // sequence_ 之前的更新都已经不在了
+      status_ = Status::NotFound("updates are no longer retained");
+      return;
+    }
+    ReadBatch();
+  }
+
+  virtual bool Valid() const { return valid_; }
+
+  virtual void Next() {
+    assert(valid_);
+    ReadBatch();
+  }
+
+  virtual Status status() const { return status_; }
+
+  virtual uint64_t sequence() const {
+    assert(valid_);
+    return WriteBatchInternal::Sequence(&batch_);
+  }
+
+  virtual const WriteBatch& batch() const {
+    assert(valid_);
+    return batch_;
+  }
+
+ private:
+  struct Reporter : public log::Reader::Reporter {
+    Status* status;
+    virtual void Corruption(size_t bytes, const Status& s) {
+      if (this->status->ok()) *this->status = s;
+    }
+  };
+
+  // 按顺序读取下一条记录, 当前文件读完了就接着读下一个文件.
+  bool ReadRecord(Slice* record) {
+    while (current_ < sources_.size() && status_.ok()) {
+      LogSource* source = sources_[current_];
+      if (source->has_first_record) {
+        source->has_first_record = false;
+        *record = source->first_record;
+        return true;
+      }
+      if (source->reader->ReadRecord(record, &source->scratch)) {
+        return true;
+      }
+      current_++;
+    }
+    return false;
+  }
+
+  // 读取下一个包含 sequence_ 及其之后的 batch.
+  void ReadBatch() {
+    valid_ = false;
+    Slice record;
+    while (ReadRecord(&record)) {
+      if (record.size() < 12) {
+        status_ = Status::Corruption("log record too small");
+        return;
+      }
+      WriteBatchInternal::SetContents(&batch_, record);
+      const SequenceNumber first = WriteBatchInternal::Sequence(&batch_);
+      if (first > last_sequence_) {
+        // 创建迭代器之后才写入的 batch, 可能还没有写完整.
+        return;
+      }
+      const SequenceNumber last = first + WriteBatchInternal::Count(&batch_);
+      if (last > sequence_) {
+        // batch 覆盖的序列号区间是 [first, last).
+        valid_ = true;
+        return;
+      }
+    }
+  }
+
+  const SequenceNumber sequence_;
+  const SequenceNumber last_sequence_;
+  Reporter reporter_;
+  Status status_;
+  std::vector<LogSource*> sources_;
+  size_t current_;
+  WriteBatch batch_;
+  bool valid_;
+};
+
+}  // anonymous namespace
+
+Status NewTransactionLogIterator(const std::vector<SequentialFile*>& files,
+                                 SequenceNumber sequence,
+                                 SequenceNumber last_sequence,
+                                 TransactionLogIterator** result) {
+  // 序列号从 1 开始
+  if (sequence == 0) {
+    sequence = 1;
+  }
+  TransactionLogIteratorImpl* iter =
+      new TransactionLogIteratorImpl(files, sequence, last_sequence);
+  iter->SeekToStart();
+  Status s = iter->status();
+  if (s.ok()) {
+    *result = iter;
+  } else {
+    delete iter;
+    *result = nullptr;
+  }
+  return s;
+}
+
+}  // namespace leveldb
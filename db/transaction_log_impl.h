@@ -0,0 +1,28 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_DB_TRANSACTION_LOG_IMPL_H_
+#define STORAGE_LEVELDB_DB_TRANSACTION_LOG_IMPL_H_
+
+#include <vector>
+#include "db/dbformat.h"
+#include "leveldb/transaction_log.h"
+
+namespace leveldb {
+
+class SequentialFile;
+
+// 创建一个迭代器, 遍历 log 文件 files(按照 log 编号从小到大排列)中
+// 包含序列号 sequence 及其之后的全部 batch, 起始序列号大于 last_sequence
+// 的 batch 不会返回. 无论成功与否, 都会接管 files 中的全部文件.
+//
+// 如果 sequence 对应的 batch 已经不在这些文件中了, 返回 NotFound.
+Status NewTransactionLogIterator(const std::vector<SequentialFile*>& files,
+                                 SequenceNumber sequence,
+                                 SequenceNumber last_sequence,
+                                 TransactionLogIterator** result);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_TRANSACTION_LOG_IMPL_H_
@@ -0,0 +1,219 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/transaction_log.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "db/filename.h"
+#include "leveldb/db.h"
+#include "leveldb/env.h"
+#include "leveldb/write_batch.h"
+#include "util/logging.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+namespace {
+
+// Deletes one file right after listing a directory, the way the purge
+// thread can remove an obsolete log while GetUpdatesSince is running.
+class DeleteAfterListingEnv : public EnvWrapper {
+ public:
+  explicit DeleteAfterListingEnv(Env* base) : EnvWrapper(base) { }
+
+  virtual Status GetChildren(const std::string& dir,
+                             std::vector<std::string>* result) {
+    Status s = target()->GetChildren(dir, result);
+    if (s.ok() && !victim.empty()) {
+      target()->DeleteFile(victim);
+      victim.clear();
+    }
+    return s;
+  }
+
+  std::string victim;
+};
+
+// Renders the updates of a batch as "seq:put(k,v)" / "seq:del(k)".
+class BatchPrinter : public WriteBatch::Handler {
+ public:
+  explicit BatchPrinter(uint64_t sequence) : sequence_(sequence) { }
+
+  virtual void Put(const Slice& key, const Slice& value) {
+    Append("put(" + key.ToString() + "," + value.ToString() + ")");
+  }
+
+  virtual void Delete(const Slice& key) {
+    Append("del(" + key.ToString() + ")");
+  }
+
+  std::string result;
+
+ private:
+  void Append(const std::string& op) {
+    if (!result.empty()) {
+      result += " ";
+    }
+    result += NumberToString(sequence_++) + ":" + op;
+  }
+
+  uint64_t sequence_;
+};
+
+}  // namespace
+
+class TransactionLogTest {
+ public:
+  std::string dbname_;
+  Options options_;
+  DB* db_;
+
+  TransactionLogTest() : db_(nullptr) {
+    dbname_ = test::TmpDir() + "/transaction_log_test";
+    DestroyDB(dbname_, Options());
+    options_.create_if_missing = true;
+    Reopen();
+  }
+
+  ~TransactionLogTest() {
+    delete db_;
+    DestroyDB(dbname_, Options());
+  }
+
+  void Reopen() {
+    delete db_;
+    db_ = nullptr;
+    ASSERT_OK(DB::Open(options_, dbname_, &db_));
+  }
+
+  // Returns all updates since "seq", one batch per line.
+  std::string UpdatesSince(uint64_t seq) {
+    TransactionLogIterator* iter;
+    Status s = db_->GetUpdatesSince(seq, &iter);
+    if (!s.ok()) {
+      return s.ToString();
+    }
+    std::string result;
+    for (; iter->Valid(); iter->Next()) {
+      BatchPrinter printer(iter->sequence());
+      ASSERT_OK(iter->batch().Iterate(&printer));
+      result += printer.result + "\n";
+    }
+    ASSERT_OK(iter->status());
+    delete iter;
+    return result;
+  }
+};
+
+TEST(TransactionLogTest, Basic) {
+  ASSERT_EQ("", UpdatesSince(1));
+  ASSERT_OK(db_->Put(WriteOptions(), "a", "va"));
+  WriteBatch batch;
+  batch.Put("b", "vb");
+  batch.Delete("a");
+  batch.Put("c", "vc");
+  ASSERT_OK(db_->Write(WriteOptions(), &batch));
+  ASSERT_OK(db_->Delete(WriteOptions(), "b"));
+
+  const std::string all =
+      "1:put(a,va)\n"
+      "2:put(b,vb) 3:del(a) 4:put(c,vc)\n"
+      "5:del(b)\n";
+  ASSERT_EQ(all, UpdatesSince(0));
+  ASSERT_EQ(all, UpdatesSince(1));
+  // Starts with the batch containing the requested sequence.
+  ASSERT_EQ("2:put(b,vb) 3:del(a) 4:put(c,vc)\n5:del(b)\n", UpdatesSince(3));
+  ASSERT_EQ("5:del(b)\n", UpdatesSince(5));
+  ASSERT_EQ("", UpdatesSince(6));
+}
+
+TEST(TransactionLogTest, IteratorSeesOnlyEarlierWrites) {
+  ASSERT_OK(db_->Put(WriteOptions(), "a", "v1"));
+  TransactionLogIterator* iter;
+  ASSERT_OK(db_->GetUpdatesSince(1, &iter));
+  ASSERT_OK(db_->Put(WriteOptions(), "a", "v2"));
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ(1, iter->sequence());
+  iter->Next();
+  ASSERT_TRUE(!iter->Valid());
+  ASSERT_OK(iter->status());
+  delete iter;
+  ASSERT_EQ("2:put(a,v2)\n", UpdatesSince(2));
+}
+
+TEST(TransactionLogTest, ObsoleteLogsDeletedByDefault) {
+  ASSERT_OK(db_->Put(WriteOptions(), "a", "v1"));
+  // Reopening converts the log to a table and starts a new log.
+  Reopen();
+  ASSERT_OK(db_->Put(WriteOptions(), "a", "v2"));
+  ASSERT_TRUE(UpdatesSince(1).find("NotFound") == 0) << UpdatesSince(1);
+  ASSERT_EQ("2:put(a,v2)\n", UpdatesSince(2));
+}
+
+TEST(TransactionLogTest, RetainedLogs) {
+  options_.wal_ttl_seconds = 3600;
+  Reopen();
+  ASSERT_OK(db_->Put(WriteOptions(), "a", "v1"));
+  Reopen();
+  ASSERT_OK(db_->Put(WriteOptions(), "b", "v2"));
+  Reopen();
+  ASSERT_OK(db_->Put(WriteOptions(), "c", "v3"));
+  ASSERT_EQ("1:put(a,v1)\n2:put(b,v2)\n3:put(c,v3)\n", UpdatesSince(1));
+  ASSERT_EQ("2:put(b,v2)\n3:put(c,v3)\n", UpdatesSince(2));
+
+  // A tiny size limit drops all the retained logs again.
+  options_.wal_size_limit = 1;
+  Reopen();
+  ASSERT_TRUE(UpdatesSince(1).find("NotFound") == 0) << UpdatesSince(1);
+  ASSERT_OK(db_->Put(WriteOptions(), "d", "v4"));
+  ASSERT_EQ("4:put(d,v4)\n", UpdatesSince(4));
+}
+
+TEST(TransactionLogTest, LogDeletedWhileListing) {
+  DeleteAfterListingEnv env(Env::Default());
+  options_.env = &env;
+  options_.wal_ttl_seconds = 3600;
+  Reopen();
+  ASSERT_OK(db_->Put(WriteOptions(), "a", "v1"));
+  Reopen();
+  ASSERT_OK(db_->Put(WriteOptions(), "b", "v2"));
+  Reopen();
+  ASSERT_OK(db_->Put(WriteOptions(), "c", "v3"));
+  Reopen();
+  ASSERT_OK(db_->Put(WriteOptions(), "d", "v4"));
+
+  std::vector<std::string> filenames;
+  ASSERT_OK(env.GetChildren(dbname_, &filenames));
+  std::vector<uint64_t> logs;
+  uint64_t number;
+  FileType type;
+  for (size_t i = 0; i < filenames.size(); i++) {
+    if (ParseFileName(filenames[i], &number, &type) && type == kLogFile) {
+      logs.push_back(number);
+    }
+  }
+  std::sort(logs.begin(), logs.end());
+  ASSERT_GE(logs.size(), 4);
+
+  // Losing the oldest log just shortens the history.
+  env.victim = LogFileName(dbname_, logs[logs.size() - 4]);
+  ASSERT_EQ("2:put(b,v2)\n3:put(c,v3)\n4:put(d,v4)\n", UpdatesSince(2));
+
+  // Losing a log in the middle must not silently skip its updates.
+  env.victim = LogFileName(dbname_, logs[logs.size() - 2]);
+  ASSERT_EQ("NotFound: updates are no longer retained", UpdatesSince(2));
+  ASSERT_EQ("4:put(d,v4)\n", UpdatesSince(4));
+
+  delete db_;
+  db_ = nullptr;
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
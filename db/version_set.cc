@@ -96,6 +96,7 @@ Version::~Version() {
       assert(f->refs > 0);
       f->refs--; // 每个文件元数据被某个 version 引用的时候它对应的计数会加一, 因为该 version 要销毁了, 所以这里将其减一
       if (f->refs <= 0) {
+        vset_->UnrefFileNumber(f->number);
         delete f; // 如果没有任何 version 引用该文件元数据, 则将其所占空间释放
       }
     }
@@ -298,7 +299,16 @@ void Version::AddIterators(const ReadOptions& options,
   // 将 level-0 文件合并到一起, 因为它们互相之间可能有重叠. 
   // 合并过程就是为各个 table 文件生成相应的两级迭代器, 然后将各个迭代器放入 *iters.
   // 注意这里是按照从小到达顺序进行追加的, 这样虽然部分重叠, 但是整体有序.
+  //
+  // 设置了迭代范围时跳过在该范围内没有 key 的文件. 带时间戳的 user key 不能
+  // 直接与不带时间戳的上下界比较, 所以这时不跳过任何文件, 由 DBIter 过滤.
+  const bool bounded = (options.iterate_lower_bound != nullptr ||
+                        options.iterate_upper_bound != nullptr) &&
+                       vset_->icmp_.user_comparator()->timestamp_size() == 0;
   for (size_t i = 0; i < files_[0].size(); i++) {
+    if (bounded && !FileMayOverlapBounds(options, files_[0][i])) {
+      continue;
+    }
     iters->push_back(
         // 针对给定的 file_number(对应的文件长度也必须恰好是 file_size 字节数), 
         // 返回一个与其对应 table 的 iterator. 
@@ -316,12 +326,60 @@ void Version::AddIterators(const ReadOptions& options,
   //    level-1 及其之上, 每一层内部, 文件不会发生重叠)放入 *iters
   // 注意这里是从低 level 到高 level 追加的, 这样可以保证整体有序.
   for (int level = 1; level < config::kNumLevels; level++) {
-    if (!files_[level].empty()) {
+    if (files_[level].empty()) {
+      continue;
+    }
+    if (!bounded) {
+      iters->push_back(NewConcatenatingIterator(options, level));
+      continue;
+    }
+    // 与迭代范围相交的文件是连续的一段, 其中可能有 key 在范围内的文件
+    // 只有一个时直接使用它的迭代器, 一个都没有时跳过该层.
+    const std::vector<FileMetaData*>& files = files_[level];
+    size_t i = 0;
+    if (options.iterate_lower_bound != nullptr) {
+      InternalKey target(*options.iterate_lower_bound, kMaxSequenceNumber,
+                         kValueTypeForSeek);
+      i = FindFile(vset_->icmp_, files, target.Encode());
+    }
+    FileMetaData* match = nullptr;
+    int matches = 0;
+    for (; i < files.size() && matches < 2; i++) {
+      FileMetaData* f = files[i];
+      if (options.iterate_upper_bound != nullptr &&
+          vset_->icmp_.user_comparator()->Compare(
+              f->smallest.user_key(), *options.iterate_upper_bound) >= 0) {
+        break;
+      }
+      if (FileMayOverlapBounds(options, f)) {
+        match = f;
+        matches++;
+      }
+    }
+    if (matches == 1) {
+      iters->push_back(vset_->table_cache_->NewIterator(
+          options, match->number, match->file_size));
+    } else if (matches > 1) {
       iters->push_back(NewConcatenatingIterator(options, level));
     }
   }
 }
 
+bool Version::FileMayOverlapBounds(const ReadOptions& options,
+                                   const FileMetaData* f) const {
+  const Comparator* ucmp = vset_->icmp_.user_comparator();
+  const Slice* lower = options.iterate_lower_bound;
+  const Slice* upper = options.iterate_upper_bound;
+  if (lower != nullptr && ucmp->Compare(f->largest.user_key(), *lower) < 0) {
+    return false;
+  }
+  if (upper != nullptr && ucmp->Compare(f->smallest.user_key(), *upper) >= 0) {
+    return false;
+  }
+  return vset_->table_cache_->RangeMayMatch(f->number, f->file_size,
+                                            lower, upper);
+}
+
 // Callback from TableCache::Get()
 // 以下结构和方法使用见 TableCache::Get() 方法
 namespace {
@@ -330,12 +388,15 @@ enum SaverState {
   kFound,
   kDeleted,
   kCorrupt,
+  kInvisible, // 找到的版本对快照不可见, 需要从 skip_key 处重新查找
 };
 struct Saver {
   SaverState state;
   const Comparator* ucmp; // user_key comparator
   Slice user_key;
+  SequenceNumber sequence; // 快照对应的序列号
   std::string* value;
+  std::string skip_key;
 };
 }
 
@@ -348,7 +409,18 @@ static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
   if (!ParseInternalKey(ikey, &parsed_key)) {
     s->state = kCorrupt;
   } else {
-    if (s->ucmp->Compare(parsed_key.user_key, s->user_key) == 0) {
+    if (s->ucmp->CompareWithoutTimestamp(parsed_key.user_key,
+                                         s->user_key) == 0) {
+      if (parsed_key.sequence > s->sequence) {
+        // 带时间戳时, 时间戳更早的版本序列号可能比快照还大(见 MemTable::Get).
+        // 跳过该时间戳下全部不可见的版本, 从第一个可能可见的版本重新查找.
+        s->state = kInvisible;
+        s->skip_key.clear();
+        AppendInternalKey(&s->skip_key,
+                          ParsedInternalKey(parsed_key.user_key, s->sequence,
+                                            kValueTypeForSeek));
+        return;
+      }
       // 因为 leveldb 的删除也是一种写操作, 所以要检查 key 的 type
       s->state = (parsed_key.type == kTypeValue) ? kFound : kDeleted;
       if (s->state == kFound) {
@@ -466,8 +538,11 @@ Status Version::Get(const ReadOptions& options,
       for (uint32_t i = 0; i < num_files; i++) {
         // 遍历 level-0 全部文件, 找出包含 user_key 的文件
         FileMetaData* f = files[i];
-        if (ucmp->Compare(user_key, f->smallest.user_key()) >= 0 &&
-            ucmp->Compare(user_key, f->largest.user_key()) <= 0) {
+        // 带时间戳时, 文件中可能有 user_key 的更老版本, 只比较去掉时间戳的部分
+        if (ucmp->CompareWithoutTimestamp(user_key,
+                                          f->smallest.user_key()) >= 0 &&
+            ucmp->CompareWithoutTimestamp(user_key,
+                                          f->largest.user_key()) <= 0) {
           // 将可能包含 user_key 的文件加入到临时存储
           tmp.push_back(f);
         }
@@ -497,7 +572,8 @@ Status Version::Get(const ReadOptions& options,
         // 找到文件了, 再在文件内确认目标 key 是否存在
         tmp2 = files[index];
         // 不在
-        if (ucmp->Compare(user_key, tmp2->smallest.user_key()) < 0) {
+        if (ucmp->CompareWithoutTimestamp(user_key,
+                                          tmp2->smallest.user_key()) < 0) {
           // All of "tmp2" is past any data for user_key
           files = nullptr;
           num_files = 0;
@@ -527,20 +603,27 @@ Status Version::Get(const ReadOptions& options,
       last_file_read_level = level;
 
       Saver saver;
-      saver.state = kNotFound;
       saver.ucmp = ucmp;
       saver.user_key = user_key;
+      saver.sequence = k.sequence();
       saver.value = value;
-      // sstable 文件 f 对应的 table 文件可能已经在 cache 中了
-      // (不在的话读取后也会加入 cache), 
-      // 从该文件中查找有无 internal_key 为 ikey 的数据项, 
-      // 如果找到, 则调用 SaveValue 将
-      // 对应的 value 保存到 saver 数据结构中. 
-      s = vset_->table_cache_->Get(options, f->number, f->file_size,
-                                   ikey, &saver, SaveValue);
-      if (!s.ok()) {
-        return s;
-      }
+      std::string seek_key;
+      Slice target = ikey;
+      do {
+        saver.state = kNotFound;
+        // sstable 文件 f 对应的 table 文件可能已经在 cache 中了
+        // (不在的话读取后也会加入 cache), 
+        // 从该文件中查找有无 internal_key 为 target 的数据项, 
+        // 如果找到, 则调用 SaveValue 将
+        // 对应的 value 保存到 saver 数据结构中. 
+        s = vset_->table_cache_->Get(options, f->number, f->file_size,
+                                     target, &saver, SaveValue);
+        if (!s.ok()) {
+          return s;
+        }
+        seek_key.swap(saver.skip_key);
+        target = seek_key;
+      } while (saver.state == kInvisible);
       switch (saver.state) {
         case kNotFound:
           // 未在该文件中找到, 继续查找下个文件
@@ -558,6 +641,9 @@ Status Version::Get(const ReadOptions& options,
           // 文件损坏了, 返回
           s = Status::Corruption("corrupted key for ", user_key);
           return s;
+        case kInvisible:
+          // 不会出现, 上面会一直查找到可见的版本或者文件末尾为止
+          break;
       }
     }
   }
@@ -565,6 +651,57 @@ Status Version::Get(const ReadOptions& options,
   return Status::NotFound(Slice());  // Use an empty error message for speed
 }
 
+Status Version::GetLatestSequence(const ReadOptions& options,
+                                  const LookupKey& k,
+                                  SequenceNumber* sequence, bool* found) {
+  struct State {
+    const ReadOptions* options;
+    TableCache* table_cache;
+    const Comparator* ucmp;
+    Slice user_key;
+    Slice ikey;
+    Status s;
+    bool found;
+    SequenceNumber sequence;
+
+    // 每个文件只需要一次定位, 第一个不小于查询 key 的记录就是文件中
+    // key 最新的记录.
+    static bool Match(void* arg, int level, FileMetaData* f) {
+      State* state = reinterpret_cast<State*>(arg);
+      state->s = state->table_cache->Get(*state->options, f->number,
+                                         f->file_size, state->ikey, state,
+                                         &State::Save);
+      // 找到了或者出错了就不用再查更老的文件了
+      return state->s.ok() && !state->found;
+    }
+
+    static void Save(void* arg, const Slice& ikey, const Slice& v) {
+      State* state = reinterpret_cast<State*>(arg);
+      ParsedInternalKey parsed;
+      if (!ParseInternalKey(ikey, &parsed)) {
+        state->s = Status::Corruption("corrupted key for ", state->user_key);
+      } else if (state->ucmp->Compare(parsed.user_key, state->user_key) == 0) {
+        state->sequence = parsed.sequence;
+        state->found = true;
+      }
+    }
+  };
+
+  State state;
+  state.options = &options;
+  state.table_cache = vset_->table_cache_;
+  state.ucmp = vset_->icmp_.user_comparator();
+  state.user_key = k.user_key();
+  state.ikey = k.internal_key();
+  state.found = false;
+  ForEachOverlapping(state.user_key, state.ikey, &state, &State::Match);
+  *found = state.found;
+  if (state.found) {
+    *sequence = state.sequence;
+  }
+  return state.s;
+}
+
 bool Version::UpdateStats(const GetStats& stats) {
   FileMetaData* f = stats.seek_file;
   if (f != nullptr) {
@@ -862,6 +999,7 @@ class VersionSet::Builder {
         FileMetaData* f = to_unref[i];
         f->refs--;
         if (f->refs <= 0) {
+          vset_->UnrefFileNumber(f->number);
           delete f;
         }
       }
@@ -902,6 +1040,7 @@ class VersionSet::Builder {
       // pair 第二个参数为 FileMetaData
       FileMetaData* f = new FileMetaData(edit->new_files_[i].second);
       f->refs = 1;
+      vset_->RefFileNumber(f->number);
 
       // leveldb 针对经过一定查询次数的文件进行自动压实. 我们假设:
       //    (1)一次查询消耗 10ms
@@ -1085,7 +1224,7 @@ Status VersionSet::LogAndApply(VersionEdit* edit, port::Mutex* mu) {
   }
 
   edit->SetNextFile(next_file_number_);
-  edit->SetLastSequence(last_sequence_);
+  edit->SetLastSequence(LastSequence());
 
   // 新建一个 Version 用于存储 Builder 输出
   Version* v = new Version(this);
@@ -1298,7 +1437,7 @@ Status VersionSet::Recover(bool *save_manifest) {
     AppendVersion(v);
     manifest_file_number_ = next_file;
     next_file_number_ = next_file + 1;
-    last_sequence_ = last_sequence;
+    SetLastSequence(last_sequence);
     log_number_ = log_number;
     prev_log_number_ = prev_log_number;
 
@@ -1505,6 +1644,65 @@ uint64_t VersionSet::ApproximateOffsetOf(Version* v, const InternalKey& ikey) {
   return result;
 }
 
+void VersionSet::ApproximateStatsOf(Version* v, const InternalKey& start,
+                                    const InternalKey& limit,
+                                    uint64_t* bytes, uint64_t* entries) {
+  *bytes = 0;
+  *entries = 0;
+  if (icmp_.Compare(start, limit) >= 0) {
+    return;
+  }
+  // 没有记录数据项个数的 table 所占的字节数
+  uint64_t uncounted_bytes = 0;
+  uint64_t counted_bytes = 0;
+  for (int level = 0; level < config::kNumLevels; level++) {
+    const std::vector<FileMetaData*>& files = v->files_[level];
+    size_t i = 0;
+    if (level > 0) {
+      // 文件互不重叠, 直接跳到第一个可能与范围相交的文件
+      i = FindFile(icmp_, files, start.Encode());
+    }
+    for (; i < files.size(); i++) {
+      const FileMetaData* f = files[i];
+      if (icmp_.Compare(f->smallest, limit) >= 0) {
+        if (level > 0) {
+          break;
+        }
+        continue;
+      }
+      if (icmp_.Compare(f->largest, start) < 0) {
+        continue;
+      }
+      uint64_t start_offset = 0, start_entries = 0;
+      bool counted = true;
+      if (icmp_.Compare(f->smallest, start) < 0) {
+        counted = table_cache_->ApproximatePositionOf(
+            f->number, f->file_size, start.Encode(),
+            &start_offset, &start_entries);
+      }
+      uint64_t limit_offset, limit_entries;
+      counted &= table_cache_->ApproximatePositionOf(
+          f->number, f->file_size, limit.Encode(),
+          &limit_offset, &limit_entries);
+      const uint64_t file_bytes =
+          limit_offset > start_offset ? limit_offset - start_offset : 0;
+      *bytes += file_bytes;
+      if (counted) {
+        counted_bytes += file_bytes;
+        if (limit_entries > start_entries) {
+          *entries += limit_entries - start_entries;
+        }
+      } else {
+        uncounted_bytes += file_bytes;
+      }
+    }
+  }
+  if (uncounted_bytes > 0 && counted_bytes > 0) {
+    *entries += static_cast<uint64_t>(
+        static_cast<double>(*entries) * uncounted_bytes / counted_bytes);
+  }
+}
+
 // Add all files listed in any live version to *live.
 // May also mutate some internal state.
 //
@@ -1532,6 +1730,25 @@ void VersionSet::AddLiveFiles(std::set<uint64_t>* live) {
   }
 }
 
+void VersionSet::TakeObsoleteFiles(std::vector<uint64_t>* numbers) {
+  numbers->insert(numbers->end(), obsolete_files_.begin(),
+                  obsolete_files_.end());
+  obsolete_files_.clear();
+}
+
+void VersionSet::RefFileNumber(uint64_t number) {
+  file_meta_counts_[number]++;
+}
+
+void VersionSet::UnrefFileNumber(uint64_t number) {
+  std::map<uint64_t, int>::iterator iter = file_meta_counts_.find(number);
+  assert(iter != file_meta_counts_.end());
+  if (--iter->second == 0) {
+    file_meta_counts_.erase(iter);
+    obsolete_files_.push_back(number);
+  }
+}
+
 int64_t VersionSet::NumLevelBytes(int level) const {
   assert(level >= 0);
   assert(level < config::kNumLevels);
@@ -1827,7 +2044,11 @@ Compaction::Compaction(const Options* options, int level)
       input_version_(nullptr),
       grandparent_index_(0),
       seen_key_(false),
-      overlapped_bytes_(0) {
+      overlapped_bytes_(0),
+      base_cached_(false),
+      base_result_(false),
+      base_has_limit_(false),
+      base_limit_inclusive_(false) {
   for (int i = 0; i < config::kNumLevels; i++) {
     level_ptrs_[i] = 0;
   }
@@ -1855,6 +2076,15 @@ bool Compaction::IsTrivialMove() const {
               MaxGrandParentOverlapBytes(vset->options_));
 }
 
+bool Compaction::IsBottommostLevel() const {
+  for (int lvl = level_ + 2; lvl < config::kNumLevels; lvl++) {
+    if (!input_version_->files_[lvl].empty()) {
+      return false;
+    }
+  }
+  return true;
+}
+
 void Compaction::AddInputDeletions(VersionEdit* edit) {
   for (int which = 0; which < 2; which++) {
     for (size_t i = 0; i < inputs_[which].size(); i++) {
@@ -1864,8 +2094,21 @@ void Compaction::AddInputDeletions(VersionEdit* edit) {
 }
 
 bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
-  // Maybe use binary search to find right entry instead of linear search?
   const Comparator* user_cmp = input_version_->vset_->icmp_.user_comparator();
+  // 还在上次计算得到的文件范围内, 直接使用缓存的结果
+  if (base_cached_) {
+    if (!base_has_limit_) {
+      return base_result_;
+    }
+    const int r = user_cmp->CompareWithoutTimestamp(user_key, base_limit_);
+    if (r < 0 || (r == 0 && base_limit_inclusive_)) {
+      return base_result_;
+    }
+  }
+
+  // Maybe use binary search to find right entry instead of linear search?
+  base_cached_ = true;
+  base_has_limit_ = false;
   // 从祖父层开始向上遍历
   for (int lvl = level_ + 2; lvl < config::kNumLevels; lvl++) {
     // 第 lvl 层的文件列表
@@ -1874,22 +2117,37 @@ bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
     for (; level_ptrs_[lvl] < files.size(); ) {
       FileMetaData* f = files[level_ptrs_[lvl]];
       // user_key 可能落在了 f 文件里
-      if (user_cmp->Compare(user_key, f->largest.user_key()) <= 0) {
+      if (user_cmp->CompareWithoutTimestamp(user_key,
+                                            f->largest.user_key()) <= 0) {
         // We've advanced far enough
-        if (user_cmp->Compare(user_key, f->smallest.user_key()) >= 0) {
+        if (user_cmp->CompareWithoutTimestamp(user_key,
+                                              f->smallest.user_key()) >= 0) {
           // Key falls in this file's range, so definitely not base level
           // user_key 确实落在了文件 f 里, 这就意味着
-          // 祖父层或之上的 level 也包含有 user_key
+          // 祖父层或之上的 level 也包含有 user_key.
+          // 直到 f 的最大 key 为止结果都是 false.
+          base_result_ = false;
+          base_has_limit_ = true;
+          base_limit_inclusive_ = true;
+          base_limit_ = f->largest.user_key();
           return false;
         }
         // user_key 既然小于 f->largest 但又未落在了文件 f 里,
-        // 那它肯定不在 lvl 层里.
+        // 那它肯定不在 lvl 层里. 在 f 的最小 key 之前都是如此.
+        if (!base_has_limit_ ||
+            user_cmp->CompareWithoutTimestamp(f->smallest.user_key(),
+                                              base_limit_) < 0) {
+          base_has_limit_ = true;
+          base_limit_ = f->smallest.user_key();
+        }
         break;
       }
       // 遍历下个文件
       level_ptrs_[lvl]++;
     }
   }
+  base_result_ = true;
+  base_limit_inclusive_ = false;
   return true;
 }
 
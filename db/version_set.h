@@ -21,6 +21,7 @@
 #ifndef STORAGE_LEVELDB_DB_VERSION_SET_H_
 #define STORAGE_LEVELDB_DB_VERSION_SET_H_
 
+#include <atomic>
 #include <map>
 #include <set>
 #include <vector>
@@ -104,6 +105,12 @@ class Version {
   Status Get(const ReadOptions&, const LookupKey& key, std::string* val,
              GetStats* stats);
 
+  // 和 Get 一样逐个查找可能包含 key 的文件, 但只取出 key 最新一条记录(包括删除)
+  // 的序列号. 找到时将其存储到 *sequence 中并将 *found 置为 true.
+  // 前提: 调用该方法之前必须未持有锁.
+  Status GetLatestSequence(const ReadOptions&, const LookupKey& key,
+                           SequenceNumber* sequence, bool* found);
+
   // 如果上次调用 Get 查询感知到疑似需要进行压实, 则此处进一步检查确定是否触发压实.
   // 检查条件是 stats 的 allowed_seeks 是否降为 0.
   // 如果需要触发一个压实, 则返回 true; 否则返回 false. 
@@ -176,6 +183,11 @@ class Version {
   class LevelFileNumIterator;
   Iterator* NewConcatenatingIterator(const ReadOptions&, int level) const;
 
+  // 文件 f 中是否可能有 user key 位于 options.iterate_lower_bound 和
+  // iterate_upper_bound 限定的范围内, 见 Options::range_filter.
+  bool FileMayOverlapBounds(const ReadOptions& options,
+                            const FileMetaData* f) const;
+
   // Call func(arg, level, f) for every file that overlaps user_key in
   // order from newest to oldest.  If an invocation of func returns
   // false, makes no more calls.
@@ -295,15 +307,19 @@ class VersionSet {
   // 返回当前 version, 代表了当前 leveldb 磁盘文件架构的一个视图.
   Version* current() const { return current_; }
 
-  // 返回上一个序列号
-  uint64_t LastSequence() const { return last_sequence_; }
+  // 返回上一个序列号.
+  // 读操作不持有锁也可以调用该方法, 能看到该序列号就意味着
+  // 能看到它对应的写入.
+  uint64_t LastSequence() const {
+    return last_sequence_.load(std::memory_order_acquire);
+  }
 
   // Set the last sequence number to s.
   //
   // 将上个序列号设置为 s, 注意 s 必须大于等于上个序列号
   void SetLastSequence(uint64_t s) {
-    assert(s >= last_sequence_);
-    last_sequence_ = s;
+    assert(s >= LastSequence());
+    last_sequence_.store(s, std::memory_order_release);
   }
 
   // Mark the specified file number as used.
@@ -368,9 +384,21 @@ class VersionSet {
   // 将 level 中的文件都插入到集合 live 中.
   void AddLiveFiles(std::set<uint64_t>* live);
 
+  // 将自上次调用以来不再被任何存活 version 引用的 sstable 文件编号追加到
+  // *numbers 中. 与 AddLiveFiles 不同, 该方法不需要遍历全部 version,
+  // 代价只与新过期的文件个数有关.
+  void TakeObsoleteFiles(std::vector<uint64_t>* numbers);
+
   // 返回目标 key 在 v 对应的 level 架构中的估计字节偏移量
   uint64_t ApproximateOffsetOf(Version* v, const InternalKey& key);
 
+  // 估计 v 中位于 [start, limit) 的数据占用的字节数(*bytes)和数据项个数(*entries).
+  // 只访问与该范围相交的文件, 每个文件在 index block 中查找两次.
+  // 没有记录数据项个数的旧 table 按其它 table 每字节的数据项个数折算.
+  void ApproximateStatsOf(Version* v, const InternalKey& start,
+                          const InternalKey& limit,
+                          uint64_t* bytes, uint64_t* entries);
+
   // Return a human-readable short (single-line) summary of the number
   // of files per level.  Uses *scratch as backing store.
   struct LevelSummaryStorage {
@@ -410,6 +438,11 @@ class VersionSet {
   // 具体操作为将 v 插入到双向循环链表, 且位于 dummy_versions_ 前面. 
   void AppendVersion(Version* v);
 
+  // 每创建或者释放一个 FileMetaData 都要调用对应的方法.
+  // 某个编号的 FileMetaData 全部释放后该文件即过期, 记录到 obsolete_files_ 中.
+  void RefFileNumber(uint64_t number);
+  void UnrefFileNumber(uint64_t number);
+
   Env* const env_;
   const std::string dbname_;
   const Options* const options_;
@@ -425,7 +458,8 @@ class VersionSet {
   uint64_t manifest_file_number_;
   // 记录最近一次更新操作对应的序列号(逐一递增, WriteBatch 包含一批更新操作, 每个更新操作都会有一个序列号).
   // 具体修改建 DbImpl::Write 方法
-  uint64_t last_sequence_;
+  // 写操作持有锁更新, 读操作可以无锁读取.
+  std::atomic<uint64_t> last_sequence_;
   uint64_t log_number_;
   uint64_t prev_log_number_;  // 0 or backing store for memtable being compacted
 
@@ -447,6 +481,12 @@ class VersionSet {
   // 记录了每个 level 各自对应的下次压实的起始 key
   std::string compact_pointer_[config::kNumLevels];
 
+  // 文件编号到对应 FileMetaData 个数的映射. 同一个文件可能同时出现在
+  // 多个 version 中(比如被直接移动到下一层), 每处都是单独的 FileMetaData.
+  std::map<uint64_t, int> file_meta_counts_;
+  // 已经不再被任何 version 引用, 但还没有被 TakeObsoleteFiles 取走的文件编号
+  std::vector<uint64_t> obsolete_files_;
+
   // No copying allowed
   VersionSet(const VersionSet&);
   void operator=(const VersionSet&);
@@ -479,12 +519,19 @@ class Compaction {
   // 那这就是一个平凡的压实. 
   bool IsTrivialMove() const;
 
+  // 如果比输出层(level+1)更深的层都没有文件, 即本次压实输出到当前
+  // 有数据的最深一层, 返回 true.
+  bool IsBottommostLevel() const;
+
   // 将本次压实的全部输入作为删除操作添加到 *edit 中
   void AddInputDeletions(VersionEdit* edit);
 
   // 如果我们可用的信息能够保证压实正在 "level+1" 产生数据,
   // 而且对于 "level+1" 来说, 它包含的数据没有出现在更高层, 
-  // 那么返回 true. 
+  // 那么返回 true.
+  // 要求调用时 user_key 单调不减. 同一个文件范围内的 key 结果相同,
+  // 因此结果会按文件范围缓存, 范围内的后续调用只需要一次比较.
+  // 带时间戳时忽略时间戳比较, 即更高层没有这个 key 的任何版本才返回 true.
   bool IsBaseLevelForKey(const Slice& user_key);
 
   // 如果参数 internal_key 在 level+2 太靠后意味着 level 与
@@ -531,6 +578,15 @@ class Compaction {
   // level_ptrs_ 持有 input_version_->levels_ 的索引: 
   // 我们被定位到其中一个文件范围内, 对于没一个比当前中那个在进行压实的 level. 
   size_t level_ptrs_[config::kNumLevels];
+
+  // IsBaseLevelForKey 的缓存结果: 在 base_limit_ 之前(base_limit_inclusive_
+  // 为 true 时包括 base_limit_)的 key 结果都是 base_result_. base_limit_
+  // 指向 input_version_ 中某个文件的边界 key.
+  bool base_cached_;
+  bool base_result_;
+  bool base_has_limit_;        // 为 false 表示之后全部 key 结果都相同
+  bool base_limit_inclusive_;
+  Slice base_limit_;
 };
 
 }  // namespace leveldb
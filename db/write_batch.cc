@@ -15,11 +15,15 @@
 
 #include "leveldb/write_batch.h"
 
+#include <unordered_set>
+#include <vector>
+
 #include "leveldb/db.h"
 #include "db/dbformat.h"
 #include "db/memtable.h"
 #include "db/write_batch_internal.h"
 #include "util/coding.h"
+#include "util/hash.h"
 
 namespace leveldb {
 
@@ -212,6 +216,51 @@ class MemTableInserter : public WriteBatch::Handler {
 };
 }  // namespace
 
+namespace {
+// 记录 batch 中是否有长度不在 [min_length_, max_length_] 内的 key
+class KeyLengthChecker : public WriteBatch::Handler {
+ public:
+  KeyLengthChecker(size_t min_length, size_t max_length)
+      : min_length_(min_length), max_length_(max_length), mismatch_(false) { }
+
+  virtual void Put(const Slice& key, const Slice& value) { Check(key); }
+  virtual void Delete(const Slice& key) { Check(key); }
+
+  bool mismatch() const { return mismatch_; }
+
+ private:
+  void Check(const Slice& key) {
+    if (key.size() < min_length_ || key.size() > max_length_) {
+      mismatch_ = true;
+    }
+  }
+
+  const size_t min_length_;
+  const size_t max_length_;
+  bool mismatch_;
+};
+}  // namespace
+
+Status WriteBatchInternal::CheckKeyLength(const WriteBatch* b,
+                                          size_t key_length) {
+  KeyLengthChecker checker(key_length, key_length);
+  Status s = b->Iterate(&checker);
+  if (s.ok() && checker.mismatch()) {
+    s = Status::InvalidArgument("key length does not match fixed_key_length");
+  }
+  return s;
+}
+
+Status WriteBatchInternal::CheckTimestampSize(const WriteBatch* b,
+                                              size_t timestamp_size) {
+  KeyLengthChecker checker(timestamp_size, ~static_cast<size_t>(0));
+  Status s = b->Iterate(&checker);
+  if (s.ok() && checker.mismatch()) {
+    s = Status::InvalidArgument("key is shorter than timestamp_size");
+  }
+  return s;
+}
+
 /**
  * 将数据填充到 memtable 中
  * @param b
@@ -226,6 +275,59 @@ Status WriteBatchInternal::InsertInto(const WriteBatch* b,
   return b->Iterate(&inserter);
 }
 
+namespace {
+// 先收集 batch 中的全部操作, 之后从后往前插入, 同一个 key 只插入最后一次.
+class DedupMemTableCollector : public WriteBatch::Handler {
+ public:
+  struct Entry {
+    SequenceNumber sequence;
+    ValueType type;
+    Slice key;    // 指向 batch 内部, 生命期同 batch
+    Slice value;
+  };
+
+  SequenceNumber sequence_;
+  std::vector<Entry> entries_;
+
+  virtual void Put(const Slice& key, const Slice& value) {
+    Entry e = { sequence_++, kTypeValue, key, value };
+    entries_.push_back(e);
+  }
+  virtual void Delete(const Slice& key) {
+    Entry e = { sequence_++, kTypeDeletion, key, Slice() };
+    entries_.push_back(e);
+  }
+};
+
+struct SliceHash {
+  size_t operator()(const Slice& s) const {
+    return Hash(s.data(), s.size(), 0);
+  }
+};
+}  // namespace
+
+Status WriteBatchInternal::InsertIntoDeduplicated(const WriteBatch* b,
+                                                  MemTable* memtable) {
+  if (Count(b) < 2) {
+    return InsertInto(b, memtable);
+  }
+  DedupMemTableCollector collector;
+  collector.sequence_ = Sequence(b);
+  collector.entries_.reserve(Count(b));
+  // 即使 batch 损坏也像 InsertInto 一样插入出错之前的操作
+  Status s = b->Iterate(&collector);
+  std::unordered_set<Slice, SliceHash> seen;
+  seen.reserve(collector.entries_.size());
+  for (size_t i = collector.entries_.size(); i > 0; i--) {
+    const DedupMemTableCollector::Entry& e = collector.entries_[i - 1];
+    // 按字节比较 key: 字节不同但比较器认为相等的 key 都会保留, 结果依然正确.
+    if (seen.insert(e.key).second) {
+      memtable->Add(e.sequence, e.type, e.key, e.value);
+    }
+  }
+  return s;
+}
+
 /**
  * 将 contents 存储的操作内容赋值给 batch b
  * @param b
@@ -60,9 +60,23 @@ class WriteBatchInternal {
   // 将 contents 存储的操作内容赋值给 batch b
   static void SetContents(WriteBatch* batch, const Slice& contents);
 
+  // 检查 batch 中全部 key 的长度都等于 key_length, 否则返回 InvalidArgument.
+  static Status CheckKeyLength(const WriteBatch* batch, size_t key_length);
+
+  // 检查 batch 中全部 key 都不短于 timestamp_size, 即都带有时间戳,
+  // 否则返回 InvalidArgument.
+  static Status CheckTimestampSize(const WriteBatch* batch,
+                                   size_t timestamp_size);
+
   // 将 b 中包含的操作应用到 memtable 中
   static Status InsertInto(const WriteBatch* batch, MemTable* memtable);
 
+  // 与 InsertInto 相同, 但同一个 key 的多次更新只插入最后一次(保留其原有的
+  // 序列号), 被覆盖的更新只存在于 log 文件中.
+  // 只有在被覆盖的更新对任何读者都不可见时才能使用, 比如整个 batch 一起生效.
+  static Status InsertIntoDeduplicated(const WriteBatch* batch,
+                                       MemTable* memtable);
+
   // 将 src 中除了 header 以外内容追加到 dst 中
   static void Append(WriteBatch* dst, const WriteBatch* src);
 };
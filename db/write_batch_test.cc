@@ -12,12 +12,13 @@
 
 namespace leveldb {
 
-static std::string PrintContents(WriteBatch* b) {
+static std::string PrintContents(WriteBatch* b, bool dedup = false) {
   InternalKeyComparator cmp(BytewiseComparator());
   MemTable* mem = new MemTable(cmp);
   mem->Ref();
   std::string state;
-  Status s = WriteBatchInternal::InsertInto(b, mem);
+  Status s = dedup ? WriteBatchInternal::InsertIntoDeduplicated(b, mem)
+                   : WriteBatchInternal::InsertInto(b, mem);
   int count = 0;
   Iterator* iter = mem->NewIterator();
   for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
@@ -45,7 +46,7 @@ static std::string PrintContents(WriteBatch* b) {
   delete iter;
   if (!s.ok()) {
     state.append("ParseError()");
-  } else if (count != WriteBatchInternal::Count(b)) {
+  } else if (!dedup && count != WriteBatchInternal::Count(b)) {
     state.append("CountMismatch()");
   }
   mem->Unref();
@@ -74,6 +75,29 @@ TEST(WriteBatchTest, Multiple) {
             PrintContents(&batch));
 }
 
+TEST(WriteBatchTest, Deduplicated) {
+  WriteBatch batch;
+  batch.Put(Slice("foo"), Slice("v1"));
+  batch.Put(Slice("bar"), Slice("v2"));
+  batch.Put(Slice("foo"), Slice("v3"));
+  batch.Delete(Slice("bar"));
+  batch.Put(Slice("baz"), Slice("v4"));
+  batch.Delete(Slice("foo"));
+  batch.Put(Slice("foo"), Slice("v5"));
+  WriteBatchInternal::SetSequence(&batch, 100);
+  // Only the last update of each key is inserted, with its own sequence.
+  ASSERT_EQ("Delete(bar)@103"
+            "Put(baz, v4)@104"
+            "Put(foo, v5)@106",
+            PrintContents(&batch, true));
+  ASSERT_EQ(7, WriteBatchInternal::Count(&batch));
+
+  WriteBatch single;
+  single.Put(Slice("foo"), Slice("bar"));
+  WriteBatchInternal::SetSequence(&single, 200);
+  ASSERT_EQ("Put(foo, bar)@200", PrintContents(&single, true));
+}
+
 TEST(WriteBatchTest, Corruption) {
   WriteBatch batch;
   batch.Put(Slice("foo"), Slice("bar"));
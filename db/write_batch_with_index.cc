@@ -0,0 +1,482 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/write_batch_with_index.h"
+
+#include <stdint.h>
+
+#include "db/dbformat.h"
+#include "db/skiplist.h"
+#include "db/write_batch_internal.h"
+#include "util/arena.h"
+#include "util/coding.h"
+
+namespace leveldb {
+
+namespace {
+
+// 索引项. 对于真正的 batch 记录, offset 是该记录在 WriteBatch::rep_ 中的偏移量,
+// count 是该记录在 batch 中的序号; 查找用的临时索引项 offset 无意义,
+// search_key 指向要查找的 key.
+struct IndexEntry {
+  size_t offset;
+  uint32_t count;
+  const Slice* search_key;
+};
+
+// 查找时使用的序号, 比 batch 中任何记录的序号都大.
+static const uint32_t kMaxCount = UINT32_MAX;
+
+// 从 batch 的 rep_ 中解析 offset 处的记录
+static void DecodeRecord(const WriteBatch* batch, size_t offset,
+                         ValueType* type, Slice* key, Slice* value) {
+  Slice input = WriteBatchInternal::Contents(batch);
+  input.remove_prefix(offset);
+  *type = static_cast<ValueType>(input[0]);
+  input.remove_prefix(1);
+  GetLengthPrefixedSlice(&input, key);
+  if (*type == kTypeValue) {
+    GetLengthPrefixedSlice(&input, value);
+  } else {
+    *value = Slice();
+  }
+}
+
+// 索引项按 key 升序排列, key 相同的按序号降序排列, 这样同一个 key
+// 最新的那次操作排在最前面.
+struct IndexComparator {
+  const Comparator* user_comparator;
+  const WriteBatch* batch;
+
+  IndexComparator(const Comparator* c, const WriteBatch* b)
+      : user_comparator(c), batch(b) { }
+
+  Slice KeyOf(const IndexEntry* entry) const {
+    if (entry->search_key != nullptr) {
+      return *entry->search_key;
+    }
+    ValueType type;
+    Slice key, value;
+    DecodeRecord(batch, entry->offset, &type, &key, &value);
+    return key;
+  }
+
+  int operator()(const IndexEntry* a, const IndexEntry* b) const {
+    int r = user_comparator->Compare(KeyOf(a), KeyOf(b));
+    if (r == 0) {
+      if (a->count > b->count) {
+        r = -1;
+      } else if (a->count < b->count) {
+        r = +1;
+      }
+    }
+    return r;
+  }
+};
+
+typedef SkipList<const IndexEntry*, IndexComparator> IndexList;
+
+}  // anonymous namespace
+
+struct WriteBatchWithIndex::Rep {
+  const Comparator* comparator;
+  WriteBatch batch;
+  Arena* arena;
+  IndexList* index;
+
+  explicit Rep(const Comparator* cmp)
+      : comparator(cmp), arena(nullptr), index(nullptr) {
+    ResetIndex();
+  }
+
+  ~Rep() {
+    delete index;
+    delete arena;
+  }
+
+  // 跳跃表不支持删除, 清空时整个换掉
+  void ResetIndex() {
+    delete index;
+    delete arena;
+    arena = new Arena;
+    index = new IndexList(IndexComparator(comparator, &batch), arena);
+  }
+
+  // 为 batch 中刚刚追加的、起始于 offset 的记录建立索引
+  void AddIndex(size_t offset) {
+    char* mem = arena->AllocateAligned(sizeof(IndexEntry));
+    IndexEntry* entry = reinterpret_cast<IndexEntry*>(mem);
+    entry->offset = offset;
+    entry->count = WriteBatchInternal::Count(&batch) - 1;
+    entry->search_key = nullptr;
+    index->Insert(entry);
+  }
+};
+
+namespace {
+
+// 只遍历 batch 的迭代器. 同一个 key 有多个操作时只返回最新的那个,
+// 所以 key 不会重复; 被删除的 key 也会返回, 由 IsDeletion() 区分.
+class BatchIndexIterator : public Iterator {
+ public:
+  BatchIndexIterator(const WriteBatch* batch, const IndexList* index,
+                     const Comparator* comparator)
+      : batch_(batch), comparator_(comparator), iter_(index) { }
+
+  virtual bool Valid() const { return iter_.Valid(); }
+
+  virtual void SeekToFirst() {
+    iter_.SeekToFirst();
+    Decode();
+  }
+
+  virtual void SeekToLast() {
+    iter_.SeekToLast();
+    SeekToNewest();
+  }
+
+  virtual void Seek(const Slice& target) {
+    IndexEntry search = { 0, kMaxCount, &target };
+    iter_.Seek(&search);
+    Decode();
+  }
+
+  virtual void Next() {
+    assert(Valid());
+    // 跳过同一个 key 更老的操作. key_ 指向 batch 内部, batch 不变它就一直有效.
+    const Slice current = key_;
+    do {
+      iter_.Next();
+      Decode();
+    } while (iter_.Valid() && comparator_->Compare(key_, current) == 0);
+  }
+
+  virtual void Prev() {
+    assert(Valid());
+    // 当前位于某个 key 最新的操作, 前一项是上一个 key 最老的操作
+    iter_.Prev();
+    SeekToNewest();
+  }
+
+  virtual Slice key() const { return key_; }
+  virtual Slice value() const { return value_; }
+  virtual Status status() const { return Status::OK(); }
+
+  bool IsDeletion() const { return type_ == kTypeDeletion; }
+
+ private:
+  void Decode() {
+    if (iter_.Valid()) {
+      DecodeRecord(batch_, iter_.key()->offset, &type_, &key_, &value_);
+    }
+  }
+
+  // 将迭代器从当前 key 的某个操作移动到该 key 最新的操作上
+  void SeekToNewest() {
+    if (iter_.Valid()) {
+      Decode();
+      const Slice target = key_;
+      IndexEntry search = { 0, kMaxCount, &target };
+      iter_.Seek(&search);
+      Decode();
+    }
+  }
+
+  const WriteBatch* const batch_;
+  const Comparator* const comparator_;
+  IndexList::Iterator iter_;
+  ValueType type_;
+  Slice key_;
+  Slice value_;
+};
+
+// 把 batch 合并到 base 迭代器上. 两个迭代器上 key 相同时以 batch 为准,
+// batch 中被删除的 key 不会出现在结果中.
+class BaseDeltaIterator : public Iterator {
+ public:
+  BaseDeltaIterator(Iterator* base, BatchIndexIterator* delta,
+                    const Comparator* comparator)
+      : forward_(true),
+        current_at_base_(true),
+        equal_keys_(false),
+        base_(base),
+        delta_(delta),
+        comparator_(comparator) { }
+
+  virtual ~BaseDeltaIterator() {
+    delete base_;
+    delete delta_;
+  }
+
+  virtual bool Valid() const {
+    return current_at_base_ ? base_->Valid() : delta_->Valid();
+  }
+
+  virtual void SeekToFirst() {
+    forward_ = true;
+    base_->SeekToFirst();
+    delta_->SeekToFirst();
+    UpdateCurrent();
+  }
+
+  virtual void SeekToLast() {
+    forward_ = false;
+    base_->SeekToLast();
+    delta_->SeekToLast();
+    UpdateCurrent();
+  }
+
+  virtual void Seek(const Slice& target) {
+    forward_ = true;
+    base_->Seek(target);
+    delta_->Seek(target);
+    UpdateCurrent();
+  }
+
+  virtual void Next() {
+    assert(Valid());
+    if (!forward_) {
+      // 调转方向. 两个迭代器位于同一个 key 时不用调整; 否则反向遍历时
+      // 没有指向当前 key 的那个迭代器位于比当前 key 小的位置(或者已经越过开头),
+      // 需要把它移动到比当前 key 大的位置.
+      forward_ = true;
+      if (!equal_keys_) {
+        if (!base_->Valid()) {
+          base_->SeekToFirst();
+        } else if (!delta_->Valid()) {
+          delta_->SeekToFirst();
+        } else if (current_at_base_) {
+          delta_->Next();
+        } else {
+          base_->Next();
+        }
+      }
+    }
+    Advance();
+  }
+
+  virtual void Prev() {
+    assert(Valid());
+    if (forward_) {
+      // 调转方向, 和 Next 对称.
+      forward_ = false;
+      if (!equal_keys_) {
+        if (!base_->Valid()) {
+          base_->SeekToLast();
+        } else if (!delta_->Valid()) {
+          delta_->SeekToLast();
+        } else if (current_at_base_) {
+          delta_->Prev();
+        } else {
+          base_->Prev();
+        }
+      }
+    }
+    Advance();
+  }
+
+  virtual Slice key() const {
+    return current_at_base_ ? base_->key() : delta_->key();
+  }
+
+  virtual Slice value() const {
+    return current_at_base_ ? base_->value() : delta_->value();
+  }
+
+  virtual Status status() const {
+    return base_->status();
+  }
+
+ private:
+  void AdvanceBase() {
+    if (forward_) {
+      base_->Next();
+    } else {
+      base_->Prev();
+    }
+  }
+
+  void AdvanceDelta() {
+    if (forward_) {
+      delta_->Next();
+    } else {
+      delta_->Prev();
+    }
+  }
+
+  void Advance() {
+    if (equal_keys_) {
+      AdvanceBase();
+      AdvanceDelta();
+    } else if (current_at_base_) {
+      AdvanceBase();
+    } else {
+      AdvanceDelta();
+    }
+    UpdateCurrent();
+  }
+
+  // 根据两个迭代器的位置决定当前指向哪一个, 跳过 batch 中被删除的 key.
+  void UpdateCurrent() {
+    while (true) {
+      equal_keys_ = false;
+      if (!base_->Valid()) {
+        if (!delta_->Valid()) {
+          // 两个都遍历完了
+          return;
+        }
+        if (!delta_->IsDeletion()) {
+          current_at_base_ = false;
+          return;
+        }
+        AdvanceDelta();
+      } else if (!delta_->Valid()) {
+        current_at_base_ = true;
+        return;
+      } else {
+        int compare = comparator_->Compare(delta_->key(), base_->key());
+        if (!forward_) {
+          compare = -compare;
+        }
+        if (compare > 0) {
+          current_at_base_ = true;
+          return;
+        }
+        // batch 的 key 排在前面或者和 base 相同, 以 batch 为准
+        if (compare == 0) {
+          equal_keys_ = true;
+        }
+        if (!delta_->IsDeletion()) {
+          current_at_base_ = false;
+          return;
+        }
+        // 被删除的 key, 两边一起跳过
+        AdvanceDelta();
+        if (equal_keys_) {
+          AdvanceBase();
+        }
+      }
+    }
+  }
+
+  // 当前遍历方向
+  bool forward_;
+  // 当前指向 base 还是 batch
+  bool current_at_base_;
+  // base 和 batch 是否位于同一个 key
+  bool equal_keys_;
+  Iterator* const base_;
+  BatchIndexIterator* const delta_;
+  const Comparator* const comparator_;
+};
+
+// 只遍历 batch, 跳过被删除的 key.
+class LiveBatchIterator : public Iterator {
+ public:
+  explicit LiveBatchIterator(BatchIndexIterator* iter) : iter_(iter) { }
+  virtual ~LiveBatchIterator() { delete iter_; }
+
+  virtual bool Valid() const { return iter_->Valid(); }
+  virtual void SeekToFirst() { iter_->SeekToFirst(); SkipForward(); }
+  virtual void SeekToLast() { iter_->SeekToLast(); SkipBackward(); }
+  virtual void Seek(const Slice& target) {
+    iter_->Seek(target);
+    SkipForward();
+  }
+  virtual void Next() { iter_->Next(); SkipForward(); }
+  virtual void Prev() { iter_->Prev(); SkipBackward(); }
+  virtual Slice key() const { return iter_->key(); }
+  virtual Slice value() const { return iter_->value(); }
+  virtual Status status() const { return iter_->status(); }
+
+ private:
+  void SkipForward() {
+    while (iter_->Valid() && iter_->IsDeletion()) {
+      iter_->Next();
+    }
+  }
+
+  void SkipBackward() {
+    while (iter_->Valid() && iter_->IsDeletion()) {
+      iter_->Prev();
+    }
+  }
+
+  BatchIndexIterator* const iter_;
+};
+
+}  // anonymous namespace
+
+WriteBatchWithIndex::WriteBatchWithIndex(const Comparator* comparator)
+    : rep_(new Rep(comparator)) {
+}
+
+WriteBatchWithIndex::~WriteBatchWithIndex() {
+  delete rep_;
+}
+
+void WriteBatchWithIndex::Put(const Slice& key, const Slice& value) {
+  size_t offset = WriteBatchInternal::ByteSize(&rep_->batch);
+  rep_->batch.Put(key, value);
+  rep_->AddIndex(offset);
+}
+
+void WriteBatchWithIndex::Delete(const Slice& key) {
+  size_t offset = WriteBatchInternal::ByteSize(&rep_->batch);
+  rep_->batch.Delete(key);
+  rep_->AddIndex(offset);
+}
+
+void WriteBatchWithIndex::Clear() {
+  rep_->batch.Clear();
+  rep_->ResetIndex();
+}
+
+WriteBatch* WriteBatchWithIndex::GetWriteBatch() {
+  return &rep_->batch;
+}
+
+Status WriteBatchWithIndex::GetFromBatch(const Slice& key,
+                                         std::string* value) const {
+  BatchIndexIterator iter(&rep_->batch, rep_->index, rep_->comparator);
+  iter.Seek(key);
+  if (iter.Valid() && rep_->comparator->Compare(iter.key(), key) == 0 &&
+      !iter.IsDeletion()) {
+    value->assign(iter.value().data(), iter.value().size());
+    return Status::OK();
+  }
+  return Status::NotFound(Slice());
+}
+
+Status WriteBatchWithIndex::GetFromBatchAndDB(DB* db,
+                                              const ReadOptions& options,
+                                              const Slice& key,
+                                              std::string* value) const {
+  BatchIndexIterator iter(&rep_->batch, rep_->index, rep_->comparator);
+  iter.Seek(key);
+  if (iter.Valid() && rep_->comparator->Compare(iter.key(), key) == 0) {
+    if (iter.IsDeletion()) {
+      return Status::NotFound(Slice());
+    }
+    value->assign(iter.value().data(), iter.value().size());
+    return Status::OK();
+  }
+  // batch 中没有 key 的任何操作, 去数据库中查找
+  return db->Get(options, key, value);
+}
+
+Iterator* WriteBatchWithIndex::NewIteratorWithBase(
+    Iterator* base_iterator) const {
+  return new BaseDeltaIterator(
+      base_iterator,
+      new BatchIndexIterator(&rep_->batch, rep_->index, rep_->comparator),
+      rep_->comparator);
+}
+
+Iterator* WriteBatchWithIndex::NewIterator() const {
+  return new LiveBatchIterator(
+      new BatchIndexIterator(&rep_->batch, rep_->index, rep_->comparator));
+}
+
+}  // namespace leveldb
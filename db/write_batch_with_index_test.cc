@@ -0,0 +1,209 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/write_batch_with_index.h"
+
+#include <map>
+#include <string>
+
+#include "helpers/memenv/memenv.h"
+#include "leveldb/db.h"
+#include "leveldb/env.h"
+#include "util/random.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+class WriteBatchWithIndexTest {
+ public:
+  Env* env_;
+  DB* db_;
+
+  WriteBatchWithIndexTest() : env_(NewMemEnv(Env::Default())), db_(nullptr) {
+    Options options;
+    options.env = env_;
+    options.create_if_missing = true;
+    ASSERT_OK(DB::Open(options, "/dir/db", &db_));
+  }
+
+  ~WriteBatchWithIndexTest() {
+    delete db_;
+    delete env_;
+  }
+
+  std::string Get(const WriteBatchWithIndex& batch, const std::string& k) {
+    std::string result;
+    Status s = batch.GetFromBatchAndDB(db_, ReadOptions(), k, &result);
+    if (s.IsNotFound()) {
+      result = "NOT_FOUND";
+    } else if (!s.ok()) {
+      result = s.ToString();
+    }
+    return result;
+  }
+
+  static std::string Contents(Iterator* iter) {
+    std::string result;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      result += iter->key().ToString() + "=" + iter->value().ToString() + " ";
+    }
+    return result;
+  }
+};
+
+TEST(WriteBatchWithIndexTest, GetFromBatch) {
+  WriteBatchWithIndex batch;
+  std::string value;
+  ASSERT_TRUE(batch.GetFromBatch("a", &value).IsNotFound());
+  batch.Put("a", "v1");
+  batch.Put("b", "vb");
+  batch.Put("a", "v2");
+  ASSERT_OK(batch.GetFromBatch("a", &value));
+  ASSERT_EQ("v2", value);
+  batch.Delete("a");
+  ASSERT_TRUE(batch.GetFromBatch("a", &value).IsNotFound());
+  batch.Put("a", "v3");
+  ASSERT_OK(batch.GetFromBatch("a", &value));
+  ASSERT_EQ("v3", value);
+  ASSERT_OK(batch.GetFromBatch("b", &value));
+  ASSERT_EQ("vb", value);
+
+  batch.Clear();
+  ASSERT_TRUE(batch.GetFromBatch("a", &value).IsNotFound());
+  ASSERT_TRUE(batch.GetFromBatch("b", &value).IsNotFound());
+}
+
+TEST(WriteBatchWithIndexTest, GetFromBatchAndDB) {
+  ASSERT_OK(db_->Put(WriteOptions(), "a", "db_a"));
+  ASSERT_OK(db_->Put(WriteOptions(), "b", "db_b"));
+  WriteBatchWithIndex batch;
+  batch.Put("b", "batch_b");
+  batch.Delete("a");
+  batch.Put("c", "batch_c");
+  ASSERT_EQ("NOT_FOUND", Get(batch, "a"));
+  ASSERT_EQ("batch_b", Get(batch, "b"));
+  ASSERT_EQ("batch_c", Get(batch, "c"));
+  ASSERT_EQ("NOT_FOUND", Get(batch, "d"));
+
+  // The underlying batch applies the same updates to the DB.
+  ASSERT_OK(db_->Write(WriteOptions(), batch.GetWriteBatch()));
+  std::string value;
+  ASSERT_TRUE(db_->Get(ReadOptions(), "a", &value).IsNotFound());
+  ASSERT_OK(db_->Get(ReadOptions(), "b", &value));
+  ASSERT_EQ("batch_b", value);
+}
+
+TEST(WriteBatchWithIndexTest, IteratorWithBase) {
+  ASSERT_OK(db_->Put(WriteOptions(), "a", "db_a"));
+  ASSERT_OK(db_->Put(WriteOptions(), "c", "db_c"));
+  ASSERT_OK(db_->Put(WriteOptions(), "e", "db_e"));
+  WriteBatchWithIndex batch;
+  batch.Put("b", "batch_b");
+  batch.Delete("c");
+  batch.Put("e", "batch_e1");
+  batch.Put("e", "batch_e2");
+  batch.Put("f", "batch_f");
+  batch.Delete("g");
+
+  Iterator* iter = batch.NewIteratorWithBase(db_->NewIterator(ReadOptions()));
+  ASSERT_EQ("a=db_a b=batch_b e=batch_e2 f=batch_f ", Contents(iter));
+
+  iter->SeekToLast();
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ("f", iter->key().ToString());
+  iter->Prev();
+  ASSERT_EQ("e", iter->key().ToString());
+  iter->Prev();
+  ASSERT_EQ("b", iter->key().ToString());
+  // Change direction in the middle.
+  iter->Next();
+  ASSERT_EQ("e", iter->key().ToString());
+  ASSERT_EQ("batch_e2", iter->value().ToString());
+
+  iter->Seek("c");
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ("e", iter->key().ToString());
+  iter->Prev();
+  ASSERT_EQ("b", iter->key().ToString());
+  iter->Prev();
+  ASSERT_EQ("a", iter->key().ToString());
+  iter->Prev();
+  ASSERT_TRUE(!iter->Valid());
+  ASSERT_OK(iter->status());
+  delete iter;
+
+  iter = batch.NewIterator();
+  ASSERT_EQ("b=batch_b e=batch_e2 f=batch_f ", Contents(iter));
+  delete iter;
+}
+
+TEST(WriteBatchWithIndexTest, RandomizedIteratorWithBase) {
+  Random rnd(301);
+  for (int round = 0; round < 20; round++) {
+    std::map<std::string, std::string> model;
+
+    // Start from an empty DB for every round.
+    Iterator* it = db_->NewIterator(ReadOptions());
+    for (it->SeekToFirst(); it->Valid(); it->Next()) {
+      ASSERT_OK(db_->Delete(WriteOptions(), it->key()));
+    }
+    delete it;
+
+    for (int i = 0; i < 50; i++) {
+      std::string k(1, static_cast<char>('a' + rnd.Uniform(26)));
+      std::string v = "db" + std::to_string(i);
+      ASSERT_OK(db_->Put(WriteOptions(), k, v));
+      model[k] = v;
+    }
+    WriteBatchWithIndex batch;
+    for (int i = 0; i < 50; i++) {
+      std::string k(1, static_cast<char>('a' + rnd.Uniform(26)));
+      if (rnd.OneIn(3)) {
+        batch.Delete(k);
+        model.erase(k);
+      } else {
+        std::string v = "batch" + std::to_string(i);
+        batch.Put(k, v);
+        model[k] = v;
+      }
+    }
+
+    Iterator* iter =
+        batch.NewIteratorWithBase(db_->NewIterator(ReadOptions()));
+    std::map<std::string, std::string>::iterator model_iter = model.begin();
+    iter->SeekToFirst();
+    // Random walk in both directions, checking against the model.
+    for (int step = 0; step < 200; step++) {
+      if (model_iter == model.end()) {
+        ASSERT_TRUE(!iter->Valid());
+        iter->SeekToLast();
+        if (!model.empty()) {
+          model_iter = --model.end();
+        }
+        continue;
+      }
+      ASSERT_TRUE(iter->Valid());
+      ASSERT_EQ(model_iter->first, iter->key().ToString());
+      ASSERT_EQ(model_iter->second, iter->value().ToString());
+      if (rnd.OneIn(2)) {
+        iter->Next();
+        ++model_iter;
+      } else if (model_iter == model.begin()) {
+        iter->Prev();
+        ASSERT_TRUE(!iter->Valid());
+        iter->SeekToFirst();
+      } else {
+        iter->Prev();
+        --model_iter;
+      }
+    }
+    delete iter;
+  }
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
@@ -6,7 +6,7 @@
 
 #include <string.h>
 
-#include <limits>
+#include <algorithm>
 #include <map>
 #include <string>
 #include <vector>
@@ -21,11 +21,16 @@ namespace leveldb {
 
 namespace {
 
+// The contents of a file are kept in one contiguous buffer, so reads hand
+// out pointers into it without copying, like an mmap-ed file.  When the
+// buffer has to grow while readers are open, the old buffer is kept alive
+// until the last reader goes away, since slices returned by earlier reads
+// may still point into it.
 class FileState {
  public:
   // FileStates are reference counted. The initial reference count is zero
   // and the caller must call Ref() at least once.
-  FileState() : refs_(0), size_(0) {}
+  FileState() : refs_(0), data_(nullptr), capacity_(0), size_(0), readers_(0) {}
 
   // Increase the reference count.
   void Ref() {
@@ -51,9 +56,28 @@ class FileState {
     }
   }
 
-  uint64_t Size() const { return size_; }
+  // Readers register themselves so that buffers they may point into are
+  // not freed underneath them.
+  void AddReader() {
+    MutexLock lock(&mutex_);
+    ++readers_;
+  }
+
+  void RemoveReader() {
+    MutexLock lock(&mutex_);
+    assert(readers_ > 0);
+    if (--readers_ == 0) {
+      FreeRetired();
+    }
+  }
+
+  uint64_t Size() const {
+    MutexLock lock(&mutex_);
+    return size_;
+  }
 
   Status Read(uint64_t offset, size_t n, Slice* result, char* scratch) const {
+    MutexLock lock(&mutex_);
     if (offset > size_) {
       return Status::IOError("Offset greater than file size.");
     }
@@ -65,73 +89,57 @@ class FileState {
       *result = Slice();
       return Status::OK();
     }
-
-    assert(offset / kBlockSize <= std::numeric_limits<size_t>::max());
-    size_t block = static_cast<size_t>(offset / kBlockSize);
-    size_t block_offset = offset % kBlockSize;
-
-    if (n <= kBlockSize - block_offset) {
-      // The requested bytes are all in the first block.
-      *result = Slice(blocks_[block] + block_offset, n);
-      return Status::OK();
-    }
-
-    size_t bytes_to_copy = n;
-    char* dst = scratch;
-
-    while (bytes_to_copy > 0) {
-      size_t avail = kBlockSize - block_offset;
-      if (avail > bytes_to_copy) {
-        avail = bytes_to_copy;
-      }
-      memcpy(dst, blocks_[block] + block_offset, avail);
-
-      bytes_to_copy -= avail;
-      dst += avail;
-      block++;
-      block_offset = 0;
-    }
-
-    *result = Slice(scratch, n);
+    *result = Slice(data_ + offset, n);
     return Status::OK();
   }
 
   Status Append(const Slice& data) {
-    const char* src = data.data();
-    size_t src_len = data.size();
-
-    while (src_len > 0) {
-      size_t avail;
-      size_t offset = size_ % kBlockSize;
-
-      if (offset != 0) {
-        // There is some room in the last block.
-        avail = kBlockSize - offset;
-      } else {
-        // No room in the last block; push new one.
-        blocks_.push_back(new char[kBlockSize]);
-        avail = kBlockSize;
-      }
-
-      if (avail > src_len) {
-        avail = src_len;
-      }
-      memcpy(blocks_.back() + offset, src, avail);
-      src_len -= avail;
-      src += avail;
-      size_ += avail;
+    MutexLock lock(&mutex_);
+    if (size_ + data.size() > capacity_) {
+      size_t capacity = std::max<size_t>(capacity_ * 2, kMinCapacity);
+      capacity = std::max<size_t>(capacity, size_ + data.size());
+      Resize(capacity);
     }
-
+    memcpy(data_ + size_, data.data(), data.size());
+    size_ += data.size();
     return Status::OK();
   }
 
+  // Called when the writer is done; gives back the unused part of the
+  // buffer.
+  void Close() {
+    MutexLock lock(&mutex_);
+    if (capacity_ - size_ > capacity_ / 8) {
+      Resize(size_);
+    }
+  }
+
  private:
   // Private since only Unref() should be used to delete it.
   ~FileState() {
-    for (std::vector<char*>::iterator i = blocks_.begin(); i != blocks_.end();
-         ++i) {
-      delete [] *i;
+    delete[] data_;
+    FreeRetired();
+  }
+
+  void Resize(size_t capacity) EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    char* data = new char[capacity];
+    if (size_ > 0) {
+      memcpy(data, data_, size_);
     }
+    if (readers_ > 0) {
+      retired_.push_back(data_);
+    } else {
+      delete[] data_;
+    }
+    data_ = data;
+    capacity_ = capacity;
+  }
+
+  void FreeRetired() EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    for (size_t i = 0; i < retired_.size(); i++) {
+      delete[] retired_[i];
+    }
+    retired_.clear();
   }
 
   // No copying allowed.
@@ -141,22 +149,27 @@ class FileState {
   port::Mutex refs_mutex_;
   int refs_ GUARDED_BY(refs_mutex_);
 
-  // The following fields are not protected by any mutex. They are only mutable
-  // while the file is being written, and concurrent access is not allowed
-  // to writable files.
-  std::vector<char*> blocks_;
-  uint64_t size_;
+  mutable port::Mutex mutex_;
+  char* data_ GUARDED_BY(mutex_);
+  size_t capacity_ GUARDED_BY(mutex_);
+  uint64_t size_ GUARDED_BY(mutex_);
+  // Number of open SequentialFile/RandomAccessFile objects.
+  int readers_ GUARDED_BY(mutex_);
+  // Buffers replaced while readers were open.
+  std::vector<char*> retired_ GUARDED_BY(mutex_);
 
-  enum { kBlockSize = 8 * 1024 };
+  enum { kMinCapacity = 8 * 1024 };
 };
 
 class SequentialFileImpl : public SequentialFile {
  public:
   explicit SequentialFileImpl(FileState* file) : file_(file), pos_(0) {
     file_->Ref();
+    file_->AddReader();
   }
 
   ~SequentialFileImpl() {
+    file_->RemoveReader();
     file_->Unref();
   }
 
@@ -189,9 +202,11 @@ class RandomAccessFileImpl : public RandomAccessFile {
  public:
   explicit RandomAccessFileImpl(FileState* file) : file_(file) {
     file_->Ref();
+    file_->AddReader();
   }
 
   ~RandomAccessFileImpl() {
+    file_->RemoveReader();
     file_->Unref();
   }
 
@@ -218,9 +233,13 @@ class WritableFileImpl : public WritableFile {
     return file_->Append(data);
   }
 
-  virtual Status Close() { return Status::OK(); }
+  virtual Status Close() {
+    file_->Close();
+    return Status::OK();
+  }
   virtual Status Flush() { return Status::OK(); }
   virtual Status Sync() { return Status::OK(); }
+  virtual Status SyncFlushed() { return Status::OK(); }
 
  private:
   FileState* file_;
@@ -16,9 +16,17 @@ class Env;
 // when it is no longer needed.
 // *base_env must remain live while the result is in use.
 //
+// Files are stored contiguously and reads return slices pointing directly
+// into them, as with mmap-ed files.  A database on this Env that uses
+// kNoCompression therefore reads blocks in place and never copies them
+// into its block cache.
+//
 // 返回一个新的上下文, 它将全部数据存储到内存并且将全部非文件存储任务代理给 base_env. 
 // 调用者不再使用该上下文的时候必须要删除它. 
 // *base_env 在该上下文生命期内必须有效. 
+//
+// 文件内容保存在连续的内存中, 读取时像 mmap 文件一样直接返回指向文件内容的 slice.
+// 基于该上下文且使用 kNoCompression 的数据库直接原地使用 block, 不会再将其拷贝到 block cache.
 LEVELDB_EXPORT Env* NewMemEnv(Env* base_env);
 
 }  // namespace leveldb
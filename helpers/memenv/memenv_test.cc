@@ -5,6 +5,7 @@
 #include "helpers/memenv/memenv.h"
 
 #include "db/db_impl.h"
+#include "leveldb/cache.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "util/testharness.h"
@@ -191,6 +192,62 @@ TEST(MemEnvTest, LargeWrite) {
   delete [] scratch;
 }
 
+TEST(MemEnvTest, ZeroCopyReads) {
+  const size_t kWriteSize = 100 * 1024;
+  std::string write_data;
+  for (size_t i = 0; i < kWriteSize; ++i) {
+    write_data.append(1, static_cast<char>(i));
+  }
+
+  WritableFile* writable_file;
+  ASSERT_OK(env_->NewWritableFile("/dir/f", &writable_file));
+  ASSERT_OK(writable_file->Append(write_data));
+
+  // Reads return pointers into the file, whatever the range.
+  char scratch[100];
+  RandomAccessFile* rand_file;
+  ASSERT_OK(env_->NewRandomAccessFile("/dir/f", &rand_file));
+  Slice before;
+  ASSERT_OK(rand_file->Read(8 * 1024 - 50, 100, &before, scratch));
+  ASSERT_TRUE(before.data() != scratch);
+  ASSERT_EQ(0, before.compare(Slice(write_data.data() + 8 * 1024 - 50, 100)));
+
+  // Growing the file must not invalidate slices handed out earlier.
+  ASSERT_OK(writable_file->Append(write_data));
+  ASSERT_OK(writable_file->Close());
+  delete writable_file;
+  ASSERT_EQ(0, before.compare(Slice(write_data.data() + 8 * 1024 - 50, 100)));
+
+  Slice after;
+  ASSERT_OK(rand_file->Read(kWriteSize + 10, 50, &after, scratch));
+  ASSERT_TRUE(after.data() != scratch);
+  ASSERT_EQ(0, after.compare(Slice(write_data.data() + 10, 50)));
+  delete rand_file;
+}
+
+TEST(MemEnvTest, DBBypassesBlockCache) {
+  Options options;
+  options.create_if_missing = true;
+  options.env = env_;
+  options.compression = kNoCompression;
+  options.block_cache = NewLRUCache(1 << 20);
+  DB* db;
+  ASSERT_OK(DB::Open(options, "/dir/db", &db));
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_OK(db->Put(WriteOptions(), std::to_string(i), std::string(100, 'x')));
+  }
+  ASSERT_OK(reinterpret_cast<DBImpl*>(db)->TEST_CompactMemTable());
+  std::string res;
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_OK(db->Get(ReadOptions(), std::to_string(i), &res));
+    ASSERT_EQ(std::string(100, 'x'), res);
+  }
+  // Blocks are used in place; nothing was copied into the cache.
+  ASSERT_EQ(0, options.block_cache->TotalCharge());
+  delete db;
+  delete options.block_cache;
+}
+
 TEST(MemEnvTest, DBTest) {
   Options options;
   options.create_if_missing = true;
@@ -96,6 +96,21 @@ LEVELDB_EXPORT char* leveldb_get(leveldb_t* db,
                                  const char* key, size_t keylen, size_t* vallen,
                                  char** errptr);
 
+/* Looks up num_keys keys with a single call, all of them against the same
+   state of the database (an implicit snapshot is used unless "options"
+   specify one).  Returns one malloc()ed array holding the values of the
+   found keys back to back, in key order, or NULL if that array would be
+   empty.  For each i, found[i] tells whether keys[i] exists and vallens[i]
+   is the length of its value (0 if not found).  Stops at the first error,
+   which is reported through errptr. */
+LEVELDB_EXPORT char* leveldb_multi_get(leveldb_t* db,
+                                       const leveldb_readoptions_t* options,
+                                       size_t num_keys,
+                                       const char* const* keys,
+                                       const size_t* keylens,
+                                       unsigned char* found, size_t* vallens,
+                                       char** errptr);
+
 LEVELDB_EXPORT leveldb_iterator_t* leveldb_create_iterator(
     leveldb_t* db, const leveldb_readoptions_t* options);
 
@@ -144,6 +159,19 @@ LEVELDB_EXPORT const char* leveldb_iter_value(const leveldb_iterator_t*,
 LEVELDB_EXPORT void leveldb_iter_get_error(const leveldb_iterator_t*,
                                            char** errptr);
 
+/* Copies up to max_entries entries, starting at the current position, into
+   buf with each key immediately followed by its value, stores their lengths
+   in keylens[] and vallens[], and moves the iterator past them.  Stops early
+   when the iterator becomes invalid or the next entry does not fit in the
+   rest of buf.  Returns the number of entries copied.  A return value of 0
+   while the iterator is still valid means the current entry alone is larger
+   than buflen. */
+LEVELDB_EXPORT size_t leveldb_iter_next_batch(leveldb_iterator_t*, char* buf,
+                                              size_t buflen,
+                                              size_t max_entries,
+                                              size_t* keylens,
+                                              size_t* vallens);
+
 /* Write batch */
 
 LEVELDB_EXPORT leveldb_writebatch_t* leveldb_writebatch_create();
@@ -154,6 +182,17 @@ LEVELDB_EXPORT void leveldb_writebatch_put(leveldb_writebatch_t*,
                                            const char* val, size_t vlen);
 LEVELDB_EXPORT void leveldb_writebatch_delete(leveldb_writebatch_t*,
                                               const char* key, size_t klen);
+/* Appends num puts (or deletions) to the batch with a single call. */
+LEVELDB_EXPORT void leveldb_writebatch_put_many(leveldb_writebatch_t*,
+                                                size_t num,
+                                                const char* const* keys,
+                                                const size_t* klens,
+                                                const char* const* vals,
+                                                const size_t* vlens);
+LEVELDB_EXPORT void leveldb_writebatch_delete_many(leveldb_writebatch_t*,
+                                                   size_t num,
+                                                   const char* const* keys,
+                                                   const size_t* klens);
 LEVELDB_EXPORT void leveldb_writebatch_iterate(
     const leveldb_writebatch_t*, void* state,
     void (*put)(void*, const char* k, size_t klen, const char* v, size_t vlen),
@@ -124,6 +124,16 @@ class LEVELDB_EXPORT Cache {
    */
   virtual void Prune() {}
 
+  /**
+   * 对 cache 中的每一个数据项调用 (*function)(arg, key, value).
+   * 在每个 shard 内部, 较热(最近使用过) 的数据项先被访问.
+   * 调用 function 期间会持有 cache 内部的锁, 所以 function 不能再访问该 cache.
+   *
+   * 该方法的默认实现什么也不做.
+   */
+  virtual void ApplyToAllEntries(
+      void (*function)(void* arg, const Slice& key, void* value), void* arg) {}
+
   /**
    * 返回 cache 为了存储当前全部元素的总花费的估计值
    * @return
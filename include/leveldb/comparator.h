@@ -82,6 +82,42 @@ class LEVELDB_EXPORT Comparator {
   //
   // 注意, 该方法仅在设置 index block 末尾 entry 的时候调用; 如果是非末尾, 调用 FindShortestSeparator. 
   virtual void FindShortSuccessor(std::string* key) const = 0;
+
+  // User-defined timestamp support.  A comparator with a non-zero
+  // timestamp_size() expects every user key to end with a timestamp of
+  // exactly that many bytes, and must order keys with the same prefix
+  // (the key without timestamp) by timestamp, newest first.
+  //
+  // Writes to the same key must carry non-decreasing timestamps.  Reads
+  // return the first visible version found from the memtable down to the
+  // oldest sstables, and compaction lets a version hide all versions with
+  // older timestamps, so a write with an older timestamp than an earlier
+  // write to the same key may be ignored by reads or dropped.  This is
+  // not checked, since that would need a read for every write.
+  //
+  // 用户自定义时间戳支持. 如果 timestamp_size() 不为 0, 每个 user key 的末尾
+  // 都必须带有一个长度恰好为 timestamp_size() 的时间戳, 而且对于去掉时间戳后
+  // 相同的 key, Compare 必须按照时间戳从新到旧排序. 这样数据库中同一个 key
+  // 可以同时保存多个时间点的版本, 读取时通过 ReadOptions::timestamp 指定时间点.
+  // 未指定时间点时按全 0xff 的时间戳读取, 所以它必须不早于任何合法的时间戳.
+  //
+  // 对同一个 key 的写入, 时间戳必须不减. 读取时从 memtable 到最老的 sstable
+  // 逐层查找, 以找到的第一个可见版本为准; 压实时一个版本会遮住时间戳比它早的
+  // 全部版本. 所以如果写入的时间戳早于同一个 key 之前写入的时间戳, 这次写入
+  // 可能读不到, 也可能被压实丢弃. 检查这一点需要每次写入都读一次, 所以不做检查.
+
+  // 时间戳的字节数, 0 表示不支持时间戳.
+  virtual size_t timestamp_size() const { return 0; }
+
+  // 比较两个时间戳, ts1 更早返回负数, 相同返回 0, ts1 更晚返回正数.
+  // timestamp_size() 不为 0 的 comparator 必须重写该方法, 默认实现只适用于
+  // 不支持时间戳的 comparator(此时不会被调用), 否则会触发断言.
+  virtual int CompareTimestamp(const Slice& ts1, const Slice& ts2) const;
+
+  // 忽略时间戳比较两个 user key, 即只比较去掉时间戳后的部分.
+  // 读取和压实时会频繁调用, 支持时间戳的 comparator 最好重写该方法直接比较
+  // 去掉时间戳的部分; 默认实现要先拼出一个换了时间戳的 key 再调用 Compare.
+  virtual int CompareWithoutTimestamp(const Slice& a, const Slice& b) const;
 };
 
 // Return a builtin comparator that uses lexicographic byte-wise
@@ -91,6 +127,16 @@ class LEVELDB_EXPORT Comparator {
 // 返回内置的 comparator, 它使用逐字节的字典序来实现. 返回的结果是 leveldb 内部属性, 不要删除. 
 LEVELDB_EXPORT const Comparator* BytewiseComparator();
 
+// Return a builtin comparator for user keys that end with an 8-byte
+// timestamp encoded as a little-endian uint64.  The key prefixes are
+// ordered byte-wise and equal prefixes are ordered by decreasing timestamp.
+// The result remains the property of this module and must not be deleted.
+//
+// 返回内置的支持时间戳的 comparator, user key 末尾是 8 字节的时间戳
+// (小端编码的 uint64). 去掉时间戳的部分按字典序排序, 相同时按时间戳从大到小排序.
+// 返回的结果是 leveldb 内部属性, 不要删除.
+LEVELDB_EXPORT const Comparator* BytewiseComparatorWithU64Ts();
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_INCLUDE_COMPARATOR_H_
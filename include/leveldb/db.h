@@ -22,6 +22,7 @@ static const int kMinorVersion = 20;
 struct Options;
 struct ReadOptions;
 struct WriteOptions;
+class TransactionLogIterator;
 class WriteBatch; // 通过所使用的 Handler 与 MemTable 联系了起来, 后者内部存储结构是一个 SkipList. 
 
 /**
@@ -120,6 +121,25 @@ class LEVELDB_EXPORT DB {
   virtual Status Get(const ReadOptions& options,
                      const Slice& key, std::string* value) = 0;
 
+  // GetAsync 完成时的回调函数, s 和 value 的含义同 Get. value 只在回调期间有效.
+  using GetCallback = void (*)(void* arg, const Status& s, const Slice& value);
+
+  /**
+   * 异步版本的 Get, 查询完成后调用 (*callback)(arg, status, value).
+   *
+   * 不需要读取磁盘的查询(比如在 memtable 中找到了 key)直接在调用线程上完成,
+   * 回调在返回之前被调用; 否则查询被交给内部的读线程(个数见
+   * Options::async_read_threads), 调用立即返回, 回调之后在读线程上被调用.
+   * 这样一个事件循环线程可以同时发出大量查询而不必阻塞在磁盘读取上.
+   * 读线程是阻塞读, 同时读盘的查询最多 async_read_threads 个, 多出的排队.
+   *
+   * 查询基于调用时数据库的状态(或 options.snapshot), 返回之后 key 和
+   * options 都可以释放. 关闭数据库之前会先完成全部未完成的查询.
+   * 回调中不能关闭数据库. 默认实现同步调用 Get.
+   */
+  virtual void GetAsync(const ReadOptions& options, const Slice& key,
+                        GetCallback callback, void* arg);
+
   /**
    * 返回基于堆内存的迭代器, 可以用该迭代器遍历整个数据库的内容. 
    * 该函数返回的迭代器初始是无效的(在使用迭代器之前, 调用者必须在其上调用 Seek 方法). 
@@ -177,6 +197,24 @@ class LEVELDB_EXPORT DB {
   virtual void GetApproximateSizes(const Range* range, int n,
                                    uint64_t* sizes) = 0;
 
+  /**
+   * Like GetApproximateSizes, but also estimates the number of entries in
+   * each range, and includes the memtables in both estimates.
+   *
+   * 和 GetApproximateSizes 类似, 但是同时将 [range[i].start .. range[i].limit)
+   * 中数据项的近似个数存储到 counts[i] 中, 而且 sizes 和 counts 都包含了尚在 memtable
+   * 中的数据. 数据项个数包括被覆盖的老版本和删除标记; sstable 部分按数据块粒度估计,
+   * memtable 部分由 skiplist 的索引层估计, 不需要遍历数据, 可以在每次查询前调用.
+   *
+   * 默认实现调用 GetApproximateSizes 并将 counts 置零.
+   * @param range 指定要查询一组 keys 范围
+   * @param n range, sizes 和 counts 三个数组的大小
+   * @param sizes 存储查询到的每个 range 对应的近似字节数
+   * @param counts 存储查询到的每个 range 对应的近似数据项个数
+   */
+  virtual void GetApproximateStats(const Range* range, int n,
+                                   uint64_t* sizes, uint64_t* counts);
+
   /**
    * 将键范围 [*begin,*end] 对应的底层存储压实, 注意范围是左闭右闭. 
    *
@@ -190,12 +228,38 @@ class LEVELDB_EXPORT DB {
    * @param end 截止键
    */
   virtual void CompactRange(const Slice* begin, const Slice* end) = 0;
+
+  /**
+   * 调高历史版本保留下界, 含义见 Options::full_history_ts_low.
+   * 之后的压实会据此回收老版本. 新的下界比当前下界更早时保持不变.
+   *
+   * 如果 comparator 不支持时间戳或者 ts 长度不对, 返回 InvalidArgument;
+   * 默认实现返回 NotSupported.
+   */
+  virtual Status IncreaseFullHistoryTsLow(const Slice& ts);
+
+  /**
+   * 返回一个迭代器, 按写入顺序遍历 log 文件中从序列号 seq 开始的全部 batch,
+   * 可以用于增量复制. 第一个 batch 是包含 seq 的那个, 所以它的起始序列号可能
+   * 小于 seq. 迭代器只返回调用时已经写入的 batch.
+   *
+   * 恢复数据库不再需要的 log 文件默认会被删除, 想要读取更早的更新需要设置
+   * Options::wal_ttl_seconds 或 Options::wal_size_limit 保留它们.
+   * 如果 seq 对应的更新已经不在 log 文件中了, 返回 NotFound.
+   *
+   * 成功时将迭代器存储到 *iter 并返回 OK, 调用者不再使用时负责释放它;
+   * 否则 *iter 为 nullptr. 默认实现返回 NotSupported.
+   */
+  virtual Status GetUpdatesSince(uint64_t seq, TransactionLogIterator** iter);
 };
 
 /**
  * 销毁指定数据库的全部内容, 该方法请慎用. 
  *
  * 注意: 为了保持向后兼容, 如果该方法无法列出数据库文件, 仍会返回 Status::OK() 以掩盖这种失败. 
+ *
+ * 如果设置了 options.wal_dir, 或者数据库记录了上次使用的 log 目录,
+ * 这些目录下的 log 文件也会被删除.
  * @param name 要销毁的数据库名称
  * @param options 销毁时使用的配置参数
  * @return
@@ -350,6 +350,16 @@ class LEVELDB_EXPORT WritableFile {
   virtual Status Flush() = 0;
   // 同步文件和缓存内容到磁盘, 针对 manifest 文件需要额外处理. 
   virtual Status Sync() = 0;
+
+  // Sync the data already passed to the operating system by Flush() to
+  // stable storage.  Unlike Sync(), it does not touch data buffered by
+  // Append(), so it may be called while another thread calls Append()
+  // and Flush().  The default implementation returns NotSupported.
+  //
+  // 只将已经 Flush() 给操作系统的数据同步到磁盘. 它不访问 Append() 缓存在
+  // 用户态的数据, 所以可以在其它线程 Append()/Flush() 的同时调用.
+  // 不支持时返回 NotSupported, 默认实现就是如此.
+  virtual Status SyncFlushed();
 };
 
 // An interface for writing log messages.
@@ -72,6 +72,27 @@ class LEVELDB_EXPORT Iterator {
   // 发生错误返回之; 否则返回 ok.
   virtual Status status() const = 0;
 
+  // 如果 value() 返回的数据在迭代器移动之后依然有效(直到迭代器被销毁),
+  // 返回 true, 这时调用方想要保存 value 不必拷贝一份. 默认返回 false.
+  // 注意: 调用该方法前提是迭代器当前指向必须 valid.
+  virtual bool IsValuePinned() const { return false; }
+
+  // NextBatch 的回调函数, 返回 false 表示不再接收数据项.
+  using BatchCallback = bool (*)(void* arg, const Slice& key,
+                                 const Slice& value);
+  /**
+   * 从当前数据项开始, 依次把最多 max_n 个数据项的 key 和 value 交给 callback,
+   * 每接收一项迭代器就向后移动一项, 效果相当于循环调用 key(), value() 和 Next().
+   * 如果 callback 返回 false, 它拒绝的数据项不计入结果, 迭代器停在该数据项上.
+   *
+   * 传给 callback 的 key 和 value 只在本次回调期间有效.
+   * 返回 callback 接收的数据项个数; 迭代器无效时返回 0.
+   *
+   * 默认实现就是上面的循环, 各个具体的迭代器可以覆写它, 在内部连续遍历以
+   * 省去每个数据项多次虚函数调用的开销.
+   */
+  virtual size_t NextBatch(size_t max_n, BatchCallback callback, void* arg);
+
   // 我们允许调用方注册一个带两个参数的回调函数, 当迭代器析构时该函数会被自动调用.
   using CleanupFunction = void (*)(void* arg1, void* arg2);
   // 我们允许客户端注册 CleanupFunction 类型的回调函数, 在迭代器被销毁的时候会调用它们(可以注册多个). 
@@ -0,0 +1,84 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// OptimisticTransactionDB provides transactions on top of a DB without
+// taking any locks while the transaction runs.  Conflicts are detected
+// when the transaction commits.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_OPTIMISTIC_TRANSACTION_DB_H_
+#define STORAGE_LEVELDB_INCLUDE_OPTIMISTIC_TRANSACTION_DB_H_
+
+#include <string>
+#include "leveldb/db.h"
+#include "leveldb/export.h"
+#include "leveldb/options.h"
+#include "leveldb/status.h"
+#include "leveldb/transaction.h"
+
+namespace leveldb {
+
+struct LEVELDB_EXPORT OptimisticTransactionOptions {
+  // If true, the transaction takes a snapshot when it begins and all reads
+  // and conflict checks are relative to that snapshot.
+  /**
+   * 如果为 true, 事务开始时获取一个快照, 之后的读操作都在该快照上进行,
+   * 提交时检查快照之后是否有其它写操作修改了事务读写过的 key.
+   */
+  bool set_snapshot = false;
+};
+
+/**
+ * 支持乐观事务的数据库.
+ *
+ * 事务期间不加任何锁, 写操作先缓存在事务内部的 WriteBatch 中, 读过和写过的 key
+ * 会连同当时数据库的序列号一起被记录下来. 提交时在写入队列中检查这些 key 在记录之后
+ * 是否被其它写操作修改过, 如果被修改过则放弃提交并返回 Busy 状态, 调用者可以重试;
+ * 否则事务内的全部写操作被原子地写入数据库. GetForUpdate 和 Get 的行为相同.
+ *
+ * 如果记录的 key 在数据库中已经没有任何记录, 而记录之后发生过压实, 那么之后的
+ * 修改可能已经和删除标记一起被丢弃了, 这时无法判断是否冲突, 同样返回 Busy.
+ * 设置 OptimisticTransactionOptions::set_snapshot 可以避免这种情况, 因为压实
+ * 会保留快照可见的删除标记.
+ *
+ * 底层数据库仍然可以通过 GetBaseDB 直接访问, 非事务的写操作同样会导致
+ * 与之冲突的事务提交失败.
+ */
+class LEVELDB_EXPORT OptimisticTransactionDB {
+ public:
+  /**
+   * 打开一个名为 name 的数据库.
+   *
+   * 打开成功, 会把一个指向基于堆内存的数据库指针存储到 *dbptr, 同时返回 OK;
+   * 如果打开失败, 存储 nullptr 到 *dbptr 同时返回一个错误状态.
+   *
+   * 调用者不再使用这个数据库时需要负责释放 *dbptr 指向的内存.
+   */
+  static Status Open(const Options& options,
+                     const std::string& name,
+                     OptimisticTransactionDB** dbptr);
+
+  OptimisticTransactionDB() = default;
+
+  OptimisticTransactionDB(const OptimisticTransactionDB&) = delete;
+  OptimisticTransactionDB& operator=(const OptimisticTransactionDB&) = delete;
+
+  virtual ~OptimisticTransactionDB();
+
+  /**
+   * 开始一个新事务, 事务提交时使用 write_options 写入.
+   *
+   * 调用者不再使用该事务时需要负责释放它, 事务必须在数据库之前被释放.
+   */
+  virtual Transaction* BeginTransaction(
+      const WriteOptions& write_options,
+      const OptimisticTransactionOptions& txn_options =
+          OptimisticTransactionOptions()) = 0;
+
+  // 返回底层的数据库, 它归 OptimisticTransactionDB 所有, 调用者不能释放它.
+  virtual DB* GetBaseDB() = 0;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_OPTIMISTIC_TRANSACTION_DB_H_
@@ -6,6 +6,9 @@
 #define STORAGE_LEVELDB_INCLUDE_OPTIONS_H_
 
 #include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
 #include "leveldb/export.h"
 
 namespace leveldb {
@@ -15,6 +18,8 @@ class Comparator;
 class Env;
 class FilterPolicy;
 class Logger;
+class PersistentCache;
+class Slice;
 class Snapshot;
 
 // DB contents are stored in a set of blocks, each of which holds a
@@ -176,6 +181,50 @@ struct LEVELDB_EXPORT Options {
    */
   Cache* block_cache;
 
+  // If non-null, data blocks that miss in block_cache are looked up in
+  // this cache before being read from the table file, and blocks read
+  // from table files are added to it.  See leveldb/persistent_cache.h.
+  // Default: nullptr
+  /**
+   * 如果该值非空, block_cache 未命中的 data block 在读取 sstable 文件前
+   * 先在这个位于本地高速设备上的二级缓存中查找; 从 sstable 文件读出的
+   * data block 也会被(异步地) 写入该缓存. 具体见 leveldb/persistent_cache.h.
+   *
+   * 默认值为 nullptr
+   */
+  PersistentCache* persistent_cache;
+
+  // If true, the blocks of this database held in block_cache are recorded
+  // in a file when the database is closed, and read back into block_cache
+  // by background threads when it is opened again.
+  // Default: false
+  /**
+   * 如果为 true, 关闭数据库时把 block_cache 中属于本数据库的 block
+   * (文件编号与偏移量) 记录到 BLOCKCACHE 文件; 再次打开数据库时由若干
+   * 后台线程并行地把这些 block 读回 block_cache, 以尽快恢复重启前的命中率.
+   *
+   * 默认值为 false
+   */
+  bool persist_block_cache;
+
+  // Data blocks of memtable flush outputs, and of compaction outputs at
+  // levels <= this value, are inserted into block_cache as they are
+  // written, so that reads of freshly written hot data do not go to disk.
+  // Flush outputs count as level 0.  A negative value disables this.
+  // (Index and filter blocks are always loaded into the table cache when
+  // a new table is verified after being written.)
+  // Default: -1
+  /**
+   * memtable 转储生成的文件, 以及输出到 level 不大于该值的压实所生成的文件,
+   * 它们的 data block 在写入文件的同时被放入 block_cache, 这样读取刚写入的
+   * 热数据时不用再去读磁盘. memtable 转储生成的文件按 level-0 处理.
+   * 负数表示禁用该功能.
+   * (index block 和 filter block 在新文件写完校验时就已经被加载到 table cache 中了.)
+   *
+   * 默认值为 -1
+   */
+  int warm_block_cache_level;
+
   // Approximate size of user data packed per block.  Note that the
   // block size specified here corresponds to uncompressed data.  The
   // actual size of the unit read from disk may be smaller if
@@ -207,6 +256,30 @@ struct LEVELDB_EXPORT Options {
    */
   int block_restart_interval;
 
+  // If non-zero, every user key (including any timestamp) must be exactly
+  // this many bytes long; writes with other keys fail with InvalidArgument.
+  // Keys are then stored without length prefixes: data and index blocks
+  // keep keys in a fixed-stride array searched by plain binary search, and
+  // with BytewiseComparator() 8- and 16-byte keys are compared as
+  // big-endian uint64s.  Tables written this way are self-describing, so
+  // the option may be turned on for an existing DB only if all its keys
+  // already have this length.
+  //
+  // Default: 0
+  /**
+   * 如果不为 0, 每个 user key(包括时间戳, 如果有的话)的长度都必须恰好为该值,
+   * 写入其它长度的 key 会返回 InvalidArgument.
+   *
+   * 此时 key 不再带长度前缀: data block 和 index block 中的 key 按固定步长
+   * 连续存放, 直接二分查找, 不再做前缀压缩; 使用 BytewiseComparator() 时,
+   * 长度为 8 或 16 字节的 key 会按大端序 uint64 进行比较.
+   * 按该模式写出的 sstable 是自描述的, 但只有当数据库中已有的 key 长度都等于
+   * 该值时才能对已有数据库开启该选项.
+   *
+   * 默认值为 0
+   */
+  size_t fixed_key_length;
+
   // Leveldb will write up to this amount of bytes to a file before
   // switching to a new one.
   // Most clients should leave this parameter alone.  However if your
@@ -274,6 +347,187 @@ struct LEVELDB_EXPORT Options {
    */
   const FilterPolicy* filter_policy;
 
+  // If non-empty, entry i (when present and non-null) is used instead of
+  // "filter_policy" to build the filters of tables written to level i, for
+  // example bloom filters with a different number of bits per key.  Tables
+  // are always read with "filter_policy", so every entry must build filters
+  // that "filter_policy" can read and must return the same Name().  Has no
+  // effect if "filter_policy" is null.
+  //
+  // Default: empty
+  /**
+   * 不为空时, 写入第 i 层的 sstable 使用第 i 个元素(存在且不为 nullptr 时)
+   * 代替 filter_policy 生成 filter, 比如每一层使用不同 bits per key 的
+   * bloom filter. 读取时总是使用 filter_policy, 所以每个元素生成的 filter
+   * 都必须能被 filter_policy 读取, 并且 Name() 相同. filter_policy 为空时
+   * 该参数无效.
+   *
+   * 默认为空
+   */
+  std::vector<const FilterPolicy*> level_filter_policies;
+
+  // If true, tables written by a compaction into the bottommost level that
+  // holds data are built without filters.  When nearly every lookup is for
+  // a key that exists, the filter of the last level that can contain the
+  // key only confirms what reading the table finds anyway, yet that level
+  // holds most of the data and hence most of the filter memory and the
+  // filter-building CPU.  Such tables keep having no filter if deeper
+  // levels receive data later.
+  //
+  // Default: false
+  /**
+   * 为 true 时, 压实写入到当前有数据的最深一层的 sstable 不生成 filter.
+   * 几乎所有查询的 key 都存在时, 最后一层的 filter 只是确认读 sstable
+   * 也能得出的结论, 而这一层存放了绝大部分数据, 也就占了绝大部分 filter
+   * 内存以及构建 filter 的 CPU. 之后更深的层有了数据, 这些 sstable 依然没有 filter.
+   *
+   * 默认值为 false
+   */
+  bool optimize_filters_for_hits;
+
+  // If true, every table also stores a range filter built from its keys,
+  // and iterators created with ReadOptions::iterate_lower_bound or
+  // iterate_upper_bound skip tables that hold no key in the bounded range.
+  // Unlike filter_policy this helps short range scans.  Only used when
+  // "comparator" is BytewiseComparator(); the filter takes roughly as much
+  // space as the keys' distinguishing prefixes.
+  //
+  // Default: false
+  /**
+   * 为 true 时, 每个 sstable 还会根据其 key 生成一个范围过滤器, 设置了
+   * ReadOptions::iterate_lower_bound 或 iterate_upper_bound 的迭代器会跳过
+   * 在该范围内没有 key 的 sstable. 与 filter_policy 不同, 它可以加速短范围扫描.
+   * 仅当 comparator 为 BytewiseComparator() 时有效; 过滤器的大小约等于
+   * 各个 key 的最短区分前缀的总长度.
+   *
+   * 默认值为 false
+   */
+  bool range_filter;
+
+  // Write ahead log files that are no longer needed for recovery are
+  // normally deleted right away.  If either of the following is non-zero,
+  // they are kept so that DB::GetUpdatesSince() can read the updates
+  // they hold, and deleted once they have been obsolete for more than
+  // "wal_ttl_seconds" or once the retained files exceed "wal_size_limit"
+  // bytes in total, oldest first.  Zero disables the corresponding limit.
+  //
+  // Default: 0
+  /**
+   * 默认情况下, 恢复数据库不再需要的 log 文件会被立即删除.
+   *
+   * 如果下面两个参数任意一个不为 0, 这些 log 文件会被保留下来, 供 DB::GetUpdatesSince()
+   * 读取其中的更新(比如用于主从复制). 保留的 log 文件过期超过 wal_ttl_seconds 秒,
+   * 或者全部保留文件总大小超过 wal_size_limit 字节时, 从最老的开始删除.
+   * 为 0 表示不做对应的限制. 检查发生在后台压实清理文件的时候.
+   *
+   * 默认值均为 0
+   */
+  uint64_t wal_ttl_seconds;
+  size_t wal_size_limit;
+
+  // Directory for the log (WAL) files.  Log files receive small synced
+  // sequential writes, so placing them on a dedicated low-latency device
+  // keeps sync latency away from compaction I/O.  An empty value puts
+  // them in the DB directory.
+  //
+  // The directory must belong to exactly one DB: log files in it are
+  // deleted when that DB no longer needs them and by DestroyDB().  The
+  // directory in use is recorded in the DB, so the logs in the old one are
+  // still recovered after wal_dir changes; Open fails if it is unreadable.
+  //
+  // Default: empty
+  /**
+   * 存放 log 文件的目录. log 文件承受的是频繁 sync 的小块顺序写, 把它放到独立的
+   * 低延迟设备上可以避免同步写延迟受到压实 I/O 的干扰. 为空表示放在数据库目录下.
+   *
+   * 该目录必须只属于一个数据库: 其中编号小于当前 log 的 log 文件会被当作本数据库
+   * 过期的 log 文件删除, DestroyDB 也会删除其中全部 log 文件. 多个数据库需要
+   * 各自使用不同的目录(ShardedDB 会为每个分片使用 wal_dir 下单独的子目录).
+   *
+   * 正在使用的 log 目录记录在数据库目录下的 WALDIR 文件中. 两次打开之间修改该选项时,
+   * 恢复, 清理过期文件, DestroyDB 和 RepairDB 仍会扫描数据库目录和上次的 log 目录,
+   * 其中的 log 文件在恢复之后删除; 上次的 log 目录无法读取时打开失败, 而不是丢弃
+   * 其中的更新.
+   *
+   * 默认为空
+   */
+  std::string wal_dir;
+
+  // Only used when comparator->timestamp_size() > 0.  Versions of a key
+  // that are not visible to a read at this timestamp or later may be
+  // dropped by compaction.  An empty value keeps the full history.
+  // Deletions at or before the bound are dropped once no older version
+  // can remain below them.  This relies on writes to a key using
+  // non-decreasing timestamps (see Comparator::timestamp_size()).
+  // The bound can be raised later with DB::IncreaseFullHistoryTsLow().
+  //
+  // Default: empty
+  /**
+   * 仅当 comparator->timestamp_size() 大于 0 时才有意义.
+   *
+   * 历史版本保留下界: 对于同一个 key, 时间戳不晚于该值的版本中只有最新的那个
+   * 对时间点不早于该值的读取可见, 更老的版本会在压实时被回收. 这之后在早于该值
+   * 的时间点上读取, 结果是不确定的. 为空表示保留全部历史版本.
+   *
+   * 时间戳不晚于该值的删除标记, 在确定不会再有更老版本留在它下面时也会被回收.
+   * 这些都依赖于对同一个 key 的写入时间戳不减(见 Comparator::timestamp_size()).
+   *
+   * 打开数据库之后可以通过 DB::IncreaseFullHistoryTsLow() 调高该值.
+   *
+   * 默认值为空
+   */
+  std::string full_history_ts_low;
+
+  // Number of threads DB::GetAsync() uses for lookups that have to read
+  // table files.  Env has no asynchronous read interface, so each of these
+  // threads blocks on its reads: at most this many such lookups are in
+  // progress at once and the rest wait in a queue.  Set it to the number of
+  // concurrent lookups the application expects to have outstanding.  The
+  // threads are started only as lookups queue up.  Clipped to [1, 256].
+  //
+  // Default: 16
+  /**
+   * DB::GetAsync() 查询需要读取 sstable 文件时由内部的读线程完成.
+   * Env 没有异步读接口, 读线程在磁盘读取上阻塞, 所以同时进行的这类查询
+   * 最多为该参数个, 其余的排队等待. 应设置为应用预期同时发出的查询个数.
+   * 读线程随着查询排队逐个启动. 取值范围 [1, 256].
+   *
+   * 默认值为 16
+   */
+  int async_read_threads;
+
+  // Obsolete files are deleted by a background thread without holding the
+  // DB mutex.  If non-zero, that thread deletes at most this many bytes
+  // per second, spreading out the I/O of deleting many large files at once.
+  //
+  // Default: 0 (unlimited)
+  /**
+   * 过期文件由后台线程在不持有数据库锁的情况下删除. 该参数不为 0 时
+   * 后台线程每秒最多删除这么多字节的文件, 避免一次删除大量大文件造成
+   * 磁盘 IO 抖动. 数据库关闭时剩余的文件不再限速.
+   *
+   * 默认值为 0, 表示不限速
+   */
+  uint64_t delete_rate_bytes_per_second;
+
+  // If true, when a write group (the batches of concurrent writers that are
+  // logged together) updates the same key more than once, only the last
+  // update is inserted into the memtable.  The group becomes visible to
+  // readers and snapshots all at once, so the overwritten updates could
+  // never be read anyway; they are still recorded in the log.  This saves
+  // memtable space and flush volume when a few keys are updated very often.
+  //
+  // Default: false
+  /**
+   * 为 true 时, 如果同一组写入(一起写入 log 文件的若干并发写入的 batch)
+   * 多次更新同一个 key, 只将最后一次更新插入 memtable. 整组写入对读者和快照
+   * 是同时生效的, 被覆盖的更新本来就不可能被读到; log 文件中依然记录全部更新.
+   * 少数 key 被频繁更新时可以节省 memtable 空间以及落盘数据量.
+   *
+   * 默认值为 false
+   */
+  bool dedup_group_updates;
+
   // Create an Options object with default values for all fields.
   /**
    * 使用各个参数的默认值创建一个 Option 对象
@@ -319,10 +573,45 @@ struct LEVELDB_EXPORT ReadOptions {
    */
   const Snapshot* snapshot;
 
+  // Only used when the comparator supports timestamps, in which case keys
+  // passed to reads never carry one.  If "timestamp" is non-null, reads see
+  // for every key the newest version whose timestamp is not later than
+  // *timestamp; otherwise the newest version.
+  // Default: nullptr
+  /**
+   * 仅当数据库的 comparator 支持时间戳时才有意义, 这时读操作传入的 key 不带时间戳.
+   * 如果该参数为非空, 对每个 key 读取时间戳不晚于 *timestamp 的最新版本,
+   * 否则读取最新的版本. 迭代器返回的 key 带有所读版本的时间戳.
+   *
+   * 默认值为 nullptr
+   */
+  const Slice* timestamp;
+
+  // Only used by iterators.  If non-null, the iterator returns no key
+  // before *iterate_lower_bound (inclusive), resp. at or after
+  // *iterate_upper_bound (exclusive); Seek() and SeekToFirst() start no
+  // earlier than the lower bound and SeekToLast() starts below the upper
+  // bound.  Tables holding no key in the range are not read, see
+  // Options::range_filter.  The bounds are copied by NewIterator().
+  // Default: nullptr
+  /**
+   * 仅用于迭代器. 如果不为空, 迭代器不返回小于 *iterate_lower_bound 的 key,
+   * 也不返回不小于 *iterate_upper_bound 的 key; Seek() 和 SeekToFirst()
+   * 从下界开始, SeekToLast() 从上界之前开始. 在该范围内没有 key 的 sstable
+   * 不会被读取, 见 Options::range_filter. NewIterator() 会拷贝上下界.
+   *
+   * 默认值为 nullptr
+   */
+  const Slice* iterate_lower_bound;
+  const Slice* iterate_upper_bound;
+
   ReadOptions()
       : verify_checksums(false),
         fill_cache(true),
-        snapshot(nullptr) {
+        snapshot(nullptr),
+        timestamp(nullptr),
+        iterate_lower_bound(nullptr),
+        iterate_upper_bound(nullptr) {
   }
 };
 
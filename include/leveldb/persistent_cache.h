@@ -0,0 +1,72 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A PersistentCache is a second-tier block cache kept on a fast local
+// device (e.g. an SSD).  Table consults it after a block_cache miss and
+// before reading the block from the (possibly slow) table file.
+//
+// Table keys its blocks by a unique id of the DB (kept in its IDENTITY
+// file) plus the table file number, so a cache directory may be kept
+// across DestroyDB() and RepairDB(): blocks of the old DB are never
+// served and age out of the cache.
+/**
+ * PersistentCache 是位于本地高速设备(比如 SSD) 上的二级 block 缓存.
+ * Table 读取 data block 时, 如果 block_cache 未命中, 会先查该缓存,
+ * 仍未命中才去(可能很慢的) sstable 文件读取, 读到的 block 随后被异步写入该缓存.
+ *
+ * Table 以数据库的唯一标识(保存在数据库的 IDENTITY 文件中) 加上 sstable 文件编号
+ * 作为缓存 block 的 key, 所以 DestroyDB() 或者 RepairDB() 之后可以继续使用
+ * 同一个缓存目录: 之前数据库的 block 不会被命中, 会逐渐被淘汰.
+ */
+
+#ifndef STORAGE_LEVELDB_INCLUDE_PERSISTENT_CACHE_H_
+#define STORAGE_LEVELDB_INCLUDE_PERSISTENT_CACHE_H_
+
+#include <stdint.h>
+#include <string>
+#include "leveldb/export.h"
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class Env;
+class PersistentCache;
+
+// Create a cache that stores up to "capacity" bytes in files under "dir"
+// (created if missing).  Entries written by a previous instance over the
+// same directory are recovered.  On success stores the cache in *result.
+/**
+ * 创建一个把数据存储在 dir 目录下文件中的持久化缓存, 最多占用 capacity 字节.
+ * 目录不存在则创建之; 之前同一目录上的缓存实例写入的数据会被恢复出来.
+ * 成功则将缓存保存到 *result, 不再使用时由调用方负责删除之.
+ */
+LEVELDB_EXPORT Status NewPersistentCache(Env* env, const std::string& dir,
+                                         uint64_t capacity,
+                                         PersistentCache** result);
+
+class LEVELDB_EXPORT PersistentCache {
+ public:
+  PersistentCache() = default;
+
+  PersistentCache(const PersistentCache&) = delete;
+  PersistentCache& operator=(const PersistentCache&) = delete;
+
+  // 析构时会把尚未落盘的数据写入文件.
+  virtual ~PersistentCache();
+
+  // Add a copy of "value" under "key".  The write to the device happens
+  // asynchronously and the entry may be dropped if the cache is busy.
+  // 插入 <key, value> 的一份拷贝. 写设备的动作是异步进行的, 缓存繁忙时
+  // 可能直接丢弃本次插入.
+  virtual void Insert(const Slice& key, const Slice& value) = 0;
+
+  // If the cache holds "key", store its value in *value and return true.
+  // 如果缓存中存在 key, 则将其 value 保存到 *value 并返回 true.
+  virtual bool Lookup(const Slice& key, std::string* value) = 0;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_PERSISTENT_CACHE_H_
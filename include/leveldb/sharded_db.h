@@ -0,0 +1,92 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// ShardedDB partitions the key space over several independent databases
+// ("shards") stored in subdirectories, so that writes, memtable flushes and
+// compactions of different shards proceed in parallel.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_SHARDED_DB_H_
+#define STORAGE_LEVELDB_INCLUDE_SHARDED_DB_H_
+
+#include <string>
+#include <vector>
+#include "leveldb/db.h"
+#include "leveldb/export.h"
+#include "leveldb/options.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+struct LEVELDB_EXPORT ShardedDBOptions {
+  // Number of shards when keys are hash-partitioned.  Ignored if
+  // split_keys is not empty.
+  /**
+   * 按 key 的哈希值分片时的分片个数. split_keys 不为空时忽略该值.
+   */
+  int num_shards = 4;
+
+  // If not empty, keys are range-partitioned into split_keys.size() + 1
+  // shards: shard i holds the keys k with split_keys[i-1] <= k <
+  // split_keys[i].  Must be sorted by Options::comparator.
+  /**
+   * 如果不为空, 则按 key 的范围分成 split_keys.size() + 1 个分片, 第 i 个分片
+   * 保存满足 split_keys[i-1] <= k < split_keys[i] 的 key.
+   * 必须按照 Options::comparator 严格递增.
+   */
+  std::vector<std::string> split_keys;
+};
+
+/**
+ * 把 key 空间划分到多个分片上的数据库, 每个分片是 name 目录下一个独立的数据库,
+ * 有自己的写队列、memtable 和压实线程, 所以不同分片上的写入和压实可以并行执行.
+ *
+ * 分片方式在创建时确定并记录在 name 目录中, 之后必须以相同的 ShardedDBOptions
+ * 打开. Options 原样用于每个分片, 所以 write_buffer_size 等内存开销按分片个数
+ * 成倍增加; 不支持 persistent_cache 以及带时间戳的 comparator.
+ *
+ * 跨分片的语义如下:
+ * - Write 按分片拆分 batch, 每个分片上的部分原子地生效, 但不同分片之间不保证原子性.
+ * - GetSnapshot 依次获取每个分片的快照, 对每个分片一致, 但不是全局一致的时间点.
+ * - NewIterator 归并全部分片的迭代器, 按 comparator 顺序遍历整个数据库.
+ * - GetUpdatesSince 不支持, 各分片的序列号相互独立.
+ */
+class LEVELDB_EXPORT ShardedDB : public DB {
+ public:
+  /**
+   * 打开一个名为 name 的分片数据库.
+   *
+   * 打开成功, 会把一个指向基于堆内存的数据库指针存储到 *dbptr, 同时返回 OK;
+   * 如果打开失败, 存储 nullptr 到 *dbptr 同时返回一个错误状态.
+   * 分片方式与已有数据库不一致时返回 InvalidArgument.
+   *
+   * 调用者不再使用这个数据库时需要负责释放 *dbptr 指向的内存.
+   */
+  static Status Open(const Options& options,
+                     const ShardedDBOptions& sharded_options,
+                     const std::string& name,
+                     ShardedDB** dbptr);
+
+  ShardedDB() = default;
+
+  ShardedDB(const ShardedDB&) = delete;
+  ShardedDB& operator=(const ShardedDB&) = delete;
+
+  virtual ~ShardedDB();
+
+  // 返回分片个数
+  virtual int NumShards() const = 0;
+
+  // 返回第 i 个分片的数据库, 它归 ShardedDB 所有, 调用者不能释放它.
+  virtual DB* GetShard(int i) = 0;
+};
+
+/**
+ * 销毁指定分片数据库的全部内容, 包括全部分片. 该方法请慎用.
+ */
+LEVELDB_EXPORT Status DestroyShardedDB(const std::string& name,
+                                       const Options& options);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_SHARDED_DB_H_
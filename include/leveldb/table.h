@@ -6,12 +6,14 @@
 #define STORAGE_LEVELDB_INCLUDE_TABLE_H_
 
 #include <stdint.h>
+#include <vector>
 #include "leveldb/export.h"
 #include "leveldb/iterator.h"
 
 namespace leveldb {
 
 class Block;
+struct BlockContents;
 class BlockHandle;
 class Footer;
 struct Options;
@@ -44,6 +46,26 @@ class LEVELDB_EXPORT Table {
                      uint64_t file_size,
                      Table** table);
 
+  // Same as above, but also records the unique id of the database the
+  // table belongs to and the number of the file within it.  Together with
+  // a block's offset they form the block's key in
+  // options.persistent_cache; zero for either disables the persistent
+  // cache.  A non-zero "cache_id" is used as the prefix of this table's
+  // keys in options.block_cache instead of a newly allocated id (see
+  // TableBuilder::CacheDataBlocks).
+  // 同上, 另外记录该 table 所属数据库的唯一标识以及它在数据库中的文件编号.
+  // 二者与 block 偏移量一起构成 block 在 options.persistent_cache 中的 key;
+  // 任意一个为 0 表示不使用持久化缓存.
+  // cache_id 非 0 时用它代替新分配的 id 作为该 table 在 options.block_cache
+  // 中的 key 前缀(见 TableBuilder::CacheDataBlocks).
+  static Status Open(const Options& options,
+                     RandomAccessFile* file,
+                     uint64_t file_size,
+                     uint64_t db_id,
+                     uint64_t file_number,
+                     uint64_t cache_id,
+                     Table** table);
+
   Table(const Table&) = delete;
   void operator=(const Table&) = delete;
 
@@ -71,6 +93,18 @@ class LEVELDB_EXPORT Table {
   // 那么返回的就是如果它存在时所处的大致位置). 
   uint64_t ApproximateOffsetOf(const Slice& key) const;
 
+  // Same as ApproximateOffsetOf(), and also stores in *entries the number
+  // of entries in the data blocks before the one holding "key" (all
+  // entries if "key" is past the last key).  Returns false, leaving
+  // *entries zero, if the table does not record per-block entry counts
+  // (tables written by older versions).
+  //
+  // 同 ApproximateOffsetOf(), 另外将 key 所在 data block 之前的数据项个数
+  // 存储到 *entries(key 大于全部 key 时为数据项总数). table 没有记录每个
+  // data block 的数据项个数(旧版本生成的 table)时返回 false, *entries 为 0.
+  bool ApproximatePositionOf(const Slice& key, uint64_t* offset,
+                             uint64_t* entries) const;
+
  private:
   struct Rep;
   Rep* rep_;
@@ -90,6 +124,18 @@ class LEVELDB_EXPORT Table {
 
   void ReadMeta(const Footer& footer);
   void ReadFilter(const Slice& filter_handle_value);
+  void ReadRangeFilter(const Slice& handle_value);
+
+  // 该 table 中是否可能有 user key 位于 [*lower, *upper), nullptr 表示
+  // 对应方向无界. 没有范围过滤器时总是返回 true.
+  bool RangeMayMatch(const Slice* lower, const Slice* upper) const;
+  Status ReadDataBlock(const ReadOptions& options, const BlockHandle& handle,
+                       BlockContents* contents) const;
+
+  // 该 table 的 block 在 block_cache 中的 key 前缀
+  uint64_t CacheId() const;
+  // 将偏移量位于 offsets(升序排列) 中的 data block 读入 block_cache
+  void PrefetchBlocks(const std::vector<uint64_t>& offsets);
 };
 
 }  // namespace leveldb
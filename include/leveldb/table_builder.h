@@ -84,6 +84,25 @@ class LEVELDB_EXPORT TableBuilder {
   // 如果成功调用了 Finish(), 则返回最终生成文件的大小. 
   uint64_t FileSize() const;
 
+  // Return the last key added so far.  The returned slice remains valid
+  // until the next call to Add().
+  // REQUIRES: NumEntries() > 0, Finish(), Abandon() have not been called
+  //
+  // 返回最近一次调用 Add() 添加的 key, 返回的 slice 在下次调用 Add() 之前有效.
+  // 前提: 至少调用过一次 Add(), 且还没有调用过 Finish() 或 Abandon().
+  Slice LastKey() const;
+
+  // Insert every data block into options.block_cache as it is written,
+  // keyed by "cache_id" and the block's offset.  A Table later opened over
+  // the finished file with the same cache id finds these blocks there.
+  // REQUIRES: options.block_cache != nullptr, Add() has not been called
+  //
+  // 每写入一个 data block, 就以 cache_id 和 block 偏移量为 key 将其放入
+  // options.block_cache. 之后以相同的 cache_id 打开生成的文件, 即可直接
+  // 从 block_cache 命中这些 block.
+  // 前提: options.block_cache 非空, 且还没有调用过 Add().
+  void CacheDataBlocks(uint64_t cache_id);
+
  private:
   bool ok() const { return status().ok(); }
   // 将 block 内容根据设置进行压缩, 然后写入文件;
@@ -97,6 +116,8 @@ class LEVELDB_EXPORT TableBuilder {
   // 下个 block 在 table 中的偏移量. 
   // 写失败时该方法只将错误状态记录到 r->status, 不做其它任何处理.
   void WriteRawBlock(const Slice& data, CompressionType, BlockHandle* handle);
+  // 把刚写入文件的 data block 放入 block_cache
+  void InsertIntoCache(const Slice& raw, const BlockHandle& handle);
 
   struct Rep;
   Rep* rep_;
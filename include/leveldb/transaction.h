@@ -0,0 +1,73 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A Transaction groups reads and writes that are committed to a DB
+// atomically.  Transactions are created by OptimisticTransactionDB or
+// TransactionDB, which differ in how conflicts between transactions are
+// handled.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_TRANSACTION_H_
+#define STORAGE_LEVELDB_INCLUDE_TRANSACTION_H_
+
+#include <string>
+#include "leveldb/export.h"
+#include "leveldb/options.h"
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+/**
+ * 事务.
+ *
+ * 事务期间的写操作先缓存在事务内部, 提交之前对其它读者不可见, 提交时
+ * 全部写操作被原子地写入数据库. 冲突如何处理取决于创建事务的数据库,
+ * 具体见 OptimisticTransactionDB 和 TransactionDB.
+ *
+ * 一个 Transaction 不能被多个线程并发使用.
+ */
+class LEVELDB_EXPORT Transaction {
+ public:
+  Transaction() = default;
+
+  Transaction(const Transaction&) = delete;
+  Transaction& operator=(const Transaction&) = delete;
+
+  virtual ~Transaction();
+
+  /**
+   * 读取 key 对应的 value. 本事务已经写过的 key 直接返回事务内部缓存的值.
+   *
+   * 如果 options.snapshot 不为空则在该快照上读取.
+   */
+  virtual Status Get(const ReadOptions& options,
+                     const Slice& key, std::string* value) = 0;
+
+  /**
+   * 和 Get 一样, 但是保证事务提交时 key 没有在读取之后被其它事务修改过,
+   * 适用于先读后写(read-modify-write)的场景.
+   */
+  virtual Status GetForUpdate(const ReadOptions& options,
+                              const Slice& key, std::string* value) = 0;
+
+  // 将 <key, value> 写入事务内部缓存, 提交之前对其它读者不可见.
+  virtual Status Put(const Slice& key, const Slice& value) = 0;
+
+  // 在事务内部缓存中删除 key, 提交之前对其它读者不可见.
+  virtual Status Delete(const Slice& key) = 0;
+
+  /**
+   * 提交事务, 将事务内部缓存的全部写操作原子地写入数据库.
+   *
+   * 不论提交成功与否, 事务随后都会被重置, 可以作为一个新事务继续使用.
+   */
+  virtual Status Commit() = 0;
+
+  // 丢弃事务内部缓存的全部写操作, 事务被重置.
+  virtual void Rollback() = 0;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_TRANSACTION_H_
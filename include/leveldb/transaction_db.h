@@ -0,0 +1,108 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// TransactionDB provides pessimistic transactions on top of a DB: keys are
+// locked when they are written or read with GetForUpdate, so conflicting
+// transactions wait for each other instead of failing at commit time.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_TRANSACTION_DB_H_
+#define STORAGE_LEVELDB_INCLUDE_TRANSACTION_DB_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include "leveldb/db.h"
+#include "leveldb/export.h"
+#include "leveldb/options.h"
+#include "leveldb/status.h"
+#include "leveldb/transaction.h"
+
+namespace leveldb {
+
+struct LEVELDB_EXPORT TransactionDBOptions {
+  // Number of stripes the lock table is split into.  Keys in different
+  // stripes never contend on the same mutex.
+  /**
+   * 锁表被分成的条带个数, 不同条带上的 key 加锁时不会竞争同一个互斥量.
+   */
+  size_t num_stripes = 16;
+
+  // Default time in milliseconds a transaction waits for a lock before
+  // giving up with a Busy status.  A negative value means wait forever.
+  /**
+   * 事务等待一把锁的默认超时时间, 单位为毫秒. 超时后返回 Busy 状态.
+   * 负数表示一直等待, 这时最好开启死锁检测.
+   */
+  int64_t lock_timeout = 1000;
+
+  // If true, a transaction that would deadlock by waiting for a lock fails
+  // immediately with a Busy status.
+  /**
+   * 如果为 true, 等待某把锁会导致死锁的事务立即返回 Busy 状态.
+   */
+  bool deadlock_detect = true;
+};
+
+struct LEVELDB_EXPORT TransactionOptions {
+  // Time in milliseconds this transaction waits for a lock.  A negative
+  // value means use TransactionDBOptions::lock_timeout.
+  /**
+   * 该事务等待一把锁的超时时间, 单位为毫秒.
+   * 负数表示使用 TransactionDBOptions::lock_timeout.
+   */
+  int64_t lock_timeout = -1;
+};
+
+/**
+ * 支持悲观事务的数据库.
+ *
+ * 事务写 key 或者通过 GetForUpdate 读 key 时会先获取该 key 的排他锁,
+ * 锁一直持有到事务提交或回滚. 有冲突的事务相互等待而不是在提交时失败,
+ * 等待超时或者等待会导致死锁时返回 Busy 状态, 事务此前获取的锁仍然有效,
+ * 调用者可以重试该操作或者回滚事务.
+ *
+ * 提交时事务内缓存的写操作通过一次批量写原子地写入数据库.
+ *
+ * 普通的 Get 不加锁, 读取的是最新提交的数据. 底层数据库仍然可以通过
+ * GetBaseDB 直接访问, 但是这样的写操作不受事务锁的约束.
+ */
+class LEVELDB_EXPORT TransactionDB {
+ public:
+  /**
+   * 打开一个名为 name 的数据库.
+   *
+   * 打开成功, 会把一个指向基于堆内存的数据库指针存储到 *dbptr, 同时返回 OK;
+   * 如果打开失败, 存储 nullptr 到 *dbptr 同时返回一个错误状态.
+   *
+   * 调用者不再使用这个数据库时需要负责释放 *dbptr 指向的内存.
+   */
+  static Status Open(const Options& options,
+                     const TransactionDBOptions& txn_db_options,
+                     const std::string& name,
+                     TransactionDB** dbptr);
+
+  TransactionDB() = default;
+
+  TransactionDB(const TransactionDB&) = delete;
+  TransactionDB& operator=(const TransactionDB&) = delete;
+
+  virtual ~TransactionDB();
+
+  /**
+   * 开始一个新事务, 事务提交时使用 write_options 写入.
+   *
+   * 调用者不再使用该事务时需要负责释放它, 释放时未提交的写操作被丢弃,
+   * 持有的锁被释放. 事务必须在数据库之前被释放.
+   */
+  virtual Transaction* BeginTransaction(
+      const WriteOptions& write_options,
+      const TransactionOptions& txn_options = TransactionOptions()) = 0;
+
+  // 返回底层的数据库, 它归 TransactionDB 所有, 调用者不能释放它.
+  virtual DB* GetBaseDB() = 0;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_TRANSACTION_DB_H_
@@ -0,0 +1,56 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A TransactionLogIterator yields the write batches recorded in the write
+// ahead log in the order they were applied, together with the sequence
+// number of their first update.  See DB::GetUpdatesSince().
+//
+// Multiple threads can invoke const methods on a TransactionLogIterator
+// without external synchronization, but if any of the threads may call a
+// non-const method, all threads accessing the same TransactionLogIterator
+// must use external synchronization.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_TRANSACTION_LOG_H_
+#define STORAGE_LEVELDB_INCLUDE_TRANSACTION_LOG_H_
+
+#include <stdint.h>
+#include "leveldb/export.h"
+#include "leveldb/status.h"
+#include "leveldb/write_batch.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT TransactionLogIterator {
+ public:
+  TransactionLogIterator();
+
+  TransactionLogIterator(const TransactionLogIterator&) = delete;
+  TransactionLogIterator& operator=(const TransactionLogIterator&) = delete;
+
+  virtual ~TransactionLogIterator();
+
+  // 当且仅当迭代器指向一个 batch 时为 true.
+  virtual bool Valid() const = 0;
+
+  // 移动到下一个 batch. 到达创建迭代器时已经写入的最后一个 batch 之后,
+  // Valid() 变为 false, 想要读取更新的 batch 需要重新创建迭代器.
+  // 注意: 调用该方法前提是迭代器当前指向必须 valid.
+  virtual void Next() = 0;
+
+  // 读取 log 文件出错时返回对应错误, 否则返回 OK.
+  virtual Status status() const = 0;
+
+  // 当前 batch 中第一个操作的序列号, 后续操作的序列号依次加一.
+  // 注意: 调用该方法前提是迭代器当前指向必须 valid.
+  virtual uint64_t sequence() const = 0;
+
+  // 当前 batch, 可以通过 WriteBatch::Iterate 遍历其中的操作,
+  // 在迭代器移动之前一直有效.
+  // 注意: 调用该方法前提是迭代器当前指向必须 valid.
+  virtual const WriteBatch& batch() const = 0;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_TRANSACTION_LOG_H_
@@ -0,0 +1,94 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// WriteBatchWithIndex is a WriteBatch that also keeps a searchable index
+// over its entries, so pending updates can be read back before the batch
+// is written to a DB.
+//
+// Multiple threads can invoke const methods on a WriteBatchWithIndex without
+// external synchronization, but if any of the threads may call a
+// non-const method, all threads accessing the same WriteBatchWithIndex must
+// use external synchronization.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_WRITE_BATCH_WITH_INDEX_H_
+#define STORAGE_LEVELDB_INCLUDE_WRITE_BATCH_WITH_INDEX_H_
+
+#include <string>
+#include "leveldb/comparator.h"
+#include "leveldb/db.h"
+#include "leveldb/export.h"
+#include "leveldb/iterator.h"
+#include "leveldb/options.h"
+#include "leveldb/status.h"
+#include "leveldb/write_batch.h"
+
+namespace leveldb {
+
+/**
+ * 带索引的 WriteBatch.
+ *
+ * 除了像 WriteBatch 一样按顺序缓存更新操作, 它还在一个 arena 中维护一个
+ * 跳跃表, 按 key 索引 batch 中的每个操作. 这样写入数据库之前就能查询
+ * batch 中某个 key 最新的状态, 或者把 batch 和数据库合并起来遍历.
+ */
+class LEVELDB_EXPORT WriteBatchWithIndex {
+ public:
+  // 用 comparator 对 key 排序, 它必须和要合并的数据库使用的比较器一致.
+  explicit WriteBatchWithIndex(
+      const Comparator* comparator = BytewiseComparator());
+
+  WriteBatchWithIndex(const WriteBatchWithIndex&) = delete;
+  WriteBatchWithIndex& operator=(const WriteBatchWithIndex&) = delete;
+
+  ~WriteBatchWithIndex();
+
+  // Store the mapping "key->value" in the batch.
+  void Put(const Slice& key, const Slice& value);
+
+  // Record a deletion of "key" in the batch.
+  void Delete(const Slice& key);
+
+  // Clear all updates buffered in this batch.
+  void Clear();
+
+  // 返回底层的 WriteBatch, 可以直接传给 DB::Write. 它归 WriteBatchWithIndex
+  // 所有, 调用者不能通过它修改 batch, 否则索引会失效.
+  WriteBatch* GetWriteBatch();
+
+  /**
+   * 只在 batch 中查找 key 最新的状态.
+   *
+   * 如果 key 最后一次操作是 Put, 将对应的 value 存储到 *value 并返回 OK;
+   * 如果 key 最后一次操作是 Delete 或者 batch 中没有 key, 返回 NotFound.
+   */
+  Status GetFromBatch(const Slice& key, std::string* value) const;
+
+  /**
+   * 先在 batch 中查找 key, batch 中没有 key 的任何操作时再去 db 中查找,
+   * 效果相当于 batch 已经写入了 db.
+   */
+  Status GetFromBatchAndDB(DB* db, const ReadOptions& options,
+                           const Slice& key, std::string* value) const;
+
+  /**
+   * 返回一个把 batch 和 base_iterator 合并起来的迭代器, 效果相当于
+   * 在 batch 写入之后的数据库上遍历: batch 中的 Put 覆盖 base 中相同的 key,
+   * batch 中的 Delete 隐藏 base 中相同的 key.
+   *
+   * 返回的迭代器接管 base_iterator, 使用期间不能修改 batch.
+   * 调用者不再使用时需要负责释放它.
+   */
+  Iterator* NewIteratorWithBase(Iterator* base_iterator) const;
+
+  // 返回只遍历 batch 的迭代器, 被删除的 key 不会出现在结果中.
+  Iterator* NewIterator() const;
+
+ private:
+  struct Rep;
+  Rep* rep_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_WRITE_BATCH_WITH_INDEX_H_
@@ -55,6 +55,11 @@ class CondVar {
   // REQUIRES: this thread holds *mu
   void Wait();
 
+  // Like Wait(), but gives up after timeout_micros microseconds.
+  // Returns true iff the wait timed out.
+  // REQUIRES: this thread holds *mu
+  bool TimedWait(uint64_t timeout_micros);
+
   // If there are some threads waiting, wake up at least one of them.
   void Signal();
 
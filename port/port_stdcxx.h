@@ -32,6 +32,7 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <cassert>
+#include <chrono>              // NOLINT
 #include <condition_variable>  // NOLINT
 #include <mutex>               // NOLINT
 #include <string>
@@ -88,6 +89,14 @@ class CondVar {
     cv_.wait(lock);
     lock.release();
   }
+  // 最多等待 timeout_micros 微秒, 超时返回 true.
+  bool TimedWait(uint64_t timeout_micros) {
+    std::unique_lock<std::mutex> lock(mu_->mu_, std::adopt_lock);
+    std::cv_status status =
+        cv_.wait_for(lock, std::chrono::microseconds(timeout_micros));
+    lock.release();
+    return status == std::cv_status::timeout;
+  }
   void Signal() { cv_.notify_one(); }
   void SignalAll() { cv_.notify_all(); }
  private:
@@ -10,6 +10,7 @@
 
 #include <vector>
 #include <algorithm>
+#include "db/dbformat.h"
 #include "leveldb/comparator.h"
 #include "table/format.h"
 #include "util/coding.h"
@@ -27,11 +28,28 @@ inline uint32_t Block::NumRestarts() const {
 Block::Block(const BlockContents& contents)
     : data_(contents.data.data()),
       size_(contents.data.size()),
+      fixed_width_(false),
+      key_width_(0),
       owned_(contents.heap_allocated) { 
   //　当数据存储在堆上的时候 owned_ 才为 true
   if (size_ < sizeof(uint32_t)) { 
     // block 最后 4 字节用于存储 restart 个数, 所以最小也为 4 字节长度
     size_ = 0;  // Error marker
+  } else if ((NumRestarts() & kFixedWidthBlockFlag) != 0) {
+    // 定长 key 格式, 末尾依次为 value 偏移量数组、key 长度和数据项个数
+    fixed_width_ = true;
+    const uint32_t num_entries = NumRestarts() & ~kFixedWidthBlockFlag;
+    if (size_ < 2 * sizeof(uint32_t) ||
+        num_entries > (size_ - 2 * sizeof(uint32_t)) / sizeof(uint32_t)) {
+      size_ = 0;
+    } else {
+      restart_offset_ = size_ - (2 + num_entries) * sizeof(uint32_t);
+      key_width_ = DecodeFixed32(data_ + size_ - 2 * sizeof(uint32_t));
+      // keys 部分不能越过 value 偏移量数组
+      if (static_cast<uint64_t>(key_width_) * num_entries > restart_offset_) {
+        size_ = 0;
+      }
+    }
   } else {
     // 该 Block 最多可以分配的 restart 的个数, 其中每个 restart 
     // 为 4 字节偏移量.
@@ -128,6 +146,22 @@ class Block::Iter : public Iterator {
   // 当前迭代器对应的状态
   Status status_;
 
+  // 反向迭代时使用的缓存. 数据项的 key 采用前缀压缩, 只能从 restart point
+  // 开始正向解码, 所以每次 Prev 都要从前一个 restart point 重新解码. 这里在
+  // 第一次进入某个 restart 段时把整段解码一次并缓存起来, 段内后续的 Prev
+  // 直接从缓存中取, 不再重复解码.
+  struct CachedEntry {
+    uint32_t offset;      // 数据项在 data_ 里的偏移量
+    uint32_t key_offset;  // key 在 prev_keys_ 里的偏移量
+    uint32_t key_size;
+    Slice value;
+  };
+  // 按 offset 递增排列, 都属于索引为 prev_restart_index_ 的 restart 段
+  std::vector<CachedEntry> prev_entries_;
+  // 缓存的全部 key 拼接在一起
+  std::string prev_keys_;
+  uint32_t prev_restart_index_;
+
   inline int Compare(const Slice& a, const Slice& b) const {
     return comparator_->Compare(a, b);
   }
@@ -171,7 +205,8 @@ class Block::Iter : public Iterator {
         restarts_(restarts),
         num_restarts_(num_restarts),
         current_(restarts_),
-        restart_index_(num_restarts_) {
+        restart_index_(num_restarts_),
+        prev_restart_index_(num_restarts_) {
     assert(num_restarts_ > 0);
   }
 
@@ -192,12 +227,39 @@ class Block::Iter : public Iterator {
     ParseNextKey();
   }
 
-  // 将 current 指向当前数据项前一个数据项. 
+  // 直接在 block 内连续解码, 不经过虚函数
+  virtual size_t NextBatch(size_t max_n, BatchCallback callback, void* arg) {
+    size_t n = 0;
+    while (n < max_n && current_ < restarts_) {
+      if (!(*callback)(arg, key_, value_)) {
+        break;
+      }
+      n++;
+      ParseNextKey();
+    }
+    return n;
+  }
+
+  // 将 current 指向当前数据项前一个数据项.
   // 如果 current 指向的已经是 block 第 0 个数据项, 则无须移动了; 
   virtual void Prev() {
     // 向前移动前提是当前指向合法
     assert(Valid());
 
+    // 前一个数据项已经缓存了, 直接取出来
+    if (!prev_entries_.empty() && restart_index_ == prev_restart_index_) {
+      std::vector<CachedEntry>::const_iterator iter = std::lower_bound(
+          prev_entries_.begin(), prev_entries_.end(), current_,
+          [](const CachedEntry& e, uint32_t offset) {
+            return e.offset < offset;
+          });
+      if (iter != prev_entries_.begin() && iter != prev_entries_.end() &&
+          iter->offset == current_) {
+        SetCachedEntry(*(iter - 1));
+        return;
+      }
+    }
+
     // 倒着扫描, 直到 current_ 之前的一个 restart point.
     // current_ 大于等于所处 restart 段起始地址, 下面要做的
     // 是寻找 current_ 之前的一个 restart point. 
@@ -228,11 +290,10 @@ class Block::Iter : public Iterator {
       restart_index_--;
     }
 
-    // 粗粒度移动, 即先将 current_ 移动到指定 restart 分段
-    SeekToRestartPoint(restart_index_);
-    do {
-      // 细粒度移动, 将 current_ 移动到 original (current_ 移动之前的值)的前一个数据项
-    } while (ParseNextKey() && NextEntryOffset() < original);
+    // 粗粒度移动, 即先将 current_ 移动到指定 restart 分段,
+    // 然后细粒度移动, 将 current_ 移动到 original (current_ 移动之前的值)的
+    // 前一个数据项, 同时缓存途经的数据项.
+    CacheRestartInterval(restart_index_, original);
   }
 
   // 寻找 block 中第一个 key 大于等于 target 的数据项. 
@@ -305,15 +366,40 @@ class Block::Iter : public Iterator {
 
   // 将迭代器移动到 block 最后一个数据项
   virtual void SeekToLast() {
-    // 定位到最后一个 restart 段
-    SeekToRestartPoint(num_restarts_ - 1);
-    // 在之前基础上定位到最后一个数据项
-    while (ParseNextKey() && NextEntryOffset() < restarts_) {
-      // Keep skipping
-    }
+    // 最后一个 restart 段通常紧接着会被反向遍历, 顺便缓存起来
+    CacheRestartInterval(num_restarts_ - 1, restarts_);
   }
 
  private:
+  // 从索引为 index 的 restart point 开始解码, 直到下一个数据项的偏移量
+  // 不小于 limit 为止, 途经的数据项全部缓存到 prev_entries_ 中.
+  // 结束时迭代器指向最后一个解码的数据项.
+  void CacheRestartInterval(uint32_t index, uint32_t limit) {
+    prev_entries_.clear();
+    prev_keys_.clear();
+    prev_restart_index_ = index;
+    SeekToRestartPoint(index);
+    while (ParseNextKey()) {
+      CachedEntry entry;
+      entry.offset = current_;
+      entry.key_offset = static_cast<uint32_t>(prev_keys_.size());
+      entry.key_size = static_cast<uint32_t>(key_.size());
+      entry.value = value_;
+      prev_entries_.push_back(entry);
+      prev_keys_.append(key_);
+      if (NextEntryOffset() >= limit) {
+        break;
+      }
+    }
+  }
+
+  void SetCachedEntry(const CachedEntry& entry) {
+    current_ = entry.offset;
+    restart_index_ = prev_restart_index_;
+    key_.assign(prev_keys_.data() + entry.key_offset, entry.key_size);
+    value_ = entry.value;
+  }
+
   // 如果出错, 则将各个成员置为非法值
   void CorruptionError() {
     current_ = restarts_;
@@ -321,6 +407,8 @@ class Block::Iter : public Iterator {
     status_ = Status::Corruption("bad entry in block");
     key_.clear();
     value_.clear();
+    prev_entries_.clear();
+    prev_keys_.clear();
   }
 
   // 将 current_, key_, value_ 指向下一个数据项的
@@ -371,12 +459,184 @@ class Block::Iter : public Iterator {
   }
 };
 
+namespace {
+
+// 通过 comparator 比较 key
+class ComparatorKeyOrder {
+ public:
+  explicit ComparatorKeyOrder(const Comparator* cmp) : cmp_(cmp) { }
+  int Compare(const Slice& a, const Slice& b) const {
+    return cmp_->Compare(a, b);
+  }
+
+ private:
+  const Comparator* const cmp_;
+};
+
+// 直接比较 user key 长度为 kUserKeyLength 的 internal key 的字节内容,
+// 长度不符的 key(比如用户传入的 Seek 目标)仍交给 comparator 比较.
+template <size_t kUserKeyLength>
+class FixedInternalKeyOrder {
+ public:
+  explicit FixedInternalKeyOrder(const Comparator* cmp) : cmp_(cmp) { }
+  int Compare(const Slice& a, const Slice& b) const {
+    if (a.size() == kUserKeyLength + 8 && b.size() == kUserKeyLength + 8) {
+      return CompareFixedInternalKeys<kUserKeyLength>(a.data(), b.data());
+    }
+    return cmp_->Compare(a, b);
+  }
+
+ private:
+  const Comparator* const cmp_;
+};
+
+}  // namespace
+
+// 定长 key 格式的 block 的迭代器. 全部 key 按固定步长紧密排列, 第 i 个 key
+// 可以直接定位, 所以 Seek 直接对全部数据项二分查找, Prev 也不需要回退到
+// restart point 重新解码, key() 直接指向 block 内容而不必拷贝.
+template <typename KeyOrder>
+class Block::FixedWidthIter : public Iterator {
+ private:
+  const KeyOrder order_;
+  const char* const data_;
+  const uint32_t key_width_;
+  const uint32_t num_entries_;
+  // keys 部分的结束位置, 即 values 部分在 block 中的起始偏移量
+  const uint32_t values_;
+  // value 偏移量数组在 block 中的起始偏移量, 也是 values 部分的结束位置
+  const uint32_t offsets_;
+
+  // 当前数据项的序号, 迭代器无效时等于 num_entries_
+  uint32_t current_;
+  Slice value_;
+  Status status_;
+
+  Slice KeyAt(uint32_t index) const {
+    return Slice(data_ + index * key_width_, key_width_);
+  }
+
+  uint32_t ValueOffset(uint32_t index) const {
+    return DecodeFixed32(data_ + offsets_ + index * sizeof(uint32_t));
+  }
+
+  // 将迭代器移动到第 index 个数据项并定位其 value.
+  // index 不小于 num_entries_ 时迭代器变为无效.
+  void SeekToEntry(uint32_t index) {
+    if (index >= num_entries_) {
+      current_ = num_entries_;
+      value_.clear();
+      return;
+    }
+    const uint32_t start = ValueOffset(index);
+    const uint32_t limit =
+        (index + 1 < num_entries_) ? ValueOffset(index + 1) : offsets_;
+    if (start < values_ || start > limit || limit > offsets_) {
+      CorruptionError();
+      return;
+    }
+    current_ = index;
+    value_ = Slice(data_ + start, limit - start);
+  }
+
+  void CorruptionError() {
+    current_ = num_entries_;
+    status_ = Status::Corruption("bad entry in block");
+    value_.clear();
+  }
+
+ public:
+  FixedWidthIter(const KeyOrder& order, const char* data, uint32_t key_width,
+                 uint32_t num_entries, uint32_t offsets)
+      : order_(order),
+        data_(data),
+        key_width_(key_width),
+        num_entries_(num_entries),
+        values_(key_width * num_entries),
+        offsets_(offsets),
+        current_(num_entries) {
+    assert(num_entries_ > 0);
+  }
+
+  virtual bool Valid() const { return current_ < num_entries_; }
+  virtual Status status() const { return status_; }
+  virtual Slice key() const {
+    assert(Valid());
+    return KeyAt(current_);
+  }
+  virtual Slice value() const {
+    assert(Valid());
+    return value_;
+  }
+
+  virtual void Next() {
+    assert(Valid());
+    SeekToEntry(current_ + 1);
+  }
+
+  virtual size_t NextBatch(size_t max_n, BatchCallback callback, void* arg) {
+    size_t n = 0;
+    while (n < max_n && Valid()) {
+      if (!(*callback)(arg, KeyAt(current_), value_)) {
+        break;
+      }
+      n++;
+      SeekToEntry(current_ + 1);
+    }
+    return n;
+  }
+
+  virtual void Prev() {
+    assert(Valid());
+    SeekToEntry(current_ == 0 ? num_entries_ : current_ - 1);
+  }
+
+  // 二分查找第一个 key 大于等于 target 的数据项
+  virtual void Seek(const Slice& target) {
+    uint32_t left = 0;
+    uint32_t right = num_entries_;
+    while (left < right) {
+      const uint32_t mid = left + (right - left) / 2;
+      if (order_.Compare(KeyAt(mid), target) < 0) {
+        left = mid + 1;
+      } else {
+        right = mid;
+      }
+    }
+    SeekToEntry(left);
+  }
+
+  virtual void SeekToFirst() { SeekToEntry(0); }
+  virtual void SeekToLast() { SeekToEntry(num_entries_ - 1); }
+};
+
 // 根据用户定制的 comparator 构造该 block 的一个迭代器
-Iterator* Block::NewIterator(const Comparator* cmp) {
+Iterator* Block::NewIterator(const Comparator* cmp,
+                             bool bytewise_internal_keys) {
   // block 尾部 4 字节为 restart 个数, 最少 4 字节
   if (size_ < sizeof(uint32_t)) { 
     return NewErrorIterator(Status::Corruption("bad block contents"));
   }
+  if (fixed_width_) {
+    const uint32_t num_entries = NumRestarts() & ~kFixedWidthBlockFlag;
+    if (num_entries == 0) {
+      return NewEmptyIterator();
+    }
+    // 常见的 8 字节和 16 字节 user key 使用编译期特化的比较函数
+    if (bytewise_internal_keys && key_width_ == 16 + 8) {
+      return new FixedWidthIter<FixedInternalKeyOrder<16> >(
+          FixedInternalKeyOrder<16>(cmp), data_, key_width_, num_entries,
+          restart_offset_);
+    }
+    if (bytewise_internal_keys && key_width_ == 8 + 8) {
+      return new FixedWidthIter<FixedInternalKeyOrder<8> >(
+          FixedInternalKeyOrder<8>(cmp), data_, key_width_, num_entries,
+          restart_offset_);
+    }
+    return new FixedWidthIter<ComparatorKeyOrder>(
+        ComparatorKeyOrder(cmp), data_, key_width_, num_entries,
+        restart_offset_);
+  }
   const uint32_t num_restarts = NumRestarts();
   if (num_restarts == 0) {
     return NewEmptyIterator();
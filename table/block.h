@@ -31,6 +31,9 @@ class Comparator;
 // - restarts: uint32[num_restarts](保存 restart points 在 block 内偏移量的数组)
 // - num_restarts: uint32(restart points 偏移量数组大小)
 // restarts[i] 保存的是第 i 个 restart point 在 block 内的偏移量. 
+//
+// 定长 key 格式的 block 布局见 block_builder.h, 通过末尾数据项个数中的
+// kFixedWidthBlockFlag 标记区分.
 
 class Block {
  public:
@@ -40,8 +43,12 @@ class Block {
   ~Block();
 
   size_t size() const { return size_; }
-  // 根据用户定制的 comparator 构造该 block 的一个迭代器
-  Iterator* NewIterator(const Comparator* comparator);
+  // 根据用户定制的 comparator 构造该 block 的一个迭代器.
+  // 如果 bytewise_internal_keys 为 true(comparator 是 user comparator 为
+  // BytewiseComparator() 的 InternalKeyComparator), 定长 key 格式的 block
+  // 会直接比较 key 的字节内容而不调用 comparator.
+  Iterator* NewIterator(const Comparator* comparator,
+                        bool bytewise_internal_keys = false);
 
  private:
   uint32_t NumRestarts() const;
@@ -50,8 +57,13 @@ class Block {
   const char* data_;
   // block 总大小 
   size_t size_; 
-  // block 的 restart array 在 block 中的起始偏移量
+  // block 的 restart array 在 block 中的起始偏移量,
+  // 定长 key 格式下为 value 偏移量数组的起始偏移量
   uint32_t restart_offset_;
+  // 是否为定长 key 格式的 block
+  bool fixed_width_;
+  // 定长 key 格式下每个 key 的长度
+  uint32_t key_width_;
   // 如果 data_ 指向的空间是在堆上分配的, 
   // 那么该 block 对象销毁时需要释放该处空间, 该成员使用见析构方法.
   bool owned_;                  
@@ -62,6 +74,9 @@ class Block {
 
   // 为迭代 block 内容服务的迭代器, block 相当于迭代器的数据源.
   class Iter;
+  // 定长 key 格式的 block 的迭代器, 由 KeyOrder 决定 key 的比较方式.
+  template <typename KeyOrder>
+  class FixedWidthIter;
 };
 
 }  // namespace leveldb
@@ -25,6 +25,10 @@
 //     restarts: uint32[num_restarts]
 //     num_restarts: uint32
 // restarts[i] contains the offset within the block of the ith restart point.
+//
+// Blocks with fixed-width keys use a different layout (see block_builder.h).
+// They are told apart by kFixedWidthBlockFlag, which is set in the last
+// uint32 of the block, i.e. the word holding num_restarts above.
 
 #include "table/block_builder.h"
 
@@ -32,26 +36,33 @@
 #include <assert.h>
 #include "leveldb/comparator.h"
 #include "leveldb/table_builder.h"
+#include "table/format.h"
 #include "util/coding.h"
 
 namespace leveldb {
 
-BlockBuilder::BlockBuilder(const Options* options)
+BlockBuilder::BlockBuilder(const Options* options, bool fixed_width_keys)
     : options_(options),
+      fixed_width_(fixed_width_keys),
       restarts_(),
       counter_(0),
       finished_(false) {
   assert(options->block_restart_interval >= 1);
   // 第一个 restart point 在 block 中的偏移量为 0
-  restarts_.push_back(0);
+  if (!fixed_width_) {
+    restarts_.push_back(0);
+  }
 }
 
 void BlockBuilder::Reset() {
   // 清空 buffer 和 restarts 数组
   buffer_.clear();
+  values_.clear();
   restarts_.clear();
   // 第一个 restart point 在 block 中的偏移量为 0
-  restarts_.push_back(0);
+  if (!fixed_width_) {
+    restarts_.push_back(0);
+  }
   counter_ = 0;
   finished_ = false;
   last_key_.clear();
@@ -60,6 +71,11 @@ void BlockBuilder::Reset() {
 size_t BlockBuilder::CurrentSizeEstimate() const {
   // 原始数据所占空间的大小 + restarts 数组所占空间
   // 大小 + restart 数组长度所占空间
+  if (fixed_width_) {
+    return (buffer_.size() + values_.size() +       // Keys and values
+            restarts_.size() * sizeof(uint32_t) +   // Value offsets
+            2 * sizeof(uint32_t));                  // Key width and count
+  }
   return (buffer_.size() +                        // Raw data buffer
           restarts_.size() * sizeof(uint32_t) +   // Restart array
           sizeof(uint32_t));                      // Restart array length
@@ -72,6 +88,18 @@ Slice BlockBuilder::Finish() {
    * 最后根据 buffer 构造一个新的 slice 返回(注意该 slice 引用的内存是 
    * buffer, 所以生命期同 builder, 除非 builder 调用了 Reset)
    */
+  if (fixed_width_) {
+    // 依次追加 values, value 偏移量数组, key 长度以及带标记的数据项个数
+    const uint32_t values_offset = buffer_.size();
+    buffer_.append(values_);
+    for (size_t i = 0; i < restarts_.size(); i++) {
+      PutFixed32(&buffer_, values_offset + restarts_[i]);
+    }
+    PutFixed32(&buffer_, counter_ == 0 ? 0 : values_offset / counter_);
+    PutFixed32(&buffer_, counter_ | kFixedWidthBlockFlag);
+    finished_ = true;
+    return Slice(buffer_);
+  }
   // Append restart array
   for (size_t i = 0; i < restarts_.size(); i++) {
     PutFixed32(&buffer_, restarts_[i]);
@@ -88,16 +116,32 @@ void BlockBuilder::Add(const Slice& key, const Slice& value) {
   assert(!finished_);
   // 自上个 restart 之后追加的 key 的个数没有超过要求的两个
   // restart points 之间 keys 的个数.
-  assert(counter_ <= options_->block_restart_interval);
+  assert(fixed_width_ || counter_ <= options_->block_restart_interval);
   // 当前要追加的 key 要大于任何之前追加到 buffer 中的 key
-  assert(buffer_.empty() // No values yet?
+  assert(empty() // No values yet?
          || options_->comparator->Compare(key, last_key_piece) > 0);
+  if (fixed_width_) {
+    // 定长 key 直接追加到 keys 部分, value 及其偏移量单独存放
+    assert(empty() || key.size() == last_key_piece.size());
+    buffer_.append(key.data(), key.size());
+    restarts_.push_back(values_.size());
+    values_.append(value.data(), value.size());
+    last_key_.assign(key.data(), key.size());
+    counter_++;
+    return;
+  }
   size_t shared = 0;
   // 如果自上个 restart 之后追加的 key 的个数小于所配置的
   // 两个相邻 restart 之间 keys 的个数. 
   if (counter_ < options_->block_restart_interval) {
     const size_t min_length = std::min(last_key_piece.size(), key.size());
-    // 计算当前要追加的 key 与上次追加的 key 的公共前缀长度. 
+    // 计算当前要追加的 key 与上次追加的 key 的公共前缀长度.
+    // 先每次比较 8 个字节, 再逐字节比较剩下的部分.
+    while (shared + 8 <= min_length &&
+           DecodeFixed64(last_key_piece.data() + shared) ==
+               DecodeFixed64(key.data() + shared)) {
+      shared += 8;
+    }
     while ((shared < min_length) && (last_key_piece[shared] == key[shared])) {
       shared++;
     }
@@ -49,9 +49,20 @@ struct Options;
 // - restarts: uint32[num_restarts](保存 restart points 在 block 内偏移量的数组)
 // - num_restarts: uint32(restart points 偏移量数组大小)
 // restarts[i] 保存的是第 i 个 restart point 在 block 内的偏移量.  
+//
+// 定长 key 格式(fixed_width_keys 为 true, 全部 key 长度相同)的 block 不做
+// 前缀压缩也不需要 restart points, 布局如下:
+// - keys: char[num_entries * key_width](按顺序紧密排列的全部 key)
+// - values: 全部 value 依次拼接
+// - value_offsets: uint32[num_entries](每个 value 在 block 内的偏移量,
+//   第 i 个 value 结束于第 i+1 个 value 的起始处)
+// - key_width: uint32
+// - num_entries | kFixedWidthBlockFlag: uint32
+// 标记保存在 block 最后一个 uint32 中, 即普通格式下 num_restarts 所在的位置,
+// 读取时据此区分两种格式; restarts 数组和 block 压缩类型都不受影响.
 class BlockBuilder {
  public:
-  explicit BlockBuilder(const Options* options);
+  explicit BlockBuilder(const Options* options, bool fixed_width_keys = false);
 
   // 重置 BlockBuilder 对象状态信息, 就像该对象刚刚被创建时一样. 
   void Reset();
@@ -76,18 +87,30 @@ class BlockBuilder {
   // 自从上次 reset 后, 当且仅当没有任何数据项被添加
   // 到该 BlockBuilder 时返回 true.
   bool empty() const {
-    return buffer_.empty();
+    return fixed_width_ ? (counter_ == 0) : buffer_.empty();
   }
 
+  // 返回上次调用 Add 追加的 key. 前提: 自从上次 Reset() 后至少调用过一次 Add.
+  Slice last_key() const { return Slice(last_key_); }
+
+  // 将上次调用 Add 追加的 key 与 *key 交换, 之后只能 Finish() 或者 Reset().
+  // 供 TableBuilder 在 data block 写满时拿走最后一个 key 而不用逐个拷贝.
+  void SwapLastKey(std::string* key) { last_key_.swap(*key); }
+
  private:
   const Options*        options_;
-  // 存储目标 block 内容的缓冲区
+  // 是否构造定长 key 格式的 block
+  const bool            fixed_width_;
+  // 存储目标 block 内容的缓冲区, 定长 key 格式下只存放 keys 部分
   std::string           buffer_;
+  // 定长 key 格式下存放拼接在一起的全部 value
+  std::string           values_;
   // 存储目标 block 的全部 restart points
   // (即每个 restart point 在 block 中的偏移量, 
-  // 第一个 restart point 偏移量为 0)
+  // 第一个 restart point 偏移量为 0).
+  // 定长 key 格式下存储的是每个 value 在 values_ 中的偏移量.
   std::vector<uint32_t> restarts_;
-  // 某个 restart 之后新添加的数据项个数
+  // 某个 restart 之后新添加的数据项个数, 定长 key 格式下为数据项总数
   int                   counter_;
   // 标识方法 Finish() 是否被调用过了
   bool                  finished_;
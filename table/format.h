@@ -119,6 +119,10 @@ static const uint64_t kTableMagicNumber = 0xdb4775248b80fb57ull;
 // 共 5 字节. 
 static const size_t kBlockTrailerSize = 5;
 
+// 定长 key 格式的 block 末尾的数据项个数带有该标记. 旧版本会把带标记的个数
+// 当作过大的 restart 个数从而将该 block 视为损坏, 不会误解析其内容.
+static const uint32_t kFixedWidthBlockFlag = 0x80000000u;
+
 // 用于保存 block 的数据部分(block 包含三个部分, 数据/压缩类型/crc)
 struct BlockContents {
   Slice data;           // Actual contents of data 真正的数据内容
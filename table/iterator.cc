@@ -43,6 +43,19 @@ void Iterator::RegisterCleanup(CleanupFunction func, void* arg1, void* arg2) {
   node->arg2 = arg2;
 }
 
+// 逐项调用 key(), value() 和 Next(), 具体的迭代器可以覆写为更快的实现.
+size_t Iterator::NextBatch(size_t max_n, BatchCallback callback, void* arg) {
+  size_t n = 0;
+  while (n < max_n && Valid()) {
+    if (!(*callback)(arg, key(), value())) {
+      break;
+    }
+    n++;
+    Next();
+  }
+  return n;
+}
+
 namespace {
 
 class EmptyIterator : public Iterator {
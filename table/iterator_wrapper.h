@@ -47,9 +47,16 @@ class IteratorWrapper {
   Slice key() const         { assert(Valid()); return key_; }
   // 迭代器接口方法, 因为没缓存 value 所以这里的实现通过所封装的迭代器间接获取
   Slice value() const       { assert(Valid()); return iter_->value(); }
+  bool IsValuePinned() const { assert(Valid()); return iter_->IsValuePinned(); }
   // 下述迭代器接口方法调用前需确保 iter() != nullptr
   Status status() const     { assert(iter_); return iter_->status(); }
   void Next()               { assert(iter_); iter_->Next();        Update(); }
+  size_t NextBatch(size_t max_n, Iterator::BatchCallback callback, void* arg) {
+    assert(iter_);
+    size_t n = iter_->NextBatch(max_n, callback, arg);
+    Update();
+    return n;
+  }
   void Prev()               { assert(iter_); iter_->Prev();        Update(); }
   void Seek(const Slice& k) { assert(iter_); iter_->Seek(k);       Update(); }
   void SeekToFirst()        { assert(iter_); iter_->SeekToFirst(); Update(); }
@@ -105,6 +105,39 @@ class MergingIterator : public Iterator {
     FindSmallest(); // 在全部之前 child 的 next 寻找最小的那个
   }
 
+  // 正向移动时, current_ 中小于其它 child 最小 key 的数据项一定是连续的,
+  // 把它们交给 current_ 批量遍历, 每个数据项只需比较一次.
+  virtual size_t NextBatch(size_t max_n, BatchCallback callback, void* arg) {
+    if (direction_ != kForward) {
+      return Iterator::NextBatch(max_n, callback, arg);
+    }
+    size_t n = 0;
+    while (n < max_n && current_ != nullptr) {
+      BatchState state;
+      state.comparator = comparator_;
+      state.has_bound = false;
+      state.callback = callback;
+      state.arg = arg;
+      state.refused = false;
+      for (int i = 0; i < n_; i++) {
+        IteratorWrapper* child = &children_[i];
+        if (child != current_ && child->Valid() &&
+            (!state.has_bound ||
+             comparator_->Compare(child->key(), state.bound) < 0)) {
+          state.bound = child->key();
+          state.has_bound = true;
+        }
+      }
+      n += current_->NextBatch(max_n - n, &MergingIterator::BatchEntry,
+                               &state);
+      if (state.refused) {
+        break;
+      }
+      FindSmallest();
+    }
+    return n;
+  }
+
   // 在全部迭代器范围内寻找第一个小于 current_->key 的数据项
   virtual void Prev() {
     assert(Valid());
@@ -154,6 +187,11 @@ class MergingIterator : public Iterator {
     return current_->value();
   }
 
+  virtual bool IsValuePinned() const {
+    assert(Valid());
+    return current_->IsValuePinned();
+  }
+
   // 全部 child 迭代器 ok 才算 ok
   virtual Status status() const {
     Status status;
@@ -167,6 +205,29 @@ class MergingIterator : public Iterator {
   }
 
  private:
+  struct BatchState {
+    const Comparator* comparator;
+    Slice bound;         // 其它 child 中最小的 key
+    bool has_bound;      // 为 false 表示其它 child 都已经无效了
+    BatchCallback callback;
+    void* arg;
+    bool refused;        // 调用方的 callback 是否拒绝了数据项
+  };
+
+  // 遇到不小于 bound 的数据项就停下来, 重新挑选 current_
+  static bool BatchEntry(void* arg, const Slice& key, const Slice& value) {
+    BatchState* state = reinterpret_cast<BatchState*>(arg);
+    if (state->has_bound &&
+        state->comparator->Compare(key, state->bound) >= 0) {
+      return false;
+    }
+    if (!(*state->callback)(state->arg, key, value)) {
+      state->refused = true;
+      return false;
+    }
+    return true;
+  }
+
   void FindSmallest();
   void FindLargest();
 
@@ -0,0 +1,108 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "table/range_filter.h"
+
+#include <algorithm>
+
+#include "leveldb/comparator.h"
+#include "leveldb/iterator.h"
+#include "table/block.h"
+#include "table/format.h"
+
+namespace leveldb {
+
+RangeFilterBuilder::RangeFilterBuilder()
+    : block_(&options_),
+      last_shared_(0),
+      has_last_key_(false) {
+  // options_ 使用默认的 BytewiseComparator 和每 16 个前缀一个 restart point
+}
+
+void RangeFilterBuilder::AddKey(const Slice& key) {
+  if (has_last_key_) {
+    if (key == Slice(last_key_)) {
+      // 同一个 key 的多个版本
+      return;
+    }
+    const size_t min_length = std::min(last_key_.size(), key.size());
+    size_t shared = 0;
+    while (shared < min_length && last_key_[shared] == key[shared]) {
+      shared++;
+    }
+    // last_key_ 要同时与前后两个 key 区分开
+    AddPrefix(std::max(last_shared_, shared) + 1);
+    last_shared_ = shared;
+  }
+  last_key_.assign(key.data(), key.size());
+  has_last_key_ = true;
+}
+
+void RangeFilterBuilder::AddPrefix(size_t len) {
+  block_.Add(Slice(last_key_.data(), std::min(len, last_key_.size())),
+             Slice());
+}
+
+Slice RangeFilterBuilder::Finish() {
+  if (has_last_key_) {
+    AddPrefix(last_shared_ + 1);
+    has_last_key_ = false;
+  }
+  return block_.Finish();
+}
+
+RangeFilterReader::RangeFilterReader(const Slice& contents) {
+  BlockContents block_contents;
+  block_contents.data = contents;
+  block_contents.cachable = false;
+  block_contents.heap_allocated = false;
+  block_ = new Block(block_contents);
+}
+
+RangeFilterReader::~RangeFilterReader() {
+  delete block_;
+}
+
+// 记前缀为 p[0..n), 对应的 key 为 k[0..n), 则 p[i] 是 k[i] 的前缀且 p 与 k 顺序一致.
+// 设 p[j] 是第一个不小于 lower 的前缀:
+// - i < j - 1 时 k[i] 一定小于 lower;
+// - p[j-1] 是 lower 的前缀时 k[j-1] 可能在范围内, 否则 k[j-1] < lower;
+// - k[j] >= p[j] >= lower, 所以 k[j] 在范围内当且仅当 k[j] < upper,
+//   而 p[j] >= upper 时一定不满足.
+bool RangeFilterReader::RangeMayMatch(const Slice* lower,
+                                      const Slice* upper) const {
+  const Comparator* cmp = BytewiseComparator();
+  if (lower != nullptr && upper != nullptr &&
+      cmp->Compare(*lower, *upper) >= 0) {
+    return false;
+  }
+  Iterator* iter = block_->NewIterator(cmp);
+  bool result = false;
+  if (lower == nullptr) {
+    iter->SeekToFirst();
+  } else {
+    iter->Seek(*lower);
+    if (iter->Valid()) {
+      iter->Prev();
+    } else {
+      iter->SeekToLast();
+    }
+    if (iter->Valid() && lower->starts_with(iter->key())) {
+      result = true;
+    } else {
+      iter->Seek(*lower);
+    }
+  }
+  if (!result && iter->Valid()) {
+    result = (upper == nullptr || cmp->Compare(iter->key(), *upper) < 0);
+  }
+  if (!iter->status().ok()) {
+    // 损坏的 filter 不能用来跳过 table
+    result = true;
+  }
+  delete iter;
+  return result;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,73 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A range filter is stored as a meta block of a Table file.  It answers
+// "may the table contain a key in [lower, upper)?" so that iterators over
+// short ranges can skip tables holding no key in the range.
+
+#ifndef STORAGE_LEVELDB_TABLE_RANGE_FILTER_H_
+#define STORAGE_LEVELDB_TABLE_RANGE_FILTER_H_
+
+#include <string>
+#include "leveldb/options.h"
+#include "leveldb/slice.h"
+#include "table/block_builder.h"
+
+namespace leveldb {
+
+class Block;
+
+// metaindex block 中指向范围过滤器的 key
+static const char kRangeFilterMetaKey[] = "rangefilter.leveldb.KeyPrefixes";
+
+// 范围过滤器保存 table 中每个不同 key 的最短区分前缀, 即在相邻 key 的
+// 公共前缀之后再多保留一个字节(和 SuRF-Base 截断 trie 的方式相同).
+// 这些前缀与 key 的顺序一致, 查询时在其中二分查找就能确定 [lower, upper)
+// 内是否可能有 key: 回答"否"一定正确, 回答"是"则可能误判.
+//
+// 前缀按顺序用 BlockBuilder 前缀压缩后保存, 只适用于字节序比较的 key.
+//
+// 该类的方法调用序列必须满足: AddKey* Finish, 且 AddKey 的 key 升序(可以重复).
+class RangeFilterBuilder {
+ public:
+  RangeFilterBuilder();
+
+  RangeFilterBuilder(const RangeFilterBuilder&) = delete;
+  RangeFilterBuilder& operator=(const RangeFilterBuilder&) = delete;
+
+  void AddKey(const Slice& key);
+  Slice Finish();
+
+ private:
+  // 保存 last_key_ 长度为 len 的前缀
+  void AddPrefix(size_t len);
+
+  Options options_;
+  BlockBuilder block_;
+  // 上一个 key, 它的前缀要等下一个 key 到来才能确定长度
+  std::string last_key_;
+  // last_key_ 与它前一个 key 的公共前缀长度
+  size_t last_shared_;
+  bool has_last_key_;
+};
+
+class RangeFilterReader {
+ public:
+  // contents 由 Finish() 生成, 在 reader 存续期间必须有效.
+  explicit RangeFilterReader(const Slice& contents);
+  ~RangeFilterReader();
+
+  RangeFilterReader(const RangeFilterReader&) = delete;
+  RangeFilterReader& operator=(const RangeFilterReader&) = delete;
+
+  // table 中是否可能有 key 位于 [*lower, *upper), nullptr 表示对应方向无界.
+  bool RangeMayMatch(const Slice* lower, const Slice* upper) const;
+
+ private:
+  Block* block_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_TABLE_RANGE_FILTER_H_
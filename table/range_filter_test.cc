@@ -0,0 +1,123 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "table/range_filter.h"
+
+#include <algorithm>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "util/random.h"
+#include "util/testharness.h"
+#include "util/testutil.h"
+
+namespace leveldb {
+
+class RangeFilterTest {
+ public:
+  std::string contents_;
+  RangeFilterReader* reader_;
+
+  RangeFilterTest() : reader_(nullptr) { }
+  ~RangeFilterTest() { delete reader_; }
+
+  void Build(const std::vector<std::string>& keys) {
+    RangeFilterBuilder builder;
+    for (size_t i = 0; i < keys.size(); i++) {
+      builder.AddKey(keys[i]);
+    }
+    contents_ = builder.Finish().ToString();
+    delete reader_;
+    reader_ = new RangeFilterReader(contents_);
+  }
+
+  bool Matches(const char* lower, const char* upper) {
+    Slice l(lower != nullptr ? lower : "");
+    Slice u(upper != nullptr ? upper : "");
+    return reader_->RangeMayMatch(lower != nullptr ? &l : nullptr,
+                                  upper != nullptr ? &u : nullptr);
+  }
+};
+
+TEST(RangeFilterTest, Empty) {
+  Build(std::vector<std::string>());
+  ASSERT_TRUE(!Matches(nullptr, nullptr));
+  ASSERT_TRUE(!Matches("a", "z"));
+}
+
+TEST(RangeFilterTest, Small) {
+  std::vector<std::string> keys;
+  keys.push_back("apple");
+  keys.push_back("apricot");
+  keys.push_back("apricot");  // Several versions of one key
+  keys.push_back("banana");
+  keys.push_back("bandana");
+  keys.push_back("cherry");
+  Build(keys);
+
+  ASSERT_TRUE(Matches(nullptr, nullptr));
+  ASSERT_TRUE(Matches("apple", "apple\x01"));
+  ASSERT_TRUE(Matches("b", "c"));
+  ASSERT_TRUE(Matches(nullptr, "apple\x01"));
+  ASSERT_TRUE(Matches("cherry", nullptr));
+
+  // Gaps between the distinguishing prefixes are ruled out.
+  ASSERT_TRUE(!Matches(nullptr, "ap"));
+  ASSERT_TRUE(!Matches("aq", "b"));
+  ASSERT_TRUE(!Matches("bb", "c"));
+  ASSERT_TRUE(!Matches("d", nullptr));
+  ASSERT_TRUE(!Matches("c", "a"));
+
+  // Keys are only known up to their distinguishing prefix.
+  ASSERT_TRUE(Matches("ch", "ci"));
+  ASSERT_TRUE(Matches("apples", "apr"));
+}
+
+TEST(RangeFilterTest, NoFalseNegatives) {
+  Random rnd(301);
+  std::set<std::string> key_set;
+  for (int i = 0; i < 2000; i++) {
+    std::string key;
+    test::RandomString(&rnd, 1 + rnd.Uniform(8), &key);
+    // Restrict the alphabet so that keys share prefixes.
+    for (size_t j = 0; j < key.size(); j++) {
+      key[j] = 'a' + (key[j] & 3);
+    }
+    key_set.insert(key);
+  }
+  std::vector<std::string> keys(key_set.begin(), key_set.end());
+  Build(keys);
+
+  int positives = 0;
+  int false_positives = 0;
+  for (int i = 0; i < 10000; i++) {
+    std::string lower, upper;
+    test::RandomString(&rnd, 1 + rnd.Uniform(8), &lower);
+    for (size_t j = 0; j < lower.size(); j++) {
+      lower[j] = 'a' + (lower[j] & 3);
+    }
+    upper = lower;
+    upper.push_back('a' + rnd.Uniform(4));
+    std::vector<std::string>::iterator it =
+        std::lower_bound(keys.begin(), keys.end(), lower);
+    const bool expected = (it != keys.end() && *it < upper);
+    Slice l(lower), u(upper);
+    const bool matched = reader_->RangeMayMatch(&l, &u);
+    if (expected) {
+      ASSERT_TRUE(matched);
+      positives++;
+    } else if (matched) {
+      false_positives++;
+    }
+  }
+  ASSERT_GT(positives, 0);
+  ASSERT_LT(false_positives, 10000 - positives);
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
@@ -4,14 +4,17 @@
 
 #include "leveldb/table.h"
 
+#include "db/dbformat.h"
 #include "leveldb/cache.h"
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/options.h"
+#include "leveldb/persistent_cache.h"
 #include "table/block.h"
 #include "table/filter_block.h"
 #include "table/format.h"
+#include "table/range_filter.h"
 #include "table/two_level_iterator.h"
 #include "util/coding.h"
 
@@ -22,6 +25,8 @@ struct Table::Rep {
   ~Rep() {
     delete filter;
     delete [] filter_data;
+    delete range_filter;
+    delete [] range_filter_data;
     delete index_block;
   }
 
@@ -33,10 +38,22 @@ struct Table::Rep {
   // 如果该 table 具备对应的 block_cache, 
   // 该值与 block 在 table 中的起始偏移量一起构成 key, value 为 block
   uint64_t cache_id; 
+  // table 所属数据库的唯一标识, 对应的文件编号及文件大小, 与 block 偏移量
+  // 一起构成 persistent_cache 的 key. 标识或者文件编号为 0 时不使用 persistent_cache.
+  uint64_t db_id;
+  uint64_t file_number;
+  uint64_t file_size;
+  // comparator 是否为 user comparator 为 BytewiseComparator() 的
+  // InternalKeyComparator, 是则定长 key 格式的 block 直接比较 key 的字节内容.
+  bool bytewise_internal_keys;
   // 解析出来的 filter block
   FilterBlockReader* filter; 
   // filter block 原始数据
   const char* filter_data; 
+  // 范围过滤器及其原始数据(仅当原始数据是从堆分配的时候非空),
+  // 未开启 Options::range_filter 或 table 中没有范围过滤器时为 nullptr
+  RangeFilterReader* range_filter;
+  const char* range_filter_data;
 
   // 从 table Footer 取出来的, 指向 table 的 metaindex block
   BlockHandle metaindex_handle;
@@ -55,6 +72,16 @@ Status Table::Open(const Options& options,
                    RandomAccessFile* file,
                    uint64_t size,
                    Table** table) {
+  return Open(options, file, size, 0, 0, 0, table);
+}
+
+Status Table::Open(const Options& options,
+                   RandomAccessFile* file,
+                   uint64_t size,
+                   uint64_t db_id,
+                   uint64_t file_number,
+                   uint64_t cache_id,
+                   Table** table) {
   /**
    * 1 解析 footer: 它是 sstable 的入口.
    */
@@ -106,10 +133,21 @@ Status Table::Open(const Options& options,
     //  具体见 Table::NewIterator() 方法)
     rep->index_block = index_block;
     // 如果调用方要求缓存这个 table, 则为其分配缓存 id
-    rep->cache_id = (options.block_cache ? options.block_cache->NewId() : 0);
+    if (cache_id != 0) {
+      rep->cache_id = cache_id;
+    } else {
+      rep->cache_id = (options.block_cache ? options.block_cache->NewId() : 0);
+    }
+    rep->db_id = db_id;
+    rep->file_number = file_number;
+    rep->file_size = size;
+    rep->bytewise_internal_keys =
+        IsBytewiseInternalKeyComparator(options.comparator);
     // 接下来跟 filter 相关的两个成员将在下面 ReadMeta 进行填充.
     rep->filter_data = nullptr;
     rep->filter = nullptr;
+    rep->range_filter_data = nullptr;
+    rep->range_filter = nullptr;
     *table = new Table(rep);
     /**
      * 3 解析 meta-index block 和 meta block:
@@ -133,7 +171,7 @@ Status Table::Open(const Options& options,
 // 这就是我们要的元数据, 解析出来的元数据会被放到 Table::rep_ 中. 
 void Table::ReadMeta(const Footer& footer) {
   // 如果压根就没配置过滤策略, 那么无序解析元数据
-  if (rep_->options.filter_policy == nullptr) {
+  if (rep_->options.filter_policy == nullptr && !rep_->options.range_filter) {
     return;
   }
 
@@ -162,16 +200,24 @@ void Table::ReadMeta(const Footer& footer) {
   // 具体见 table_format.md
   // metaindex block 有一个 entry 包含了 FilterPolicy name 
   // 到其对应的 filter block 的映射
-  std::string key = "filter.";
-  // filter-policy name 在调用方传进来的配置项中
-  key.append(rep_->options.filter_policy->Name());
-  // 在 metaindex block 搜寻 key 对应的 meta block 的 handle
-  iter->Seek(key); 
-  if (iter->Valid() && iter->key() == Slice(key)) {
-    // 2 找到了, 迭代器对应的 value 即为 meta block handle,
-    // 根据其解析对应的 filter block(就是 meta block), 解析出来的
-    // 内容会放到 rep_ 中.
-    ReadFilter(iter->value()); 
+  if (rep_->options.filter_policy != nullptr) {
+    std::string key = "filter.";
+    // filter-policy name 在调用方传进来的配置项中
+    key.append(rep_->options.filter_policy->Name());
+    // 在 metaindex block 搜寻 key 对应的 meta block 的 handle
+    iter->Seek(key); 
+    if (iter->Valid() && iter->key() == Slice(key)) {
+      // 2 找到了, 迭代器对应的 value 即为 meta block handle,
+      // 根据其解析对应的 filter block(就是 meta block), 解析出来的
+      // 内容会放到 rep_ 中.
+      ReadFilter(iter->value()); 
+    }
+  }
+  if (rep_->options.range_filter) {
+    iter->Seek(kRangeFilterMetaKey);
+    if (iter->Valid() && iter->key() == Slice(kRangeFilterMetaKey)) {
+      ReadRangeFilter(iter->value());
+    }
   }
   delete iter;
   delete meta;
@@ -207,6 +253,35 @@ void Table::ReadFilter(const Slice& filter_handle_value) {
   rep_->filter = new FilterBlockReader(rep_->options.filter_policy, block.data);
 }
 
+// 解析 table 的范围过滤器, 与 ReadFilter 一样出错时直接忽略
+void Table::ReadRangeFilter(const Slice& handle_value) {
+  Slice v = handle_value;
+  BlockHandle handle;
+  if (!handle.DecodeFrom(&v).ok()) {
+    return;
+  }
+
+  ReadOptions opt;
+  if (rep_->options.paranoid_checks) {
+    opt.verify_checksums = true;
+  }
+  BlockContents block;
+  if (!ReadBlock(rep_->file, opt, handle, &block).ok()) {
+    return;
+  }
+  if (block.heap_allocated) {
+    rep_->range_filter_data = block.data.data();
+  }
+  rep_->range_filter = new RangeFilterReader(block.data);
+}
+
+bool Table::RangeMayMatch(const Slice* lower, const Slice* upper) const {
+  if (rep_->range_filter == nullptr) {
+    return true;
+  }
+  return rep_->range_filter->RangeMayMatch(lower, upper);
+}
+
 Table::~Table() {
   delete rep_;
 }
@@ -226,6 +301,44 @@ static void ReleaseBlock(void* arg, void* h) {
   cache->Release(handle);
 }
 
+// 读取 handle 指向的 data block. 如果配置了 persistent_cache, 先在其中查找,
+// 未命中再读文件, 并把从文件读出的 block 插入 persistent_cache.
+// persistent_cache 中保存的是解压后的 block 内容.
+Status Table::ReadDataBlock(const ReadOptions& options,
+                            const BlockHandle& handle,
+                            BlockContents* contents) const {
+  const Rep* rep = rep_;
+  PersistentCache* pcache = rep->options.persistent_cache;
+  if (pcache == nullptr || rep->db_id == 0 || rep->file_number == 0) {
+    return ReadBlock(rep->file, options, handle, contents);
+  }
+
+  // 同一个数据库中文件编号不会被复用; 数据库被销毁重建或者修复之后标识会改变,
+  // 缓存目录中属于之前数据库的 block 不会再被命中.
+  char key_buffer[32];
+  EncodeFixed64(key_buffer, rep->db_id);
+  EncodeFixed64(key_buffer + 8, rep->file_number);
+  EncodeFixed64(key_buffer + 16, rep->file_size);
+  EncodeFixed64(key_buffer + 24, handle.offset());
+  Slice key(key_buffer, sizeof(key_buffer));
+  std::string value;
+  if (pcache->Lookup(key, &value)) {
+    char* buf = new char[value.size()];
+    memcpy(buf, value.data(), value.size());
+    contents->data = Slice(buf, value.size());
+    contents->cachable = true;
+    contents->heap_allocated = true;
+    return Status::OK();
+  }
+
+  Status s = ReadBlock(rep->file, options, handle, contents);
+  // 不可缓存的 block 直接指向 mmap 的文件内容, 说明文件本身就在本地, 无需再缓存.
+  if (s.ok() && contents->cachable && options.fill_cache) {
+    pcache->Insert(key, contents->data);
+  }
+  return s;
+}
+
 // 基于 data block 的 handle (即 index_value 参数) 
 // 定位并读取对应的 data block, 然后为该 data block 
 // 内容构造一个迭代器. 
@@ -270,11 +383,13 @@ Iterator* Table::BlockReader(void* arg,
         block = reinterpret_cast<Block*>(block_cache->Value(cache_handle)); 
       } else {
         // 如果 block 不在 cache 中, 就去 table 对应的文件去读取
-        s = ReadBlock(table->rep_->file, options, handle, &contents); 
+        s = table->ReadDataBlock(options, handle, &contents); 
         if (s.ok()) {
           block = new Block(contents);
           // 如果用户允许 block 可被缓存, 则将从文件读取的 block 
-          // 放到 table 对应的 cache 中
+          // 放到 table 对应的 cache 中. 是否可缓存按 block 实际的读取结果决定:
+          // 未压缩的 block 从 mmap 文件或者内存文件读出时直接引用文件内存
+          // (cachable 为 false), 缓存它只会多占一份内存.
           if (contents.cachable && options.fill_cache) { 
             // 将 block 插入到 table 对应的缓存
             cache_handle = block_cache->Insert(
@@ -284,7 +399,7 @@ Iterator* Table::BlockReader(void* arg,
       }
     } else { 
       // table 禁用缓存, 则直接从文件读取 block
-      s = ReadBlock(table->rep_->file, options, handle, &contents);
+      s = table->ReadDataBlock(options, handle, &contents);
       if (s.ok()) {
         block = new Block(contents);
       }
@@ -294,7 +409,8 @@ Iterator* Table::BlockReader(void* arg,
   Iterator* iter;
   // 如果 index_value 指向的 block 存在, 则为其创建一个迭代器
   if (block != nullptr) { 
-    iter = block->NewIterator(table->rep_->options.comparator);
+    iter = block->NewIterator(table->rep_->options.comparator,
+                              table->rep_->bytewise_internal_keys);
     // 如果 table 没有配置用于缓存 block 的 cache, 
     //    则为该 block 在其迭代器中注册名为 DeleteBlock 
     //    的清理函数用于在迭代器销毁时释放 block 指向的内存; 
@@ -313,6 +429,36 @@ Iterator* Table::BlockReader(void* arg,
   return iter;
 }
 
+uint64_t Table::CacheId() const {
+  return rep_->cache_id;
+}
+
+// 按顺序遍历 data-index block, 偏移量匹配的 block 通过 BlockReader
+// 读取, 它会负责将 block 放入 block_cache.
+void Table::PrefetchBlocks(const std::vector<uint64_t>& offsets) {
+  ReadOptions options;
+  Iterator* index_iter =
+      rep_->index_block->NewIterator(rep_->options.comparator,
+                                     rep_->bytewise_internal_keys);
+  size_t i = 0;
+  for (index_iter->SeekToFirst(); index_iter->Valid() && i < offsets.size();
+       index_iter->Next()) {
+    Slice input = index_iter->value();
+    BlockHandle handle;
+    if (!handle.DecodeFrom(&input).ok()) {
+      break;
+    }
+    while (i < offsets.size() && offsets[i] < handle.offset()) {
+      i++;
+    }
+    if (i < offsets.size() && offsets[i] == handle.offset()) {
+      delete BlockReader(this, options, index_iter->value());
+      i++;
+    }
+  }
+  delete index_iter;
+}
+
 // 先为 data-index block 数据项构造一个迭代器 index_iter, 
 // 然后基于 index_iter 查询时, 为其指向的具体 data block 
 // 构造一个迭代器 data_iter, 进而可以迭代该 data block 里
@@ -320,7 +466,8 @@ Iterator* Table::BlockReader(void* arg,
 // 这样就构成了一个两级迭代器, 从而实现遍历全部 data blocks 的数据项. 
 Iterator* Table::NewIterator(const ReadOptions& options) const {
   return NewTwoLevelIterator(
-      rep_->index_block->NewIterator(rep_->options.comparator),
+      rep_->index_block->NewIterator(rep_->options.comparator,
+                                     rep_->bytewise_internal_keys),
       &Table::BlockReader, const_cast<Table*>(this), options);
 }
 
@@ -334,7 +481,8 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k,
                           void (*saver)(void*, const Slice&, const Slice&)) {
   Status s;
   // 针对 data index block 构造 iterator
-  Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator);
+  Iterator* iiter = rep_->index_block->NewIterator(
+      rep_->options.comparator, rep_->bytewise_internal_keys);
   // 在 data index block 中寻找第一个大于等于 k 的数据项, 这个数据项
   // 就是目标 data block 的 handle.
   iiter->Seek(k);
@@ -376,7 +524,8 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k,
 uint64_t Table::ApproximateOffsetOf(const Slice& key) const {
   // 获取 index block 的迭代器
   Iterator* index_iter =
-      rep_->index_block->NewIterator(rep_->options.comparator);
+      rep_->index_block->NewIterator(rep_->options.comparator,
+                                     rep_->bytewise_internal_keys);
   // 先在 data block 级别寻找目标 data block
   index_iter->Seek(key);
   uint64_t result;
@@ -404,4 +553,40 @@ uint64_t Table::ApproximateOffsetOf(const Slice& key) const {
   return result;
 }
 
+// index block 的 value 在 BlockHandle 之后记录了截至该 data block(含)
+// 的数据项个数, 所以 key 所在 data block 之前的数据项个数就是前一个
+// index 数据项记录的值.
+bool Table::ApproximatePositionOf(const Slice& key, uint64_t* offset,
+                                  uint64_t* entries) const {
+  *offset = rep_->metaindex_handle.offset();
+  *entries = 0;
+  Iterator* index_iter =
+      rep_->index_block->NewIterator(rep_->options.comparator,
+                                     rep_->bytewise_internal_keys);
+  index_iter->Seek(key);
+  if (index_iter->Valid()) {
+    BlockHandle handle;
+    Slice input = index_iter->value();
+    if (handle.DecodeFrom(&input).ok()) {
+      *offset = handle.offset();
+    }
+    index_iter->Prev();
+  } else {
+    index_iter->SeekToLast();
+  }
+  bool result = true;
+  if (index_iter->Valid()) {
+    BlockHandle handle;
+    Slice input = index_iter->value();
+    result = handle.DecodeFrom(&input).ok() && GetVarint64(&input, entries);
+    if (!result) {
+      *entries = 0;
+    }
+  } else if (!index_iter->status().ok()) {
+    result = false;
+  }
+  delete index_iter;
+  return result;
+}
+
 }  // namespace leveldb
@@ -5,13 +5,18 @@
 #include "leveldb/table_builder.h"
 
 #include <assert.h>
+#include <string.h>
+#include "db/dbformat.h"
+#include "leveldb/cache.h"
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/options.h"
+#include "table/block.h"
 #include "table/block_builder.h"
 #include "table/filter_block.h"
 #include "table/format.h"
+#include "table/range_filter.h"
 #include "util/coding.h"
 #include "util/crc32c.h"
 
@@ -29,7 +34,9 @@ struct TableBuilder::Rep {
   BlockBuilder data_block; 
   // 用于构造 index block
   BlockBuilder index_block; 
-  // 最近一次成功调用 Add 添加的 key
+  // 最近一次成功调用 Add 添加的 key. data block 不为空时最新的 key
+  // 在 data_block 里, 这里只在 data block 写入文件时通过交换更新,
+  // 省去每次 Add 都拷贝一遍 key.
   std::string last_key; 
   // 当前 table 中全部 data block entries 个数
   int64_t num_entries; 
@@ -37,6 +44,11 @@ struct TableBuilder::Rep {
   bool closed;          
   // 构造 filter block
   FilterBlockBuilder* filter_block; 
+  // 构造范围过滤器, 未开启 Options::range_filter 或者 comparator
+  // 不是字节序时为 nullptr
+  RangeFilterBuilder* range_filter;
+  // 为 true 表示 key 是 internal key, 范围过滤器只保存其中的 user key
+  bool range_filter_internal_keys;
 
   // 直到当追加下一个 data block 第一个 key 的时候, 我们才会将
   // 当前 data block 对应的 index 数据项追加到 index block,  
@@ -61,21 +73,35 @@ struct TableBuilder::Rep {
 
   std::string compressed_output;
 
+  // 非 0 时, 写入的 data block 会以它为前缀放入 block_cache, 见 CacheDataBlocks
+  uint64_t cache_id;
+
   Rep(const Options& opt, WritableFile* f)
       : options(opt),
         index_block_options(opt),
         file(f),
         offset(0),
-        data_block(&options),
-        index_block(&index_block_options),
+        data_block(&options, opt.fixed_key_length > 0),
+        index_block(&index_block_options, opt.fixed_key_length > 0),
         num_entries(0),
         closed(false),
         filter_block(opt.filter_policy == nullptr ? nullptr
                      : new FilterBlockBuilder(opt.filter_policy)),
-        pending_index_entry(false) {
+        range_filter(nullptr),
+        range_filter_internal_keys(false),
+        pending_index_entry(false),
+        cache_id(0) {
     // index block 的 key 不需要做前缀压缩, 
     // 所以把该值设置为 1, 表示每个 restart 段长度为 1.
     index_block_options.block_restart_interval = 1; 
+    if (opt.range_filter) {
+      range_filter_internal_keys =
+          IsBytewiseInternalKeyComparator(opt.comparator);
+      if (range_filter_internal_keys ||
+          opt.comparator == BytewiseComparator()) {
+        range_filter = new RangeFilterBuilder;
+      }
+    }
   }
 };
 
@@ -90,6 +116,7 @@ TableBuilder::~TableBuilder() {
   // 析构之前必须调用 Finish()
   assert(rep_->closed);  
   delete rep_->filter_block;
+  delete rep_->range_filter;
   delete rep_;
 }
 
@@ -100,6 +127,11 @@ Status TableBuilder::ChangeOptions(const Options& options) {
     // 不允许动态修改 comparator
     return Status::InvalidArgument("changing comparator while building table");
   }
+  if (options.fixed_key_length != rep_->options.fixed_key_length) {
+    // block 格式在构造时已经确定, 不允许动态修改
+    return Status::InvalidArgument(
+        "changing fixed_key_length while building table");
+  }
 
   // Note that any live BlockBuilders point to rep_->options and therefore
   // will automatically pick up the updated options.
@@ -117,7 +149,13 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
   // 如果该条件成立则说明之前调用过 Add 添加过数据了
   if (r->num_entries > 0) { 
     // 确保待添加的 key 大于之前已添加过的全部 keys
-    assert(r->options.comparator->Compare(key, Slice(r->last_key)) > 0); 
+    assert(r->options.comparator->Compare(key, LastKey()) > 0);
+    // 定长 key 格式要求全部 key 长度相同
+    if (r->options.fixed_key_length > 0 && key.size() != LastKey().size()) {
+      r->status = Status::InvalidArgument(
+          "key length does not match fixed_key_length");
+      return;
+    }
   }
 
   // 需要构造一个新的 data block
@@ -135,11 +173,18 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
     // 就是这里的 last_key, 它和 data block 对应的 handle 一起构成了 data block 
     // 在 data-index block 中的数据项. 第一个定位主要过程就是在 data-index block 
     // 上查找第一个大于等于要查询数据的数据项, 具体见 TwoLevelIterator::Seek().  
-    r->options.comparator->FindShortestSeparator(&r->last_key, key);
+    //
+    // 定长 key 格式下 index block 的 key 也必须定长, 所以直接使用 last_key.
+    if (r->options.fixed_key_length == 0) {
+      r->options.comparator->FindShortestSeparator(&r->last_key, key);
+    }
     // 用于存储序列化后的 BlockHandle
     std::string handle_encoding;
     // 将刚刚 flush 过的 data block 对应的 BlockHandle 序列化
     r->pending_handle.EncodeTo(&handle_encoding);
+    // BlockHandle 之后追加截至该 data block(含)的数据项个数,
+    // 用于 Table::ApproximatePositionOf 估计 key 范围内的数据项个数.
+    PutVarint64(&handle_encoding, r->num_entries);
     // data index block 构造相关:
     // 为刚刚 flush 过的 data block 在 index block 增加一个数据项, 
     // last_key 肯定大于等于其全部所有的 keys 且小于新的 
@@ -156,9 +201,11 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
   if (r->filter_block != nullptr) {
     r->filter_block->AddKey(key);
   }
+  if (r->range_filter != nullptr) {
+    r->range_filter->AddKey(r->range_filter_internal_keys
+                                ? ExtractUserKey(key) : key);
+  }
 
-  // 用新 key 更新 last_key
-  r->last_key.assign(key.data(), key.size());
   r->num_entries++;
   // data block 相关:
   // 将 key,value 添加到 data block 中
@@ -178,6 +225,8 @@ void TableBuilder::Flush() {
   if (!ok()) return;
   if (r->data_block.empty()) return;
   assert(!r->pending_index_entry);
+  // 拿走 data block 的最后一个 key 用于生成 index entry
+  r->data_block.SwapLastKey(&r->last_key);
   // 将 data block 压缩并落盘, 在该方法中 data_block 会调用 Reset()
   WriteBlock(&r->data_block, &r->pending_handle); 
   if (ok()) {
@@ -228,11 +277,44 @@ void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle) {
   
   // 将 block 内容写入文件
   WriteRawBlock(block_contents, type, handle); 
+  if (ok() && r->cache_id != 0 && block == &r->data_block) {
+    InsertIntoCache(raw, *handle);
+  }
   r->compressed_output.clear();
   // block 清空, 准备复用构建下个 block
   block->Reset(); 
 }
  
+static void DeleteCachedBlock(const Slice& key, void* value) {
+  delete reinterpret_cast<Block*>(value);
+}
+
+void TableBuilder::CacheDataBlocks(uint64_t cache_id) {
+  assert(rep_->options.block_cache != nullptr);
+  assert(rep_->num_entries == 0);
+  rep_->cache_id = cache_id;
+}
+
+// 将未压缩的 block 内容拷贝一份放入 block_cache, key 的格式与
+// Table::BlockReader 中的一致.
+void TableBuilder::InsertIntoCache(const Slice& raw, const BlockHandle& handle) {
+  Rep* r = rep_;
+  char* buf = new char[raw.size()];
+  memcpy(buf, raw.data(), raw.size());
+  BlockContents contents;
+  contents.data = Slice(buf, raw.size());
+  contents.cachable = true;
+  contents.heap_allocated = true;
+  Block* block = new Block(contents);
+
+  char cache_key_buffer[16];
+  EncodeFixed64(cache_key_buffer, r->cache_id);
+  EncodeFixed64(cache_key_buffer + 8, handle.offset());
+  Cache* cache = r->options.block_cache;
+  cache->Release(cache->Insert(Slice(cache_key_buffer, sizeof(cache_key_buffer)),
+                               block, block->size(), &DeleteCachedBlock));
+}
+
 void TableBuilder::WriteRawBlock(const Slice& block_contents,
                                  CompressionType type,
                                  BlockHandle* handle) {
@@ -274,6 +356,7 @@ Status TableBuilder::Finish() {
   r->closed = true;
 
   BlockHandle filter_block_handle, metaindex_block_handle, index_block_handle;
+  BlockHandle range_filter_handle;
 
   // 2 如果存在 filter block, 则将其写入文件; 
   // 写完后, filter_block_handle 保存着该 block 
@@ -287,6 +370,12 @@ Status TableBuilder::Finish() {
                   &filter_block_handle); 
   }
 
+  // 范围过滤器同样作为 meta block 不压缩地写入
+  if (ok() && r->range_filter != nullptr) {
+    WriteRawBlock(r->range_filter->Finish(), kNoCompression,
+                  &range_filter_handle);
+  }
+
   // 3 filter block 就是 table_format.md 中提到的 
   // meta block, 写完 meta block 该写它对应的索引
   // metaindex block 到文件中了.
@@ -305,6 +394,12 @@ Status TableBuilder::Finish() {
       filter_block_handle.EncodeTo(&handle_encoding);
       meta_index_block.Add(key, handle_encoding);
     }
+    if (r->range_filter != nullptr) {
+      // metaindex block 的 key 有序, "filter." 在 "rangefilter." 之前
+      std::string handle_encoding;
+      range_filter_handle.EncodeTo(&handle_encoding);
+      meta_index_block.Add(kRangeFilterMetaKey, handle_encoding);
+    }
     // 将 metaindex block 写入文件
     WriteBlock(&meta_index_block, &metaindex_block_handle); 
   }
@@ -314,9 +409,12 @@ Status TableBuilder::Finish() {
   if (ok()) {
     // 最后构建的 data block 对应的 index block entry 还没有写入
     if (r->pending_index_entry) { 
-      r->options.comparator->FindShortSuccessor(&r->last_key);
+      if (r->options.fixed_key_length == 0) {
+        r->options.comparator->FindShortSuccessor(&r->last_key);
+      }
       std::string handle_encoding;
       r->pending_handle.EncodeTo(&handle_encoding);
+      PutVarint64(&handle_encoding, r->num_entries);
       // 写入最后构建的 data block 对应的 index block entry
       r->index_block.Add(r->last_key, Slice(handle_encoding)); 
       r->pending_index_entry = false;
@@ -355,4 +453,9 @@ uint64_t TableBuilder::FileSize() const {
   return rep_->offset;
 }
 
+Slice TableBuilder::LastKey() const {
+  const Rep* r = rep_;
+  return r->data_block.empty() ? Slice(r->last_key) : r->data_block.last_key();
+}
+
 }  // namespace leveldb
@@ -237,6 +237,7 @@ class TableConstructor: public Constructor {
          ++it) {
       builder.Add(it->first, it->second);
       ASSERT_TRUE(builder.status().ok());
+      ASSERT_EQ(it->first, builder.LastKey().ToString());
     }
     Status s = builder.Finish();
     ASSERT_TRUE(s.ok()) << s.ToString();
@@ -481,9 +482,49 @@ class Harness {
 
     TestForwardScan(keys, data);
     TestBackwardScan(keys, data);
+    TestBatchScan(rnd, data);
     TestRandomAccess(rnd, keys, data);
   }
 
+  struct BatchOutput {
+    std::vector<std::string> entries;
+    size_t limit;  // Refuse entries once this many were accepted
+  };
+
+  static bool CollectBatchEntry(void* arg, const Slice& key,
+                                const Slice& value) {
+    BatchOutput* out = reinterpret_cast<BatchOutput*>(arg);
+    if (out->entries.size() >= out->limit) {
+      return false;
+    }
+    out->entries.push_back("'" + key.ToString() + "->" + value.ToString() +
+                           "'");
+    return true;
+  }
+
+  // Scan with NextBatch in random chunk sizes, sometimes having the
+  // callback refuse entries part way through a chunk.
+  void TestBatchScan(Random* rnd, const KVMap& data) {
+    Iterator* iter = constructor_->NewIterator();
+    iter->SeekToFirst();
+    KVMap::const_iterator model_iter = data.begin();
+    while (model_iter != data.end()) {
+      BatchOutput out;
+      size_t max_n = 1 + rnd->Uniform(7);
+      out.limit = rnd->OneIn(3) ? rnd->Uniform(max_n) : max_n;
+      size_t n = iter->NextBatch(max_n, &CollectBatchEntry, &out);
+      ASSERT_EQ(out.entries.size(), n);
+      for (size_t i = 0; i < n; i++) {
+        ASSERT_TRUE(model_iter != data.end());
+        ASSERT_EQ(ToString(data, model_iter), out.entries[i]);
+        ++model_iter;
+      }
+      ASSERT_EQ(ToString(data, model_iter), ToString(iter));
+    }
+    ASSERT_EQ(0, iter->NextBatch(10, &CollectBatchEntry, nullptr));
+    delete iter;
+  }
+
   void TestForwardScan(const std::vector<std::string>& keys,
                        const KVMap& data) {
     Iterator* iter = constructor_->NewIterator();
@@ -674,6 +715,55 @@ TEST(Harness, ZeroRestartPointsInBlock) {
   delete iter;
 }
 
+// Reverse iteration within a block reuses the decoded restart interval;
+// interleave Prev with Next and Seek to check it never goes stale.
+TEST(Harness, BlockReverseIteration) {
+  Options options;
+  options.block_restart_interval = 4;
+  BlockBuilder builder(&options);
+  std::vector<std::string> keys;
+  for (int i = 0; i < 50; i++) {
+    char buf[20];
+    snprintf(buf, sizeof(buf), "key%06d", i);
+    keys.push_back(buf);
+    builder.Add(keys.back(), "v" + keys.back());
+  }
+  std::string data = builder.Finish().ToString();
+  BlockContents contents;
+  contents.data = data;
+  contents.cachable = false;
+  contents.heap_allocated = false;
+  Block block(contents);
+  Iterator* iter = block.NewIterator(BytewiseComparator());
+
+  iter->SeekToLast();
+  for (int i = 49; i >= 0; i--) {
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ(keys[i], iter->key().ToString());
+    ASSERT_EQ("v" + keys[i], iter->value().ToString());
+    iter->Prev();
+  }
+  ASSERT_TRUE(!iter->Valid());
+
+  iter->Seek(keys[30]);
+  iter->Prev();
+  ASSERT_EQ(keys[29], iter->key().ToString());
+  iter->Prev();
+  ASSERT_EQ(keys[28], iter->key().ToString());
+  iter->Next();
+  iter->Next();
+  iter->Next();
+  ASSERT_EQ(keys[31], iter->key().ToString());
+  iter->Prev();
+  ASSERT_EQ(keys[30], iter->key().ToString());
+  iter->Seek(keys[10]);
+  iter->Prev();
+  ASSERT_EQ(keys[9], iter->key().ToString());
+  ASSERT_EQ("v" + keys[9], iter->value().ToString());
+  ASSERT_OK(iter->status());
+  delete iter;
+}
+
 // Test the empty key
 TEST(Harness, SimpleEmptyKey) {
   for (int i = 0; i < kNumTestArgs; i++) {
@@ -869,6 +959,198 @@ TEST(TableTest, ApproximateOffsetOfCompressed) {
   ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"), 2 * min_z, 2 * max_z));
 }
 
+// Builds 16-byte keys whose bytes straddle 0x80 so that signed/unsigned
+// mistakes in the specialized comparisons show up.  Keys are increasing
+// in "i" for 0 <= i < 500.
+static std::string FixedKey(int i) {
+  const uint64_t hi = static_cast<uint64_t>(i / 100) << 61;
+  const uint64_t lo = static_cast<uint64_t>(i % 100) * 0x0202020202020202ull;
+  std::string result;
+  for (int b = 56; b >= 0; b -= 8) {
+    result.push_back(static_cast<char>(hi >> b));
+  }
+  for (int b = 56; b >= 0; b -= 8) {
+    result.push_back(static_cast<char>(lo >> b));
+  }
+  return result;
+}
+
+static std::string SeekKey(const Slice& user_key) {
+  return InternalKey(user_key, kMaxSequenceNumber,
+                     kValueTypeForSeek).Encode().ToString();
+}
+
+class FixedKeyTest { };
+
+TEST(FixedKeyTest, Block) {
+  Options options;
+  BlockBuilder builder(&options, true);
+  std::vector<std::string> keys;
+  size_t values_size = 0;
+  for (int i = 0; i < 100; i++) {
+    char buf[20];
+    snprintf(buf, sizeof(buf), "key%06d", i * 2);
+    keys.push_back(buf);
+    builder.Add(keys.back(), std::string(i % 7, 'v'));
+    values_size += i % 7;
+  }
+  const size_t estimate = builder.CurrentSizeEstimate();
+  std::string data = builder.Finish().ToString();
+  ASSERT_EQ(estimate, data.size());
+  // No length prefixes or restart points: keys, values, value offsets,
+  // key width and entry count.
+  ASSERT_EQ(100 * 9 + values_size + 100 * 4 + 8, data.size());
+
+  BlockContents contents;
+  contents.data = data;
+  contents.cachable = false;
+  contents.heap_allocated = false;
+  Block block(contents);
+  Iterator* iter = block.NewIterator(BytewiseComparator());
+
+  iter->SeekToFirst();
+  for (int i = 0; i < 100; i++) {
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ(keys[i], iter->key().ToString());
+    ASSERT_EQ(std::string(i % 7, 'v'), iter->value().ToString());
+    iter->Next();
+  }
+  ASSERT_TRUE(!iter->Valid());
+
+  iter->SeekToLast();
+  for (int i = 99; i >= 0; i--) {
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ(keys[i], iter->key().ToString());
+    iter->Prev();
+  }
+  ASSERT_TRUE(!iter->Valid());
+
+  iter->Seek(keys[10]);
+  ASSERT_EQ(keys[10], iter->key().ToString());
+  iter->Seek("key000021");
+  ASSERT_EQ(keys[11], iter->key().ToString());
+  iter->Seek("a");
+  ASSERT_EQ(keys[0], iter->key().ToString());
+  iter->Seek("key00003");        // Shorter than the stored keys
+  ASSERT_EQ(keys[15], iter->key().ToString());
+  iter->Seek(keys[20] + "x");    // Longer than the stored keys
+  ASSERT_EQ(keys[21], iter->key().ToString());
+  iter->Seek("z");
+  ASSERT_TRUE(!iter->Valid());
+  ASSERT_OK(iter->status());
+  delete iter;
+}
+
+TEST(FixedKeyTest, TableWithInternalKeys) {
+  InternalKeyComparator icmp(BytewiseComparator());
+  Options options;
+  options.comparator = &icmp;
+  options.fixed_key_length = 16;
+  options.block_size = 256;
+  options.compression = kNoCompression;
+
+  StringSink sink;
+  TableBuilder builder(options, &sink);
+  std::vector<std::string> keys;
+  for (int i = 0; i < 500; i++) {
+    keys.push_back(InternalKey(FixedKey(i), 100, kTypeValue).Encode()
+                       .ToString());
+    builder.Add(keys.back(), "v" + std::to_string(i));
+    ASSERT_OK(builder.status());
+  }
+  ASSERT_OK(builder.Finish());
+
+  StringSource source(sink.contents());
+  Table* table;
+  ASSERT_OK(Table::Open(options, &source, sink.contents().size(), &table));
+  Iterator* iter = table->NewIterator(ReadOptions());
+  iter->SeekToFirst();
+  for (int i = 0; i < 500; i++) {
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ(keys[i], iter->key().ToString());
+    ASSERT_EQ("v" + std::to_string(i), iter->value().ToString());
+    iter->Next();
+  }
+  ASSERT_TRUE(!iter->Valid());
+
+  iter->SeekToLast();
+  for (int i = 499; i >= 0; i--) {
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ(keys[i], iter->key().ToString());
+    iter->Prev();
+  }
+  ASSERT_TRUE(!iter->Valid());
+
+  for (int i = 0; i < 500; i++) {
+    iter->Seek(SeekKey(FixedKey(i)));
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ(keys[i], iter->key().ToString());
+  }
+  // Targets of other lengths fall back to the comparator.
+  iter->Seek(SeekKey(FixedKey(250).substr(0, 8)));
+  ASSERT_EQ(keys[200], iter->key().ToString());
+  iter->Seek(SeekKey(FixedKey(250) + "x"));
+  ASSERT_EQ(keys[251], iter->key().ToString());
+  ASSERT_OK(iter->status());
+  delete iter;
+  delete table;
+}
+
+TEST(FixedKeyTest, TableRejectsOtherKeyLengths) {
+  Options options;
+  options.fixed_key_length = 4;
+  StringSink sink;
+  TableBuilder builder(options, &sink);
+  builder.Add("abcd", "v");
+  ASSERT_OK(builder.status());
+  builder.Add("abcde", "v");
+  ASSERT_TRUE(builder.status().IsInvalidArgument());
+  builder.Abandon();
+}
+
+TEST(FixedKeyTest, MemTable) {
+  InternalKeyComparator cmp(BytewiseComparator());
+  MemTable* memtable = new MemTable(cmp, 16);
+  memtable->Ref();
+  // Insert in a scrambled order.
+  for (int i = 0; i < 500; i++) {
+    const int k = (i * 7) % 500;
+    memtable->Add(i + 1, kTypeValue, FixedKey(k), "v" + std::to_string(k));
+  }
+  memtable->Add(501, kTypeDeletion, FixedKey(3), Slice());
+
+  std::string value;
+  Status s;
+  ASSERT_TRUE(memtable->Get(LookupKey(FixedKey(42), 1000), &value, &s));
+  ASSERT_EQ("v42", value);
+  ASSERT_TRUE(memtable->Get(LookupKey(FixedKey(3), 1000), &value, &s));
+  ASSERT_TRUE(s.IsNotFound());
+  ASSERT_TRUE(!memtable->Get(LookupKey("short", 1000), &value, &s));
+
+  Iterator* iter = memtable->NewIterator();
+  iter->SeekToFirst();
+  for (int i = 0; i < 500; i++) {
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ(FixedKey(i), ExtractUserKey(iter->key()).ToString());
+    if (i == 3) {
+      iter->Next();  // Skip the deletion, which sorts first
+      ASSERT_EQ(FixedKey(i), ExtractUserKey(iter->key()).ToString());
+    }
+    ASSERT_EQ("v" + std::to_string(i), iter->value().ToString());
+    iter->Next();
+  }
+  ASSERT_TRUE(!iter->Valid());
+
+  iter->Seek(SeekKey(FixedKey(250).substr(0, 8)));
+  ASSERT_EQ(FixedKey(200), ExtractUserKey(iter->key()).ToString());
+  iter->Seek(SeekKey(FixedKey(250) + "x"));
+  ASSERT_EQ(FixedKey(251), ExtractUserKey(iter->key()).ToString());
+  iter->Seek(SeekKey(""));
+  ASSERT_EQ(FixedKey(0), ExtractUserKey(iter->key()).ToString());
+  delete iter;
+  memtable->Unref();
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
@@ -49,6 +49,7 @@ class TwoLevelIterator: public Iterator {
   virtual void SeekToLast();
   virtual void Next();
   virtual void Prev();
+  virtual size_t NextBatch(size_t max_n, BatchCallback callback, void* arg);
 
   virtual bool Valid() const {
     return data_iter_.Valid();
@@ -172,6 +173,21 @@ void TwoLevelIterator::Next() {
   SkipEmptyDataBlocksForward();
 }
 
+// 在当前 data block 内批量遍历, 遍历完再切换到下一个 data block
+size_t TwoLevelIterator::NextBatch(size_t max_n, BatchCallback callback,
+                                   void* arg) {
+  size_t n = 0;
+  while (n < max_n && Valid()) {
+    n += data_iter_.NextBatch(max_n - n, callback, arg);
+    if (data_iter_.Valid()) {
+      // callback 拒绝了当前数据项或者已经够数了
+      break;
+    }
+    SkipEmptyDataBlocksForward();
+  }
+  return n;
+}
+
 // 使得 data_iter_ 指向前一个数据项
 void TwoLevelIterator::Prev() {
   assert(Valid());
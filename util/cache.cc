@@ -248,6 +248,9 @@ class LRUCache {
   void Release(Cache::Handle* handle);
   void Erase(const Slice& key, uint32_t hash);
   void Prune();
+  void ApplyToAllEntries(void (*function)(void* arg, const Slice& key,
+                                          void* value),
+                         void* arg);
   /**
    * 返回该 shard 的内存使用量
    * @return
@@ -552,6 +555,18 @@ void LRUCache::Prune() {
   }
 }
 
+// 先访问正被客户端使用的数据项, 再按照从新到旧的顺序访问 lru 链表中的数据项.
+void LRUCache::ApplyToAllEntries(
+    void (*function)(void* arg, const Slice& key, void* value), void* arg) {
+  MutexLock l(&mutex_);
+  for (LRUHandle* e = in_use_.next; e != &in_use_; e = e->next) {
+    (*function)(arg, e->key(), e->value);
+  }
+  for (LRUHandle* e = lru_.prev; e != &lru_; e = e->prev) {
+    (*function)(arg, e->key(), e->value);
+  }
+}
+
 // 默认用于 sharding 的 bits 共 4 位, 即 16 个 shards.
 static const int kNumShardBits = 4;
 // 默认 cache 具有 16 个 shards
@@ -661,6 +676,12 @@ class ShardedLRUCache : public Cache {
       shard_[s].Prune();
     }
   }
+  virtual void ApplyToAllEntries(
+      void (*function)(void* arg, const Slice& key, void* value), void* arg) {
+    for (int s = 0; s < kNumShards; s++) {
+      shard_[s].ApplyToAllEntries(function, arg);
+    }
+  }
   /**
    * 返回该 cache 全部 shards 的使用量之和.
    * 主要用于供使用者刁永刚以估计自己应用的内存占用.
@@ -112,6 +112,20 @@ inline uint64_t DecodeFixed64(const char* ptr) {
   }
 }
 
+// 按大端序将 8 字节解码为 uint64, 这样解码结果的大小关系与按字节比较的结果一致.
+inline uint64_t DecodeBigEndian64(const char* ptr) {
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(ptr);
+  // gcc/clang 会将其优化为一次加载加一条 bswap 指令
+  return ((static_cast<uint64_t>(p[0]) << 56) |
+          (static_cast<uint64_t>(p[1]) << 48) |
+          (static_cast<uint64_t>(p[2]) << 40) |
+          (static_cast<uint64_t>(p[3]) << 32) |
+          (static_cast<uint64_t>(p[4]) << 24) |
+          (static_cast<uint64_t>(p[5]) << 16) |
+          (static_cast<uint64_t>(p[6]) << 8) |
+          (static_cast<uint64_t>(p[7])));
+}
+
 // Internal routine for use by fallback path of GetVarint32Ptr
 /**
  * 根据每个字节最高位是否为 1 判断是否需要继续处理, 1 继续, 0 不继续; 
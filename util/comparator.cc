@@ -4,10 +4,12 @@
 
 #include <algorithm>
 #include <cstdint>
+#include <cstring>
 #include <string>
 
 #include "leveldb/comparator.h"
 #include "leveldb/slice.h"
+#include "util/coding.h"
 #include "util/logging.h"
 #include "util/no_destructor.h"
 
@@ -15,6 +17,36 @@ namespace leveldb {
 
 Comparator::~Comparator() { }
 
+int Comparator::CompareTimestamp(const Slice& ts1, const Slice& ts2) const {
+  // 支持时间戳的 comparator 必须重写该方法, 否则所有版本都会被当作同一时间点
+  assert(timestamp_size() == 0);
+  return 0;
+}
+
+int Comparator::CompareWithoutTimestamp(const Slice& a, const Slice& b) const {
+  const size_t ts_size = timestamp_size();
+  if (ts_size == 0) {
+    return Compare(a, b);
+  }
+  assert(a.size() >= ts_size && b.size() >= ts_size);
+  const Slice a_ts(a.data() + a.size() - ts_size, ts_size);
+  if (a_ts == Slice(b.data() + b.size() - ts_size, ts_size)) {
+    return Compare(a, b);
+  }
+  // 给两个 key 换上相同的时间戳之后再比较, 结果就只取决于时间戳之前的部分.
+  // 短 key 在栈上拼接, 避免每次比较都分配内存.
+  char space[200];
+  std::string heap;
+  char* buf = space;
+  if (b.size() > sizeof(space)) {
+    heap.resize(b.size());
+    buf = &heap[0];
+  }
+  memcpy(buf, b.data(), b.size() - ts_size);
+  memcpy(buf + b.size() - ts_size, a_ts.data(), ts_size);
+  return Compare(a, Slice(buf, b.size()));
+}
+
 namespace {
 //  
 class BytewiseComparatorImpl : public Comparator {
@@ -88,6 +120,64 @@ class BytewiseComparatorImpl : public Comparator {
     }
     // *key is a run of 0xffs.  Leave it alone.
   }
+
+  // 没有时间戳, 直接比较, 省去基类中的判断.
+  virtual int CompareWithoutTimestamp(const Slice& a, const Slice& b) const {
+    return a.compare(b);
+  }
+};
+
+// user key 由不带时间戳的 key 和 8 字节小端编码的时间戳组成.
+// 先按 key 的字典序排序, key 相同的按时间戳从大到小排序.
+class BytewiseComparatorWithU64TsImpl : public Comparator {
+ public:
+  static const size_t kTimestampSize = 8;
+
+  BytewiseComparatorWithU64TsImpl() { }
+
+  virtual const char* Name() const {
+    return "leveldb.BytewiseComparator.u64ts";
+  }
+
+  virtual int Compare(const Slice& a, const Slice& b) const {
+    int r = CompareWithoutTimestamp(a, b);
+    if (r == 0) {
+      // 时间戳越大越新, 越靠前
+      r = -CompareTimestamp(Timestamp(a), Timestamp(b));
+    }
+    return r;
+  }
+
+  // 缩短 key 需要重新拼接时间戳, 这里保持 key 不变, 这样总是正确的.
+  virtual void FindShortestSeparator(std::string* start,
+                                     const Slice& limit) const { }
+
+  virtual void FindShortSuccessor(std::string* key) const { }
+
+  virtual size_t timestamp_size() const { return kTimestampSize; }
+
+  virtual int CompareTimestamp(const Slice& ts1, const Slice& ts2) const {
+    assert(ts1.size() == kTimestampSize && ts2.size() == kTimestampSize);
+    const uint64_t t1 = DecodeFixed64(ts1.data());
+    const uint64_t t2 = DecodeFixed64(ts2.data());
+    if (t1 < t2) {
+      return -1;
+    } else if (t1 > t2) {
+      return +1;
+    }
+    return 0;
+  }
+
+  virtual int CompareWithoutTimestamp(const Slice& a, const Slice& b) const {
+    assert(a.size() >= kTimestampSize && b.size() >= kTimestampSize);
+    return Slice(a.data(), a.size() - kTimestampSize).compare(
+        Slice(b.data(), b.size() - kTimestampSize));
+  }
+
+ private:
+  static Slice Timestamp(const Slice& key) {
+    return Slice(key.data() + key.size() - kTimestampSize, kTimestampSize);
+  }
 };
 }  // namespace
 
@@ -96,4 +186,9 @@ const Comparator* BytewiseComparator() {
   return singleton.get();
 }
 
+const Comparator* BytewiseComparatorWithU64Ts() {
+  static NoDestructor<BytewiseComparatorWithU64TsImpl> singleton;
+  return singleton.get();
+}
+
 }  // namespace leveldb
@@ -22,6 +22,10 @@ RandomAccessFile::~RandomAccessFile() {
 WritableFile::~WritableFile() {
 }
 
+Status WritableFile::SyncFlushed() {
+  return Status::NotSupported("SyncFlushed");
+}
+
 Logger::~Logger() {
 }
 
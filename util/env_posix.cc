@@ -407,6 +407,18 @@ class PosixWritableFile final : public WritableFile {
     return status;
   }
 
+  // 只访问 fd_, 不碰 buf_ 和 pos_, 可以和 Append()/Flush() 并发执行.
+  // manifest 文件需要先同步目录, 只能用 Sync().
+  Status SyncFlushed() override {
+    if (is_manifest_) {
+      return Status::NotSupported("SyncFlushed", filename_);
+    }
+    if (::fdatasync(fd_) != 0) {
+      return PosixError(filename_, errno);
+    }
+    return Status::OK();
+  }
+
  private:
   // 将缓存内容写到文件
   Status FlushBuffer() {
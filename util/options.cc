@@ -19,12 +19,23 @@ Options::Options()
       write_buffer_size(4<<20),
       max_open_files(1000),
       block_cache(nullptr),
+      persistent_cache(nullptr),
+      persist_block_cache(false),
+      warm_block_cache_level(-1),
       block_size(4096),
       block_restart_interval(16),
+      fixed_key_length(0),
       max_file_size(2<<20),
       compression(kSnappyCompression),
       reuse_logs(false),
-      filter_policy(nullptr) {
+      filter_policy(nullptr),
+      optimize_filters_for_hits(false),
+      range_filter(false),
+      wal_ttl_seconds(0),
+      wal_size_limit(0),
+      async_read_threads(16),
+      delete_rate_bytes_per_second(0),
+      dedup_group_updates(false) {
 }
 
 }  // namespace leveldb
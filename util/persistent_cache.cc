@@ -0,0 +1,403 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/persistent_cache.h"
+
+#include <assert.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/coding.h"
+#include "util/crc32c.h"
+#include "util/hash.h"
+#include "util/logging.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+PersistentCache::~PersistentCache() {
+}
+
+namespace {
+
+// 缓存数据以日志结构保存在若干个 segment 文件中, 每个文件由若干条记录构成:
+//
+//    masked crc32c: fixed32 (覆盖其后的全部内容)
+//    key 长度:      fixed32
+//    value 长度:    fixed32
+//    key:           char[key 长度]
+//    value:         char[value 长度]
+//
+// 新插入的数据先追加到内存中的活跃 segment, 写满之后由后台线程
+// 一次性写入文件, 这样读路径上的 Insert 不会触发任何 IO.
+// 超出容量时整个淘汰最老的 segment.
+static const size_t kRecordHeaderSize = 12;
+
+// 等待后台线程写入的 segment 超过该数目时, 说明设备写入跟不上, 直接丢弃新插入的数据.
+static const size_t kMaxUnwrittenSegments = 2;
+
+static const uint64_t kMinSegmentSize = 4 << 10;
+static const uint64_t kMaxSegmentSize = 4 << 20;
+
+struct Segment {
+  explicit Segment(uint64_t n) : number(n), size(0), file(nullptr), refs(1) { }
+  ~Segment() { delete file; }
+
+  uint64_t number;
+  uint64_t size;
+  // 尚未写入文件时, 数据保存在 buffer 中; 写入之后 buffer 被清空, file 非空.
+  std::string buffer;
+  RandomAccessFile* file;
+  // 存储在该 segment 中的全部 key 的哈希值, 淘汰时用于清理索引
+  std::vector<uint64_t> keys;
+  // 所在缓存持有一个引用, 正在读取该 segment 的线程各持有一个引用
+  int refs;
+};
+
+// 索引以 key 的 64 位哈希值为 key, 这样查找和插入都不需要拷贝 key.
+// 哈希冲突时读出的记录中的 key 与要找的不同, 当作未命中处理.
+static uint64_t KeyHash(const Slice& key) {
+  return (static_cast<uint64_t>(Hash(key.data(), key.size(), 0x9ae16a3b))
+          << 32) |
+         Hash(key.data(), key.size(), 0xbc9f1d34);
+}
+
+static void EncodeRecord(std::string* dst, const Slice& key,
+                         const Slice& value) {
+  size_t start = dst->size();
+  dst->resize(start + 4);
+  PutFixed32(dst, static_cast<uint32_t>(key.size()));
+  PutFixed32(dst, static_cast<uint32_t>(value.size()));
+  dst->append(key.data(), key.size());
+  dst->append(value.data(), value.size());
+  uint32_t crc = crc32c::Value(dst->data() + start + 4,
+                               dst->size() - start - 4);
+  EncodeFixed32(&(*dst)[start], crc32c::Mask(crc));
+}
+
+// 从 *input 头部解析出一条记录, 成功则前移 *input 并返回 true.
+static bool DecodeRecord(Slice* input, Slice* key, Slice* value) {
+  if (input->size() < kRecordHeaderSize) {
+    return false;
+  }
+  const char* p = input->data();
+  const uint32_t key_size = DecodeFixed32(p + 4);
+  const uint32_t value_size = DecodeFixed32(p + 8);
+  const uint64_t record_size =
+      kRecordHeaderSize + static_cast<uint64_t>(key_size) + value_size;
+  if (record_size > input->size()) {
+    return false;
+  }
+  const uint32_t crc = crc32c::Unmask(DecodeFixed32(p));
+  if (crc != crc32c::Value(p + 4, record_size - 4)) {
+    return false;
+  }
+  *key = Slice(p + kRecordHeaderSize, key_size);
+  *value = Slice(p + kRecordHeaderSize + key_size, value_size);
+  input->remove_prefix(record_size);
+  return true;
+}
+
+class FilePersistentCache : public PersistentCache {
+ public:
+  FilePersistentCache(Env* env, const std::string& dir, uint64_t capacity)
+      : env_(env),
+        dir_(dir),
+        capacity_(capacity),
+        segment_size_(std::min(kMaxSegmentSize,
+                               std::max(kMinSegmentSize, capacity / 8))),
+        cv_(&mu_),
+        active_(nullptr),
+        usage_(0),
+        next_number_(1),
+        writer_running_(false),
+        shutting_down_(false) {
+  }
+
+  ~FilePersistentCache() override {
+    mu_.Lock();
+    // 把内存中尚未落盘的数据也写入文件, 以便下次打开时恢复
+    if (active_ != nullptr && active_->size > 0) {
+      SealActive();
+    }
+    shutting_down_ = true;
+    cv_.SignalAll();
+    while (writer_running_) {
+      cv_.Wait();
+    }
+    for (size_t i = 0; i < segments_.size(); i++) {
+      Unref(segments_[i]);
+    }
+    mu_.Unlock();
+  }
+
+  // 从 dir_ 下已有的 segment 文件恢复索引
+  Status Recover() {
+    env_->CreateDir(dir_);  // 忽略错误, 目录可能已经存在
+    std::vector<std::string> filenames;
+    Status s = env_->GetChildren(dir_, &filenames);
+    if (!s.ok()) {
+      return s;
+    }
+    std::vector<uint64_t> numbers;
+    for (size_t i = 0; i < filenames.size(); i++) {
+      Slice name(filenames[i]);
+      uint64_t number;
+      if (ConsumeDecimalNumber(&name, &number) && name == Slice(".pcache")) {
+        numbers.push_back(number);
+      }
+    }
+    // 按照编号从小到大(即从老到新) 处理, 较新的记录覆盖较老的记录
+    std::sort(numbers.begin(), numbers.end());
+
+    MutexLock l(&mu_);
+    for (size_t i = 0; i < numbers.size(); i++) {
+      const std::string fname = SegmentFileName(numbers[i]);
+      next_number_ = std::max(next_number_, numbers[i] + 1);
+      std::string data;
+      RandomAccessFile* file = nullptr;
+      if (!ReadFileToString(env_, fname, &data).ok() ||
+          !env_->NewRandomAccessFile(fname, &file).ok()) {
+        env_->DeleteFile(fname);
+        continue;
+      }
+      Segment* seg = new Segment(numbers[i]);
+      seg->file = file;
+      seg->size = data.size();
+      Slice input(data), key, value;
+      while (true) {
+        const uint64_t offset = data.size() - input.size();
+        // 遇到损坏的记录(比如写到一半崩溃) 即停止, 其后的数据全部作废
+        if (!DecodeRecord(&input, &key, &value)) {
+          break;
+        }
+        AddToIndex(key, seg, offset, data.size() - input.size() - offset);
+      }
+      segments_.push_back(seg);
+      usage_ += seg->size;
+    }
+    active_ = new Segment(next_number_++);
+    segments_.push_back(active_);
+    EvictIfNeeded();
+    return Status::OK();
+  }
+
+  void Insert(const Slice& key, const Slice& value) override {
+    const uint64_t record_size = kRecordHeaderSize + key.size() + value.size();
+    MutexLock l(&mu_);
+    if (shutting_down_ || record_size > segment_size_ ||
+        unwritten_.size() >= kMaxUnwrittenSegments ||
+        index_.count(KeyHash(key)) > 0) {
+      return;
+    }
+    if (active_->size + record_size > segment_size_) {
+      SealActive();
+    }
+    const uint64_t offset = active_->buffer.size();
+    EncodeRecord(&active_->buffer, key, value);
+    active_->size = active_->buffer.size();
+    usage_ += record_size;
+    AddToIndex(key, active_, offset, record_size);
+    EvictIfNeeded();
+  }
+
+  bool Lookup(const Slice& key, std::string* value) override {
+    mu_.Lock();
+    std::unordered_map<uint64_t, Location>::const_iterator it =
+        index_.find(KeyHash(key));
+    if (it == index_.end()) {
+      mu_.Unlock();
+      return false;
+    }
+    const Location loc = it->second;
+    Segment* seg = loc.segment;
+    bool found = false;
+    Slice record, k, v;
+    if (seg->file == nullptr) {
+      // 数据还在内存里, 直接拷贝
+      record = Slice(seg->buffer.data() + loc.offset, loc.size);
+      if (DecodeRecord(&record, &k, &v) && k == key) {
+        value->assign(v.data(), v.size());
+        found = true;
+      }
+      mu_.Unlock();
+      return found;
+    }
+
+    // 读文件期间不持有锁, 引用计数保证 segment 被淘汰后文件对象依然有效
+    seg->refs++;
+    mu_.Unlock();
+    std::string scratch;
+    scratch.resize(loc.size);
+    if (seg->file->Read(loc.offset, loc.size, &record, &scratch[0]).ok() &&
+        DecodeRecord(&record, &k, &v) && k == key) {
+      value->assign(v.data(), v.size());
+      found = true;
+    }
+    mu_.Lock();
+    Unref(seg);
+    mu_.Unlock();
+    return found;
+  }
+
+ private:
+  struct Location {
+    Segment* segment;
+    uint64_t offset;  // 记录在 segment 中的起始偏移量
+    uint64_t size;    // 记录总长度(含头部)
+  };
+
+  std::string SegmentFileName(uint64_t number) const {
+    char buf[100];
+    snprintf(buf, sizeof(buf), "/%06llu.pcache",
+             static_cast<unsigned long long>(number));
+    return dir_ + buf;
+  }
+
+  void AddToIndex(const Slice& key, Segment* seg, uint64_t offset,
+                  uint64_t size) EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    Location loc;
+    loc.segment = seg;
+    loc.offset = offset;
+    loc.size = size;
+    const uint64_t hash = KeyHash(key);
+    seg->keys.push_back(hash);
+    index_[hash] = loc;
+  }
+
+  void Unref(Segment* seg) EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    assert(seg->refs > 0);
+    if (--seg->refs == 0) {
+      delete seg;
+    }
+  }
+
+  // 将写满的活跃 segment 交给后台线程写入文件, 并新建一个活跃 segment
+  void SealActive() EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    unwritten_.push_back(active_);
+    active_ = new Segment(next_number_++);
+    segments_.push_back(active_);
+    if (!writer_running_) {
+      writer_running_ = true;
+      env_->StartThread(&FilePersistentCache::WriterThread, this);
+    }
+    cv_.SignalAll();
+  }
+
+  // 将 seg 从缓存中移除: 清理其索引项并删除其文件
+  void RemoveSegment(Segment* seg) EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    for (size_t i = 0; i < seg->keys.size(); i++) {
+      std::unordered_map<uint64_t, Location>::iterator it =
+          index_.find(seg->keys[i]);
+      if (it != index_.end() && it->second.segment == seg) {
+        index_.erase(it);
+      }
+    }
+    usage_ -= seg->size;
+    segments_.erase(std::find(segments_.begin(), segments_.end(), seg));
+    env_->DeleteFile(SegmentFileName(seg->number));
+    Unref(seg);
+  }
+
+  // 超出容量时从最老的 segment 开始淘汰, 尚未写入文件的 segment 不参与淘汰
+  void EvictIfNeeded() EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    while (usage_ > capacity_ && segments_.front()->file != nullptr) {
+      RemoveSegment(segments_.front());
+    }
+  }
+
+  static void WriterThread(void* arg) {
+    reinterpret_cast<FilePersistentCache*>(arg)->WriterLoop();
+  }
+
+  void WriterLoop() {
+    mu_.Lock();
+    while (true) {
+      while (unwritten_.empty() && !shutting_down_) {
+        cv_.Wait();
+      }
+      if (unwritten_.empty()) {
+        break;
+      }
+      Segment* seg = unwritten_.front();
+      seg->refs++;
+      const std::string fname = SegmentFileName(seg->number);
+      mu_.Unlock();
+
+      // 被封存的 segment 不再修改, 因此可以不持锁读取其 buffer
+      RandomAccessFile* file = nullptr;
+      WritableFile* out = nullptr;
+      Status s = env_->NewWritableFile(fname, &out);
+      if (s.ok()) {
+        s = out->Append(seg->buffer);
+        if (s.ok()) {
+          s = out->Close();
+        }
+        delete out;
+      }
+      if (s.ok()) {
+        s = env_->NewRandomAccessFile(fname, &file);
+      }
+
+      mu_.Lock();
+      unwritten_.pop_front();
+      if (s.ok()) {
+        seg->file = file;
+        std::string().swap(seg->buffer);
+      } else {
+        // 写入失败只是损失了一部分缓存数据, 不影响正确性
+        RemoveSegment(seg);
+      }
+      Unref(seg);
+      EvictIfNeeded();
+    }
+    writer_running_ = false;
+    cv_.SignalAll();
+    mu_.Unlock();
+  }
+
+  Env* const env_;
+  const std::string dir_;
+  const uint64_t capacity_;
+  const uint64_t segment_size_;
+
+  port::Mutex mu_;
+  port::CondVar cv_ GUARDED_BY(mu_);
+  // key 的哈希值到其所在记录的映射
+  std::unordered_map<uint64_t, Location> index_ GUARDED_BY(mu_);
+  // 全部 segment, 从老到新排列, 最后一个为 active_
+  std::deque<Segment*> segments_ GUARDED_BY(mu_);
+  Segment* active_ GUARDED_BY(mu_);
+  // 已封存但尚未写入文件的 segment
+  std::deque<Segment*> unwritten_ GUARDED_BY(mu_);
+  uint64_t usage_ GUARDED_BY(mu_);
+  uint64_t next_number_ GUARDED_BY(mu_);
+  bool writer_running_ GUARDED_BY(mu_);
+  bool shutting_down_ GUARDED_BY(mu_);
+};
+
+}  // anonymous namespace
+
+Status NewPersistentCache(Env* env, const std::string& dir, uint64_t capacity,
+                          PersistentCache** result) {
+  *result = nullptr;
+  FilePersistentCache* cache = new FilePersistentCache(env, dir, capacity);
+  Status s = cache->Recover();
+  if (s.ok()) {
+    *result = cache;
+  } else {
+    delete cache;
+  }
+  return s;
+}
+
+}  // namespace leveldb
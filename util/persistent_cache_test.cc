@@ -0,0 +1,245 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/persistent_cache.h"
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "helpers/memenv/memenv.h"
+#include "leveldb/cache.h"
+#include "leveldb/db.h"
+#include "leveldb/env.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+static bool IsTableFile(const std::string& fname) {
+  return fname.size() > 4 && fname.compare(fname.size() - 4, 4, ".ldb") == 0;
+}
+
+// Simulates slow remote storage: table reads are copied into the caller's
+// scratch buffer (so blocks are cachable) and counted.
+class SlowTableEnv : public EnvWrapper {
+ public:
+  std::atomic<int> table_reads_;
+
+  explicit SlowTableEnv(Env* base) : EnvWrapper(base), table_reads_(0) { }
+
+  Status NewRandomAccessFile(const std::string& f, RandomAccessFile** r) {
+    class CountingFile : public RandomAccessFile {
+     public:
+      CountingFile(RandomAccessFile* target, std::atomic<int>* counter)
+          : target_(target), counter_(counter) { }
+      ~CountingFile() { delete target_; }
+      Status Read(uint64_t offset, size_t n, Slice* result,
+                  char* scratch) const {
+        counter_->fetch_add(1);
+        Status s = target_->Read(offset, n, result, scratch);
+        if (s.ok() && result->data() != scratch) {
+          memcpy(scratch, result->data(), result->size());
+          *result = Slice(scratch, result->size());
+        }
+        return s;
+      }
+     private:
+      RandomAccessFile* target_;
+      std::atomic<int>* counter_;
+    };
+
+    Status s = target()->NewRandomAccessFile(f, r);
+    if (s.ok() && IsTableFile(f)) {
+      *r = new CountingFile(*r, &table_reads_);
+    }
+    return s;
+  }
+};
+
+class PersistentCacheTest {
+ public:
+  Env* env_;
+  PersistentCache* cache_;
+
+  PersistentCacheTest() : env_(NewMemEnv(Env::Default())), cache_(nullptr) { }
+
+  ~PersistentCacheTest() {
+    delete cache_;
+    delete env_;
+  }
+
+  void Open(uint64_t capacity) {
+    delete cache_;
+    cache_ = nullptr;
+    ASSERT_OK(NewPersistentCache(env_, "/cache", capacity, &cache_));
+  }
+
+  std::string Lookup(const std::string& key) {
+    std::string value;
+    if (!cache_->Lookup(key, &value)) {
+      return "NOT_FOUND";
+    }
+    return value;
+  }
+
+  // Inserts are dropped while the writer falls behind; retry until the
+  // entry is visible.
+  void InsertUntilVisible(const std::string& key, const std::string& value) {
+    while (true) {
+      cache_->Insert(key, value);
+      if (Lookup(key) != "NOT_FOUND") break;
+      env_->SleepForMicroseconds(1000);
+    }
+  }
+
+  uint64_t DiskUsage() {
+    std::vector<std::string> files;
+    ASSERT_OK(env_->GetChildren("/cache", &files));
+    uint64_t total = 0;
+    for (size_t i = 0; i < files.size(); i++) {
+      uint64_t size;
+      if (env_->GetFileSize("/cache/" + files[i], &size).ok()) {
+        total += size;
+      }
+    }
+    return total;
+  }
+};
+
+static std::string Key(int i) {
+  char buf[100];
+  snprintf(buf, sizeof(buf), "key%06d", i);
+  return buf;
+}
+
+TEST(PersistentCacheTest, InsertAndLookup) {
+  Open(1 << 20);
+  ASSERT_EQ("NOT_FOUND", Lookup("a"));
+  cache_->Insert("a", "va");
+  cache_->Insert("b", "vb");
+  ASSERT_EQ("va", Lookup("a"));
+  ASSERT_EQ("vb", Lookup("b"));
+  ASSERT_EQ("NOT_FOUND", Lookup("c"));
+}
+
+TEST(PersistentCacheTest, RecoverAfterReopen) {
+  Open(1 << 20);
+  const std::string value(1000, 'x');
+  // Enough data to seal several segments plus a partially filled one.
+  for (int i = 0; i < 500; i++) {
+    InsertUntilVisible(Key(i), value + Key(i));
+  }
+  Open(1 << 20);
+  for (int i = 0; i < 500; i++) {
+    ASSERT_EQ(value + Key(i), Lookup(Key(i)));
+  }
+}
+
+TEST(PersistentCacheTest, Eviction) {
+  const uint64_t kCapacity = 256 << 10;
+  Open(kCapacity);
+  const std::string value(1000, 'x');
+  for (int i = 0; i < 5000; i++) {
+    InsertUntilVisible(Key(i), value);
+  }
+  Open(kCapacity);
+  ASSERT_LE(DiskUsage(), kCapacity);
+  ASSERT_EQ("NOT_FOUND", Lookup(Key(0)));
+  ASSERT_EQ(value, Lookup(Key(4999)));
+}
+
+TEST(PersistentCacheTest, ServesTableReads) {
+  SlowTableEnv env(env_);
+  Cache* block_cache = NewLRUCache(0);  // Disable the primary cache
+  Open(4 << 20);
+
+  Options options;
+  options.env = &env;
+  options.create_if_missing = true;
+  options.block_cache = block_cache;
+  options.persistent_cache = cache_;
+  DB* db;
+  ASSERT_OK(DB::Open(options, "/db", &db));
+  const std::string value(1000, 'v');
+  for (int i = 0; i < 200; i++) {
+    ASSERT_OK(db->Put(WriteOptions(), Key(i), value));
+  }
+  db->CompactRange(nullptr, nullptr);
+
+  std::string result;
+  for (int i = 0; i < 200; i++) {
+    ASSERT_OK(db->Get(ReadOptions(), Key(i), &result));
+  }
+  ASSERT_GT(env.table_reads_.load(), 0);
+
+  // Every data block is now in the persistent cache.
+  env.table_reads_.store(0);
+  for (int i = 0; i < 200; i++) {
+    ASSERT_OK(db->Get(ReadOptions(), Key(i), &result));
+    ASSERT_EQ(value, result);
+  }
+  ASSERT_EQ(0, env.table_reads_.load());
+
+  // The cache contents survive reopening both the cache and the DB;
+  // only the footer and index block of each table are read again.
+  delete db;
+  Open(4 << 20);
+  options.persistent_cache = cache_;
+  ASSERT_OK(DB::Open(options, "/db", &db));
+  std::vector<std::string> files;
+  ASSERT_OK(env_->GetChildren("/db", &files));
+  int tables = 0;
+  for (size_t i = 0; i < files.size(); i++) {
+    if (IsTableFile(files[i])) tables++;
+  }
+  env.table_reads_.store(0);
+  for (int i = 0; i < 200; i++) {
+    ASSERT_OK(db->Get(ReadOptions(), Key(i), &result));
+    ASSERT_EQ(value, result);
+  }
+  ASSERT_EQ(2 * tables, env.table_reads_.load());
+
+  delete db;
+  delete block_cache;
+}
+
+TEST(PersistentCacheTest, IgnoresBlocksOfDestroyedDB) {
+  SlowTableEnv env(env_);
+  Cache* block_cache = NewLRUCache(0);  // Disable the primary cache
+  Open(4 << 20);
+
+  Options options;
+  options.env = &env;
+  options.create_if_missing = true;
+  options.block_cache = block_cache;
+  options.persistent_cache = cache_;
+  std::string result;
+  // The second DB reuses the same file numbers and sizes, so only the DB
+  // id tells its blocks apart from the cached ones.
+  for (char c = 'a'; c <= 'b'; c++) {
+    DB* db;
+    ASSERT_OK(DB::Open(options, "/db", &db));
+    const std::string value(1000, c);
+    for (int i = 0; i < 200; i++) {
+      ASSERT_OK(db->Put(WriteOptions(), Key(i), value));
+    }
+    db->CompactRange(nullptr, nullptr);
+    for (int pass = 0; pass < 2; pass++) {
+      for (int i = 0; i < 200; i++) {
+        ASSERT_OK(db->Get(ReadOptions(), Key(i), &result));
+        ASSERT_EQ(value, result);
+      }
+    }
+    delete db;
+    ASSERT_OK(DestroyDB("/db", options));
+  }
+
+  delete block_cache;
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}